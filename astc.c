@@ -112,7 +112,7 @@ void decompress_astc_file(const char *filename, Image *image) {
 	flip_image_vertical(image);
 }
 
-void compress_image_to_astc_texture(Image *image, int texture_type, Texture *texture) {
+void compress_image_to_astc_texture(Image *image, int texture_type, int speed, Texture *texture) {
 	// Create temporary .png filename
 	char *tmp_filename = tmpnam(NULL);
 	char *png_filename = (char *)alloca(strlen(tmp_filename) + 5);
@@ -128,7 +128,10 @@ void compress_image_to_astc_texture(Image *image, int texture_type, Texture *tex
 	// Execute encoding command.
 	char *s = (char *)malloc(strlen(png_filename) + strlen(astc_filename) + 40);
 	char *astcenc_speed_option;
-	switch (option_speed) {
+	switch (speed) {
+	case SPEED_INSTANT :
+		astcenc_speed_option = "-veryfast";
+		break;
 	case SPEED_ULTRA :
 		astcenc_speed_option = "-fast";
 		break;
@@ -139,6 +142,7 @@ void compress_image_to_astc_texture(Image *image, int texture_type, Texture *tex
 		astcenc_speed_option = "-thorough";
 		break;
 	case SPEED_SLOW :
+	case SPEED_EXHAUSTIVE :
 		astcenc_speed_option = "-exhaustive";
 		break;
 	}
@@ -0,0 +1,629 @@
+/*
+    batch.c -- part of texgenpack, a texture compressor using fgen.
+
+    texgenpack -- a genetic algorithm texture compressor.
+    Copyright 2013 Harm Hanemaaijer
+
+    This file is part of texgenpack.
+
+    texgenpack is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    texgenpack is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with texgenpack.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Batched evaluation of candidate compressed blocks. Instead of decoding each candidate into a pixel buffer and
+// comparing it with the source block, the candidates are decoded into a structure-of-arrays palette representation
+// (the possible colors of each candidate and a palette index for each pixel). The pixel colors and errors are then
+// calculated for several candidates at once using SSE2 or AVX2. Supported are DXT1, ETC1 and the individual and
+// differential modes of ETC2 RGB8, RGTC1 and R11 EAC; other formats and modes are evaluated one by one using the
+// regular decoding and comparison functions.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BATCH_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// The AVX2 kernels are compiled with a function target attribute and selected at run-time.
+#define BATCH_AVX2
+#include <immintrin.h>
+#endif
+#endif
+#include "texgenpack.h"
+#include "decode.h"
+#include "packing.h"
+
+#define BATCH_SIZE	16	// Maximum number of candidates processed at once.
+#define BATCH_ALIGNMENT	4	// The number of candidates processed is rounded up to a multiple of four.
+#define BATCH_MIN_CANDIDATES 4	// Smaller requests don't fill a vector and are evaluated one by one.
+
+// Metrics supported by the kernels.
+
+#define BATCH_METRIC_NONE	0
+#define BATCH_METRIC_RGB8	1	// Sum of squared differences of three 8-bit components.
+#define BATCH_METRIC_R8		2	// Squared difference of one 8-bit component.
+#define BATCH_METRIC_R16	3	// Squared difference of one 16-bit component.
+
+// Layouts of the pixel indices in the index words of a candidate.
+
+#define BATCH_INDEX_DXT		0	// 2-bit indices, row-major, in word 0.
+#define BATCH_INDEX_ALPHA3	1	// 3-bit indices, row-major, in a 48-bit value (RGTC).
+#define BATCH_INDEX_EAC		2	// 3-bit indices, column-major, in a 48-bit value with the first at the top.
+#define BATCH_INDEX_ETC		3	// 2-bit indices split into LSB and MSB halves, column-major, plus the subblock.
+#define BATCH_NU_INDEX_LAYOUTS	4
+
+typedef struct {
+	int32_t value[3][8][BATCH_SIZE];	// Palette colors [component][palette entry][candidate].
+	// The raw index bits of each candidate. 48-bit values are stored as bits 0-31 in word 0 and bits 16-47 in
+	// word 1, so that every index can be extracted from one of the words.
+	uint32_t index_word[2][BATCH_SIZE];
+	uint32_t flip[BATCH_SIZE];		// ETC flip bit (0 or 0xFFFFFFFF).
+	int nu_values;				// Number of palette entries.
+	int index_layout;
+} PaletteBatch;
+
+typedef struct {
+	int32_t value[3][16];			// Source pixel components in the domain of the metric.
+	int pixel_in_image[16];
+} BatchSource;
+
+// The palette entry of pixel i is ((word[word_a] >> shift_a) & mask_a) | ((word[word_b] >> shift_b) & mask_b),
+// plus subblock[flip] * 4.
+
+typedef struct {
+	int word_a, shift_a, mask_a;
+	int word_b, shift_b, mask_b;
+	int subblock[2];
+} BatchPixelIndex;
+
+static BatchPixelIndex batch_pixel_index[BATCH_NU_INDEX_LAYOUTS][16];
+
+static void init_batch_pixel_index() {
+	for (int i = 0; i < 16; i++) {
+		int x = i & 3;
+		int y = i >> 2;
+		int k = x * 4 + y;	// Column-major pixel number.
+		for (int l = 0; l < BATCH_NU_INDEX_LAYOUTS; l++) {
+			BatchPixelIndex *p = &batch_pixel_index[l][i];
+			p->word_b = p->shift_b = p->mask_b = 0;
+			p->subblock[0] = p->subblock[1] = 0;
+			int shift;
+			switch (l) {
+			case BATCH_INDEX_DXT :
+				p->word_a = 0;
+				p->shift_a = i * 2;
+				p->mask_a = 0x3;
+				break;
+			case BATCH_INDEX_ALPHA3 :
+			case BATCH_INDEX_EAC :
+				shift = l == BATCH_INDEX_ALPHA3 ? i * 3 : 45 - k * 3;
+				p->word_a = shift > 29;
+				p->shift_a = shift > 29 ? shift - 16 : shift;
+				p->mask_a = 0x7;
+				break;
+			case BATCH_INDEX_ETC :
+				p->word_a = 0;
+				p->shift_a = k;
+				p->mask_a = 0x1;
+				p->word_b = 0;
+				p->shift_b = 16 + k - 1;
+				p->mask_b = 0x2;
+				p->subblock[0] = x >> 1;
+				p->subblock[1] = y >> 1;
+				break;
+			}
+		}
+	}
+}
+
+static int get_batch_index(const PaletteBatch *batch, int i, int j) {
+	const BatchPixelIndex *p = &batch_pixel_index[batch->index_layout][i];
+	return ((batch->index_word[p->word_a][j] >> p->shift_a) & p->mask_a) |
+		((batch->index_word[p->word_b][j] >> p->shift_b) & p->mask_b) | (p->subblock[batch->flip[j] & 1] * 4);
+}
+
+// A kernel calculates the error of each pixel (pixel_error[pixel * BATCH_SIZE + candidate], when not NULL) and the
+// total error of the first nu_candidates candidates of the batch. The wide kernel requires a multiple of eight
+// candidates, the narrow kernel a multiple of four.
+
+typedef void (*PaletteBatchScoreFunction)(const PaletteBatch *batch, const BatchSource *source, int metric,
+	int nu_candidates, uint32_t *pixel_error, uint64_t *error);
+
+// Generic C kernel, used when SSE2 is not available.
+
+static void score_palette_batch_c(const PaletteBatch *batch, const BatchSource *source, int metric,
+int nu_candidates, uint32_t *pixel_error, uint64_t *error) {
+	int nu_components = metric == BATCH_METRIC_RGB8 ? 3 : 1;
+	for (int j = 0; j < nu_candidates; j++)
+		error[j] = 0;
+	for (int i = 0; i < 16; i++) {
+		if (!source->pixel_in_image[i]) {
+			if (pixel_error != NULL)
+				memset(&pixel_error[i * BATCH_SIZE], 0, BATCH_SIZE * sizeof(uint32_t));
+			continue;
+		}
+		for (int j = 0; j < nu_candidates; j++) {
+			int k = get_batch_index(batch, i, j);
+			uint32_t e = 0;
+			for (int c = 0; c < nu_components; c++) {
+				int64_t d = batch->value[c][k][j] - source->value[c][i];
+				e += d * d;
+			}
+			if (pixel_error != NULL)
+				pixel_error[i * BATCH_SIZE + j] = e;
+			error[j] += e;
+		}
+	}
+}
+
+#ifdef BATCH_SSE2
+
+static void score_palette_batch_sse2(const PaletteBatch *batch, const BatchSource *source, int metric,
+int nu_candidates, uint32_t *pixel_error, uint64_t *error) {
+	int nu_components = metric == BATCH_METRIC_RGB8 ? 3 : 1;
+	const BatchPixelIndex *pixel_index = batch_pixel_index[batch->index_layout];
+	for (int j = 0; j < nu_candidates; j += 4) {
+		// Accumulate the total error as 64-bit values, for even and odd candidates separately.
+		__m128i error_even = _mm_setzero_si128();
+		__m128i error_odd = _mm_setzero_si128();
+		__m128i word[2];
+		word[0] = _mm_loadu_si128((const __m128i *)&batch->index_word[0][j]);
+		word[1] = _mm_loadu_si128((const __m128i *)&batch->index_word[1][j]);
+		__m128i flip = _mm_loadu_si128((const __m128i *)&batch->flip[j]);
+		for (int i = 0; i < 16; i++) {
+			if (!source->pixel_in_image[i]) {
+				if (pixel_error != NULL)
+					_mm_storeu_si128((__m128i *)&pixel_error[i * BATCH_SIZE + j], _mm_setzero_si128());
+				continue;
+			}
+			const BatchPixelIndex *p = &pixel_index[i];
+			__m128i index = _mm_and_si128(_mm_srl_epi32(word[p->word_a], _mm_cvtsi32_si128(p->shift_a)),
+				_mm_set1_epi32(p->mask_a));
+			if (p->mask_b != 0) {
+				index = _mm_or_si128(index, _mm_and_si128(_mm_srl_epi32(word[p->word_b],
+					_mm_cvtsi32_si128(p->shift_b)), _mm_set1_epi32(p->mask_b)));
+				index = _mm_add_epi32(index, _mm_or_si128(
+					_mm_and_si128(flip, _mm_set1_epi32(p->subblock[1] * 4)),
+					_mm_andnot_si128(flip, _mm_set1_epi32(p->subblock[0] * 4))));
+			}
+			// Select the palette colors; the masks are shared between the components.
+			__m128i mask[8];
+			for (int k = 0; k < batch->nu_values; k++)
+				mask[k] = _mm_cmpeq_epi32(index, _mm_set1_epi32(k));
+			__m128i e = _mm_setzero_si128();
+			for (int c = 0; c < nu_components; c++) {
+				__m128i v = _mm_and_si128(mask[0], _mm_loadu_si128((const __m128i *)&batch->value[c][0][j]));
+				for (int k = 1; k < batch->nu_values; k++)
+					v = _mm_or_si128(v, _mm_and_si128(mask[k],
+						_mm_loadu_si128((const __m128i *)&batch->value[c][k][j])));
+				__m128i d = _mm_sub_epi32(v, _mm_set1_epi32(source->value[c][i]));
+				if (metric == BATCH_METRIC_R16) {
+					// The squared difference of 16-bit values needs the full 32 bits.
+					__m128i sign = _mm_srai_epi32(d, 31);
+					d = _mm_sub_epi32(_mm_xor_si128(d, sign), sign);
+					__m128i e_even = _mm_mul_epu32(d, d);
+					__m128i d_odd = _mm_srli_epi64(d, 32);
+					e = _mm_or_si128(e_even, _mm_slli_epi64(_mm_mul_epu32(d_odd, d_odd), 32));
+				}
+				else {
+					// Differences of 8-bit values fit in 16 bits; square them with a multiply-add of
+					// the lower 16-bit halves (the upper halves are cleared).
+					d = _mm_and_si128(d, _mm_set1_epi32(0xFFFF));
+					e = _mm_add_epi32(e, _mm_madd_epi16(d, d));
+				}
+			}
+			error_even = _mm_add_epi64(error_even, _mm_and_si128(e, _mm_set_epi32(0, - 1, 0, - 1)));
+			error_odd = _mm_add_epi64(error_odd, _mm_srli_epi64(e, 32));
+			if (pixel_error != NULL)
+				_mm_storeu_si128((__m128i *)&pixel_error[i * BATCH_SIZE + j], e);
+		}
+		uint64_t even[2], odd[2];
+		_mm_storeu_si128((__m128i *)even, error_even);
+		_mm_storeu_si128((__m128i *)odd, error_odd);
+		error[j] = even[0];
+		error[j + 1] = odd[0];
+		error[j + 2] = even[1];
+		error[j + 3] = odd[1];
+	}
+}
+
+#endif
+
+#ifdef BATCH_AVX2
+
+__attribute__ ((target("avx2")))
+static void score_palette_batch_avx2(const PaletteBatch *batch, const BatchSource *source, int metric,
+int nu_candidates, uint32_t *pixel_error, uint64_t *error) {
+	int nu_components = metric == BATCH_METRIC_RGB8 ? 3 : 1;
+	const BatchPixelIndex *pixel_index = batch_pixel_index[batch->index_layout];
+	for (int j = 0; j < nu_candidates; j += 8) {
+		__m256i error_even = _mm256_setzero_si256();
+		__m256i error_odd = _mm256_setzero_si256();
+		__m256i word[2];
+		word[0] = _mm256_loadu_si256((const __m256i *)&batch->index_word[0][j]);
+		word[1] = _mm256_loadu_si256((const __m256i *)&batch->index_word[1][j]);
+		__m256i flip = _mm256_loadu_si256((const __m256i *)&batch->flip[j]);
+		for (int i = 0; i < 16; i++) {
+			if (!source->pixel_in_image[i]) {
+				if (pixel_error != NULL)
+					_mm256_storeu_si256((__m256i *)&pixel_error[i * BATCH_SIZE + j],
+						_mm256_setzero_si256());
+				continue;
+			}
+			const BatchPixelIndex *p = &pixel_index[i];
+			__m256i index = _mm256_and_si256(_mm256_srl_epi32(word[p->word_a],
+				_mm_cvtsi32_si128(p->shift_a)), _mm256_set1_epi32(p->mask_a));
+			if (p->mask_b != 0) {
+				index = _mm256_or_si256(index, _mm256_and_si256(_mm256_srl_epi32(word[p->word_b],
+					_mm_cvtsi32_si128(p->shift_b)), _mm256_set1_epi32(p->mask_b)));
+				index = _mm256_add_epi32(index, _mm256_blendv_epi8(_mm256_set1_epi32(p->subblock[0] * 4),
+					_mm256_set1_epi32(p->subblock[1] * 4), flip));
+			}
+			__m256i mask[8];
+			for (int k = 0; k < batch->nu_values; k++)
+				mask[k] = _mm256_cmpeq_epi32(index, _mm256_set1_epi32(k));
+			__m256i e = _mm256_setzero_si256();
+			for (int c = 0; c < nu_components; c++) {
+				__m256i v = _mm256_and_si256(mask[0],
+					_mm256_loadu_si256((const __m256i *)&batch->value[c][0][j]));
+				for (int k = 1; k < batch->nu_values; k++)
+					v = _mm256_or_si256(v, _mm256_and_si256(mask[k],
+						_mm256_loadu_si256((const __m256i *)&batch->value[c][k][j])));
+				__m256i d = _mm256_sub_epi32(v, _mm256_set1_epi32(source->value[c][i]));
+				if (metric == BATCH_METRIC_R16) {
+					d = _mm256_abs_epi32(d);
+					__m256i e_even = _mm256_mul_epu32(d, d);
+					__m256i d_odd = _mm256_srli_epi64(d, 32);
+					e = _mm256_or_si256(e_even, _mm256_slli_epi64(_mm256_mul_epu32(d_odd, d_odd), 32));
+				}
+				else
+					e = _mm256_add_epi32(e, _mm256_mullo_epi32(d, d));
+			}
+			error_even = _mm256_add_epi64(error_even, _mm256_and_si256(e, _mm256_set1_epi64x(0xFFFFFFFF)));
+			error_odd = _mm256_add_epi64(error_odd, _mm256_srli_epi64(e, 32));
+			if (pixel_error != NULL)
+				_mm256_storeu_si256((__m256i *)&pixel_error[i * BATCH_SIZE + j], e);
+		}
+		uint64_t even[4], odd[4];
+		_mm256_storeu_si256((__m256i *)even, error_even);
+		_mm256_storeu_si256((__m256i *)odd, error_odd);
+		for (int k = 0; k < 4; k++) {
+			error[j + k * 2] = even[k];
+			error[j + k * 2 + 1] = odd[k];
+		}
+	}
+}
+
+#endif
+
+static PaletteBatchScoreFunction score_palette_batch_wide = score_palette_batch_c;
+static PaletteBatchScoreFunction score_palette_batch_narrow = score_palette_batch_c;
+
+// Select the batch kernels of the given level (COMPARE_KERNELS_C, COMPARE_KERNELS_SSE2 or COMPARE_KERNELS_AVX2),
+// using the kernels of a lower level where a kernel of the level is not compiled in or not supported by the processor.
+// Returns the highest level actually selected.
+
+int select_batch_kernels(int level) {
+	int selected = COMPARE_KERNELS_C;
+	score_palette_batch_wide = score_palette_batch_c;
+	score_palette_batch_narrow = score_palette_batch_c;
+#ifdef BATCH_SSE2
+	if (level >= COMPARE_KERNELS_SSE2) {
+		score_palette_batch_wide = score_palette_batch_sse2;
+		score_palette_batch_narrow = score_palette_batch_sse2;
+		selected = COMPARE_KERNELS_SSE2;
+	}
+#endif
+#ifdef BATCH_AVX2
+	__builtin_cpu_init();
+	if (level >= COMPARE_KERNELS_AVX2 && __builtin_cpu_supports("avx2")) {
+		score_palette_batch_wide = score_palette_batch_avx2;
+		selected = COMPARE_KERNELS_AVX2;
+	}
+#endif
+	return selected;
+}
+
+// Select the fastest kernels supported by the processor. Must be called before any batch evaluation.
+
+void init_batch_evaluation() {
+	init_batch_pixel_index();
+	select_batch_kernels(COMPARE_KERNELS_AVX2);
+}
+
+// Palette decoding functions. Each decodes candidate j of the batch, returning 1 if the candidate was decoded,
+// 0 if it is invalid, or - 1 if it uses a mode that must be evaluated with the regular decoding function.
+
+static int decode_palette_dxt1(const unsigned char *bitstring, int flags, PaletteBatch *batch, int j) {
+	unsigned int colors = (unsigned int)bitstring[0] | ((unsigned int)bitstring[1] << 8) |
+		((unsigned int)bitstring[2] << 16) | ((unsigned int)bitstring[3] << 24);
+	int color[3][4];
+	color[2][0] = (colors & 0x0000001F) << 3;
+	color[1][0] = (colors & 0x000007E0) >> (5 - 2);
+	color[0][0] = (colors & 0x0000F800) >> (11 - 3);
+	color[2][1] = (colors & 0x001F0000) >> (16 - 3);
+	color[1][1] = (colors & 0x07E00000) >> (21 - 2);
+	color[0][1] = (colors & 0xF8000000) >> (27 - 3);
+	for (int c = 0; c < 3; c++) {
+		if ((colors & 0xFFFF) > ((colors & 0xFFFF0000) >> 16)) {
+			color[c][2] = (2 * color[c][0] + color[c][1]) / 3;
+			color[c][3] = (color[c][0] + 2 * color[c][1]) / 3;
+		}
+		else {
+			color[c][2] = (color[c][0] + color[c][1]) / 2;
+			color[c][3] = 0;
+		}
+		for (int k = 0; k < 4; k++)
+			batch->value[c][k][j] = color[c][k];
+	}
+	batch->index_word[0][j] = (unsigned int)bitstring[4] | ((unsigned int)bitstring[5] << 8) |
+		((unsigned int)bitstring[6] << 16) | ((unsigned int)bitstring[7] << 24);
+	return 1;
+}
+
+static int decode_palette_etc(const unsigned char *bitstring, int flags, int etc2, PaletteBatch *batch, int j) {
+	int base_color[2][3];
+	if (bitstring[3] & 2) {
+		// Differential mode.
+		for (int c = 0; c < 3; c++) {
+			int base = bitstring[c] & 0xF8;
+			int delta = bitstring[c] & 7;
+			int base2 = base + ((delta & 4) ? ((delta & 3) - 4) << 3 : delta << 3);
+			if (base2 & 0xFF07)
+				// In ETC2 this selects the T, H or planar mode, in ETC1 the block is invalid.
+				return etc2 ? - 1 : 0;
+			base_color[0][c] = base | (base >> 5);
+			base_color[1][c] = base2 | (base2 >> 5);
+		}
+		if ((flags & ETC_MODE_ALLOWED_DIFFERENTIAL) == 0)
+			return 0;
+	}
+	else {
+		if ((flags & ETC_MODE_ALLOWED_INDIVIDUAL) == 0)
+			return 0;
+		for (int c = 0; c < 3; c++) {
+			base_color[0][c] = (bitstring[c] & 0xF0) | (bitstring[c] >> 4);
+			base_color[1][c] = (bitstring[c] & 0x0F) | ((bitstring[c] & 0x0F) << 4);
+		}
+	}
+	int table_codeword[2];
+	table_codeword[0] = (bitstring[3] & 224) >> 5;
+	table_codeword[1] = (bitstring[3] & 28) >> 2;
+	for (int s = 0; s < 2; s++)
+		for (int k = 0; k < 4; k++) {
+			int modifier = etc_modifier_table[table_codeword[s]][k];
+			for (int c = 0; c < 3; c++) {
+				int v = base_color[s][c] + modifier;
+				batch->value[c][s * 4 + k][j] = v < 0 ? 0 : (v > 255 ? 255 : v);
+			}
+		}
+	// The palette entry of a pixel is the subblock number times four plus the pixel index.
+	batch->index_word[0][j] = ((unsigned int)bitstring[4] << 24) | ((unsigned int)bitstring[5] << 16) |
+		((unsigned int)bitstring[6] << 8) | bitstring[7];
+	batch->flip[j] = (bitstring[3] & 1) ? 0xFFFFFFFF : 0;
+	return 1;
+}
+
+static int decode_palette_rgtc1(const unsigned char *bitstring, int flags, int sixteen_bit, PaletteBatch *batch,
+int j) {
+	int lum0 = bitstring[0];
+	int lum1 = bitstring[1];
+	int value[8];
+	value[0] = lum0;
+	value[1] = lum1;
+	if (lum0 > lum1)
+		for (int k = 2; k < 8; k++)
+			value[k] = ((8 - k) * lum0 + (k - 1) * lum1) / 7;
+	else {
+		for (int k = 2; k < 6; k++)
+			value[k] = ((6 - k) * lum0 + (k - 1) * lum1) / 5;
+		value[6] = 0;
+		value[7] = 0xFF;
+	}
+	for (int k = 0; k < 8; k++)
+		// Comparison with a 16-bit source image scales the 8-bit value.
+		batch->value[0][k][j] = sixteen_bit ? value[k] * 65535 / 255 : value[k];
+	batch->index_word[0][j] = (unsigned int)bitstring[2] | ((unsigned int)bitstring[3] << 8) |
+		((unsigned int)bitstring[4] << 16) | ((unsigned int)bitstring[5] << 24);
+	batch->index_word[1][j] = (unsigned int)bitstring[4] | ((unsigned int)bitstring[5] << 8) |
+		((unsigned int)bitstring[6] << 16) | ((unsigned int)bitstring[7] << 24);
+	return 1;
+}
+
+static int decode_palette_r11_eac(const unsigned char *bitstring, int flags, PaletteBatch *batch, int j) {
+	int base_codeword_times_8_plus_4 = (bitstring[0] << 3) | 0x4;
+	int modifier_index = bitstring[1] & 0xF;
+	int multiplier_times_8 = (bitstring[1] & 0xF0) >> (4 - 3);
+	for (int k = 0; k < 8; k++) {
+		int modifier = eac_modifier_table[modifier_index][k];
+		int v = base_codeword_times_8_plus_4 + (multiplier_times_8 == 0 ? modifier :
+			modifier * multiplier_times_8);
+		v = v < 0 ? 0 : (v > 2047 ? 2047 : v);
+		batch->value[0][k][j] = (v << 5) | (v >> 6);
+	}
+	batch->index_word[0][j] = ((unsigned int)bitstring[4] << 24) | ((unsigned int)bitstring[5] << 16) |
+		((unsigned int)bitstring[6] << 8) | bitstring[7];
+	batch->index_word[1][j] = ((unsigned int)bitstring[2] << 24) | ((unsigned int)bitstring[3] << 16) |
+		((unsigned int)bitstring[4] << 8) | bitstring[5];
+	return 1;
+}
+
+// Determine the batch metric for the texture and its comparison function.
+
+static int get_batch_metric(Texture *texture) {
+	TextureComparisonFunction f = texture->comparison_function;
+	switch (texture->type) {
+	case TEXTURE_TYPE_DXT1 :
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+		if (f == compare_block_4x4_rgb)
+			return BATCH_METRIC_RGB8;
+		break;
+	case TEXTURE_TYPE_RGTC1 :
+		if (f == compare_block_4x4_8_bit_components)
+			return BATCH_METRIC_R8;
+		if (f == compare_block_4x4_8_bit_components_with_16_bit)
+			return BATCH_METRIC_R16;
+		break;
+	case TEXTURE_TYPE_R11_EAC :
+		if (f == compare_block_4x4_r16)
+			return BATCH_METRIC_R16;
+		break;
+	}
+	return BATCH_METRIC_NONE;
+}
+
+static int decode_palette(Texture *texture, const unsigned char *bitstring, int flags, PaletteBatch *batch, int j) {
+	switch (texture->type) {
+	case TEXTURE_TYPE_DXT1 :
+		return decode_palette_dxt1(bitstring, flags, batch, j);
+	case TEXTURE_TYPE_ETC1 :
+		return decode_palette_etc(bitstring, flags, 0, batch, j);
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+		return decode_palette_etc(bitstring, flags, 1, batch, j);
+	case TEXTURE_TYPE_RGTC1 :
+		return decode_palette_rgtc1(bitstring, flags,
+			texture->comparison_function == compare_block_4x4_8_bit_components_with_16_bit, batch, j);
+	case TEXTURE_TYPE_R11_EAC :
+		return decode_palette_r11_eac(bitstring, flags, batch, j);
+	}
+	return - 1;
+}
+
+static void get_batch_source(BlockUserData *user_data, int metric, BatchSource *source) {
+	Texture *texture = user_data->texture;
+	unsigned int *pix = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
+		user_data->x_offset;
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++) {
+			int i = y * 4 + x;
+			source->pixel_in_image[i] = (user_data->x_offset + x < texture->width &&
+				user_data->y_offset + y < texture->height);
+			if (!source->pixel_in_image[i])
+				continue;
+			unsigned int pixel = pix[y * (user_data->image_rowstride / 4) + x];
+			if (metric == BATCH_METRIC_R16)
+				source->value[0][i] = pixel_get_r16(pixel);
+			else {
+				source->value[0][i] = pixel_get_r(pixel);
+				source->value[1][i] = pixel_get_g(pixel);
+				source->value[2][i] = pixel_get_b(pixel);
+			}
+		}
+}
+
+// Evaluate a single candidate with the regular decoding and comparison functions.
+
+static double calculate_fitness_single(BlockUserData *user_data, const unsigned char *bitstring,
+double *pixel_error) {
+	unsigned int image_buffer[32];
+	Texture *texture = user_data->texture;
+	if (!texture->decoding_function(bitstring, image_buffer, user_data->flags))
+		return 0;
+	if (pixel_error != NULL && calculate_block_pixel_errors(image_buffer, user_data, pixel_error)) {
+		double error = 0;
+		for (int i = 0; i < 16; i++)
+			error += pixel_error[i];
+		return (double)1 / error;
+	}
+	return texture->comparison_function(image_buffer, user_data);
+}
+
+// Calculate the fitness (the inverse of the error, zero for invalid blocks) of n candidate bitstrings of the
+// texture format, stored consecutively in bitstrings, for the block described by user_data. If pixel_error is not
+// NULL, the error of each pixel of each candidate is stored in pixel_error[candidate * 16 + pixel] (this requires
+// a comparison function supported by calculate_block_pixel_errors()). The results are identical to those of the
+// regular decoding and comparison functions.
+
+void calculate_fitness_batch(BlockUserData *user_data, const unsigned char *bitstrings, int n, double *fitness,
+double *pixel_error) {
+	Texture *texture = user_data->texture;
+	int bytes_per_block = texture->bits_per_block / 8;
+	int metric = get_batch_metric(texture);
+	if (metric == BATCH_METRIC_NONE || n < BATCH_MIN_CANDIDATES || texture->block_width != 4 ||
+	texture->block_height != 4) {
+		for (int i = 0; i < n; i++)
+			fitness[i] = calculate_fitness_single(user_data, &bitstrings[i * bytes_per_block],
+				pixel_error == NULL ? NULL : &pixel_error[i * 16]);
+		return;
+	}
+	BatchSource source;
+	get_batch_source(user_data, metric, &source);
+	PaletteBatch batch;
+	switch (texture->type) {
+	case TEXTURE_TYPE_DXT1 :
+		batch.index_layout = BATCH_INDEX_DXT;
+		batch.nu_values = 4;
+		break;
+	case TEXTURE_TYPE_RGTC1 :
+		batch.index_layout = BATCH_INDEX_ALPHA3;
+		batch.nu_values = 8;
+		break;
+	case TEXTURE_TYPE_R11_EAC :
+		batch.index_layout = BATCH_INDEX_EAC;
+		batch.nu_values = 8;
+		break;
+	default :
+		batch.index_layout = BATCH_INDEX_ETC;
+		batch.nu_values = 8;
+		break;
+	}
+	if (batch.index_layout != BATCH_INDEX_ETC)
+		memset(batch.flip, 0, sizeof(batch.flip));
+	uint32_t batch_pixel_error[16 * BATCH_SIZE];
+	uint64_t batch_error[BATCH_SIZE];
+	int status[BATCH_SIZE];
+	for (int start = 0; start < n; start += BATCH_SIZE) {
+		int m = n - start < BATCH_SIZE ? n - start : BATCH_SIZE;
+		int nu_candidates = (m + BATCH_ALIGNMENT - 1) & ~(BATCH_ALIGNMENT - 1);
+		for (int j = 0; j < nu_candidates; j++) {
+			if (j < m)
+				status[j] = decode_palette(texture, &bitstrings[(start + j) * bytes_per_block],
+					user_data->flags, &batch, j);
+			else
+				status[j] = 0;
+			if (status[j] != 1) {
+				// Fill in a dummy candidate so that the kernel doesn't operate on uninitialized data.
+				for (int c = 0; c < 3; c++)
+					for (int k = 0; k < 8; k++)
+						batch.value[c][k][j] = 0;
+				batch.index_word[0][j] = 0;
+				batch.index_word[1][j] = 0;
+				batch.flip[j] = 0;
+			}
+		}
+		PaletteBatchScoreFunction score_palette_batch = (nu_candidates & 7) ? score_palette_batch_narrow :
+			score_palette_batch_wide;
+		score_palette_batch(&batch, &source, metric, nu_candidates,
+			pixel_error == NULL ? NULL : batch_pixel_error, batch_error);
+		for (int j = 0; j < m; j++) {
+			double *candidate_pixel_error = pixel_error == NULL ? NULL : &pixel_error[(start + j) * 16];
+			if (status[j] == 0)
+				fitness[start + j] = 0;
+			else
+			if (status[j] < 0)
+				fitness[start + j] = calculate_fitness_single(user_data,
+					&bitstrings[(start + j) * bytes_per_block], candidate_pixel_error);
+			else {
+				fitness[start + j] = (double)1 / batch_error[j];
+				if (candidate_pixel_error != NULL)
+					for (int i = 0; i < 16; i++)
+						candidate_pixel_error[i] = batch_pixel_error[i * BATCH_SIZE + j];
+			}
+		}
+	}
+}
@@ -0,0 +1,1262 @@
+/*
+    benchmark.c -- part of texgenpack, a texture compressor using fgen.
+
+    texgenpack -- a genetic algorithm texture compressor.
+    Copyright 2013 Harm Hanemaaijer
+
+    This file is part of texgenpack.
+
+    texgenpack is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    texgenpack is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with texgenpack.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Compression benchmark (--benchmark). A fixed corpus of generated images is compressed to every texture format
+// with every speed setting. The blocks per second, fitness evaluations per second, RMSE and PSNR of each run are
+// written to a .csv file, and compared with those of a baseline .csv file written by an earlier run, so that
+// speed and quality regressions show up. Compression is deterministic, so the RMSE of a run only changes when the
+// compressor changes, while the speed depends on the machine.
+//
+// With --decoders, the throughput of the block decoding functions and the block comparison functions, which
+// dominate the fitness evaluation of the GA, is measured instead, in the same way.
+//
+// With --check, nothing is measured; instead the results of the vector block comparison kernels are checked to be
+// exactly the same as those of the C kernels, and compression with --deterministic is checked to give the same
+// result with different numbers of threads.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "texgenpack.h"
+#include "decode.h"
+#include "packing.h"
+
+// The width and height of the images of the corpus.
+
+#define BENCHMARK_IMAGE_SIZE	16
+
+#define BENCHMARK_IMAGE_GRADIENT	0
+#define BENCHMARK_IMAGE_NOISE		1
+#define BENCHMARK_IMAGE_FLAT		2
+#define BENCHMARK_IMAGE_ALPHA_CUTOUT	3
+#define BENCHMARK_IMAGE_NORMAL_MAP	4
+#define BENCHMARK_IMAGE_HDR_RAMP	5
+#define NU_BENCHMARK_IMAGES		6
+
+static const char *benchmark_image_text[NU_BENCHMARK_IMAGES] = {
+	"gradient", "noise", "flat", "alpha-cutout", "normal-map", "hdr-ramp" };
+
+static const char *speed_text[NU_SPEEDS] = { "ultra", "fast", "medium", "slow", "instant", "exhaustive" };
+
+// A run is a speed regression when its blocks per second drop by more than this fraction compared to the
+// baseline, and a quality regression when its RMSE increases by more than this fraction (plus a small absolute
+// margin for runs with an RMSE close to zero).
+
+#define SPEED_REGRESSION_TOLERANCE	0.25
+#define RMSE_REGRESSION_TOLERANCE	0.01
+#define RMSE_REGRESSION_MARGIN		0.001
+
+typedef struct {
+	char format[32];
+	char speed[16];
+	char image[16];
+	int nu_blocks;
+	double time;
+	int64_t nu_evaluations;
+	double rmse;
+	double psnr;
+} BenchmarkResult;
+
+// Random number generator with a fixed sequence for a given seed, independent of the C library.
+
+static unsigned int benchmark_random(unsigned int *seed) {
+	*seed = *seed * 1664525 + 1013904223;
+	return *seed >> 16;
+}
+
+static int clamp_component(double x) {
+	if (x < 0)
+		return 0;
+	if (x > 255)
+		return 255;
+	return (int)floor(x + 0.5);
+}
+
+static void create_benchmark_image(Image *image, int nu_components, int alpha_bits) {
+	image->width = BENCHMARK_IMAGE_SIZE;
+	image->height = BENCHMARK_IMAGE_SIZE;
+	image->extended_width = BENCHMARK_IMAGE_SIZE;
+	image->extended_height = BENCHMARK_IMAGE_SIZE;
+	image->alpha_bits = alpha_bits;
+	image->nu_components = nu_components;
+	image->bits_per_component = 8;
+	image->is_signed = 0;
+	image->srgb = 0;
+	image->is_half_float = 0;
+	image->pixels = (unsigned int *)malloc(BENCHMARK_IMAGE_SIZE * BENCHMARK_IMAGE_SIZE * 4);
+}
+
+// Generate the image of the corpus with the given index. The HDR ramp is a half-float image with values well
+// above 1.0; the other images have 8-bit components.
+
+static void generate_benchmark_image(int index, Image *image) {
+	const int n = BENCHMARK_IMAGE_SIZE;
+	unsigned int seed = 12345 + index;
+	if (index == BENCHMARK_IMAGE_HDR_RAMP) {
+		create_benchmark_image(image, 3, 0);
+		image->bits_per_component = 16;
+		image->is_half_float = 1;
+		free(image->pixels);
+		image->pixels = (unsigned int *)malloc(n * n * 8);
+		for (int y = 0; y < n; y++)
+			for (int x = 0; x < n; x++) {
+				// Exponential ramp from 1/4 to 16 along x, with the hue changing along y.
+				float v = powf(2.0, (float)x * 6.0 / (n - 1) - 2.0);
+				float f[4];
+				f[0] = v;
+				f[1] = v * (0.5 + 0.5 * y / (n - 1));
+				f[2] = v * (1.0 - 0.75 * y / (n - 1));
+				f[3] = 1.0;
+				singles2halfp(&image->pixels[(y * n + x) * 2], &f[0], 4);
+			}
+		return;
+	}
+	if (index == BENCHMARK_IMAGE_ALPHA_CUTOUT)
+		create_benchmark_image(image, 4, 1);
+	else
+		create_benchmark_image(image, 3, 0);
+	for (int y = 0; y < n; y++)
+		for (int x = 0; x < n; x++) {
+			unsigned int pixel;
+			switch (index) {
+			case BENCHMARK_IMAGE_GRADIENT :
+				pixel = pack_rgb_alpha_0xff(x * 255 / (n - 1), y * 255 / (n - 1),
+					(x + y) * 255 / (2 * (n - 1)));
+				break;
+			case BENCHMARK_IMAGE_NOISE :
+				pixel = pack_rgb_alpha_0xff(benchmark_random(&seed) & 0xFF, benchmark_random(&seed) & 0xFF,
+					benchmark_random(&seed) & 0xFF);
+				break;
+			case BENCHMARK_IMAGE_FLAT : {
+				// Four flat quadrants with a single bright line in the lower right one.
+				static const unsigned char color[4][3] = {
+					{ 200, 40, 40 }, { 40, 160, 60 }, { 30, 60, 190 }, { 128, 128, 128 } };
+				int q = (x >= n / 2) + (y >= n / 2) * 2;
+				if (q == 3 && x == y)
+					pixel = pack_rgb_alpha_0xff(255, 255, 255);
+				else
+					pixel = pack_rgb_alpha_0xff(color[q][0], color[q][1], color[q][2]);
+				break;
+				}
+			case BENCHMARK_IMAGE_ALPHA_CUTOUT : {
+				// A gradient with fully transparent circular holes.
+				int dx = (x % 8) - 4;
+				int dy = (y % 8) - 4;
+				int a = dx * dx + dy * dy < 8 ? 0 : 0xFF;
+				pixel = pack_rgba(255 - x * 255 / (n - 1), y * 255 / (n - 1), 128, a);
+				break;
+				}
+			case BENCHMARK_IMAGE_NORMAL_MAP :
+			default : {
+				// Normals of a height field of overlapping bumps, stored as RGB in [0, 255].
+				double fx = 2.0 * M_PI * x / n;
+				double fy = 2.0 * M_PI * y / n;
+				double dhdx = 0.8 * cos(fx * 2.0) * sin(fy) + 0.3 * cos(fx * 5.0 + fy);
+				double dhdy = 0.8 * sin(fx * 2.0) * cos(fy) * 0.5 + 0.3 * cos(fx * 5.0 + fy);
+				double len = sqrt(dhdx * dhdx + dhdy * dhdy + 1.0);
+				pixel = pack_rgb_alpha_0xff(clamp_component((- dhdx / len * 0.5 + 0.5) * 255.0),
+					clamp_component((- dhdy / len * 0.5 + 0.5) * 255.0),
+					clamp_component((1.0 / len * 0.5 + 0.5) * 255.0));
+				break;
+				}
+			}
+			image->pixels[y * n + x] = pixel;
+		}
+}
+
+// Convert a copy of an image of the corpus to the pixel format expected for the given texture format. The alpha
+// component is removed for formats without alpha.
+
+static void convert_benchmark_image(Image *source, TextureInfo *info, Image *image) {
+	clone_image(source, image);
+	if (image->alpha_bits > 0 && info->alpha_bits == 0)
+		remove_alpha_from_image(image);
+	if (info->type & TEXTURE_TYPE_HALF_FLOAT_BIT) {
+		if (!image->is_half_float)
+			convert_image_to_half_float(image);
+	}
+	else
+	if (info->type & TEXTURE_TYPE_16_BIT_COMPONENTS_BIT)
+		convert_image_to_16_bit_format(image, info->nu_components, (info->type & TEXTURE_TYPE_SIGNED_BIT) != 0);
+	else
+	if (info->nu_components <= 2)
+		convert_image_to_8_bit_format(image, info->nu_components, (info->type & TEXTURE_TYPE_SIGNED_BIT) != 0);
+}
+
+static void benchmark_callback(BlockUserData *user_data) {
+}
+
+// Initialize a context for deterministic and silent compression with the given speed setting.
+
+static void init_benchmark_context(CompressContext *context, int speed, int hdr) {
+	init_compress_context(context, benchmark_callback);
+	context->option_speed = speed;
+	context->option_deterministic = 1;
+	context->option_quiet = 1;
+	context->option_progress = 0;
+	context->option_verbose = 0;
+	context->option_hdr = hdr;
+}
+
+// Compress an image to the given texture format with the given speed setting, and store the measurements in
+// result.
+
+static void run_benchmark(Image *image, TextureInfo *info, int speed, int hdr, BenchmarkResult *result) {
+	CompressContext context;
+	init_benchmark_context(&context, speed, hdr);
+	context.collect_statistics = 1;
+	// The global HDR setting is used for the texture decoding function and by compare_images.
+	option_hdr = hdr;
+	Texture texture;
+	double start_time = get_time();
+	compress_image(&context, image, info->type, &texture);
+	result->time = get_time() - start_time;
+	result->nu_blocks = (texture.extended_width / texture.block_width) *
+		(texture.extended_height / texture.block_height);
+	result->nu_evaluations = 0;
+	if (context.block_statistics != NULL)
+		for (int i = 0; i < result->nu_blocks; i++)
+			result->nu_evaluations += context.block_statistics[i].nu_evaluations;
+	free(context.block_statistics);
+	Image compressed_image;
+	convert_texture_to_image(&texture, &compressed_image);
+	// Compare only the components present in the source image.
+	if (compressed_image.alpha_bits > 0 && image->alpha_bits == 0 &&
+	compressed_image.nu_components == image->nu_components + 1)
+		remove_alpha_from_image(&compressed_image);
+	result->rmse = compare_images(image, &compressed_image);
+	destroy_image(&compressed_image);
+	destroy_texture(&texture);
+	// Calculate the PSNR like compare_images does.
+	double range = 255.0;
+	if (image->is_half_float)
+		range = 1.0;
+	else
+	if (image->bits_per_component == 16)
+		range = 65535.0;
+	int nu_components = image->nu_components;
+	if (info->nu_components < nu_components)
+		nu_components = info->nu_components;
+	if (result->rmse == 0)
+		result->psnr = INFINITY;
+	else
+		result->psnr = 10.0 * log10(range * range * nu_components / (result->rmse * result->rmse));
+	option_hdr = 0;
+}
+
+static double get_blocks_per_second(BenchmarkResult *r) {
+	if (r->time <= 0)
+		return 0;
+	return r->nu_blocks / r->time;
+}
+
+static double get_evaluations_per_second(BenchmarkResult *r) {
+	if (r->time <= 0)
+		return 0;
+	return r->nu_evaluations / r->time;
+}
+
+static void write_results(const char *filename, BenchmarkResult *results, int nu_results) {
+	FILE *f = fopen(filename, "wb");
+	if (f == NULL) {
+		printf("Error -- couldn't open benchmark results file %s for writing.\n", filename);
+		exit(1);
+	}
+	fprintf(f, "format,speed,image,blocks,time,blocks_per_second,evaluations,evaluations_per_second,rmse,psnr\n");
+	for (int i = 0; i < nu_results; i++) {
+		BenchmarkResult *r = &results[i];
+		fprintf(f, "%s,%s,%s,%d,%.6lf,%.2lf,%lld,%.1lf,%.6lf,", r->format, r->speed, r->image, r->nu_blocks,
+			r->time, get_blocks_per_second(r), (long long)r->nu_evaluations, get_evaluations_per_second(r),
+			r->rmse);
+		if (isinf(r->psnr))
+			fprintf(f, "inf\n");
+		else
+			fprintf(f, "%.4lf\n", r->psnr);
+	}
+	fclose(f);
+}
+
+// Read the results of an earlier run from a .csv file written by write_results. Returns the number of results,
+// or - 1 when the file cannot be opened.
+
+static int read_results(const char *filename, BenchmarkResult **results_out) {
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL)
+		return - 1;
+	int nu_results = 0;
+	int max_results = 64;
+	BenchmarkResult *results = (BenchmarkResult *)malloc(sizeof(BenchmarkResult) * max_results);
+	char line[256];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		BenchmarkResult r;
+		long long nu_evaluations;
+		double blocks_per_second, evaluations_per_second;
+		// The header line does not match.
+		if (sscanf(line, "%31[^,],%15[^,],%15[^,],%d,%lf,%lf,%lld,%lf,%lf", r.format, r.speed, r.image,
+		&r.nu_blocks, &r.time, &blocks_per_second, &nu_evaluations, &evaluations_per_second, &r.rmse) < 9)
+			continue;
+		r.nu_evaluations = nu_evaluations;
+		r.psnr = 0;
+		if (nu_results == max_results) {
+			max_results *= 2;
+			results = (BenchmarkResult *)realloc(results, sizeof(BenchmarkResult) * max_results);
+		}
+		results[nu_results] = r;
+		nu_results++;
+	}
+	fclose(f);
+	*results_out = results;
+	return nu_results;
+}
+
+static BenchmarkResult *find_result(BenchmarkResult *results, int nu_results, BenchmarkResult *r) {
+	for (int i = 0; i < nu_results; i++)
+		if (strcmp(results[i].format, r->format) == 0 && strcmp(results[i].speed, r->speed) == 0 &&
+		strcmp(results[i].image, r->image) == 0)
+			return &results[i];
+	return NULL;
+}
+
+// Compare the results with those of the baseline, printing the runs that regressed and a summary unless quiet.
+// Returns the number of regressions.
+
+static int compare_with_baseline(BenchmarkResult *results, int nu_results, BenchmarkResult *baseline,
+int nu_baseline, int quiet) {
+	int nu_compared = 0;
+	int nu_speed_regressions = 0;
+	int nu_quality_regressions = 0;
+	double log_speed_ratio = 0;
+	for (int i = 0; i < nu_results; i++) {
+		BenchmarkResult *r = &results[i];
+		BenchmarkResult *b = find_result(baseline, nu_baseline, r);
+		if (b == NULL || get_blocks_per_second(b) <= 0 || get_blocks_per_second(r) <= 0)
+			continue;
+		nu_compared++;
+		double speed_ratio = get_blocks_per_second(r) / get_blocks_per_second(b);
+		log_speed_ratio += log(speed_ratio);
+		int speed_regression = speed_ratio < 1.0 - SPEED_REGRESSION_TOLERANCE;
+		int quality_regression = r->rmse > b->rmse * (1.0 + RMSE_REGRESSION_TOLERANCE) + RMSE_REGRESSION_MARGIN;
+		nu_speed_regressions += speed_regression;
+		nu_quality_regressions += quality_regression;
+		if ((speed_regression || quality_regression) && !quiet)
+			printf("Regression: %s %s %s: %.1lf blocks/s (baseline %.1lf, x%.2lf), RMSE %lf (baseline %lf)\n",
+				r->format, r->speed, r->image, get_blocks_per_second(r), get_blocks_per_second(b),
+				speed_ratio, r->rmse, b->rmse);
+	}
+	if (!quiet) {
+		if (nu_compared == 0)
+			printf("No runs in common with the baseline.\n");
+		else
+			printf("Compared %d runs with the baseline: speed x%.3lf (geometric mean), %d speed regression%s "
+				"(more than %.0lf%% slower), %d quality regression%s (RMSE more than %.0lf%% higher).\n",
+				nu_compared, exp(log_speed_ratio / nu_compared), nu_speed_regressions,
+				nu_speed_regressions == 1 ? "" : "s", SPEED_REGRESSION_TOLERANCE * 100.0,
+				nu_quality_regressions, nu_quality_regressions == 1 ? "" : "s",
+				RMSE_REGRESSION_TOLERANCE * 100.0);
+	}
+	return nu_speed_regressions + nu_quality_regressions;
+}
+
+// Run the benchmark for the given texture format (or all formats when texture_type is - 1) and the speed
+// settings in the bit mask speeds (bit i for speed setting i), write the results to results_filename and compare
+// them with those in baseline_filename when it is not NULL. Returns the number of regressions. The ASTC formats,
+// which are compressed by an external program, and the uncompressed formats are skipped.
+
+int benchmark(const char *results_filename, const char *baseline_filename, int texture_type, int speeds) {
+	int quiet = option_quiet;
+	// Silence the messages of the compressor and the image conversion and comparison functions.
+	option_quiet = 1;
+	Image corpus[NU_BENCHMARK_IMAGES];
+	for (int i = 0; i < NU_BENCHMARK_IMAGES; i++)
+		generate_benchmark_image(i, &corpus[i]);
+	int nu_formats = get_number_of_texture_formats();
+	BenchmarkResult *results = (BenchmarkResult *)malloc(sizeof(BenchmarkResult) * nu_formats * NU_SPEEDS *
+		NU_BENCHMARK_IMAGES);
+	int nu_results = 0;
+	double start_time = get_time();
+	for (int i = 0; i < nu_formats; i++) {
+		TextureInfo *info = match_texture_description(get_texture_format_index_text(i, 0));
+		if (info->type & (TEXTURE_TYPE_UNCOMPRESSED_BIT | TEXTURE_TYPE_ASTC_BIT))
+			continue;
+		if (texture_type != - 1 && info->type != texture_type)
+			continue;
+		for (int speed = 0; speed < NU_SPEEDS; speed++) {
+			if (!(speeds & (1 << speed)))
+				continue;
+			// Formats without an exhaustive encoder would be compressed with the default speed setting again.
+			if (speed == SPEED_EXHAUSTIVE && !exhaustive_encoding_supported(info->type))
+				continue;
+			for (int j = 0; j < NU_BENCHMARK_IMAGES; j++) {
+				// The HDR ramp only applies to the half-float formats.
+				int hdr = (j == BENCHMARK_IMAGE_HDR_RAMP);
+				if (hdr && !(info->type & TEXTURE_TYPE_HALF_FLOAT_BIT))
+					continue;
+				Image image;
+				convert_benchmark_image(&corpus[j], info, &image);
+				BenchmarkResult *r = &results[nu_results];
+				strcpy(r->format, get_texture_format_index_text(i, 0));
+				strcpy(r->speed, speed_text[speed]);
+				strcpy(r->image, benchmark_image_text[j]);
+				run_benchmark(&image, info, speed, hdr, r);
+				destroy_image(&image);
+				nu_results++;
+				if (!quiet) {
+					printf("%-22s %-10s %-12s %8.1lf blocks/s %10.0lf evaluations/s  RMSE %10.6lf  PSNR ",
+						r->format, r->speed, r->image, get_blocks_per_second(r),
+						get_evaluations_per_second(r), r->rmse);
+					if (isinf(r->psnr))
+						printf("inf\n");
+					else
+						printf("%.2lf\n", r->psnr);
+					fflush(stdout);
+				}
+			}
+		}
+	}
+	for (int i = 0; i < NU_BENCHMARK_IMAGES; i++)
+		destroy_image(&corpus[i]);
+	write_results(results_filename, results, nu_results);
+	if (!quiet)
+		printf("Wrote %d benchmark results to %s (%.1lf s).\n", nu_results, results_filename,
+			get_time() - start_time);
+	int nu_regressions = 0;
+	if (baseline_filename != NULL) {
+		BenchmarkResult *baseline;
+		int nu_baseline = read_results(baseline_filename, &baseline);
+		if (nu_baseline < 0) {
+			if (!quiet)
+				printf("Baseline file %s not found, skipping the comparison.\n", baseline_filename);
+		}
+		else {
+			nu_regressions = compare_with_baseline(results, nu_results, baseline, nu_baseline, quiet);
+			free(baseline);
+		}
+	}
+	free(results);
+	option_quiet = quiet;
+	return nu_regressions;
+}
+
+// The number of blocks of the random block set of each decoder.
+
+#define DECODER_BENCHMARK_BLOCKS	65536
+
+// Each decoder or comparison function is run repeatedly over its block set for at least this number of seconds.
+
+#define DECODER_BENCHMARK_MIN_TIME	0.2
+
+#define DECODER_SET_RANDOM	0
+#define DECODER_SET_CORPUS	1
+
+static const char *decoder_set_text[2] = { "random", "corpus" };
+
+// The mode of a block that has no mode, and the number of modes (including invalid ones) for which results are
+// reported.
+
+#define NO_MODE		- 2
+#define NU_MODES	16
+
+typedef struct {
+	char kind[16];			// "decode" or "compare".
+	char name[48];			// Texture format or comparison function.
+	char set[16];			// Block set.
+	char mode[16];			// Block mode, or "all".
+	int64_t nu_blocks;		// Number of blocks decoded or compared.
+	double time;
+} DecoderResult;
+
+// Pixel formats of the source image and of the decoded block of a comparison function.
+
+#define PIXEL_8_BIT	0
+#define PIXEL_16_BIT	1
+#define PIXEL_HALF_FLOAT 2
+
+typedef struct {
+	const char *name;
+	TextureComparisonFunction func;
+	int texture_type;		// Determines whether alpha is compared.
+	int nu_components;
+	int source_format;
+	int block_format;
+} ComparisonFunction;
+
+#define NU_COMPARISON_FUNCTIONS 19
+
+static const ComparisonFunction comparison_function[NU_COMPARISON_FUNCTIONS] = {
+	{ "any_size_rgba", compare_block_any_size_rgba, TEXTURE_TYPE_BPTC, 4, PIXEL_8_BIT, PIXEL_8_BIT },
+	{ "4x4_rgb", compare_block_4x4_rgb, TEXTURE_TYPE_ETC1, 3, PIXEL_8_BIT, PIXEL_8_BIT },
+	{ "4x4_rgba", compare_block_4x4_rgba, TEXTURE_TYPE_BPTC, 4, PIXEL_8_BIT, PIXEL_8_BIT },
+	{ "4x4_rgb8_with_half_float", compare_block_4x4_rgb8_with_half_float, TEXTURE_TYPE_ETC1, 3,
+		PIXEL_HALF_FLOAT, PIXEL_8_BIT },
+	{ "4x4_rgba8_with_half_float", compare_block_4x4_rgba8_with_half_float, TEXTURE_TYPE_BPTC, 4,
+		PIXEL_HALF_FLOAT, PIXEL_8_BIT },
+	{ "4x4_8_bit_components", compare_block_4x4_8_bit_components, TEXTURE_TYPE_RGTC2, 2, PIXEL_8_BIT,
+		PIXEL_8_BIT },
+	{ "4x4_signed_8_bit_components", compare_block_4x4_signed_8_bit_components, TEXTURE_TYPE_RGTC2, 2,
+		PIXEL_8_BIT, PIXEL_8_BIT },
+	{ "4x4_8_bit_components_with_16_bit", compare_block_4x4_8_bit_components_with_16_bit, TEXTURE_TYPE_RGTC2, 2,
+		PIXEL_16_BIT, PIXEL_8_BIT },
+	{ "4x4_signed_8_bit_components_with_16_bit", compare_block_4x4_signed_8_bit_components_with_16_bit,
+		TEXTURE_TYPE_RGTC2, 2, PIXEL_16_BIT, PIXEL_8_BIT },
+	{ "4x4_r16", compare_block_4x4_r16, TEXTURE_TYPE_R11_EAC, 1, PIXEL_16_BIT, PIXEL_16_BIT },
+	{ "4x4_rg16", compare_block_4x4_rg16, TEXTURE_TYPE_RG11_EAC, 2, PIXEL_16_BIT, PIXEL_16_BIT },
+	{ "4x4_r16_signed", compare_block_4x4_r16_signed, TEXTURE_TYPE_SIGNED_R11_EAC, 1, PIXEL_16_BIT,
+		PIXEL_16_BIT },
+	{ "4x4_rg16_signed", compare_block_4x4_rg16_signed, TEXTURE_TYPE_SIGNED_RG11_EAC, 2, PIXEL_16_BIT,
+		PIXEL_16_BIT },
+	{ "4x4_rgb_half_float", compare_block_4x4_rgb_half_float, TEXTURE_TYPE_BPTC_FLOAT, 3, PIXEL_HALF_FLOAT,
+		PIXEL_HALF_FLOAT },
+	{ "4x4_rgba_half_float", compare_block_4x4_rgba_half_float, TEXTURE_TYPE_UNCOMPRESSED_RGBA_HALF_FLOAT, 4,
+		PIXEL_HALF_FLOAT, PIXEL_HALF_FLOAT },
+	{ "4x4_r_half_float", compare_block_4x4_r_half_float, TEXTURE_TYPE_UNCOMPRESSED_R_HALF_FLOAT, 1,
+		PIXEL_HALF_FLOAT, PIXEL_HALF_FLOAT },
+	{ "4x4_rg_half_float", compare_block_4x4_rg_half_float, TEXTURE_TYPE_UNCOMPRESSED_RG_HALF_FLOAT, 2,
+		PIXEL_HALF_FLOAT, PIXEL_HALF_FLOAT },
+	{ "4x4_rgb_half_float_hdr", compare_block_4x4_rgb_half_float_hdr, TEXTURE_TYPE_BPTC_FLOAT, 3,
+		PIXEL_HALF_FLOAT, PIXEL_HALF_FLOAT },
+	{ "4x4_rgba_half_float_hdr", compare_block_4x4_rgba_half_float_hdr, TEXTURE_TYPE_UNCOMPRESSED_RGBA_HALF_FLOAT,
+		4, PIXEL_HALF_FLOAT, PIXEL_HALF_FLOAT },
+};
+
+static const char *etc_mode_text[5] = { "I", "D", "T", "H", "P" };
+
+// Return the mode of a block for which results per mode are reported, - 1 for an invalid mode, or NO_MODE.
+
+static int get_decoder_block_mode(int texture_type, const unsigned char *bitstring) {
+	switch (texture_type) {
+	case TEXTURE_TYPE_ETC1 :
+		// Individual or differential mode.
+		return (bitstring[3] & 2) >> 1;
+	case TEXTURE_TYPE_ETC2_EAC :
+		// The color part follows the alpha part.
+		bitstring += 8;
+		// Fall through.
+	case TEXTURE_TYPE_ETC2_RGB8 :
+		return block4x4_etc2_rgb8_get_mode(bitstring);
+	case TEXTURE_TYPE_BPTC :
+		return block4x4_bptc_get_mode(bitstring);
+	case TEXTURE_TYPE_BPTC_FLOAT :
+	case TEXTURE_TYPE_BPTC_SIGNED_FLOAT :
+		return block4x4_bptc_float_get_mode(bitstring);
+	}
+	return NO_MODE;
+}
+
+static void get_mode_text(int texture_type, int mode, char *s) {
+	if (mode == - 1)
+		strcpy(s, "invalid");
+	else
+	if (texture_type & TEXTURE_TYPE_ETC_BIT)
+		strcpy(s, etc_mode_text[mode]);
+	else
+		sprintf(s, "%d", mode);
+}
+
+static void fill_random(unsigned char *data, int size, unsigned int *seed) {
+	for (int i = 0; i < size; i++)
+		data[i] = benchmark_random(seed) & 0xFF;
+}
+
+// Fill an array with random half-floats in the range [0, 1].
+
+static void fill_random_half_floats(uint16_t *data, int n, unsigned int *seed) {
+	float *f = (float *)malloc(sizeof(float) * n);
+	for (int i = 0; i < n; i++)
+		f[i] = (float)benchmark_random(seed) / 65535.0;
+	singles2halfp(data, f, n);
+	free(f);
+}
+
+// Compress the images of the corpus that apply to a texture format with the ultra speed setting, and return the
+// compressed blocks of all images.
+
+static unsigned char *compress_corpus_blocks(Image *corpus, TextureInfo *info, int *nu_blocks_out) {
+	int block_size = info->internal_bits_per_block / 8;
+	int max_blocks = NU_BENCHMARK_IMAGES * (BENCHMARK_IMAGE_SIZE / 4) * (BENCHMARK_IMAGE_SIZE / 4);
+	unsigned char *blocks = (unsigned char *)malloc(max_blocks * block_size);
+	int nu_blocks = 0;
+	for (int i = 0; i < NU_BENCHMARK_IMAGES; i++) {
+		int hdr = (i == BENCHMARK_IMAGE_HDR_RAMP);
+		if (hdr && !(info->type & TEXTURE_TYPE_HALF_FLOAT_BIT))
+			continue;
+		Image image;
+		convert_benchmark_image(&corpus[i], info, &image);
+		CompressContext context;
+		init_benchmark_context(&context, SPEED_ULTRA, hdr);
+		option_hdr = hdr;
+		Texture texture;
+		compress_image(&context, &image, info->type, &texture);
+		option_hdr = 0;
+		int n = (texture.extended_width / texture.block_width) * (texture.extended_height / texture.block_height);
+		memcpy(&blocks[nu_blocks * block_size], texture.pixels, n * block_size);
+		nu_blocks += n;
+		destroy_texture(&texture);
+		destroy_image(&image);
+	}
+	*nu_blocks_out = nu_blocks;
+	return blocks;
+}
+
+// Decode the blocks repeatedly for at least DECODER_BENCHMARK_MIN_TIME seconds, after one untimed pass, and store
+// the number of decoded blocks and the time in result.
+
+static void time_decoder(TextureDecodingFunction decoding_func, const unsigned char *blocks, int nu_blocks,
+int block_size, int flags, DecoderResult *result) {
+	unsigned int image_buffer[32];
+	// Warm up the caches with one pass that is not timed.
+	for (int i = 0; i < nu_blocks; i++)
+		decoding_func(&blocks[i * block_size], image_buffer, flags);
+	int64_t n = 0;
+	double start_time = get_time();
+	double time;
+	do {
+		for (int i = 0; i < nu_blocks; i++)
+			decoding_func(&blocks[i * block_size], image_buffer, flags);
+		n += nu_blocks;
+		time = get_time() - start_time;
+	} while (time < DECODER_BENCHMARK_MIN_TIME);
+	result->nu_blocks = n;
+	result->time = time;
+}
+
+static double get_mblocks_per_second(DecoderResult *r) {
+	if (r->time <= 0)
+		return 0;
+	return r->nu_blocks / r->time * 1.0e-6;
+}
+
+static void print_decoder_result(DecoderResult *r) {
+	printf("%-7s %-40s %-6s %-7s %10.3lf Mblocks/s\n", r->kind, r->name, r->set, r->mode,
+		get_mblocks_per_second(r));
+	fflush(stdout);
+}
+
+// Benchmark the decoding function of a texture format on a block set, for all blocks and for the blocks of each
+// mode. Returns the number of results added.
+
+static int benchmark_decoder(TextureInfo *info, TextureDecodingFunction decoding_func, const unsigned char *blocks,
+int nu_blocks, int set, int quiet, DecoderResult *results) {
+	int block_size = info->internal_bits_per_block / 8;
+	// Use the same flags as convert_texture_to_image.
+	int flags = 0;
+	if (info->type & TEXTURE_TYPE_ETC_BIT)
+		flags = ETC2_MODE_ALLOWED_ALL;
+	if (info->type == TEXTURE_TYPE_BPTC_FLOAT || info->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
+		flags = BPTC_FLOAT_MODE_ALLOWED_ALL;
+	int nu_results = 0;
+	for (int mode = NO_MODE; mode < NU_MODES - 1; mode++) {
+		// Gather the blocks with the mode, or all blocks.
+		unsigned char *mode_blocks = (unsigned char *)malloc(nu_blocks * block_size);
+		int nu_mode_blocks = 0;
+		for (int i = 0; i < nu_blocks; i++)
+			if (mode == NO_MODE || get_decoder_block_mode(info->type, &blocks[i * block_size]) == mode) {
+				memcpy(&mode_blocks[nu_mode_blocks * block_size], &blocks[i * block_size], block_size);
+				nu_mode_blocks++;
+			}
+		if (nu_mode_blocks > 0) {
+			DecoderResult *r = &results[nu_results];
+			strcpy(r->kind, "decode");
+			strcpy(r->name, info->text1);
+			strcpy(r->set, decoder_set_text[set]);
+			if (mode == NO_MODE)
+				strcpy(r->mode, "all");
+			else
+				get_mode_text(info->type, mode, r->mode);
+			time_decoder(decoding_func, mode_blocks, nu_mode_blocks, block_size, flags, r);
+			if (!quiet)
+				print_decoder_result(r);
+			nu_results++;
+		}
+		free(mode_blocks);
+		// Formats without modes only have the result for all blocks.
+		if (mode == NO_MODE && get_decoder_block_mode(info->type, blocks) == NO_MODE)
+			break;
+	}
+	return nu_results;
+}
+
+// Set up the texture of the given size for which a comparison function is called.
+
+static void init_comparison_texture(const ComparisonFunction *f, int width, int height, TextureInfo *info,
+Texture *texture) {
+	*info = *match_texture_type(f->texture_type);
+	info->nu_components = f->nu_components;
+	texture->width = width;
+	texture->height = height;
+	texture->extended_width = (width + 3) & ~3;
+	texture->extended_height = (height + 3) & ~3;
+	texture->type = f->texture_type;
+	texture->block_width = 4;
+	texture->block_height = 4;
+	texture->info = info;
+}
+
+// Benchmark a comparison function on random decoded blocks and a random source image.
+
+static void benchmark_comparison_function(const ComparisonFunction *f, unsigned int *seed, DecoderResult *r) {
+	const int n = 64;
+	const int nu_blocks = 4096;
+	int source_pixel_size = f->source_format == PIXEL_HALF_FLOAT ? 8 : 4;
+	int block_pixel_size = f->block_format == PIXEL_HALF_FLOAT ? 8 : 4;
+	unsigned int *source_pixels = (unsigned int *)malloc(n * n * source_pixel_size);
+	unsigned int *block_pixels = (unsigned int *)malloc(nu_blocks * 16 * block_pixel_size);
+	// Random bits would include NaNs and infinities for half-float pixels.
+	if (f->source_format == PIXEL_HALF_FLOAT)
+		fill_random_half_floats((uint16_t *)source_pixels, n * n * 4, seed);
+	else
+		fill_random((unsigned char *)source_pixels, n * n * 4, seed);
+	if (f->block_format == PIXEL_HALF_FLOAT)
+		fill_random_half_floats((uint16_t *)block_pixels, nu_blocks * 16 * 4, seed);
+	else
+		fill_random((unsigned char *)block_pixels, nu_blocks * 16 * 4, seed);
+	TextureInfo info;
+	Texture texture;
+	BlockUserData user_data;
+	init_comparison_texture(f, n, n, &info, &texture);
+	user_data.flags = 0;
+	user_data.image_pixels = source_pixels;
+	user_data.image_rowstride = n * source_pixel_size;
+	user_data.texture = &texture;
+	int block_stride = 16 * block_pixel_size / 4;
+	int64_t nu_compared = 0;
+	double start_time = get_time();
+	double time;
+	do {
+		for (int i = 0; i < nu_blocks; i++) {
+			user_data.x_offset = (i % (n / 4)) * 4;
+			user_data.y_offset = ((i / (n / 4)) % (n / 4)) * 4;
+			f->func(&block_pixels[i * block_stride], &user_data);
+		}
+		nu_compared += nu_blocks;
+		time = get_time() - start_time;
+	} while (time < DECODER_BENCHMARK_MIN_TIME);
+	strcpy(r->kind, "compare");
+	strcpy(r->name, f->name);
+	strcpy(r->set, decoder_set_text[DECODER_SET_RANDOM]);
+	strcpy(r->mode, "all");
+	r->nu_blocks = nu_compared;
+	r->time = time;
+	free(source_pixels);
+	free(block_pixels);
+}
+
+// The size of the random source image of the comparison function check. It is not a multiple of the block size, so
+// that the blocks on the right and bottom borders are partly outside the image.
+
+#define CHECK_IMAGE_WIDTH	45
+#define CHECK_IMAGE_HEIGHT	38
+
+// Make the alpha component of about half of the 8-bit pixels zero, so that both images have fully transparent
+// pixels in common.
+
+static void make_random_pixels_transparent(unsigned int *pixels, int n, unsigned int *seed) {
+	for (int i = 0; i < n; i++)
+		if (benchmark_random(seed) & 1)
+			pixels[i] &= 0x00FFFFFF;
+}
+
+// Check that a comparison function gives exactly the same results with the comparison kernels of every level
+// supported by the processor as with the C kernels, for random blocks at every block position of a random source
+// image. Returns the number of mismatches.
+
+static int check_comparison_function(const ComparisonFunction *f, unsigned int *seed, int quiet) {
+	TextureInfo info;
+	Texture texture;
+	BlockUserData user_data;
+	init_comparison_texture(f, CHECK_IMAGE_WIDTH, CHECK_IMAGE_HEIGHT, &info, &texture);
+	int nu_blocks = (texture.extended_width / 4) * (texture.extended_height / 4);
+	int nu_source_pixels = texture.extended_width * texture.extended_height;
+	int source_pixel_size = f->source_format == PIXEL_HALF_FLOAT ? 8 : 4;
+	int block_pixel_size = f->block_format == PIXEL_HALF_FLOAT ? 8 : 4;
+	unsigned int *source_pixels = (unsigned int *)malloc(nu_source_pixels * source_pixel_size);
+	unsigned int *block_pixels = (unsigned int *)malloc(nu_blocks * 16 * block_pixel_size);
+	if (f->source_format == PIXEL_HALF_FLOAT)
+		fill_random_half_floats((uint16_t *)source_pixels, nu_source_pixels * 4, seed);
+	else {
+		fill_random((unsigned char *)source_pixels, nu_source_pixels * 4, seed);
+		make_random_pixels_transparent(source_pixels, nu_source_pixels, seed);
+	}
+	if (f->block_format == PIXEL_HALF_FLOAT)
+		fill_random_half_floats((uint16_t *)block_pixels, nu_blocks * 16 * 4, seed);
+	else {
+		fill_random((unsigned char *)block_pixels, nu_blocks * 16 * 4, seed);
+		make_random_pixels_transparent(block_pixels, nu_blocks * 16, seed);
+	}
+	user_data.flags = 0;
+	user_data.image_pixels = source_pixels;
+	user_data.image_rowstride = texture.extended_width * source_pixel_size;
+	user_data.texture = &texture;
+	int block_stride = 16 * block_pixel_size / 4;
+	double *expected = (double *)malloc(sizeof(double) * nu_blocks);
+	select_compare_kernels(COMPARE_KERNELS_C);
+	for (int i = 0; i < nu_blocks; i++) {
+		user_data.x_offset = (i % (texture.extended_width / 4)) * 4;
+		user_data.y_offset = (i / (texture.extended_width / 4)) * 4;
+		expected[i] = f->func(&block_pixels[i * block_stride], &user_data);
+	}
+	int nu_mismatches = 0;
+	for (int level = COMPARE_KERNELS_SSE2; level <= COMPARE_KERNELS_AVX2; level++) {
+		// Stop when the kernels of the level are the same as those of the previous level.
+		if (select_compare_kernels(level) < level)
+			break;
+		for (int i = 0; i < nu_blocks; i++) {
+			user_data.x_offset = (i % (texture.extended_width / 4)) * 4;
+			user_data.y_offset = (i / (texture.extended_width / 4)) * 4;
+			double result = f->func(&block_pixels[i * block_stride], &user_data);
+			if (memcmp(&result, &expected[i], sizeof(double)) != 0) {
+				if (!quiet)
+					printf("compare_block_%s: %s kernels give %.17g instead of %.17g for the block at "
+						"(%d, %d).\n", f->name, level == COMPARE_KERNELS_SSE2 ? "SSE2" : "AVX2", result,
+						expected[i], user_data.x_offset, user_data.y_offset);
+				nu_mismatches++;
+			}
+		}
+	}
+	init_compare_kernels();
+	free(expected);
+	free(source_pixels);
+	free(block_pixels);
+	return nu_mismatches;
+}
+
+// Texture formats and comparison functions evaluated with the batch kernels of batch.c.
+
+typedef struct {
+	const char *name;
+	int texture_type;
+	TextureComparisonFunction func;
+	int flags;
+} BatchFormat;
+
+#define NU_BATCH_FORMATS 6
+
+static const BatchFormat batch_format[NU_BATCH_FORMATS] = {
+	{ "dxt1", TEXTURE_TYPE_DXT1, compare_block_4x4_rgb, ENCODE_BIT },
+	{ "etc1", TEXTURE_TYPE_ETC1, compare_block_4x4_rgb, ENCODE_BIT | ETC_MODE_ALLOWED_ALL },
+	{ "etc2_rgb8", TEXTURE_TYPE_ETC2_RGB8, compare_block_4x4_rgb, ENCODE_BIT | ETC2_MODE_ALLOWED_ALL },
+	{ "rgtc1", TEXTURE_TYPE_RGTC1, compare_block_4x4_8_bit_components, ENCODE_BIT },
+	{ "rgtc1_with_16_bit", TEXTURE_TYPE_RGTC1, compare_block_4x4_8_bit_components_with_16_bit, ENCODE_BIT },
+	{ "r11_eac", TEXTURE_TYPE_R11_EAC, compare_block_4x4_r16, ENCODE_BIT },
+};
+
+// The maximum number of random candidate blocks evaluated at once by the batch check. The number varies per block
+// position, so that both the wide and the narrow kernels are used and partly filled batches occur.
+
+#define BATCH_CHECK_MAX_CANDIDATES 32
+
+// Check that the batch evaluation of candidate blocks gives exactly the same fitness and pixel errors with the batch
+// kernels of every level supported by the processor as the regular decoding and comparison functions, for random
+// candidates at every block position of a random source image. Returns the number of mismatches.
+
+static int check_batch_evaluation(const BatchFormat *f, unsigned int *seed, int quiet) {
+	TextureInfo info;
+	Texture texture;
+	BlockUserData user_data;
+	info = *match_texture_type(f->texture_type);
+	texture.width = CHECK_IMAGE_WIDTH;
+	texture.height = CHECK_IMAGE_HEIGHT;
+	texture.extended_width = (CHECK_IMAGE_WIDTH + 3) & ~3;
+	texture.extended_height = (CHECK_IMAGE_HEIGHT + 3) & ~3;
+	texture.type = f->texture_type;
+	texture.bits_per_block = info.bits_per_block;
+	texture.block_width = 4;
+	texture.block_height = 4;
+	texture.info = &info;
+	set_texture_decoding_function(&texture, NULL);
+	texture.comparison_function = f->func;
+	int nu_blocks = (texture.extended_width / 4) * (texture.extended_height / 4);
+	int nu_source_pixels = texture.extended_width * texture.extended_height;
+	unsigned int *source_pixels = (unsigned int *)malloc(nu_source_pixels * 4);
+	fill_random((unsigned char *)source_pixels, nu_source_pixels * 4, seed);
+	int bytes_per_block = texture.bits_per_block / 8;
+	unsigned char *candidates = (unsigned char *)malloc(BATCH_CHECK_MAX_CANDIDATES * bytes_per_block);
+	double expected_fitness[BATCH_CHECK_MAX_CANDIDATES];
+	double expected_pixel_error[BATCH_CHECK_MAX_CANDIDATES * 16];
+	double fitness[BATCH_CHECK_MAX_CANDIDATES];
+	double pixel_error[BATCH_CHECK_MAX_CANDIDATES * 16];
+	user_data.flags = f->flags;
+	user_data.image_pixels = source_pixels;
+	user_data.image_rowstride = texture.extended_width * 4;
+	user_data.texture = &texture;
+	int nu_mismatches = 0;
+	for (int i = 0; i < nu_blocks; i++) {
+		user_data.x_offset = (i % (texture.extended_width / 4)) * 4;
+		user_data.y_offset = (i / (texture.extended_width / 4)) * 4;
+		int n = 1 + i % BATCH_CHECK_MAX_CANDIDATES;
+		fill_random(candidates, n * bytes_per_block, seed);
+		for (int j = 0; j < n; j++) {
+			unsigned int image_buffer[32];
+			if (!texture.decoding_function(&candidates[j * bytes_per_block], image_buffer, f->flags)) {
+				expected_fitness[j] = 0;
+				continue;
+			}
+			expected_fitness[j] = f->func(image_buffer, &user_data);
+			calculate_block_pixel_errors(image_buffer, &user_data, &expected_pixel_error[j * 16]);
+		}
+		for (int level = COMPARE_KERNELS_C; level <= COMPARE_KERNELS_AVX2; level++) {
+			// Stop when the kernels of the level are the same as those of the previous level.
+			if (select_batch_kernels(level) < level)
+				break;
+			calculate_fitness_batch(&user_data, candidates, n, fitness, pixel_error);
+			for (int j = 0; j < n; j++) {
+				int mismatch = memcmp(&fitness[j], &expected_fitness[j], sizeof(double)) != 0;
+				if (expected_fitness[j] != 0 && memcmp(&pixel_error[j * 16], &expected_pixel_error[j * 16],
+				sizeof(double) * 16) != 0)
+					mismatch = 1;
+				if (mismatch) {
+					if (!quiet)
+						printf("batch_%s: %s kernels give %.17g instead of %.17g for candidate %d of %d "
+							"at (%d, %d).\n", f->name, level == COMPARE_KERNELS_C ? "C" :
+							(level == COMPARE_KERNELS_SSE2 ? "SSE2" : "AVX2"), fitness[j],
+							expected_fitness[j], j, n, user_data.x_offset, user_data.y_offset);
+					nu_mismatches++;
+				}
+			}
+		}
+	}
+	select_batch_kernels(COMPARE_KERNELS_AVX2);
+	free(candidates);
+	free(source_pixels);
+	return nu_mismatches;
+}
+
+static void write_decoder_results(const char *filename, DecoderResult *results, int nu_results) {
+	FILE *f = fopen(filename, "wb");
+	if (f == NULL) {
+		printf("Error -- couldn't open benchmark results file %s for writing.\n", filename);
+		exit(1);
+	}
+	fprintf(f, "kind,name,set,mode,blocks,time,mblocks_per_second\n");
+	for (int i = 0; i < nu_results; i++) {
+		DecoderResult *r = &results[i];
+		fprintf(f, "%s,%s,%s,%s,%lld,%.6lf,%.4lf\n", r->kind, r->name, r->set, r->mode, (long long)r->nu_blocks,
+			r->time, get_mblocks_per_second(r));
+	}
+	fclose(f);
+}
+
+// Read the results of an earlier run from a .csv file written by write_decoder_results. Returns the number of
+// results, or - 1 when the file cannot be opened.
+
+static int read_decoder_results(const char *filename, DecoderResult **results_out) {
+	FILE *f = fopen(filename, "rb");
+	if (f == NULL)
+		return - 1;
+	int nu_results = 0;
+	int max_results = 64;
+	DecoderResult *results = (DecoderResult *)malloc(sizeof(DecoderResult) * max_results);
+	char line[256];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		DecoderResult r;
+		long long nu_blocks;
+		double mblocks_per_second;
+		// The header line does not match.
+		if (sscanf(line, "%15[^,],%47[^,],%15[^,],%15[^,],%lld,%lf,%lf", r.kind, r.name, r.set, r.mode,
+		&nu_blocks, &r.time, &mblocks_per_second) < 7)
+			continue;
+		r.nu_blocks = nu_blocks;
+		if (nu_results == max_results) {
+			max_results *= 2;
+			results = (DecoderResult *)realloc(results, sizeof(DecoderResult) * max_results);
+		}
+		results[nu_results] = r;
+		nu_results++;
+	}
+	fclose(f);
+	*results_out = results;
+	return nu_results;
+}
+
+// Compare the decoder results with those of the baseline, printing the results that regressed and a summary
+// unless quiet. Returns the number of regressions.
+
+static int compare_decoders_with_baseline(DecoderResult *results, int nu_results, DecoderResult *baseline,
+int nu_baseline, int quiet) {
+	int nu_compared = 0;
+	int nu_regressions = 0;
+	double log_speed_ratio = 0;
+	for (int i = 0; i < nu_results; i++) {
+		DecoderResult *r = &results[i];
+		DecoderResult *b = NULL;
+		for (int j = 0; j < nu_baseline; j++)
+			if (strcmp(baseline[j].kind, r->kind) == 0 && strcmp(baseline[j].name, r->name) == 0 &&
+			strcmp(baseline[j].set, r->set) == 0 && strcmp(baseline[j].mode, r->mode) == 0) {
+				b = &baseline[j];
+				break;
+			}
+		if (b == NULL || get_mblocks_per_second(b) <= 0 || get_mblocks_per_second(r) <= 0)
+			continue;
+		nu_compared++;
+		double speed_ratio = get_mblocks_per_second(r) / get_mblocks_per_second(b);
+		log_speed_ratio += log(speed_ratio);
+		if (speed_ratio < 1.0 - SPEED_REGRESSION_TOLERANCE) {
+			nu_regressions++;
+			if (!quiet)
+				printf("Regression: %s %s %s %s: %.3lf Mblocks/s (baseline %.3lf, x%.2lf)\n", r->kind, r->name,
+					r->set, r->mode, get_mblocks_per_second(r), get_mblocks_per_second(b), speed_ratio);
+		}
+	}
+	if (!quiet) {
+		if (nu_compared == 0)
+			printf("No results in common with the baseline.\n");
+		else
+			printf("Compared %d results with the baseline: speed x%.3lf (geometric mean), %d regression%s "
+				"(more than %.0lf%% slower).\n", nu_compared, exp(log_speed_ratio / nu_compared),
+				nu_regressions, nu_regressions == 1 ? "" : "s", SPEED_REGRESSION_TOLERANCE * 100.0);
+	}
+	return nu_regressions;
+}
+
+// Run the decoder benchmark for the given texture format (or all formats when texture_type is - 1), write the
+// results to results_filename and compare them with those in baseline_filename when it is not NULL. Each
+// decoding function is timed on a set of random blocks and on the blocks of the compressed corpus, for all blocks
+// and for the blocks of each ETC or BPTC mode. Formats that share a decoding function are only benchmarked
+// once. All comparison functions are timed on random blocks when no format is given. Returns the number of
+// regressions.
+
+int benchmark_decoders(const char *results_filename, const char *baseline_filename, int texture_type) {
+	int quiet = option_quiet;
+	option_quiet = 1;
+	calculate_half_float_table();
+	calculate_normalized_float_table();
+	calculate_gamma_corrected_half_float_table();
+	init_compare_kernels();
+	Image corpus[NU_BENCHMARK_IMAGES];
+	for (int i = 0; i < NU_BENCHMARK_IMAGES; i++)
+		generate_benchmark_image(i, &corpus[i]);
+	int nu_formats = get_number_of_texture_formats();
+	int max_results = nu_formats * 2 * NU_MODES + NU_COMPARISON_FUNCTIONS;
+	DecoderResult *results = (DecoderResult *)malloc(sizeof(DecoderResult) * max_results);
+	int nu_results = 0;
+	TextureDecodingFunction *done = (TextureDecodingFunction *)malloc(sizeof(TextureDecodingFunction) * nu_formats);
+	int nu_done = 0;
+	unsigned int seed = 54321;
+	double start_time = get_time();
+	for (int i = 0; i < nu_formats; i++) {
+		TextureInfo *info = match_texture_description(get_texture_format_index_text(i, 0));
+		if (info->type & (TEXTURE_TYPE_UNCOMPRESSED_BIT | TEXTURE_TYPE_ASTC_BIT))
+			continue;
+		if (texture_type != - 1 && info->type != texture_type)
+			continue;
+		Texture texture;
+		texture.type = info->type;
+		texture.info = info;
+		set_texture_decoding_function(&texture, NULL);
+		int j;
+		for (j = 0; j < nu_done; j++)
+			if (done[j] == texture.decoding_function)
+				break;
+		if (j < nu_done)
+			continue;
+		done[nu_done++] = texture.decoding_function;
+		int block_size = info->internal_bits_per_block / 8;
+		unsigned char *blocks = (unsigned char *)malloc(DECODER_BENCHMARK_BLOCKS * block_size);
+		fill_random(blocks, DECODER_BENCHMARK_BLOCKS * block_size, &seed);
+		nu_results += benchmark_decoder(info, texture.decoding_function, blocks, DECODER_BENCHMARK_BLOCKS,
+			DECODER_SET_RANDOM, quiet, &results[nu_results]);
+		free(blocks);
+		int nu_blocks;
+		blocks = compress_corpus_blocks(corpus, info, &nu_blocks);
+		nu_results += benchmark_decoder(info, texture.decoding_function, blocks, nu_blocks, DECODER_SET_CORPUS,
+			quiet, &results[nu_results]);
+		free(blocks);
+	}
+	free(done);
+	for (int i = 0; i < NU_BENCHMARK_IMAGES; i++)
+		destroy_image(&corpus[i]);
+	if (texture_type == - 1)
+		for (int i = 0; i < NU_COMPARISON_FUNCTIONS; i++) {
+			benchmark_comparison_function(&comparison_function[i], &seed, &results[nu_results]);
+			if (!quiet)
+				print_decoder_result(&results[nu_results]);
+			nu_results++;
+		}
+	write_decoder_results(results_filename, results, nu_results);
+	if (!quiet)
+		printf("Wrote %d decoder benchmark results to %s (%.1lf s).\n", nu_results, results_filename,
+			get_time() - start_time);
+	int nu_regressions = 0;
+	if (baseline_filename != NULL) {
+		DecoderResult *baseline;
+		int nu_baseline = read_decoder_results(baseline_filename, &baseline);
+		if (nu_baseline < 0) {
+			if (!quiet)
+				printf("Baseline file %s not found, skipping the comparison.\n", baseline_filename);
+		}
+		else {
+			nu_regressions = compare_decoders_with_baseline(results, nu_results, baseline, nu_baseline, quiet);
+			free(baseline);
+		}
+	}
+	free(results);
+	option_quiet = quiet;
+	return nu_regressions;
+}
+
+// The size of the image of the deterministic compression check (not a multiple of the block size), the numbers of
+// worker threads of its runs, the number of rows of memory after the image that are filled with different values
+// in each run, and the speed settings checked. --ultra compresses each block with a single population, --fast uses
+// an archipelago per block that is seeded with the blocks to the left and above, so that the scheduling of the
+// blocks could affect the result.
+
+#define DETERMINISM_CHECK_IMAGE_WIDTH	21
+#define DETERMINISM_CHECK_IMAGE_HEIGHT	13
+#define NU_DETERMINISM_CHECK_RUNS	2
+#define DETERMINISM_CHECK_SLACK_ROWS	4
+
+#define NU_DETERMINISM_CHECK_SPEEDS	2
+
+static const int determinism_check_threads[NU_DETERMINISM_CHECK_RUNS] = { 1, 4 };
+static const int determinism_check_speeds[NU_DETERMINISM_CHECK_SPEEDS] = { SPEED_ULTRA, SPEED_FAST };
+
+// Generate the RGBA image of the deterministic compression check: a noisy gradient with fully transparent circular
+// holes, so that the BPTC modes with partitions and alpha are used.
+
+static void generate_check_image(Image *image) {
+	unsigned int seed = 13579;
+	image->width = DETERMINISM_CHECK_IMAGE_WIDTH;
+	image->height = DETERMINISM_CHECK_IMAGE_HEIGHT;
+	image->extended_width = DETERMINISM_CHECK_IMAGE_WIDTH;
+	image->extended_height = DETERMINISM_CHECK_IMAGE_HEIGHT;
+	image->alpha_bits = 8;
+	image->nu_components = 4;
+	image->bits_per_component = 8;
+	image->is_signed = 0;
+	image->srgb = 0;
+	image->is_half_float = 0;
+	image->pixels = (unsigned int *)malloc(DETERMINISM_CHECK_IMAGE_WIDTH * DETERMINISM_CHECK_IMAGE_HEIGHT * 4);
+	for (int y = 0; y < DETERMINISM_CHECK_IMAGE_HEIGHT; y++)
+		for (int x = 0; x < DETERMINISM_CHECK_IMAGE_WIDTH; x++) {
+			int dx = (x % 11) - 5;
+			int dy = (y % 9) - 4;
+			int a = dx * dx + dy * dy < 6 ? 0 : 0xFF;
+			int noise = (benchmark_random(&seed) & 0x3F) - 32;
+			image->pixels[y * DETERMINISM_CHECK_IMAGE_WIDTH + x] = pack_rgba(clamp_component(x * 11 + noise),
+				clamp_component(255 - y * 16 + noise), clamp_component((x + y) * 7 - noise), a);
+		}
+}
+
+// Compress the check image to a texture format with the given speed setting with each number of threads of
+// determinism_check_threads, and check that the compressed textures are identical. The memory after the image,
+// which the compressor must not depend on, holds different random values in each run. Returns whether the check
+// passed.
+
+static int check_deterministic_compression(Image *source, TextureInfo *info, int speed) {
+	Image converted_image;
+	convert_benchmark_image(source, info, &converted_image);
+	int pixel_size = converted_image.is_half_float ? 8 : 4;
+	int size = converted_image.extended_width * converted_image.extended_height * pixel_size;
+	int slack = DETERMINISM_CHECK_SLACK_ROWS * converted_image.extended_width * pixel_size;
+	unsigned char *first_pixels = NULL;
+	int nu_bytes = 0;
+	int passed = 1;
+	for (int run = 0; run < NU_DETERMINISM_CHECK_RUNS; run++) {
+		Image image = converted_image;
+		image.pixels = (unsigned int *)malloc(size + slack);
+		memcpy(image.pixels, converted_image.pixels, size);
+		unsigned int seed = 1000 + run;
+		fill_random((unsigned char *)image.pixels + size, slack, &seed);
+		CompressContext context;
+		init_benchmark_context(&context, speed, 0);
+		context.option_max_threads = determinism_check_threads[run];
+		Texture texture;
+		compress_image(&context, &image, info->type, &texture);
+		free(image.pixels);
+		int n = (texture.extended_width / texture.block_width) * (texture.extended_height / texture.block_height) *
+			(texture.bits_per_block / 8);
+		if (run == 0) {
+			first_pixels = (unsigned char *)malloc(n);
+			memcpy(first_pixels, texture.pixels, n);
+			nu_bytes = n;
+		}
+		else
+		if (n != nu_bytes || memcmp(texture.pixels, first_pixels, n) != 0)
+			passed = 0;
+		destroy_texture(&texture);
+	}
+	free(first_pixels);
+	destroy_image(&converted_image);
+	return passed;
+}
+
+// Run the checks of --benchmark --check: every block comparison function must give exactly the same results with
+// the vector comparison kernels as with the C kernels, the batch evaluation of candidate blocks must give the same
+// results with every batch kernel as the regular functions, and compression with --deterministic must give the same
+// texture regardless of the number of threads for every compressed texture format. The result of each check is
+// printed unless quiet. Returns the number of failed checks.
+
+int run_checks() {
+	int quiet = option_quiet;
+	calculate_half_float_table();
+	calculate_normalized_float_table();
+	calculate_gamma_corrected_half_float_table();
+	unsigned int seed = 24680;
+	int nu_checks = 0;
+	int nu_failed = 0;
+	for (int i = 0; i < NU_COMPARISON_FUNCTIONS; i++) {
+		int nu_mismatches = check_comparison_function(&comparison_function[i], &seed, quiet);
+		if (!quiet)
+			printf("compare_block_%-40s %s\n", comparison_function[i].name, nu_mismatches == 0 ? "OK" : "FAILED");
+		nu_checks++;
+		if (nu_mismatches > 0)
+			nu_failed++;
+	}
+	init_batch_evaluation();
+	for (int i = 0; i < NU_BATCH_FORMATS; i++) {
+		int nu_mismatches = check_batch_evaluation(&batch_format[i], &seed, quiet);
+		if (!quiet)
+			printf("batch_%-48s %s\n", batch_format[i].name, nu_mismatches == 0 ? "OK" : "FAILED");
+		nu_checks++;
+		if (nu_mismatches > 0)
+			nu_failed++;
+	}
+	// Silence the messages of the compressor.
+	option_quiet = 1;
+	Image image;
+	generate_check_image(&image);
+	int nu_formats = get_number_of_texture_formats();
+	for (int i = 0; i < nu_formats; i++) {
+		TextureInfo *info = match_texture_description(get_texture_format_index_text(i, 0));
+		if (info->type & (TEXTURE_TYPE_UNCOMPRESSED_BIT | TEXTURE_TYPE_ASTC_BIT))
+			continue;
+		for (int j = 0; j < NU_DETERMINISM_CHECK_SPEEDS; j++) {
+			int speed = determinism_check_speeds[j];
+			int passed = check_deterministic_compression(&image, info, speed);
+			if (!quiet) {
+				char name[64];
+				sprintf(name, "%s_%s", info->text1, speed_text[speed]);
+				printf("deterministic_%-40s %s\n", name, passed ? "OK" : "FAILED");
+			}
+			nu_checks++;
+			if (!passed)
+				nu_failed++;
+		}
+	}
+	destroy_image(&image);
+	option_quiet = quiet;
+	if (!quiet)
+		printf("%d of %d checks failed.\n", nu_failed, nu_checks);
+	return nu_failed;
+}
@@ -30,7 +30,7 @@
 
 // Functions for BPTC/BC7/BC6H decompression.
 
-static char table_P2[64 * 16] = {
+char table_P2[64 * 16] = {
     0,0,1,1,0,0,1,1,0,0,1,1,0,0,1,1,
     0,0,0,1,0,0,0,1,0,0,0,1,0,0,0,1,
     0,1,1,1,0,1,1,1,0,1,1,1,0,1,1,1,
@@ -479,6 +479,57 @@ static char mode_has_partition_bits[8] = { 1, 1, 1, 1, 0, 0, 0, 1 };
 
 static int draw_bptc_mode_1(Block *block, unsigned int *image_buffer);
 
+int block4x4_bptc_get_mode(const unsigned char *bitstring) {
+	Block block;
+	block.data0 = *(uint64_t *)&bitstring[0];
+	block.data1 = *(uint64_t *)&bitstring[8];
+	block.index = 0;
+	return extract_mode(&block);
+}
+
+int block4x4_bptc_get_partition(const unsigned char *bitstring) {
+	Block block;
+	block.data0 = *(uint64_t *)&bitstring[0];
+	block.data1 = *(uint64_t *)&bitstring[8];
+	block.index = 0;
+	int mode = extract_mode(&block);
+	if (mode == - 1 || !mode_has_partition_bits[mode])
+		return - 1;
+	return extract_partition_set_id(&block, mode);
+}
+
+int block4x4_bptc_get_anchor_pixels(int nu_subsets, int partition_set_id) {
+	int anchors = 1;
+	for (int i = 1; i < nu_subsets; i++)
+		anchors |= 1 << get_anchor_index(partition_set_id, i, nu_subsets);
+	return anchors;
+}
+
+// Return whether the mode and partition of a block are allowed by the flags used when encoding.
+
+static int mode_and_partition_allowed(const Block *block, int mode, int flags) {
+	if (!(flags & (1 << mode)))
+		return 0;
+	if (!(flags & BPTC_PARTITION_RESTRICTED) || !mode_has_partition_bits[mode])
+		return 1;
+	int partition_set_id = get_bits_uint64(block->data0, mode + 1, mode + PB[mode]);
+	int shift = get_nu_subsets(mode) == 2 ? BPTC_PARTITION2_SHIFT : BPTC_PARTITION3_SHIFT;
+	return partition_set_id == ((flags >> shift) & 0x3F);
+}
+
+void set_block4x4_bptc_mode(unsigned char *bitstring, int mode, int flags) {
+	uint64_t data0 = *(uint64_t *)&bitstring[0];
+	data0 &= ~(((uint64_t)1 << (mode + 1)) - 1);
+	data0 |= (uint64_t)1 << mode;
+	if ((flags & BPTC_PARTITION_RESTRICTED) && mode_has_partition_bits[mode]) {
+		int shift = get_nu_subsets(mode) == 2 ? BPTC_PARTITION2_SHIFT : BPTC_PARTITION3_SHIFT;
+		uint64_t mask = ((uint64_t)1 << PB[mode]) - 1;
+		data0 &= ~(mask << (mode + 1));
+		data0 |= (((uint64_t)flags >> shift) & mask) << (mode + 1);
+	}
+	*(uint64_t *)&bitstring[0] = data0;
+}
+
 // Draw a 4x4 pixel block using the BPTC/BC7 texture compression data in bitstring.
 
 int draw_block4x4_bptc(const unsigned char *bitstring, unsigned int *image_buffer, int flags) {
@@ -489,6 +540,8 @@ int draw_block4x4_bptc(const unsigned char *bitstring, unsigned int *image_buffe
 	int mode = extract_mode(&block);
 	if (mode == - 1)
 		return 0;
+	if ((flags & ENCODE_BIT) && !mode_and_partition_allowed(&block, mode, flags))
+		return 0;
 	if (mode == 1)
 		return draw_bptc_mode_1(&block, image_buffer);
 
@@ -815,6 +868,18 @@ int block4x4_bptc_float_get_mode(const unsigned char *bitstring) {
 	return mode;
 }
 
+int block4x4_bptc_float_get_partition(const unsigned char *bitstring) {
+	Block block;
+	block.data0 = *(uint64_t *)&bitstring[0];
+	block.data1 = *(uint64_t *)&bitstring[8];
+	block.index = 0;
+	int mode = extract_bptc_float_mode(&block);
+	// Modes 10 to 13 have a single subset.
+	if (mode == - 1 || mode >= 10)
+		return - 1;
+	return get_bits_uint64(block.data1, 13, 17);
+}
+
 int draw_block4x4_bptc_float_shared(const unsigned char *bitstring, unsigned int *image_buffer, int signed_flag, int flags) {
 	Block block;
 	block.data0 = *(uint64_t *)&bitstring[0];
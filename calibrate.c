@@ -77,14 +77,26 @@ static void mutation_bin_report() {
 static void compress_callback(BlockUserData *user_data) {
 }
 
+// Compress an image with the given mutation and crossover probabilities.
+
+static void compress_with_genetic_parameters(Image *image, int texture_type, Texture *texture, float mutation_prob,
+float crossover_prob) {
+	CompressContext context;
+	init_compress_context(&context, compress_callback);
+	context.genetic_parameters = 1;
+	context.mutation_probability = mutation_prob;
+	context.crossover_probability = crossover_prob;
+	compress_image(&context, image, texture_type, texture);
+}
+
 static double calibrate_calculate_error(const Ffit *fit, const double *param) {
 	FitUserData *user_data = &fit_user_data;
 	Texture texture;
 	float crossover_prob = param[1];
 	if (fixed_crossover_probability)
 		crossover_prob = 0.7;
-	compress_image(user_data->image, user_data->texture_format, compress_callback, &texture, 1,
-		param[0], crossover_prob);
+	compress_with_genetic_parameters(user_data->image, user_data->texture_format, &texture, param[0],
+		crossover_prob);
 	Image image2;
 	convert_texture_to_image(&texture, &image2);
 	double rmse = compare_images(user_data->image, &image2);
@@ -131,7 +143,7 @@ void calibrate_genetic_parameters(Image *image, int texture_type) {
 			n = 5;
 		for (int i = 0; i < n; i++) {
 			Texture texture;
-			compress_image(image, texture_type, compress_callback, &texture, 1, mut, 0.7);
+			compress_with_genetic_parameters(image, texture_type, &texture, mut, 0.7);
 			Image image2;
 			convert_texture_to_image(&texture, &image2);
 			double rmse = compare_images(image, &image2);
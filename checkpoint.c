@@ -0,0 +1,324 @@
+/*
+    checkpoint.c -- part of texgenpack, a texture compressor using fgen.
+
+    texgenpack -- a genetic algorithm texture compressor.
+    Copyright 2013 Harm Hanemaaijer
+
+    This file is part of texgenpack.
+
+    texgenpack is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    texgenpack is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with texgenpack.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Checkpointing of long-running compressions. While the blocks of a texture are compressed, the completed blocks
+// of every mipmap level are periodically written to a checkpoint file, together with a flag for each block that
+// tells whether it has been completed. When the compression is restarted with --resume, the completed blocks are
+// restored from the checkpoint and only the remaining blocks are compressed.
+//
+// No random number generator state is stored. In deterministic mode the random number sequence of each block is
+// derived from the image contents and the block position, and the neighbouring blocks used for seeding are always
+// completed before a block is started, so a resumed compression produces exactly the same texture as an
+// uninterrupted one. Otherwise the worker threads are seeded from the timer anyway.
+//
+// The checkpoint file starts with a header holding a signature, the texture type, the number of mipmap levels and
+// the settings that influence the result, followed for each level by a hash of the source image, the number of
+// blocks, the number of completed blocks, and, when there are any, a byte for each block that is one when the
+// block is completed and the compressed data of each completed block. A checkpoint that does not match the
+// source images or the settings is ignored.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "texgenpack.h"
+
+#define CHECKPOINT_VERSION	4
+#define NU_CHECKPOINT_SETTINGS	15
+
+typedef struct {
+	uint64_t image_hash;
+	int nu_blocks;
+	int bytes_per_block;
+	unsigned char *done;		// Completion flag of each block, or NULL when no block is completed.
+	unsigned char *data;		// Blocks read from the checkpoint file that have not yet been restored.
+} CheckpointLevel;
+
+// The checkpoint state of a compression, stored in its compression context.
+
+struct Checkpoint_t {
+	char *filename;
+	int interval;
+	time_t time;			// Time the checkpoint file was last written.
+	int texture_type;
+	int nu_levels;
+	Texture *textures;
+	CheckpointLevel *levels;
+};
+
+static const char checkpoint_signature[8] = { 'T', 'G', 'P', 'C', 'K', 'P', 'T', '\0' };
+
+// Get the settings of the compression context that influence the compressed texture.
+
+static void get_checkpoint_settings(CompressContext *context, int *settings) {
+	settings[0] = CHECKPOINT_VERSION;
+	settings[1] = context->option_speed;
+	settings[2] = context->option_generations;
+	settings[3] = context->option_islands;
+	settings[4] = context->option_modal_etc2;
+	settings[5] = context->option_allowed_modes_etc2;
+	settings[6] = context->option_deterministic;
+	settings[7] = context->option_convergence_window;
+	settings[8] = context->option_polish;
+	settings[9] = context->option_hdr;
+	settings[10] = context->option_half_float;
+	// The quality targets are stored with a precision of 0.001.
+	settings[11] = (int)floor(context->option_target_rmse * 1000.0 + 0.5);
+	settings[12] = (int)floor(context->option_target_psnr * 1000.0 + 0.5);
+	settings[13] = (int)(get_importance_map_hash(context) & 0x7FFFFFFF);
+	settings[14] = context->option_derive_indices;
+}
+
+static void free_checkpoint_levels(Checkpoint *checkpoint) {
+	for (int i = 0; i < checkpoint->nu_levels; i++) {
+		free(checkpoint->levels[i].done);
+		free(checkpoint->levels[i].data);
+	}
+	free(checkpoint->levels);
+	checkpoint->levels = NULL;
+}
+
+// Read the checkpoint file of a compression context and store the completed blocks of each level. Returns 0 when
+// the file does not exist or does not match the source images and settings, in which case nothing is stored.
+
+static int read_checkpoint(CompressContext *context) {
+	Checkpoint *checkpoint = context->checkpoint;
+	FILE *f = fopen(checkpoint->filename, "rb");
+	if (f == NULL)
+		return 0;
+	char signature[8];
+	int header[2 + NU_CHECKPOINT_SETTINGS];
+	int settings[NU_CHECKPOINT_SETTINGS];
+	get_checkpoint_settings(context, settings);
+	if (fread(signature, 1, 8, f) < 8 || memcmp(signature, checkpoint_signature, 8) != 0 ||
+	fread(header, sizeof(int), 2 + NU_CHECKPOINT_SETTINGS, f) < 2 + NU_CHECKPOINT_SETTINGS ||
+	header[0] != checkpoint->texture_type || header[1] != checkpoint->nu_levels ||
+	memcmp(&header[2], settings, sizeof(settings)) != 0) {
+		fclose(f);
+		return 0;
+	}
+	for (int i = 0; i < checkpoint->nu_levels; i++) {
+		CheckpointLevel *level = &checkpoint->levels[i];
+		uint64_t image_hash;
+		int counts[2];
+		if (fread(&image_hash, sizeof(uint64_t), 1, f) < 1 || fread(counts, sizeof(int), 2, f) < 2 ||
+		image_hash != level->image_hash || counts[0] != level->nu_blocks)
+			goto mismatch;
+		if (counts[1] == 0)
+			continue;
+		level->done = (unsigned char *)malloc(level->nu_blocks);
+		level->data = (unsigned char *)malloc(level->nu_blocks * level->bytes_per_block);
+		if (fread(level->done, 1, level->nu_blocks, f) < level->nu_blocks)
+			goto mismatch;
+		for (int j = 0; j < level->nu_blocks; j++)
+			if (level->done[j] && fread(&level->data[j * level->bytes_per_block], 1,
+			level->bytes_per_block, f) < level->bytes_per_block)
+				goto mismatch;
+	}
+	fclose(f);
+	return 1;
+mismatch :
+	fclose(f);
+	for (int i = 0; i < checkpoint->nu_levels; i++) {
+		free(checkpoint->levels[i].done);
+		free(checkpoint->levels[i].data);
+		checkpoint->levels[i].done = NULL;
+		checkpoint->levels[i].data = NULL;
+	}
+	return 0;
+}
+
+// Write the checkpoint file of a compression context. A temporary file is written first and then renamed, so that
+// an interruption while writing does not destroy the previous checkpoint.
+
+static void write_checkpoint(CompressContext *context) {
+	Checkpoint *checkpoint = context->checkpoint;
+	char *temp_filename = (char *)malloc(strlen(checkpoint->filename) + 5);
+	strcpy(temp_filename, checkpoint->filename);
+	strcat(temp_filename, ".tmp");
+	FILE *f = fopen(temp_filename, "wb");
+	if (f == NULL) {
+		printf("Warning -- could not write checkpoint file %s.\n", temp_filename);
+		free(temp_filename);
+		return;
+	}
+	int header[2 + NU_CHECKPOINT_SETTINGS];
+	header[0] = checkpoint->texture_type;
+	header[1] = checkpoint->nu_levels;
+	get_checkpoint_settings(context, &header[2]);
+	fwrite(checkpoint_signature, 1, 8, f);
+	fwrite(header, sizeof(int), 2 + NU_CHECKPOINT_SETTINGS, f);
+	for (int i = 0; i < checkpoint->nu_levels; i++) {
+		CheckpointLevel *level = &checkpoint->levels[i];
+		int counts[2];
+		counts[0] = level->nu_blocks;
+		counts[1] = 0;
+		if (level->done != NULL)
+			for (int j = 0; j < level->nu_blocks; j++)
+				counts[1] += level->done[j];
+		fwrite(&level->image_hash, sizeof(uint64_t), 1, f);
+		fwrite(counts, sizeof(int), 2, f);
+		if (counts[1] == 0)
+			continue;
+		fwrite(level->done, 1, level->nu_blocks, f);
+		// Blocks that have not been restored yet are taken from the previous checkpoint.
+		unsigned char *data = level->data != NULL ? level->data :
+			(unsigned char *)checkpoint->textures[i].pixels;
+		for (int j = 0; j < level->nu_blocks; j++)
+			if (level->done[j])
+				fwrite(&data[j * level->bytes_per_block], 1, level->bytes_per_block, f);
+	}
+	if (fclose(f) != 0) {
+		printf("Warning -- could not write checkpoint file %s.\n", temp_filename);
+		free(temp_filename);
+		return;
+	}
+#ifdef _WIN32
+	remove(checkpoint->filename);
+#endif
+	if (rename(temp_filename, checkpoint->filename) != 0)
+		printf("Warning -- could not rename checkpoint file %s.\n", temp_filename);
+	free(temp_filename);
+	checkpoint->time = time(NULL);
+}
+
+// Enable checkpointing of the compression of nu_levels mipmap levels from images into the texture array textures
+// with the given compression context, writing the checkpoint file every interval seconds. When resume is set, the
+// completed blocks are restored from an existing checkpoint file. The checkpoint state is kept in the context, so
+// that compressions with other contexts are not affected.
+
+void begin_checkpoint(CompressContext *context, const char *filename, int interval, int resume, int texture_type,
+int nu_levels, Image *images, Texture *textures) {
+	TextureInfo *info = match_texture_type(texture_type);
+	Checkpoint *checkpoint = (Checkpoint *)malloc(sizeof(Checkpoint));
+	context->checkpoint = checkpoint;
+	checkpoint->filename = strdup(filename);
+	checkpoint->interval = interval;
+	checkpoint->time = time(NULL);
+	checkpoint->texture_type = texture_type;
+	checkpoint->nu_levels = nu_levels;
+	checkpoint->textures = textures;
+	checkpoint->levels = (CheckpointLevel *)malloc(sizeof(CheckpointLevel) * nu_levels);
+	for (int i = 0; i < nu_levels; i++) {
+		CheckpointLevel *level = &checkpoint->levels[i];
+		level->image_hash = calculate_image_hash(&images[i]);
+		level->nu_blocks = ((images[i].width + info->block_width - 1) / info->block_width) *
+			((images[i].height + info->block_height - 1) / info->block_height);
+		level->bytes_per_block = info->internal_bits_per_block / 8;
+		level->done = NULL;
+		level->data = NULL;
+	}
+	if (!resume)
+		return;
+	if (!read_checkpoint(context)) {
+		if (!context->option_quiet)
+			printf("No matching checkpoint found in %s, starting from the beginning.\n", filename);
+		return;
+	}
+	if (!context->option_quiet) {
+		int nu_blocks = 0;
+		int nu_done = 0;
+		for (int i = 0; i < nu_levels; i++) {
+			nu_blocks += checkpoint->levels[i].nu_blocks;
+			if (checkpoint->levels[i].done != NULL)
+				for (int j = 0; j < checkpoint->levels[i].nu_blocks; j++)
+					nu_done += checkpoint->levels[i].done[j];
+		}
+		printf("Resuming from checkpoint %s (%d of %d blocks completed).\n", filename, nu_done, nu_blocks);
+	}
+}
+
+// Return the checkpoint level of a texture compressed with a compression context, or NULL when it is not
+// checkpointed.
+
+static CheckpointLevel *get_checkpoint_level(CompressContext *context, Texture *texture) {
+	Checkpoint *checkpoint = context->checkpoint;
+	if (checkpoint == NULL)
+		return NULL;
+	for (int i = 0; i < checkpoint->nu_levels; i++)
+		if (texture == &checkpoint->textures[i])
+			return &checkpoint->levels[i];
+	return NULL;
+}
+
+// Copy the completed blocks of a texture from the checkpoint of a compression context into the texture, and set
+// the corresponding flags of block_done (which has a byte for each block). Returns the number of restored blocks.
+
+int restore_checkpoint_blocks(CompressContext *context, Texture *texture, unsigned char *block_done) {
+	CheckpointLevel *level = get_checkpoint_level(context, texture);
+	int nu_blocks = (texture->extended_width / texture->block_width) *
+		(texture->extended_height / texture->block_height);
+	memset(block_done, 0, nu_blocks);
+	if (level == NULL || level->data == NULL)
+		return 0;
+	int nu_restored = 0;
+	for (int i = 0; i < nu_blocks; i++)
+		if (level->done[i]) {
+			memcpy((unsigned char *)texture->pixels + i * level->bytes_per_block,
+				&level->data[i * level->bytes_per_block], level->bytes_per_block);
+			block_done[i] = 1;
+			nu_restored++;
+		}
+	free(level->data);
+	level->data = NULL;
+	return nu_restored;
+}
+
+// Record the completed blocks of a texture compressed with a compression context (a byte for each block in
+// block_done), and write the checkpoint file when write is set. The data of completed blocks must not change
+// anymore.
+
+void update_checkpoint(CompressContext *context, Texture *texture, const unsigned char *block_done, int write) {
+	CheckpointLevel *level = get_checkpoint_level(context, texture);
+	if (level == NULL)
+		return;
+	if (level->done == NULL)
+		level->done = (unsigned char *)malloc(level->nu_blocks);
+	memcpy(level->done, block_done, level->nu_blocks);
+	if (write)
+		write_checkpoint(context);
+}
+
+// Return whether the compression with a compression context is checkpointed and the checkpoint interval has passed
+// since the checkpoint file was last written.
+
+int checkpoint_due(CompressContext *context) {
+	Checkpoint *checkpoint = context->checkpoint;
+	return checkpoint != NULL && time(NULL) - checkpoint->time >= checkpoint->interval;
+}
+
+// Stop checkpointing the compression with a compression context after the texture has been saved, and remove the
+// checkpoint file.
+
+void end_checkpoint(CompressContext *context) {
+	Checkpoint *checkpoint = context->checkpoint;
+	if (checkpoint == NULL)
+		return;
+	remove(checkpoint->filename);
+	free_checkpoint_levels(checkpoint);
+	free(checkpoint->filename);
+	free(checkpoint);
+	context->checkpoint = NULL;
+}
@@ -26,6 +26,16 @@
 #include <stdint.h>
 #include <math.h>
 #include <float.h>
+#include <pthread.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMPARE_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// The AVX2 kernels are compiled with a function target attribute and selected at run-time.
+#define COMPARE_AVX2
+#include <immintrin.h>
+#endif
+#endif
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
@@ -34,9 +44,6 @@
 #define isnan(x) _isnan(x)
 #endif
 
-static double compare_border_block_4x4_rgb(unsigned int *image_buffer, BlockUserData *user_data);
-static double compare_border_block_4x4_rgba(unsigned int *image_buffer, BlockUserData *user_data);
-
 // Compare block image with source image with regular RGBA encoded 32-bit pixels, any block size.
 
 double compare_block_any_size_rgba(unsigned int *image_buffer, BlockUserData *user_data) {
@@ -84,202 +91,368 @@ double compare_block_any_size_rgba(unsigned int *image_buffer, BlockUserData *us
 }
 
 
-// Define a few macros to speed up image comparison for 8-bit RGB(A) formats.
-
-#define compare_pixel_xy(valx, valy) \
-	{ \
-	int x = valx; \
-	int y = valy; \
-	unsigned int pixel1 = pix1[y * 4 + x]; \
-	int r1 = pixel_get_r(pixel1); \
-	int g1 = pixel_get_g(pixel1); \
-	int b1 = pixel_get_b(pixel1); \
-	unsigned int pixel2 = pix2[y * (user_data->image_rowstride / 4) + x]; \
-	int r2 = pixel_get_r(pixel2); \
-	int g2 = pixel_get_g(pixel2); \
-	int b2 = pixel_get_b(pixel2); \
-	error += (r1 - r2) * (r1 - r2); \
-	error += (g1 - g2) * (g1 - g2); \
-	error += (b1 - b2) * (b1 - b2); \
+// The comparison functions for 8-bit and 16-bit components and for normalized half-floats use kernels that
+// calculate the sum of squared differences over the part of the block that is inside the image. The vector versions
+// return exactly the same result as the C versions; init_compare_kernels() selects the fastest one supported by the
+// processor. Pixels outside the image are masked in the vector versions. A row of 8-bit pixels fits in an SSE2
+// register, and an AVX2 version was not faster for it. The half-float kernel needs the AVX2/F16C conversion
+// instruction to be faster than the table lookups of the C version.
+
+// Kernel for 32-bit pixels with 8-bit components. Only the components selected by component_mask are compared, after
+// both pixels are XOR-ed with bias (a bias of 0x80 maps a signed component to an unsigned one with the same
+// differences). When skip_transparent is set, pixels for which both alpha values are zero are skipped, because the
+// RGB values don't matter for a correct result.
+
+typedef int (*CompareKernel8Bit)(const unsigned int *pix1, const unsigned int *pix2, int stride, int w, int h,
+	unsigned int component_mask, unsigned int bias, int skip_transparent);
+
+// Kernel for 32-bit pixels with two 16-bit components. The pixels are XOR-ed with bias1 and bias2 respectively. When
+// expand is set, the first image has 8-bit components instead, which are scaled to 16 bits after applying the bias.
+
+typedef uint64_t (*CompareKernel16Bit)(const unsigned int *pix1, const unsigned int *pix2, int stride, int w, int h,
+	unsigned int component_mask, unsigned int bias1, unsigned int bias2, int expand);
+
+// Kernel for 64-bit half-float pixels, comparing the first nu_components components. The squared differences are
+// calculated in single precision and accumulated in double precision in pixel order.
+
+typedef double (*CompareKernelHalfFloat)(const uint64_t *pix1, const uint64_t *pix2, int stride, int w, int h,
+	int nu_components);
+
+static int compare_8_bit_c(const unsigned int *pix1, const unsigned int *pix2, int stride, int w, int h,
+unsigned int component_mask, unsigned int bias, int skip_transparent) {
+	int error = 0;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			unsigned int pixel1 = pix1[x] ^ bias;
+			unsigned int pixel2 = pix2[x] ^ bias;
+			if (skip_transparent && ((pixel1 | pixel2) >> 24) == 0)
+				continue;
+			pixel1 &= component_mask;
+			pixel2 &= component_mask;
+			for (int i = 0; i < 32; i += 8) {
+				int d = (int)((pixel1 >> i) & 0xFF) - (int)((pixel2 >> i) & 0xFF);
+				error += d * d;
+			}
+		}
+		pix1 += 4;
+		pix2 += stride;
 	}
+	return error;
+}
+
+static unsigned int expand_8_bit_components_to_16_bit(unsigned int pixel) {
+	// x * 65535 / 255 is equal to x * 257.
+	return ((pixel & 0xFF) | ((pixel & 0xFF00) << 8)) * 257;
+}
 
-#define compare_pixel_xy_with_alpha(valx, valy) \
-	{ \
-	int x = valx; \
-	int y = valy; \
-	unsigned int pixel1 = pix1[y * 4 + x]; \
-	unsigned int pixel2 = pix2[y * (user_data->image_rowstride / 4) + x]; \
-	int a1 = pixel_get_a(pixel1); \
-	int a2 = pixel_get_a(pixel2); \
-	if ((a1 | a2) != 0) { \
-		error += (a1 - a2) * (a1 - a2); \
-		int r1 = pixel_get_r(pixel1); \
-		int g1 = pixel_get_g(pixel1); \
-		int b1 = pixel_get_b(pixel1); \
-		int r2 = pixel_get_r(pixel2); \
-		int g2 = pixel_get_g(pixel2); \
-		int b2 = pixel_get_b(pixel2); \
-		error += (r1 - r2) * (r1 - r2); \
-		error += (g1 - g2) * (g1 - g2); \
-		error += (b1 - b2) * (b1 - b2); \
-	} \
+static uint64_t compare_16_bit_c(const unsigned int *pix1, const unsigned int *pix2, int stride, int w, int h,
+unsigned int component_mask, unsigned int bias1, unsigned int bias2, int expand) {
+	uint64_t error = 0;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			unsigned int pixel1 = pix1[x] ^ bias1;
+			if (expand)
+				pixel1 = expand_8_bit_components_to_16_bit(pixel1);
+			unsigned int pixel2 = pix2[x] ^ bias2;
+			pixel1 &= component_mask;
+			pixel2 &= component_mask;
+			int64_t d = (int64_t)(pixel1 & 0xFFFF) - (pixel2 & 0xFFFF);
+			error += d * d;
+			d = (int64_t)(pixel1 >> 16) - (pixel2 >> 16);
+			error += d * d;
+		}
+		pix1 += 4;
+		pix2 += stride;
 	}
+	return error;
+}
 
-// Compare block image with source image with regular RGB encoded into each 32-bit pixel, block size 4x4.
+static double compare_half_float_c(const uint64_t *pix1, const uint64_t *pix2, int stride, int w, int h,
+int nu_components) {
+	double error = 0;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			uint16_t *pix1p = (uint16_t *)&pix1[x];
+			uint16_t *pix2p = (uint16_t *)&pix2[x];
+			for (int i = 0; i < nu_components; i++) {
+				float f = half_float_table[pix1p[i]];
+				float g = half_float_table[pix2p[i]];
+				error += (f - g) * (f - g);
+			}
+		}
+		pix1 += 4;
+		pix2 += stride;
+	}
+	return error;
+}
 
-double compare_block_4x4_rgb(unsigned int *image_buffer, BlockUserData *user_data) {
-	// When on the borders, use the unoptimized version.
-	if ((user_data->x_offset + 4 > user_data->texture->width) ||
-	(user_data->y_offset + 4 > user_data->texture->height))
-		return compare_border_block_4x4_rgb(image_buffer, user_data);
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	// Optimized version.
-	int error = 0;
-	compare_pixel_xy(0, 0);
-	compare_pixel_xy(1, 0);
-	compare_pixel_xy(2, 0);
-	compare_pixel_xy(3, 0);
-	compare_pixel_xy(0, 1);
-	compare_pixel_xy(1, 1);
-	compare_pixel_xy(2, 1);
-	compare_pixel_xy(3, 1);
-	compare_pixel_xy(0, 2);
-	compare_pixel_xy(1, 2);
-	compare_pixel_xy(2, 2);
-	compare_pixel_xy(3, 2);
-	compare_pixel_xy(0, 3);
-	compare_pixel_xy(1, 3);
-	compare_pixel_xy(2, 3);
-	compare_pixel_xy(3, 3);
-	return (double)1 / error;
+#ifdef COMPARE_SSE2
+
+// Masks selecting the first w pixels of a row.
+
+static const uint32_t compare_row_mask[5][4] = {
+	{ 0, 0, 0, 0 },
+	{ 0xFFFFFFFF, 0, 0, 0 },
+	{ 0xFFFFFFFF, 0xFFFFFFFF, 0, 0 },
+	{ 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0 },
+	{ 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF }
+};
+
+static int horizontal_sum_epi32(__m128i v) {
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(v);
 }
 
-// Compare block image with source image with regular RGBA encoded into each 32-bit pixel, block size 4x4.
+static uint64_t horizontal_sum_epi64(__m128i v) {
+	uint64_t sum[2];
+	_mm_storeu_si128((__m128i *)sum, v);
+	return sum[0] + sum[1];
+}
 
-double compare_block_4x4_rgba(unsigned int *image_buffer, BlockUserData *user_data) {
-	// When on the borders, use the unoptimized version.
-	if ((user_data->x_offset + 4 > user_data->texture->width) ||
-	(user_data->y_offset + 4 > user_data->texture->height))
-		return compare_border_block_4x4_rgba(image_buffer, user_data);
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	// Optimized version.
-	int error = 0;
-	compare_pixel_xy_with_alpha(0, 0);
-	compare_pixel_xy_with_alpha(1, 0);
-	compare_pixel_xy_with_alpha(2, 0);
-	compare_pixel_xy_with_alpha(3, 0);
-	compare_pixel_xy_with_alpha(0, 1);
-	compare_pixel_xy_with_alpha(1, 1);
-	compare_pixel_xy_with_alpha(2, 1);
-	compare_pixel_xy_with_alpha(3, 1);
-	compare_pixel_xy_with_alpha(0, 2);
-	compare_pixel_xy_with_alpha(1, 2);
-	compare_pixel_xy_with_alpha(2, 2);
-	compare_pixel_xy_with_alpha(3, 2);
-	compare_pixel_xy_with_alpha(0, 3);
-	compare_pixel_xy_with_alpha(1, 3);
-	compare_pixel_xy_with_alpha(2, 3);
-	compare_pixel_xy_with_alpha(3, 3);
-	return (double)1 / error;
+// Load a row of four pixels of both images, apply the biases and clear the pixels and components that are not
+// compared.
+
+static void load_8_bit_rows_sse2(const unsigned int *pix1, const unsigned int *pix2, __m128i select,
+__m128i bias, int skip_transparent, __m128i *row1, __m128i *row2) {
+	__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)pix1), bias);
+	__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)pix2), bias);
+	if (skip_transparent) {
+		__m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(_mm_or_si128(a, b), 24), _mm_setzero_si128());
+		select = _mm_andnot_si128(transparent, select);
+	}
+	*row1 = _mm_and_si128(a, select);
+	*row2 = _mm_and_si128(b, select);
 }
 
-// Compare border block image with source image with regular RGB encoded into each 32-bit pixel, block size 4x4.
+static int compare_8_bit_sse2(const unsigned int *pix1, const unsigned int *pix2, int stride, int w, int h,
+unsigned int component_mask, unsigned int bias, int skip_transparent) {
+	__m128i select = _mm_and_si128(_mm_loadu_si128((const __m128i *)compare_row_mask[w]),
+		_mm_set1_epi32(component_mask));
+	__m128i bias_v = _mm_set1_epi32(bias);
+	__m128i zero = _mm_setzero_si128();
+	__m128i error = zero;
+	for (int y = 0; y < h; y++) {
+		__m128i a, b;
+		load_8_bit_rows_sse2(pix1, pix2, select, bias_v, skip_transparent, &a, &b);
+		__m128i d_low = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i d_high = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+		error = _mm_add_epi32(error, _mm_madd_epi16(d_low, d_low));
+		error = _mm_add_epi32(error, _mm_madd_epi16(d_high, d_high));
+		pix1 += 4;
+		pix2 += stride;
+	}
+	return horizontal_sum_epi32(error);
+}
 
-double compare_border_block_4x4_rgb(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	int error = 0;
+// Load a row of four pixels of both images for the 16-bit kernel, with the 8-bit components of the first image
+// expanded when required.
+
+static void load_16_bit_rows_sse2(const unsigned int *pix1, const unsigned int *pix2, __m128i select,
+__m128i bias1, __m128i bias2, int expand, __m128i *row1, __m128i *row2) {
+	__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)pix1), bias1);
+	if (expand) {
+		a = _mm_or_si128(_mm_and_si128(a, _mm_set1_epi32(0xFF)),
+			_mm_and_si128(_mm_slli_epi32(a, 8), _mm_set1_epi32(0xFF0000)));
+		a = _mm_mullo_epi16(a, _mm_set1_epi16(257));
+	}
+	__m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)pix2), bias2);
+	*row1 = _mm_and_si128(a, select);
+	*row2 = _mm_and_si128(b, select);
+}
+
+// Add the squares of four 32-bit differences to two 64-bit sums.
+
+static __m128i add_squares_epi32_sse2(__m128i error, __m128i d) {
+	__m128i sign = _mm_srai_epi32(d, 31);
+	d = _mm_sub_epi32(_mm_xor_si128(d, sign), sign);
+	error = _mm_add_epi64(error, _mm_mul_epu32(d, d));
+	d = _mm_srli_epi64(d, 32);
+	return _mm_add_epi64(error, _mm_mul_epu32(d, d));
+}
+
+static uint64_t compare_16_bit_sse2(const unsigned int *pix1, const unsigned int *pix2, int stride, int w, int h,
+unsigned int component_mask, unsigned int bias1, unsigned int bias2, int expand) {
+	__m128i select = _mm_and_si128(_mm_loadu_si128((const __m128i *)compare_row_mask[w]),
+		_mm_set1_epi32(component_mask));
+	__m128i bias1_v = _mm_set1_epi32(bias1);
+	__m128i bias2_v = _mm_set1_epi32(bias2);
+	__m128i zero = _mm_setzero_si128();
+	__m128i error = zero;
 	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			int r1 = pixel_get_r(pixel1);
-			int g1 = pixel_get_g(pixel1);
-			int b1 = pixel_get_b(pixel1);
-			int r2 = pixel_get_r(pixel2);
-			int g2 = pixel_get_g(pixel2);
-			int b2 = pixel_get_b(pixel2);
-			error += (r1 - r2) * (r1 - r2);
-			error += (g1 - g2) * (g1 - g2);
-			error += (b1 - b2) * (b1 - b2);
+		__m128i a, b;
+		load_16_bit_rows_sse2(pix1, pix2, select, bias1_v, bias2_v, expand, &a, &b);
+		error = add_squares_epi32_sse2(error, _mm_sub_epi32(_mm_unpacklo_epi16(a, zero),
+			_mm_unpacklo_epi16(b, zero)));
+		error = add_squares_epi32_sse2(error, _mm_sub_epi32(_mm_unpackhi_epi16(a, zero),
+			_mm_unpackhi_epi16(b, zero)));
+		pix1 += 4;
+		pix2 += stride;
+	}
+	return horizontal_sum_epi64(error);
+}
+
+#endif
+
+#ifdef COMPARE_AVX2
+
+static __attribute__((target("avx2"))) uint64_t compare_16_bit_avx2(const unsigned int *pix1,
+const unsigned int *pix2, int stride, int w, int h, unsigned int component_mask, unsigned int bias1,
+unsigned int bias2, int expand) {
+	__m128i select = _mm_and_si128(_mm_loadu_si128((const __m128i *)compare_row_mask[w]),
+		_mm_set1_epi32(component_mask));
+	__m128i bias1_v = _mm_set1_epi32(bias1);
+	__m128i bias2_v = _mm_set1_epi32(bias2);
+	__m256i error = _mm256_setzero_si256();
+	for (int y = 0; y < h; y++) {
+		__m128i a, b;
+		load_16_bit_rows_sse2(pix1, pix2, select, bias1_v, bias2_v, expand, &a, &b);
+		__m256i d = _mm256_abs_epi32(_mm256_sub_epi32(_mm256_cvtepu16_epi32(a), _mm256_cvtepu16_epi32(b)));
+		error = _mm256_add_epi64(error, _mm256_mul_epu32(d, d));
+		d = _mm256_srli_epi64(d, 32);
+		error = _mm256_add_epi64(error, _mm256_mul_epu32(d, d));
+		pix1 += 4;
+		pix2 += stride;
+	}
+	return horizontal_sum_epi64(_mm_add_epi64(_mm256_castsi256_si128(error),
+		_mm256_extracti128_si256(error, 1)));
+}
+
+// Add the squared differences of the first w pixels of a row to error in the same order as the C version.
+
+static double add_half_float_row_squares(double error, const float *squares, int w, int nu_components) {
+	for (int x = 0; x < w; x++)
+		for (int i = 0; i < nu_components; i++)
+			error += squares[x * 4 + i];
+	return error;
+}
+
+// The half-float conversion instruction gives the same values as half_float_table.
+
+static __attribute__((target("avx2,f16c"))) double compare_half_float_avx2(const uint64_t *pix1,
+const uint64_t *pix2, int stride, int w, int h, int nu_components) {
+	double error = 0;
+	for (int y = 0; y < h; y++) {
+		float squares[16];
+		for (int x = 0; x < w; x += 2) {
+			__m256 d = _mm256_sub_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&pix1[x])),
+				_mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&pix2[x])));
+			_mm256_storeu_ps(&squares[x * 4], _mm256_mul_ps(d, d));
 		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
+		error = add_half_float_row_squares(error, squares, w, nu_components);
+		pix1 += 4;
+		pix2 += stride;
 	}
-	return (double)1 / error;
+	return error;
 }
 
-// Compare border block image with source image with regular RGBA encoded into each 32-bit pixel, block size 4x4.
+#endif
+
+static CompareKernel8Bit compare_kernel_8_bit = compare_8_bit_c;
+static CompareKernel16Bit compare_kernel_16_bit = compare_16_bit_c;
+static CompareKernelHalfFloat compare_kernel_half_float = compare_half_float_c;
+
+// Select the comparison kernels of the given level (COMPARE_KERNELS_C, COMPARE_KERNELS_SSE2 or COMPARE_KERNELS_AVX2),
+// using the kernels of a lower level where a kernel of the level is not compiled in or not supported by the processor.
+// Returns the highest level actually selected.
+
+int select_compare_kernels(int level) {
+	int selected = COMPARE_KERNELS_C;
+	compare_kernel_8_bit = compare_8_bit_c;
+	compare_kernel_16_bit = compare_16_bit_c;
+	compare_kernel_half_float = compare_half_float_c;
+#ifdef COMPARE_SSE2
+	if (level >= COMPARE_KERNELS_SSE2) {
+		compare_kernel_8_bit = compare_8_bit_sse2;
+		compare_kernel_16_bit = compare_16_bit_sse2;
+		selected = COMPARE_KERNELS_SSE2;
+	}
+#endif
+#ifdef COMPARE_AVX2
+	__builtin_cpu_init();
+	if (level >= COMPARE_KERNELS_AVX2 && __builtin_cpu_supports("avx2")) {
+		compare_kernel_16_bit = compare_16_bit_avx2;
+		if (__builtin_cpu_supports("f16c"))
+			compare_kernel_half_float = compare_half_float_avx2;
+		selected = COMPARE_KERNELS_AVX2;
+	}
+#endif
+	return selected;
+}
 
-double compare_border_block_4x4_rgba(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
+// Select the fastest comparison kernels supported by the processor.
+
+void init_compare_kernels() {
+	select_compare_kernels(COMPARE_KERNELS_AVX2);
+}
+
+// Determine the size of the part of the block that is inside the image.
+
+static void get_block_extent(BlockUserData *user_data, int *w, int *h) {
 	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
+		*w = user_data->texture->width - user_data->x_offset;
 	else
-		w = 4;
-	int h;
+		*w = 4;
 	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
+		*h = user_data->texture->height - user_data->y_offset;
 	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
+		*h = 4;
+}
+
+static unsigned int *get_block_source_pixels(BlockUserData *user_data) {
+	return user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) + user_data->x_offset;
+}
+
+static uint64_t *get_block_source_pixels64(BlockUserData *user_data) {
+	return (uint64_t *)user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 8) +
 		user_data->x_offset;
-	int error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			if (user_data->texture->type & TEXTURE_TYPE_ALPHA_BIT) {
-				int a1 = pixel_get_a(pixel1);
-				int a2 = pixel_get_a(pixel2);
-				// When both alpha values are zero, the RGB values don't matter
-				// for a correct result.
-				if ((a1 | a2) == 0)
-					continue;
-				error += (a1 - a2) * (a1 - a2);
-			}
-			int r1 = pixel_get_r(pixel1);
-			int g1 = pixel_get_g(pixel1);
-			int b1 = pixel_get_b(pixel1);
-			int r2 = pixel_get_r(pixel2);
-			int g2 = pixel_get_g(pixel2);
-			int b2 = pixel_get_b(pixel2);
-			error += (r1 - r2) * (r1 - r2);
-			error += (g1 - g2) * (g1 - g2);
-			error += (b1 - b2) * (b1 - b2);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
+}
+
+// Compare block image with source image with regular RGB encoded into each 32-bit pixel, block size 4x4.
+
+double compare_block_4x4_rgb(unsigned int *image_buffer, BlockUserData *user_data) {
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	int error = compare_kernel_8_bit(image_buffer, get_block_source_pixels(user_data), user_data->image_rowstride / 4,
+		w, h, 0x00FFFFFF, 0, 0);
+	return (double)1 / error;
+}
+
+// Compare block image with source image with regular RGBA encoded into each 32-bit pixel, block size 4x4.
+
+double compare_block_4x4_rgba(unsigned int *image_buffer, BlockUserData *user_data) {
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	unsigned int component_mask = 0xFFFFFFFF;
+	int skip_transparent = 1;
+	// Blocks on the borders only compare alpha for textures with alpha.
+	if ((w < 4 || h < 4) && !(user_data->texture->type & TEXTURE_TYPE_ALPHA_BIT)) {
+		component_mask = 0x00FFFFFF;
+		skip_transparent = 0;
 	}
+	int error = compare_kernel_8_bit(image_buffer, get_block_source_pixels(user_data), user_data->image_rowstride / 4,
+		w, h, component_mask, 0, skip_transparent);
 	return (double)1 / error;
 }
 
+// Protects the lazy initialization of the tables below, which can be requested by concurrent compressions.
+
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 float *normalized_float_table = NULL;
 
 void calculate_normalized_float_table() {
-	if (normalized_float_table != NULL)
+	pthread_mutex_lock(&table_mutex);
+	if (normalized_float_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
 		return;
-	normalized_float_table = (float *)malloc(sizeof(float) * 256);
+	}
+	float *table = (float *)malloc(sizeof(float) * 256);
 	for (int i = 0; i < 256; i++) {
-		normalized_float_table[i] = (float)i / 255.0;
+		table[i] = (float)i / 255.0;
 	}
+	normalized_float_table = table;
+	pthread_mutex_unlock(&table_mutex);
 }
 
 // Compare RGB block image with 32-bit pixels with source image with 64-bit half-float pixels block size 4x4.
@@ -370,48 +543,12 @@ double compare_block_4x4_rgba8_with_half_float(unsigned int *image_buffer, Block
 // Compare image with source image with any number of 8-bit components (no alpha) into each 32-bit pixel, block size 4x4.
 
 double compare_block_4x4_8_bit_components(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
+	int w, h;
+	get_block_extent(user_data, &w, &h);
 	int nu_components = user_data->texture->info->nu_components;
-	int error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			int r1 = pixel_get_r(pixel1);
-			int r2 = pixel_get_r(pixel2);
-			error += (r1 - r2) * (r1 - r2);
-			if (nu_components < 2)
-				continue;
-			int g1 = pixel_get_g(pixel1);
-			int g2 = pixel_get_g(pixel2);
-			error += (g1 - g2) * (g1 - g2);
-			if (nu_components < 3)
-				continue;
-			int b1 = pixel_get_b(pixel1);
-			int b2 = pixel_get_b(pixel2);
-			error += (b1 - b2) * (b1 - b2);
-			if (nu_components < 4)
-				continue;
-			int a1 = pixel_get_a(pixel1);
-			int a2 = pixel_get_a(pixel2);
-			error += (a1 - a2) * (a1 - a2);
-
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	unsigned int component_mask = nu_components >= 4 ? 0xFFFFFFFF : (1u << (nu_components * 8)) - 1;
+	int error = compare_kernel_8_bit(image_buffer, get_block_source_pixels(user_data), user_data->image_rowstride / 4,
+		w, h, component_mask, 0, 0);
 	return (double)1 / error;
 }
 
@@ -419,38 +556,11 @@ double compare_block_4x4_8_bit_components(unsigned int *image_buffer, BlockUserD
 // block size 4x4.
 
 double compare_block_4x4_signed_8_bit_components(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	int nu_components = user_data->texture->info->nu_components;
-	int error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			int r1 = pixel_get_signed_r8(pixel1);
-			int r2 = pixel_get_signed_r8(pixel2);
-			error += (r1 - r2) * (r1 - r2);
-			if (nu_components < 2)
-				continue;
-			int g1 = pixel_get_signed_g8(pixel1);
-			int g2 = pixel_get_signed_g8(pixel2);
-			error += (g1 - g2) * (g1 - g2);
-
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	unsigned int component_mask = user_data->texture->info->nu_components < 2 ? 0xFF : 0xFFFF;
+	int error = compare_kernel_8_bit(image_buffer, get_block_source_pixels(user_data), user_data->image_rowstride / 4,
+		w, h, component_mask, 0x8080, 0);
 	return (double)1 / error;
 }
 
@@ -458,37 +568,11 @@ double compare_block_4x4_signed_8_bit_components(unsigned int *image_buffer, Blo
 // block size 4x4. one or two components.
 
 double compare_block_4x4_8_bit_components_with_16_bit(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	int nu_components = user_data->texture->info->nu_components;
-	uint64_t error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			int r1 = pixel_get_r(pixel1) * 65535 / 255;
-			int r2 = pixel_get_r16(pixel2);
-			error += ((int64_t)r1 - r2) * ((int64_t)r1 - r2);
-			if (nu_components < 2)
-				continue;
-			int g1 = pixel_get_g(pixel1) * 65535 / 255;
-			int g2 = pixel_get_g16(pixel2);
-			error += ((int64_t)g1 - g2) * ((int64_t)g1 - g2);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	unsigned int component_mask = user_data->texture->info->nu_components < 2 ? 0xFFFF : 0xFFFFFFFF;
+	uint64_t error = compare_kernel_16_bit(image_buffer, get_block_source_pixels(user_data),
+		user_data->image_rowstride / 4, w, h, component_mask, 0, 0, 1);
 	return (double)1 / error;
 }
 
@@ -496,218 +580,82 @@ double compare_block_4x4_8_bit_components_with_16_bit(unsigned int *image_buffer
 // 16-bit components block size 4x4. One or two components.
 
 double compare_block_4x4_signed_8_bit_components_with_16_bit(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	int nu_components = user_data->texture->info->nu_components;
-	uint64_t error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			// Map r1 from [-128, 127] to [-32768, 32767]
-			int r1 = (pixel_get_signed_r8(pixel1) + 128) * 65535 / 255 - 32768;
-			int r2 = pixel_get_signed_r16(pixel2);
-			error += ((int64_t)r1 - r2) * ((int64_t)r1 - r2);
-			if (nu_components < 2)
-				continue;
-			int g1 = (pixel_get_signed_g8(pixel1) + 128) * 65535 / 255 - 32768;
-			int g2 = pixel_get_signed_g16(pixel2);
-			error += ((int64_t)g1 - g2) * ((int64_t)g1 - g2);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	unsigned int component_mask = user_data->texture->info->nu_components < 2 ? 0xFFFF : 0xFFFFFFFF;
+	// With the bias, [-128, 127] is mapped to [0, 65535] and compared with [-32768, 32767] mapped to [0, 65535].
+	uint64_t error = compare_kernel_16_bit(image_buffer, get_block_source_pixels(user_data),
+		user_data->image_rowstride / 4, w, h, component_mask, 0x8080, 0x80008000, 1);
 	return (double)1 / error;
 }
 
 // Compare block image with source image with two 16-bit values encoded into each pixel, block size 4x4.
 
 double compare_block_4x4_rg16(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	uint64_t error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			unsigned int r16_1 = pixel_get_r16(pixel1);
-			unsigned int r16_2 = pixel_get_r16(pixel2);
-			error += ((int64_t)r16_1 - r16_2) * ((int64_t)r16_1 - r16_2);
-			unsigned int g16_1 = pixel_get_g16(pixel1);
-			unsigned int g16_2 = pixel_get_g16(pixel2);
-			error += ((int64_t)g16_1 - g16_2) * ((int64_t)g16_1 - g16_2);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	uint64_t error = compare_kernel_16_bit(image_buffer, get_block_source_pixels(user_data),
+		user_data->image_rowstride / 4, w, h, 0xFFFFFFFF, 0, 0, 0);
 	return (double)1 / error;
 }
 
 // Compare block image with source image with one 16-bit value encoded into each pixel, block size 4x4.
 
 double compare_block_4x4_r16(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	uint64_t error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			int r16_1 = pixel_get_r16(pixel1);
-			int r16_2 = pixel_get_r16(pixel2);
-			error += ((int64_t)r16_1 - r16_2) * ((int64_t)r16_1 - r16_2);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	uint64_t error = compare_kernel_16_bit(image_buffer, get_block_source_pixels(user_data),
+		user_data->image_rowstride / 4, w, h, 0xFFFF, 0, 0, 0);
 	return (double)1 / error;
 }
 
 // Compare block image with source image with two signed 16-bit values encoded into each pixel.
 
 double compare_block_4x4_rg16_signed(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	uint64_t error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			int r16_1 = pixel_get_signed_r16(pixel1);
-			int r16_2 = pixel_get_signed_r16(pixel2);
-			error += ((int64_t)r16_1 - r16_2) * ((int64_t)r16_1 - r16_2);
-			int g16_1 = pixel_get_signed_g16(pixel1);
-			int g16_2 = pixel_get_signed_g16(pixel2);
-			error += ((int64_t)g16_1 - g16_2) * ((int64_t)g16_1 - g16_2);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	uint64_t error = compare_kernel_16_bit(image_buffer, get_block_source_pixels(user_data),
+		user_data->image_rowstride / 4, w, h, 0xFFFFFFFF, 0x80008000, 0x80008000, 0);
 	return (double)1 / error;
 }
 
 // Compare block image with source image with one signed 16-bit values encoded into each pixel.
 
 double compare_block_4x4_r16_signed(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	unsigned int *pix1 = image_buffer;
-	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
-		user_data->x_offset;
-	uint64_t error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			unsigned int pixel1 = pix1[x];
-			unsigned int pixel2 = pix2[x];
-			int r16_1 = pixel_get_signed_r16(pixel1);
-			int r16_2 = pixel_get_signed_r16(pixel2);
-			error += ((int64_t)r16_1 - r16_2) * ((int64_t)r16_1 - r16_2);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 4;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	uint64_t error = compare_kernel_16_bit(image_buffer, get_block_source_pixels(user_data),
+		user_data->image_rowstride / 4, w, h, 0xFFFF, 0x8000, 0x8000, 0);
 	return (double)1 / error;
 }
 
-
 float *half_float_table = NULL;
 
 void calculate_half_float_table() {
-	if (half_float_table != NULL)
+	pthread_mutex_lock(&table_mutex);
+	if (half_float_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
 		return;
-	half_float_table = (float *)malloc(sizeof(float) * 65536);
+	}
+	float *table = (float *)malloc(sizeof(float) * 65536);
 	for (int i = 0; i < 65536; i++) {
 		uint16_t h[1];
 		float f[1];
 		h[0] = (uint16_t)i;
 		halfp2singles(&f[0], &h[0], 1);
-		half_float_table[i] = f[0];
+		table[i] = f[0];
 	}
+	half_float_table = table;
+	pthread_mutex_unlock(&table_mutex);
 }
 
 // Compare 4x4 rgba half-float block (64-bit pixels) in normalized format.
 
 double compare_block_4x4_rgba_half_float(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	uint64_t *pix1 = (uint64_t *)image_buffer;
-	uint64_t *pix2 = (uint64_t *)user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 8) +
-		user_data->x_offset;
-	double error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			uint16_t *pix1p = (uint16_t *)&pix1[x];
-			uint16_t *pix2p = (uint16_t *)&pix2[x];
-			for (int i = 0; i < 4; i++) {
-				float f = half_float_table[pix1p[i]];
-				float g = half_float_table[pix2p[i]];
-				error += (f - g) * (f - g);
-			}
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 8;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	double error = compare_kernel_half_float((uint64_t *)image_buffer, get_block_source_pixels64(user_data),
+		user_data->image_rowstride / 8, w, h, 4);
 	if (isnan(error)) {
 		printf("Error -- unexpected NaN in half float block.\n");
 //		exit(1);
@@ -718,33 +666,10 @@ double compare_block_4x4_rgba_half_float(unsigned int *image_buffer, BlockUserDa
 // Compare 4x4 rgb half-float block (64-bit pixels) in normalized format.
 
 double compare_block_4x4_rgb_half_float(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	uint64_t *pix1 = (uint64_t *)image_buffer;
-	uint64_t *pix2 = (uint64_t *)user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 8) +
-		user_data->x_offset;
-	double error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			uint16_t *pix1p = (uint16_t *)&pix1[x];
-			uint16_t *pix2p = (uint16_t *)&pix2[x];
-			for (int i = 0; i < 3; i++) {
-				float f = half_float_table[pix1p[i]];
-				float g = half_float_table[pix2p[i]];
-				error += (f - g) * (f - g);
-			}
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 8;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	double error = compare_kernel_half_float((uint64_t *)image_buffer, get_block_source_pixels64(user_data),
+		user_data->image_rowstride / 8, w, h, 3);
 	if (isnan(error)) {
 		printf("Error -- unexpected NaN in half float block.\n");
 //		exit(1);
@@ -756,33 +681,10 @@ double compare_block_4x4_rgb_half_float(unsigned int *image_buffer, BlockUserDat
 // Compare 4x4 rg half-float block (64-bit pixels).
 
 double compare_block_4x4_rg_half_float(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	uint64_t *pix1 = (uint64_t *)image_buffer;
-	uint64_t *pix2 = (uint64_t *)user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 8) +
-		user_data->x_offset;
-	double error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			uint16_t *pix1p = (uint16_t *)&pix1[x];
-			uint16_t *pix2p = (uint16_t *)&pix2[x];
-			for (int i = 0; i < 2; i++) {
-				float f = half_float_table[pix1p[i]];
-				float g = half_float_table[pix2p[i]];
-				error += (f - g) * (f - g);
-			}
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 8;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	double error = compare_kernel_half_float((uint64_t *)image_buffer, get_block_source_pixels64(user_data),
+		user_data->image_rowstride / 8, w, h, 2);
 	if (isnan(error)) {
 		printf("Error -- unexpected NaN in half float block.\n");
 //		exit(1);
@@ -793,31 +695,10 @@ double compare_block_4x4_rg_half_float(unsigned int *image_buffer, BlockUserData
 // Compare 4x4 r half-float block (64-bit pixels).
 
 double compare_block_4x4_r_half_float(unsigned int *image_buffer, BlockUserData *user_data) {
-	int w;
-	if (user_data->x_offset + 4 > user_data->texture->width)
-		w = user_data->texture->width - user_data->x_offset;
-	else
-		w = 4;
-	int h;
-	if (user_data->y_offset + 4 > user_data->texture->height)
-		h = user_data->texture->height - user_data->y_offset;
-	else
-		h = 4;
-	uint64_t *pix1 = (uint64_t *)image_buffer;
-	uint64_t *pix2 = (uint64_t *)user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 8) +
-		user_data->x_offset;
-	double error = 0;
-	for (int y = 0; y < h; y++) {
-		for (int x = 0; x < w; x++) {
-			uint16_t *pix1p = (uint16_t *)&pix1[x];
-			uint16_t *pix2p = (uint16_t *)&pix2[x];
-			float f = half_float_table[pix1p[0]];
-			float g = half_float_table[pix2p[0]];
-			error += (f - g) * (f - g);
-		}
-		pix1 = &pix1[4];
-		pix2 += user_data->image_rowstride / 8;
-	}
+	int w, h;
+	get_block_extent(user_data, &w, &h);
+	double error = compare_kernel_half_float((uint64_t *)image_buffer, get_block_source_pixels64(user_data),
+		user_data->image_rowstride / 8, w, h, 1);
 	if (isnan(error)) {
 		printf("Error -- unexpected NaN in half float block.\n");
 //		exit(1);
@@ -828,19 +709,24 @@ double compare_block_4x4_r_half_float(unsigned int *image_buffer, BlockUserData
 float *gamma_corrected_half_float_table = NULL;
 
 void calculate_gamma_corrected_half_float_table() {
-	if (gamma_corrected_half_float_table != NULL)
+	pthread_mutex_lock(&table_mutex);
+	if (gamma_corrected_half_float_table != NULL) {
+		pthread_mutex_unlock(&table_mutex);
 		return;
-	gamma_corrected_half_float_table = (float *)malloc(sizeof(float) * 65536);
+	}
+	float *table = (float *)malloc(sizeof(float) * 65536);
 	for (int i = 0; i < 65536; i++) {
 		uint16_t h[1];
 		float f[1];
 		h[0] = (uint16_t)i;
 		halfp2singles(&f[0], &h[0], 1);
 		if (f[0] >= 0)
-			gamma_corrected_half_float_table[i] = powf(f[0], 1 / 2.2);
+			table[i] = powf(f[0], 1 / 2.2);
 		else
-			gamma_corrected_half_float_table[i] = - powf(- f[0], 1 / 2.2);
+			table[i] = - powf(- f[0], 1 / 2.2);
 	}
+	gamma_corrected_half_float_table = table;
+	pthread_mutex_unlock(&table_mutex);
 }
 
 // Compare 4x4 rgba half-float block (64-bit pixels) in HDR (unnormalized) format.
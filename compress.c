@@ -26,41 +26,93 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
+#include <time.h>
 #include <malloc.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 #include <fgen.h>
 #include "texgenpack.h"
 #include "decode.h"
 #include "packing.h"
 
-static void compress_with_single_population(Image *image, Texture *Texture);
-static void compress_with_archipelago(Image *image, Texture *texture);
-static void compress_multiple_blocks_concurrently(Image *image, Texture *texture);
+static void compress_with_archipelago(CompressContext *context, Image *images, Texture *textures, int nu_levels);
+static void compress_multiple_blocks_concurrently(CompressContext *context, Image *images, Texture *textures,
+	int nu_levels);
+static void compress_analytically(CompressContext *context, Image *images, Texture *textures, int nu_levels);
+static void compress_exhaustively(CompressContext *context, Image *images, Texture *textures, int nu_levels);
 static void set_alpha_pixels(Image *image, int x, int y, int w, int h, unsigned char *alpha_pixels);
 static void optimize_alpha(Image *image, Texture *texture);
-static double get_rmse_threshold(Texture *texture, int speed, Image *image);
+static double get_rmse_threshold(Texture *texture, int speed, int hdr, Image *image);
+static double get_target_fitness(CompressContext *context, Texture *texture, Image *image);
+static void report_target_quality(CompressContext *context, Image *images, Texture *textures, int nu_levels);
+static BlockStatistics *create_block_statistics(Texture *textures, int nu_levels);
+static void finish_block_statistics(CompressContext *context, Image *images, Texture *textures, int nu_levels);
 
-static int nu_generations;
-static int population_size;
-static int nu_islands;
-static float mutation_probability;
-static float crossover_probability;
-static CompressCallbackFunction compress_callback_func;
-static int mode_statistics[16];
-static double rmse_threshold;
+// Protects the one-time initialization of the tables and functions shared by all compressions, which can run
+// concurrently.
 
-// Compress an image into a texture.
+static pthread_mutex_t init_tables_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int tables_initialized = 0;
 
-void compress_image(Image *image, int texture_type, CompressCallbackFunction callback_func, Texture *texture,
-int genetic_parameters, float mutation_prob, float crossover_prob) {
-	texture->info = match_texture_type(texture_type);
-	if (texture_type & TEXTURE_TYPE_UNCOMPRESSED_BIT) {
-		copy_image_to_uncompressed_texture(image, texture_type, texture);
-		return;
-	}
-	if (texture_type & TEXTURE_TYPE_ASTC_BIT) {
-		compress_image_to_astc_texture(image, texture_type, texture);
-		return;
-	}
+// The GA for a block is stopped when the best error of all islands has not decreased by more than this fraction
+// within the last convergence_window generations.
+
+#define CONVERGENCE_MIN_IMPROVEMENT 0.001
+
+// Index derivation is used by default when it takes at most this number of candidate blocks for each fitness
+// evaluation. The population size is divided by DERIVED_INDICES_POPULATION_DIVISOR.
+
+#define MAX_DEFAULT_INDEX_DERIVATION_COST	4
+#define DERIVED_INDICES_POPULATION_DIVISOR	4
+
+// With BPTC mode pre-selection, the islands only search the modes and partitions selected for the block, starting
+// from analytic encodings in these modes, and the population size is divided by BPTC_PRESELECTION_POPULATION_DIVISOR.
+// The populations of refinement runs are not restricted and keep the normal size.
+
+#define BPTC_PRESELECTION_POPULATION_DIVISOR	4
+
+#define STOP_REASON_LIMIT	0	// The maximum number of generations was reached.
+#define STOP_REASON_THRESHOLD	1	// The RMSE threshold was reached.
+#define STOP_REASON_CONVERGED	2	// The best solution stopped improving.
+#define STOP_REASON_ZERO_ERROR	3	// A perfect solution was found.
+#define NU_STOP_REASONS		4
+
+// Settings of the cheap first pass over all blocks with a time budget.
+
+#define TIME_BUDGET_POPULATION_SIZE	64
+#define TIME_BUDGET_GENERATIONS		10
+
+// The effort spent on a block with an importance map ranges from 1 / IMPORTANCE_MAX_SCALE times the normal effort
+// for black areas to IMPORTANCE_MAX_SCALE times for white areas. Mid-gray areas get the normal effort.
+
+#define IMPORTANCE_MAX_SCALE	2.0
+
+// The progress indicator is updated at most once in this many seconds.
+
+#define PROGRESS_INTERVAL	0.5
+
+// Convergence state of the populations (islands) compressing the same block.
+
+typedef struct BlockConvergence_t {
+	double best_fitness;		// Best fitness of all islands.
+	double improvement_fitness;	// Best fitness at the last significant improvement.
+	int improvement_generation;	// Generation of the last significant improvement.
+	int generations;		// Highest generation reached by any island.
+	int max_generations;		// Generation limit of the current block.
+	int window;			// Convergence window of the current block.
+	double rmse_threshold;		// RMSE threshold of the current block.
+	int stop_reason;
+	pthread_mutex_t mutex;		// Required when the islands run concurrently.
+} BlockConvergence;
+
+// Set up a texture for compression of an image.
+
+static void set_up_texture(CompressContext *context, Image *image, int texture_type, Texture *texture) {
 	if ((texture_type & TEXTURE_TYPE_HALF_FLOAT_BIT) && !image->is_half_float) {
 		printf("Error -- image is not in half float format.\n");
 		exit(1);
@@ -78,172 +130,303 @@ int genetic_parameters, float mutation_prob, float crossover_prob) {
 	texture->pixels = (unsigned int *)malloc((texture->extended_height / texture->block_height) *
 		(texture->extended_width / texture->block_width) * (texture->bits_per_block / 8));
 	set_texture_decoding_function(texture, image);
+	// The HDR setting of the context overrides the global one used by set_texture_decoding_function.
+	if (texture_type == TEXTURE_TYPE_BPTC_FLOAT || texture_type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
+		texture->comparison_function = context->option_hdr ? compare_block_4x4_rgb_half_float_hdr :
+			compare_block_4x4_rgb_half_float;
+}
+
+// Initialize a compression context with the settings of the command line options, the compress callback
+// function and no importance map. The settings can be changed before the context is passed to compress_image or
+// compress_images. Compressions that run concurrently must each use their own context.
+
+void init_compress_context(CompressContext *context, CompressCallbackFunction callback_func) {
+	context->option_speed = option_speed;
+	context->option_max_threads = option_max_threads;
+	context->option_verbose = option_verbose;
+	context->option_quiet = option_quiet;
+	context->option_progress = option_progress;
+	context->option_modal_etc2 = option_modal_etc2;
+	context->option_allowed_modes_etc2 = option_allowed_modes_etc2;
+	context->option_generations = option_generations;
+	context->option_islands = option_islands;
+	context->option_deterministic = option_deterministic;
+	context->option_convergence_window = option_convergence_window;
+	context->option_polish = option_polish;
+	context->option_derive_indices = option_derive_indices;
+	context->option_hdr = option_hdr;
+	context->option_half_float = option_half_float;
+	context->option_target_rmse = option_target_rmse;
+	context->option_target_psnr = option_target_psnr;
+	context->option_time_budget = option_time_budget;
+	context->importance_map = NULL;
+	context->checkpoint = NULL;
+	context->population_pool = NULL;
+	context->compress_callback_func = callback_func;
+	context->genetic_parameters = 0;
+	context->mutation_probability = 0;
+	context->crossover_probability = 0;
+	context->collect_statistics = 0;
+	context->deadline = 0;
+	context->exhaustive = 0;
+	context->analytic = 0;
+	context->derive_indices = 0;
+	context->block_statistics = NULL;
+}
+
+// Return a hash of the importance map of a compression context, or zero when there is none.
+
+uint64_t get_importance_map_hash(CompressContext *context) {
+	if (context->importance_map == NULL)
+		return 0;
+	return calculate_image_hash(context->importance_map);
+}
+
+// Compress an image into a texture.
+
+void compress_image(CompressContext *context, Image *image, int texture_type, Texture *texture) {
+	compress_images(context, image, 1, texture_type, texture);
+}
+
+// Compress a number of images (normally the mipmap levels of a texture) into the textures of the array textures.
+// The blocks of all images are compressed by a single pool of worker threads, so that the small images do not
+// each pay for starting the threads and the threads are kept busy while the wavefront of a large image is still
+// narrow. The settings and the state of the compression are kept in context.
+
+void compress_images(CompressContext *context, Image *images, int nu_images, int texture_type, Texture *textures) {
+	context->block_statistics = NULL;
+	for (int i = 0; i < nu_images; i++)
+		textures[i].info = match_texture_type(texture_type);
+	if (texture_type & TEXTURE_TYPE_UNCOMPRESSED_BIT) {
+		for (int i = 0; i < nu_images; i++)
+			copy_image_to_uncompressed_texture(&images[i], texture_type, &textures[i]);
+		return;
+	}
+	if (texture_type & TEXTURE_TYPE_ASTC_BIT) {
+		for (int i = 0; i < nu_images; i++)
+			compress_image_to_astc_texture(&images[i], texture_type, context->option_speed, &textures[i]);
+		return;
+	}
+	// The instant speed setting encodes the blocks without the GA when the format has analytic encoders. Otherwise,
+	// and for the GA settings derived from the speed, it is treated as --ultra.
+	int speed = context->option_speed;
+	context->analytic = 0;
+	if (speed == SPEED_INSTANT) {
+		context->analytic = analytic_encoding_supported(texture_type);
+		if (!context->analytic && !context->option_quiet)
+			printf("No instant encoder for texture format %s, compressing as with --ultra.\n",
+				texture_type_text(texture_type));
+		context->option_speed = SPEED_ULTRA;
+	}
+	// The exhaustive speed setting searches the header space of each block when the format has an exhaustive
+	// encoder. Other formats are compressed with the default speed setting. When the exhaustive encoder is optimal,
+	// as it is for the one-component formats, it is used with the GA speed settings as well.
+	context->exhaustive = 0;
+	if (speed == SPEED_EXHAUSTIVE) {
+		context->exhaustive = exhaustive_encoding_supported(texture_type);
+		if (!context->exhaustive && !context->option_quiet)
+			printf("No exhaustive encoder for texture format %s, compressing with the default speed setting.\n",
+				texture_type_text(texture_type));
+		context->option_speed = context->exhaustive ? SPEED_ULTRA : SPEED_FAST;
+	}
+	else
+	if (!context->analytic && exhaustive_encoding_is_optimal(texture_type))
+		context->exhaustive = 1;
+	for (int i = 0; i < nu_images; i++)
+		set_up_texture(context, &images[i], texture_type, &textures[i]);
+	// The images all have the same format, so the tables and thresholds only depend on the first one.
+	Image *image = &images[0];
+	Texture *texture = &textures[0];
+	// With index derivation, the fitness of an individual is calculated with the optimal pixel indices for its
+	// other bits, so that the GA effectively only searches the modes and endpoints. It pays off when deriving the
+	// indices is cheap (one index plane with at most four values), and is used for the other formats that support
+	// it with --derive-indices.
+	int derivation_cost = get_index_derivation_cost(texture);
+	context->derive_indices = derivation_cost > 0 && (derivation_cost <= MAX_DEFAULT_INDEX_DERIVATION_COST ||
+		context->option_derive_indices);
 	if ((texture_type & TEXTURE_TYPE_HALF_FLOAT_BIT) || image->is_half_float)
 		calculate_half_float_table();
-	if ((texture_type == TEXTURE_TYPE_BPTC_FLOAT || texture_type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) && option_hdr)
+	if ((texture_type == TEXTURE_TYPE_BPTC_FLOAT || texture_type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) &&
+	context->option_hdr)
 		calculate_gamma_corrected_half_float_table();
 	if (image->is_half_float)
 		calculate_normalized_float_table();
-	rmse_threshold = get_rmse_threshold(texture, option_speed, image);
-
-	if (option_verbose) {
-		memset(mode_statistics, 0, sizeof(int) * 16);
+	pthread_mutex_lock(&init_tables_mutex);
+	if (!tables_initialized) {
+		init_single_color_tables();
+		init_batch_evaluation();
+		init_compare_kernels();
+		tables_initialized = 1;
 	}
-	compress_callback_func = callback_func;
-	if (genetic_parameters) {
-		mutation_probability = mutation_prob;
-		crossover_probability = crossover_prob;
+	pthread_mutex_unlock(&init_tables_mutex);
+	context->rmse_threshold = get_rmse_threshold(texture, context->option_speed, context->option_hdr, image);
+	context->target_fitness = get_target_fitness(context, texture, image);
+
+	if (context->option_verbose) {
+		memset(context->mode_statistics, 0, sizeof(int) * 16);
 	}
-	else {
+	if (context->collect_statistics)
+		context->block_statistics = create_block_statistics(textures, nu_images);
+	// With genetic_parameters set, the mutation and crossover probabilities of the context are used as they are.
+	if (!context->genetic_parameters) {
 		// Emperically determined mutation probability.
 		if (texture_type & TEXTURE_TYPE_128BIT_BIT)
 			if (texture_type == TEXTURE_TYPE_BPTC_FLOAT)
 				// bptc_float format needs higher mutation probability.
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.016;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.016;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.014;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.014;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.018;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.018;
 				else	// SPEED_SLOW
-					mutation_probability = 0.018;
+					context->mutation_probability = 0.018;
 			else
 			if (texture_type == TEXTURE_TYPE_BPTC)
 				// bptc
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.010;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.010;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.011;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.011;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.012;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.012;
 				else	// SPEED_SLOW
-					mutation_probability = 0.012;
+					context->mutation_probability = 0.012;
 			else
 			if (texture_type == TEXTURE_TYPE_DXT5)
 				// dxt5
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.020;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.020;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.017;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.017;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.018;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.018;
 				else	// SPEED_SLOW
-					mutation_probability = 0.018;
+					context->mutation_probability = 0.018;
 			else
 				// Other 128-bit block texture types.
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.015;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.015;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.013;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.013;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.015;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.015;
 				else	// SPEED_SLOW
-					mutation_probability = 0.015;
+					context->mutation_probability = 0.015;
 		else	// 64-bit texture formats.
 			if (texture_type == TEXTURE_TYPE_ETC1)
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.027;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.027;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.023;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.023;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.024;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.024;
 				else	// SPEED_SLOW
-					mutation_probability = 0.025;
+					context->mutation_probability = 0.025;
 			else
 			if (texture_type == TEXTURE_TYPE_ETC2_RGB8)
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.023;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.023;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.022;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.022;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.024;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.024;
 				else	// SPEED_SLOW
-					mutation_probability = 0.025;
+					context->mutation_probability = 0.025;
 			else
 			if (texture_type == TEXTURE_TYPE_DXT1)
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.028;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.028;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.025;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.025;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.026;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.026;
 				else	// SPEED_SLOW
-					mutation_probability = 0.026;
+					context->mutation_probability = 0.026;
 			else
 			if (texture_type == TEXTURE_TYPE_R11_EAC)
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.029;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.029;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.028;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.028;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.026;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.026;
 				else
-					mutation_probability = 0.027;
+					context->mutation_probability = 0.027;
 			else	// Other 64-bit texture formats.
-				if (option_speed == SPEED_ULTRA)
-					mutation_probability = 0.025;
+				if (context->option_speed == SPEED_ULTRA)
+					context->mutation_probability = 0.025;
 				else
-				if (option_speed == SPEED_FAST)
-					mutation_probability = 0.024;
+				if (context->option_speed == SPEED_FAST)
+					context->mutation_probability = 0.024;
 				else
-				if (option_speed == SPEED_MEDIUM)
-					mutation_probability = 0.025;
+				if (context->option_speed == SPEED_MEDIUM)
+					context->mutation_probability = 0.025;
 				else
-					mutation_probability = 0.026;
-		crossover_probability = 0.7;
+					context->mutation_probability = 0.026;
+		context->crossover_probability = 0.7;
 	}
-	if (option_speed == SPEED_FAST) {
-		population_size = 64;
-		nu_generations = 200;
-		nu_islands = 4;
-		compress_with_archipelago(image, texture);
+	if (context->analytic)
+		compress_analytically(context, images, textures, nu_images);
+	else
+	if (context->exhaustive)
+		compress_exhaustively(context, images, textures, nu_images);
+	else
+	if (context->option_speed == SPEED_FAST) {
+		context->population_size = 64;
+		context->nu_generations = 200;
+		context->nu_islands = 4;
+		context->polish_passes = 4;
+		compress_with_archipelago(context, images, textures, nu_images);
 	}
 	else
-	if (option_speed == SPEED_MEDIUM) {
-		population_size = 128;
-		nu_generations = 200;
-		nu_islands = 8;
-		compress_with_archipelago(image, texture);
+	if (context->option_speed == SPEED_MEDIUM) {
+		context->population_size = 128;
+		context->nu_generations = 200;
+		context->nu_islands = 8;
+		context->polish_passes = 4;
+		compress_with_archipelago(context, images, textures, nu_images);
 	}
 	else
-	if (option_speed == SPEED_SLOW) {
-		population_size = 128;
-		nu_generations = 500;
-		nu_islands = 16;
-		compress_with_archipelago(image, texture);
+	if (context->option_speed == SPEED_SLOW) {
+		context->population_size = 128;
+		context->nu_generations = 500;
+		context->nu_islands = 16;
+		context->polish_passes = 8;
+		compress_with_archipelago(context, images, textures, nu_images);
 	}
 	else
-	if (option_speed == SPEED_ULTRA) {
-		population_size = 256;
-		nu_generations = 100;
-		nu_islands = 8;
-		if (option_max_threads != - 1 && option_max_threads < 8) {
-			printf("Option --ultra not compatible with max threads setting (need >= 8).\n");
-			exit(1);
-		}
-		compress_multiple_blocks_concurrently(image, texture);
+	if (context->option_speed == SPEED_ULTRA) {
+		context->population_size = 256;
+		context->nu_generations = 100;
+		context->polish_passes = 2;
+		compress_multiple_blocks_concurrently(context, images, textures, nu_images);
 	}
+	context->option_speed = speed;
 
 	// Optionally post-process the texture to optimize the alpha values.
 //	optimize_alpha(image, texture);
 
-	if (option_verbose) {
+	if (context->block_statistics != NULL)
+		finish_block_statistics(context, images, textures, nu_images);
+
+	if (context->option_verbose) {
 		int nu_modes = 0;
 		if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC)
 			nu_modes = 5;
@@ -252,655 +435,1906 @@ int genetic_parameters, float mutation_prob, float crossover_prob) {
 		if (nu_modes > 0) {
 			printf("Mode statistics:\n");
 			for (int i = 0; i < nu_modes; i++)
-				printf("Mode %d: %d blocks\n", i, mode_statistics[i]);
+				printf("Mode %d: %d blocks\n", i, context->mode_statistics[i]);
+		}
+	}
+	if (context->target_fitness > 0 && !context->option_quiet)
+		report_target_quality(context, images, textures, nu_images);
+}
+
+
+// The fitness function of the genetic algorithm.
+
+static double calculate_fitness(const FgenPopulation *pop, const unsigned char *bitstring) {
+	unsigned int image_buffer[32];	// 16 required for regular pixels, 32 for 64-bit pixel formats like half floats.
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	double fitness;
+	if (user_data->context->derive_indices) {
+		// Only the other bits of the individual matter; its own pixel indices are not used.
+		unsigned char bitstring_with_indices[16];
+		memcpy(bitstring_with_indices, bitstring, user_data->texture->bits_per_block / 8);
+		fitness = calculate_fitness_with_derived_indices(bitstring_with_indices, user_data);
+	}
+	else
+	if (user_data->fitness_cache != NULL)
+		fitness = calculate_fitness_with_cache(user_data->fitness_cache, bitstring, user_data);
+	else {
+		int flags = user_data->flags;
+		int r = user_data->texture->decoding_function(bitstring, image_buffer, flags);
+		if (r == 0)
+			fitness = 0;	// Fitness is zero for invalid blocks.
+		else
+			fitness = user_data->texture->comparison_function(image_buffer, user_data);
+	}
+	user_data->nu_evaluations++;
+	if (fitness == 0)
+		user_data->nu_invalid++;
+	return fitness;
+}
+
+// Return a time stamp in seconds.
+
+double get_time() {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 0.000000001;
+#endif
+}
+
+// Return whether the time budget of a compression has run out.
+
+static int deadline_passed(CompressContext *context) {
+	return context->deadline > 0 && get_time() >= context->deadline;
+}
+
+// The generation callback function of the genetic algorithm, called every generation. The islands compressing
+// the same block share their convergence state, so that the block is only considered converged when none of the
+// islands improves the best solution.
+
+static void generation_callback(FgenPopulation *pop, int generation) {
+	CompressContext *context = ((BlockUserData *)pop->user_data)->context;
+	BlockConvergence *c = ((BlockUserData *)pop->user_data)->convergence;
+	FgenIndividual *best = fgen_best_individual_of_population(pop);
+	int stop = 0;
+	pthread_mutex_lock(&c->mutex);
+	if (generation > c->generations)
+		c->generations = generation;
+	if (best->fitness > c->best_fitness) {
+		c->best_fitness = best->fitness;
+		// The fitness is the inverse of the error.
+		if (best->fitness * (1.0 - CONVERGENCE_MIN_IMPROVEMENT) > c->improvement_fitness) {
+			c->improvement_fitness = best->fitness;
+			c->improvement_generation = generation;
+		}
+	}
+	if (isinf(best->fitness)) {
+		// The error is zero, which can already be the case for the seeded initial population.
+		c->stop_reason = STOP_REASON_ZERO_ERROR;
+		stop = 1;
+	}
+	else
+	if (deadline_passed(context)) {
+		c->stop_reason = STOP_REASON_LIMIT;
+		stop = 1;
+	}
+	else
+	if (context->target_fitness > 0 && c->best_fitness >= context->target_fitness) {
+		// With a quality target, stop as soon as any island meets it.
+		c->stop_reason = STOP_REASON_THRESHOLD;
+		stop = 1;
+	}
+	else
+	if (generation > 0) {
+		if (generation >= c->max_generations) {
+			c->stop_reason = STOP_REASON_LIMIT;
+			stop = 1;
+		}
+		else
+		// Adaptive, if the fitness is above the threshold after nu_generations generations, stop, otherwise
+		// go on for another nu_generations generations.
+		if (context->target_fitness == 0 && generation % context->nu_generations == 0 &&
+		sqrt((1.0 / best->fitness) / 16) < c->rmse_threshold) {
+			c->stop_reason = STOP_REASON_THRESHOLD;
+			stop = 1;
+		}
+		else
+		if (c->window > 0 && generation - c->improvement_generation >= c->window) {
+			c->stop_reason = STOP_REASON_CONVERGED;
+			stop = 1;
+		}
+	}
+	pthread_mutex_unlock(&c->mutex);
+	if (stop)
+		fgen_signal_stop(pop);
+}
+
+// Return a pointer to the compressed data of the block with the given index.
+
+static unsigned char *get_compressed_block(Texture *texture, int compressed_block_index) {
+	return (unsigned char *)&texture->pixels[compressed_block_index * (texture->bits_per_block / 32)];
+}
+
+// Return the fitness of the compressed block with the given index, using the source image, the texture and the
+// mode flags in user_data.
+
+static double calculate_block_fitness(BlockUserData *user_data, int compressed_block_index) {
+	Texture *texture = user_data->texture;
+	int nu_blocks_x = texture->extended_width / texture->block_width;
+	unsigned int image_buffer[32];
+	user_data->x_offset = (compressed_block_index % nu_blocks_x) * texture->block_width;
+	user_data->y_offset = (compressed_block_index / nu_blocks_x) * texture->block_height;
+	if (texture->decoding_function(get_compressed_block(texture, compressed_block_index), image_buffer,
+	user_data->flags) == 0)
+		return 0;
+	return texture->comparison_function(image_buffer, user_data);
+}
+
+// Copy an already compressed block into a bitstring.
+
+static void copy_compressed_block(Texture *texture, int compressed_block_index, unsigned char *bitstring) {
+	memcpy(bitstring, get_compressed_block(texture, compressed_block_index), texture->bits_per_block / 8);
+}
+
+// Choose a random already compressed block within the rectangle spanned by the top-left block and the current
+// block (excluding the current block itself). The block scheduler guarantees that all blocks in that rectangle
+// have been completed before the current block is started, regardless of the number of threads. When above_only
+// is set, only blocks in the rows above the current block are considered.
+
+static int get_random_completed_block_index(FgenRNG *rng, BlockUserData *user_data, int above_only) {
+	Texture *texture = user_data->texture;
+	int bx = user_data->x_offset / texture->block_width;
+	int by = user_data->y_offset / texture->block_height;
+	int n;
+	if (above_only)
+		n = by * (bx + 1);
+	else
+		n = (by + 1) * (bx + 1) - 1;
+	int i = fgen_random_n(rng, n);
+	int x = i % (bx + 1);
+	int y = i / (bx + 1);
+	return y * (texture->extended_width / texture->block_width) + x;
+}
+
+// Copy the next unused analytic encoding of the block into a bitstring.
+
+static void copy_seed_bitstring(BlockUserData *user_data, unsigned char *bitstring) {
+	int bytes_per_block = user_data->texture->bits_per_block / 8;
+	memcpy(bitstring, &user_data->seed_bitstrings[user_data->nu_seeds_used * bytes_per_block], bytes_per_block);
+	user_data->nu_seeds_used++;
+}
+
+// Seed with a random bitstring. When the BPTC modes of the population are restricted, a random one of the allowed
+// modes is used, with the allowed partition.
+
+static void seed_random(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	fgen_seed_random(pop, bitstring);
+	if (user_data->texture->type != TEXTURE_TYPE_BPTC || ((user_data->flags & BPTC_MODE_ALLOWED_ALL) ==
+	BPTC_MODE_ALLOWED_ALL && !(user_data->flags & BPTC_PARTITION_RESTRICTED)))
+		return;
+	int nu_modes = 0;
+	for (int mode = 0; mode < 8; mode++)
+		if (user_data->flags & (1 << mode))
+			nu_modes++;
+	int r = fgen_random_n(fgen_get_rng(pop), nu_modes);
+	for (int mode = 0; mode < 8; mode++)
+		if (user_data->flags & (1 << mode)) {
+			if (r == 0) {
+				set_block4x4_bptc_mode(bitstring, mode, user_data->flags);
+				return;
+			}
+			r--;
+		}
+}
+
+// Seeding function for archipelagos where each island is compressing the same block.
+
+static void seed(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	Texture *texture = user_data->texture;
+	FgenRNG *rng = fgen_get_rng(pop);
+	int r = fgen_random_8(rng);
+	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
+	// A too high probability results in less diversity in the archipelago. The chance is inversely proportional to
+	// the actual population size (which is smaller with index derivation or BPTC mode pre-selection), so that each
+	// island gets about one copy of each kind of neighbour block.
+	int factor = 128 / pop->size;
+	if (factor < 1)
+		factor = 1;
+	int compressed_block_index = (user_data->y_offset / texture->block_height) *
+		(texture->extended_width / texture->block_width) + user_data->x_offset / texture->block_width;
+	if (user_data->nu_seeds_used < user_data->nu_seed_bitstrings) {
+		// Seed the first individuals with the analytic encodings of the block.
+		copy_seed_bitstring(user_data, bitstring);
+		goto end;
+	}
+	if (r < 2 * factor && user_data->x_offset > 0) {
+		// Seed with solution to the left with chance 1/128th for a population size of 128.
+		copy_compressed_block(texture, compressed_block_index - 1, bitstring);
+		goto end;
+	}
+	if (r < 4 * factor && user_data->y_offset > 0) {
+		// Seed with solution above with chance 1/128th (1/64th for x == 0) for a population size of 128.
+		copy_compressed_block(texture, compressed_block_index - texture->extended_width / texture->block_width,
+			bitstring);
+		goto end;
+	}
+	if (r < 6 * factor && (user_data->x_offset > 0 || user_data->y_offset > 0)) {
+		// Seed with a random already calculated solution with chance 1/128th for a population size of 128.
+		copy_compressed_block(texture, get_random_completed_block_index(rng, user_data, 0), bitstring);
+		goto end;
+	}
+	seed_random(pop, bitstring);
+end :
+	if (texture->type == TEXTURE_TYPE_DXT3)
+		optimize_block_dxt3(bitstring, user_data->alpha_pixels);
+	else
+	if (texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
+		optimize_block_etc2_punchthrough(bitstring, user_data->alpha_pixels);
+}
+
+// Seeding function for populations that each compress a different block (--ultra setting).
+// Population size is assumed to be 256.
+
+static void seed2(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	Texture *texture = user_data->texture;
+	FgenRNG *rng = fgen_get_rng(pop);
+	int r = fgen_random_8(rng);
+	if (user_data->nu_seeds_used < user_data->nu_seed_bitstrings) {
+		// Seed the first individuals with the analytic encodings of the block.
+		copy_seed_bitstring(user_data, bitstring);
+		goto end;
+	}
+	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
+	// A too high probability results in less diversity in the archipelago.
+	if (r < 3 && user_data->y_offset > 0) {
+		// Seed with solution above with chance 3/256th.
+		int compressed_block_index = (user_data->y_offset / texture->block_height - 1) *
+			(texture->extended_width / texture->block_width) + user_data->x_offset / texture->block_width;
+		copy_compressed_block(texture, compressed_block_index, bitstring);
+		goto end;
+	}
+	if (r < 6 && user_data->y_offset > 0) {
+		// Seed with a random already calculated solution from the area above with chance 3/256th
+		copy_compressed_block(texture, get_random_completed_block_index(rng, user_data, 1), bitstring);
+		goto end;
+	}
+	seed_random(pop, bitstring);
+end :
+	if (texture->type == TEXTURE_TYPE_DXT3)
+		optimize_block_dxt3(bitstring, user_data->alpha_pixels);
+	else
+	if (texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
+		optimize_block_etc2_punchthrough(bitstring, user_data->alpha_pixels);
+}
+
+// Seeding function used when refining blocks that have already been compressed. After the analytic encodings,
+// the current encoding of the block is used, so that the GA starts from it. Other blocks are not used because
+// they may be refined concurrently.
+
+static void seed_refinement(FgenPopulation *pop, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	Texture *texture = user_data->texture;
+	if (user_data->nu_seeds_used < user_data->nu_seed_bitstrings)
+		copy_seed_bitstring(user_data, bitstring);
+	else
+	if (user_data->nu_seeds_used == user_data->nu_seed_bitstrings) {
+		int compressed_block_index = (user_data->y_offset / texture->block_height) *
+			(texture->extended_width / texture->block_width) + user_data->x_offset / texture->block_width;
+		copy_compressed_block(texture, compressed_block_index, bitstring);
+		user_data->nu_seeds_used++;
+		return;
+	}
+	else
+		seed_random(pop, bitstring);
+	if (texture->type == TEXTURE_TYPE_DXT3)
+		optimize_block_dxt3(bitstring, user_data->alpha_pixels);
+	else
+	if (texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
+		optimize_block_etc2_punchthrough(bitstring, user_data->alpha_pixels);
+}
+
+// Set the source image and the texture in the auxilliary data field of a GA population.
+
+static void set_user_data_image(BlockUserData *user_data, Image *image, Texture *texture) {
+	user_data->image_pixels = image->pixels;
+	if (image->is_half_float)
+		user_data->image_rowstride = image->extended_width * 8;
+	else
+		user_data->image_rowstride = image->extended_width * 4;
+	user_data->texture = texture;
+}
+
+// Set the auxilliary data field for the GA population.
+
+static void set_user_data(BlockUserData *user_data, CompressContext *context, Image *image, Texture *texture) {
+	user_data->flags = ENCODE_BIT;
+	if (texture->type == TEXTURE_TYPE_ETC1)
+		user_data->flags |= ETC_MODE_ALLOWED_ALL;
+	else
+	if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC ||
+	texture->type == TEXTURE_TYPE_ETC2_SRGB8 || texture->type == TEXTURE_TYPE_ETC2_SRGB_EAC)
+		user_data->flags |= ETC2_MODE_ALLOWED_ALL;
+	else
+	if (texture->type == TEXTURE_TYPE_BPTC)
+		user_data->flags |= BPTC_MODE_ALLOWED_ALL;
+	else
+	if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
+		user_data->flags |= BPTC_FLOAT_MODE_ALLOWED_ALL;
+	set_user_data_image(user_data, image, texture);
+	user_data->alpha_pixels = NULL;
+	user_data->stop_signalled = 0;
+	user_data->seed_bitstrings = NULL;
+	user_data->nu_seed_bitstrings = 0;
+	user_data->nu_seeds_used = 0;
+	user_data->fitness_cache = NULL;
+	user_data->convergence = NULL;
+	user_data->context = context;
+	user_data->nu_evaluations = 0;
+	user_data->nu_invalid = 0;
+}
+
+static char *etc2_modestr = "IDTHP";
+
+// Print a progress line with the number of reported blocks, the number of blocks compressed per second and the
+// estimated remaining time. The line is overwritten at most every PROGRESS_INTERVAL seconds and is ended when the
+// last block has been reported.
+
+static void report_progress(CompressContext *context, int nu_reported, int nu_blocks) {
+	double time = get_time();
+	if (nu_reported < nu_blocks && time - context->progress_time < PROGRESS_INTERVAL)
+		return;
+	context->progress_time = time;
+	double elapsed = time - context->progress_start_time;
+	double rate = 0;
+	if (elapsed > 0)
+		rate = (nu_reported - context->progress_start_blocks) / elapsed;
+	printf("\r%d/%d blocks (%d%%), %.1lf blocks/s", nu_reported, nu_blocks, nu_reported * 100 / nu_blocks, rate);
+	if (nu_reported == nu_blocks)
+		printf(", %.2lf s\n", elapsed);
+	else
+	if (rate > 0)
+		printf(", ETA %.0lf s   ", (nu_blocks - nu_reported) / rate);
+	fflush(stdout);
+}
+
+// Report a compressed block that has been stored in the texture, printing information if required. generations is
+// the number of GA generations used for the block (zero when it was encoded directly). nu_reported is the number of
+// blocks that have been reported including this one, out of a total of nu_blocks.
+
+static void report_solution(const unsigned char *bitstring, double fitness, int generations, int nu_reported,
+int nu_blocks, BlockUserData *user_data) {
+	CompressContext *context = user_data->context;
+	Texture *texture = user_data->texture;
+	int x_offset = user_data->x_offset;
+	int y_offset = user_data->y_offset;
+	if (context->option_verbose) {
+		printf("Block %d: ", (y_offset / texture->block_height) * (texture->extended_width / texture->block_width)
+			+ (x_offset / texture->block_width));
+		if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC) {
+			int mode = block4x4_etc2_rgb8_get_mode(bitstring);
+			printf("Mode: %c ", etc2_modestr[mode]);
+			context->mode_statistics[mode]++;
+		}
+		else
+		if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) {
+			int mode = block4x4_bptc_float_get_mode(bitstring);
+			printf("Mode: %d ", mode);
+			context->mode_statistics[mode]++;
 		}
+		printf("Generations: %d ", generations);
+		printf("Combined: ");
+		printf("RMSE per pixel: %lf\n", sqrt((1.0 / fitness) / 16));
 	}
+	if (context->option_progress)
+		report_progress(context, nu_reported, nu_blocks);
+	context->compress_callback_func(user_data);
+}
+
+// Return whether the BPTC modes and partitions of the populations created with the seeding function are
+// pre-selected for each block by select_island_modes(). This is the case for the first compression of a block, but
+// not for refinement runs.
+
+static int bptc_preselection_used(Texture *texture, FgenSeedFunc seed_func) {
+	return texture->type == TEXTURE_TYPE_BPTC && seed_func != seed_refinement;
+}
+
+// Free a population together with its user data and fitness cache.
+
+static void free_population(FgenPopulation *pop) {
+	BlockUserData *user_data = (BlockUserData *)pop->user_data;
+	if (user_data->fitness_cache != NULL)
+		destroy_fitness_cache(user_data->fitness_cache);
+	free(user_data);
+	fgen_destroy(pop);
+}
+
+// Populations kept alive across compressions that share a population pool. Each compression takes the populations
+// it needs when its block workers start and returns them when they finish.
+
+typedef struct {
+	FgenPopulation *pop;
+	int nu_bits;
+	FgenSeedFunc seed_func;
+} PooledPopulation;
+
+struct PopulationPool_t {
+	PooledPopulation *pops;
+	int nu_pops;
+	int max_pops;
+	pthread_mutex_t mutex;
+};
+
+PopulationPool *create_population_pool() {
+	PopulationPool *pool = (PopulationPool *)malloc(sizeof(PopulationPool));
+	pool->pops = NULL;
+	pool->nu_pops = 0;
+	pool->max_pops = 0;
+	pthread_mutex_init(&pool->mutex, NULL);
+	return pool;
+}
+
+void destroy_population_pool(PopulationPool *pool) {
+	for (int i = 0; i < pool->nu_pops; i++)
+		free_population(pool->pops[i].pop);
+	free(pool->pops);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+}
+
+// Take a population of the given size, number of bits and seeding function from the pool. Returns NULL when
+// there is none.
+
+static FgenPopulation *take_pooled_population(PopulationPool *pool, int size, int nu_bits, FgenSeedFunc seed_func) {
+	if (pool == NULL)
+		return NULL;
+	FgenPopulation *pop = NULL;
+	pthread_mutex_lock(&pool->mutex);
+	for (int i = pool->nu_pops - 1; i >= 0; i--)
+		if (pool->pops[i].pop->size == size && pool->pops[i].nu_bits == nu_bits &&
+		pool->pops[i].seed_func == seed_func) {
+			pop = pool->pops[i].pop;
+			pool->nu_pops--;
+			pool->pops[i] = pool->pops[pool->nu_pops];
+			break;
+		}
+	pthread_mutex_unlock(&pool->mutex);
+	return pop;
+}
+
+static void return_pooled_population(PopulationPool *pool, FgenPopulation *pop, int nu_bits, FgenSeedFunc seed_func) {
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->nu_pops == pool->max_pops) {
+		pool->max_pops = pool->max_pops == 0 ? 16 : pool->max_pops * 2;
+		pool->pops = (PooledPopulation *)realloc(pool->pops, pool->max_pops * sizeof(PooledPopulation));
+	}
+	pool->pops[pool->nu_pops].pop = pop;
+	pool->pops[pool->nu_pops].nu_bits = nu_bits;
+	pool->pops[pool->nu_pops].seed_func = seed_func;
+	pool->nu_pops++;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+// Create a GA population for block compression, or take a matching one from the population pool of the context.
+
+static FgenPopulation *create_population(CompressContext *context, Image *image, Texture *texture,
+FgenSeedFunc seed_func) {
+	// The smaller search space with index derivation or BPTC mode pre-selection needs a smaller population.
+	int population_size = context->population_size;
+	if (context->derive_indices)
+		population_size /= DERIVED_INDICES_POPULATION_DIVISOR;
+	else
+	if (bptc_preselection_used(texture, seed_func))
+		population_size /= BPTC_PRESELECTION_POPULATION_DIVISOR;
+	FgenPopulation *pop = take_pooled_population(context->population_pool, population_size, texture->bits_per_block,
+		seed_func);
+	FitnessCache *fitness_cache = NULL;
+	if (pop != NULL)
+		fitness_cache = ((BlockUserData *)pop->user_data)->fitness_cache;
+	else {
+		pop = fgen_create(
+			population_size,		// Population size.
+			texture->bits_per_block,	// Number of bits.
+			1,				// Data element size.
+			generation_callback,
+			calculate_fitness,
+			seed_func,
+			fgen_mutation_per_bit_fast,
+			fgen_crossover_uniform_per_bit
+			);
+		fgen_set_generation_callback_interval(pop, 1);
+		fgen_set_migration_interval(pop, 0);	// No migration.
+		fgen_set_migration_probability(pop, 0.01);
+		pop->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
+	}
+	fgen_set_parameters(
+		pop,
+		FGEN_ELITIST_SUS,
+		FGEN_SUBTRACT_MIN_FITNESS,
+		context->crossover_probability,	// Crossover prob.
+		context->mutation_probability,	// Mutation prob. per bit
+		0		// Macro-mutation prob.
+		);
+	set_user_data((BlockUserData *)pop->user_data, context, image, texture);
+	// The fitness cache is of no use when the pixel indices are derived.
+	if (fitness_cache_supported(texture) && !context->derive_indices) {
+		if (fitness_cache == NULL)
+			fitness_cache = create_fitness_cache();
+	}
+	else
+	if (fitness_cache != NULL) {
+		destroy_fitness_cache(fitness_cache);
+		fitness_cache = NULL;
+	}
+	((BlockUserData *)pop->user_data)->fitness_cache = fitness_cache;
+	return pop;
+}
+
+// Destroy a population created by create_population(), or return it to the population pool of the context.
+
+static void destroy_population(CompressContext *context, Texture *texture, FgenSeedFunc seed_func,
+FgenPopulation *pop) {
+	if (context->population_pool != NULL) {
+		return_pooled_population(context->population_pool, pop, texture->bits_per_block, seed_func);
+		return;
+	}
+	free_population(pop);
+}
+
+// Set the mode flags for island i of an archipelago of nu_pops islands compressing the same block.
+
+static void set_island_flags(CompressContext *context, Texture *texture, int i, int nu_pops,
+BlockUserData *user_data) {
+	if (texture->type == TEXTURE_TYPE_ETC2_RGB8) {
+		if (context->option_allowed_modes_etc2 !=  - 1)
+			user_data->flags = context->option_allowed_modes_etc2 | ENCODE_BIT;
+		else
+		if (context->option_modal_etc2 && nu_pops >= 8) {
+			switch (i & 7) {
+			case 0 :
+			case 1 :
+			case 2 :
+				user_data->flags = ETC_MODE_ALLOWED_INDIVIDUAL | ENCODE_BIT;
+				break;
+			case 3 :
+			case 4 :
+				user_data->flags = ETC_MODE_ALLOWED_DIFFERENTIAL | ENCODE_BIT;
+				break;
+			case 5 :
+				user_data->flags = ETC2_MODE_ALLOWED_T | ENCODE_BIT;
+				break;
+			case 6 :
+				user_data->flags = ETC2_MODE_ALLOWED_H | ENCODE_BIT;
+				break;
+			case 7 :
+				user_data->flags = ETC2_MODE_ALLOWED_PLANAR | ENCODE_BIT;
+				break;
+			}
+		}
+	}
+	if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) {
+		if (/* option_modal_etc2 && */ nu_pops >= 8) {
+			switch (i & 7) {
+			case 0 :
+			case 1 :	// Mode 0 (very common).
+				user_data->flags = 0x1 | ENCODE_BIT;
+				break;
+			case 2 :	// Modes 5 (common) and 9.
+				user_data->flags = (1 << 5) | (1 << 9) | ENCODE_BIT;
+				break;
+			case 3 :	// Modes 2 and 6 (common).
+				user_data->flags = (1 << 2) | (1 << 6) | ENCODE_BIT;
+				break;
+			case 4 : 	// Modes 3 and 7 (common).
+				user_data->flags = (1 << 3) | (1 << 7) | ENCODE_BIT;
+				break;
+			case 5 :	// Modes 1, 4, 8 (common).
+				user_data->flags = (1 << 1) | (1 << 4) | (1 << 8) | ENCODE_BIT;
+				break;
+			case 6 :	// Mode 11.
+				user_data->flags = (1 << 11) | ENCODE_BIT;
+				break;
+			case 7 :	// Modes 10, 11, 12, 13.
+				user_data->flags = (0xF << 10) | ENCODE_BIT;
+				break;
+			}
+		}
+		else
+		if (/* option_modal_etc2 && */ nu_pops >= 4) {
+			switch (i & 3) {
+			case 0 :	// Mode 0.
+				user_data->flags = 0x1 | ENCODE_BIT;
+				break;
+			case 1 :	// Modes 2, 4, 6 (common), 8 (common), 9.
+				user_data->flags = (1 << 2) | (1 << 4) | (1 << 6) | (1 << 8) | (1 << 9) | ENCODE_BIT;
+				break;
+			case 2 :	// Modes 1, 3, 5 (common), 7 (common).
+				user_data->flags = (1 << 1) | (1 << 3) | (1 << 5) | (1 << 7) | ENCODE_BIT;
+				break;
+			case 3 :	// Modes 10, 11, 12, 13.
+				user_data->flags = (0xF << 10) | ENCODE_BIT;
+				break;
+			}
+		}
+	}
+}
+
+// Return the number of processors available, used as the default number of worker threads.
+
+int get_number_of_processors() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		return 1;
+	return n;
+#endif
+}
+
+// The block scheduler. A fixed pool of worker threads is created once for all images (normally the mipmap levels
+// of a texture) that are compressed together. Each worker owns its own GA populations and repeatedly takes the
+// next ready block from a shared wavefront-ordered queue. A block is ready when all blocks of its level in the
+// rectangle spanned by the top-left block and the block directly above it have been completed, and (for
+// archipelagos) the block to the left has been completed. This guarantees that the neighbour blocks used by the
+// seeding functions are available. Levels are independent of each other, so the ready block with the lowest
+// diagonal of any level is taken; the blocks of the small levels are thereby interleaved with the first diagonals
+// of the large levels, when there are not yet enough ready blocks in them to keep all threads busy. Completed
+// blocks are handed back to the main thread, which reports them in order of completion, so that the compress
+// callback function is always called from the thread that called compress_image.
+
+#define BLOCK_PENDING	0
+#define BLOCK_RUNNING	1
+#define BLOCK_DONE	2
+#define BLOCK_DUPLICATE	3	// Completed when the first block with identical source pixels is completed.
+
+typedef struct {
+	Image *image;
+	Texture *texture;
+	int nu_blocks_x;
+	int nu_blocks_y;
+	int first_block;		// Index of the first block of the level in arrays covering all levels.
+	uint64_t image_hash;		// Hash of the source image, used in deterministic mode.
+	unsigned char *block_state;
+	int *next_duplicate;		// Next block with identical source pixels, or - 1.
+	int *row_next;			// Next block to start on each row.
+	int *row_done;			// Number of consecutive completed blocks from the left on each row.
+	int first_row;			// First row that still has blocks that have not been started.
+	float *importance;		// Effort scale of each block from the importance map, or NULL.
+	BlockUserData report_data;	// Used to report the completed blocks of the level.
+} BlockLevel;
+
+typedef struct {
+	CompressContext *context;
+	int nu_levels;
+	BlockLevel *levels;
+	int nu_blocks;			// Total number of blocks of all levels.
+	int nu_pops;			// Number of populations per worker (islands compressing the same block).
+	int nu_escalation_pops;		// Number of populations of each worker, more than nu_pops when blocks that
+					// miss the quality target or important blocks use more islands.
+	int max_generation;		// Passed to fgen_run or fgen_run_archipelago.
+	int threaded_islands;		// Run the islands of a worker concurrently.
+	int need_left;			// Whether the block to the left must be completed first.
+	int refine;			// Whether the scheduler refines already compressed blocks.
+	FgenSeedFunc seed_func;
+	int nu_started;
+	int *completed;			// Queue of completed block indices that have not yet been reported.
+	int *completed_level;
+	double *completed_fitness;
+	int *completed_generations;
+	int completed_head;
+	int completed_tail;
+	int stop;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_available;
+	pthread_cond_t block_completed;
+	// Used when refining blocks.
+	int *queue;			// Binary heap of block indices (in arrays covering all levels), worst first.
+	int queue_size;
+	double *block_error;		// Current error of each block.
+	float *block_importance;	// Importance of each block, which multiplies the error in the queue.
+	int *nu_refinements;		// Number of times each block has been refined.
+} BlockScheduler;
+
+typedef struct {
+	BlockScheduler *scheduler;
+	FgenPopulation **pops;		// NULL when every block is encoded without the GA (--instant, --exhaustive).
+	BlockUserData user_data;	// Settings of the blocks of a worker without populations.
+	unsigned char *alpha_pixels;
+	unsigned char *seed_bitstrings;	// Analytic encodings of the current block for each population.
+	int nu_few_color_blocks;	// Number of blocks encoded directly because they have one or two colors.
+	int nu_exhaustive_blocks;	// Number of blocks encoded with the exhaustive encoder.
+	int nu_analytic_blocks;		// Number of blocks encoded with the best analytic encoding.
+	BlockConvergence convergence;	// Convergence state of the current block.
+	int nu_ga_blocks;		// Number of blocks compressed with the GA.
+	int64_t nu_ga_generations;	// Total number of generations used for these blocks.
+	int nu_stops[NU_STOP_REASONS];	// Number of these blocks for each reason the GA was stopped.
+	int nu_polished_blocks;		// Number of these blocks improved by the local search.
+	int nu_escalated_blocks;	// Number of these blocks compressed again because they missed the target.
+	int nu_refined_blocks;		// Number of refinement runs that improved a block.
+	int best_island;		// Island that found the best solution of the last GA run.
+	pthread_t thread;
+} BlockWorker;
+
+// Skip blocks on a row that are duplicates of another block or have already been completed as one.
+
+static void skip_completed_blocks(BlockLevel *l, int by) {
+	while (l->row_next[by] < l->nu_blocks_x &&
+	l->block_state[by * l->nu_blocks_x + l->row_next[by]] != BLOCK_PENDING)
+		l->row_next[by]++;
+}
+
+// Find the next ready block of a level in wavefront order (lowest x + y first, then lowest y). Returns - 1 if no
+// block is ready, otherwise the diagonal (x + y) of the block is stored in diagonal.
+
+static int get_next_ready_block_of_level(BlockScheduler *s, BlockLevel *l, int *diagonal) {
+	int best = - 1;
+	int best_diagonal = INT_MAX;
+	while (l->first_row < l->nu_blocks_y) {
+		skip_completed_blocks(l, l->first_row);
+		if (l->row_next[l->first_row] < l->nu_blocks_x)
+			break;
+		l->first_row++;
+	}
+	for (int by = l->first_row; by < l->nu_blocks_y; by++) {
+		skip_completed_blocks(l, by);
+		int bx = l->row_next[by];
+		if (bx + by >= best_diagonal)
+			break;
+		if (bx == l->nu_blocks_x)
+			continue;
+		if (by > 0 && l->row_done[by - 1] < bx + 1) {
+			if (bx == 0)
+				// None of the rows further down can be ready.
+				break;
+			continue;
+		}
+		if (s->need_left && l->row_done[by] < bx)
+			continue;
+		best = by * l->nu_blocks_x + bx;
+		best_diagonal = bx + by;
+	}
+	*diagonal = best_diagonal;
+	return best;
+}
+
+// Find the next ready block of any level, preferring the lowest diagonal and then the lowest level. Returns - 1
+// if no block is ready, otherwise the level of the block is stored in level. Must be called with the scheduler
+// mutex locked.
+
+static int get_next_ready_block(BlockScheduler *s, BlockLevel **level) {
+	int best = - 1;
+	int best_diagonal = INT_MAX;
+	for (int i = 0; i < s->nu_levels; i++) {
+		int diagonal;
+		int block_index = get_next_ready_block_of_level(s, &s->levels[i], &diagonal);
+		if (block_index >= 0 && diagonal < best_diagonal) {
+			best = block_index;
+			best_diagonal = diagonal;
+			*level = &s->levels[i];
+		}
+	}
+	return best;
+}
+
+// Calculate the random seed for island i compressing the block at (x, y) of an image with the given hash in
+// deterministic mode.
+
+static unsigned int get_block_random_seed(uint64_t image_hash, int x, int y, int i) {
+	uint64_t h = image_hash ^ ((uint64_t)x << 40) ^ ((uint64_t)y << 16) ^ (uint64_t)i;
+	// Finalization step of the SplitMix64 generator.
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	h ^= h >> 31;
+	return (unsigned int)h;
+}
+
+// Return the statistics of a block of a level, or NULL when statistics are not collected.
+
+static BlockStatistics *get_block_statistics(BlockScheduler *s, BlockLevel *l, int block_index) {
+	if (s->context->block_statistics == NULL)
+		return NULL;
+	return &s->context->block_statistics[l->first_block + block_index];
+}
+
+// Return the importance of a block, which scales the effort spent on it.
+
+static double get_block_importance(BlockLevel *l, int block_index) {
+	if (l->importance == NULL)
+		return 1.0;
+	return l->importance[block_index];
+}
+
+// Return the number of islands to use for a block with the given importance instead of nu_pops. When the islands
+// are tied to specific modes, the number of islands remains a multiple of the number of different island modes.
+
+static int get_number_of_important_islands(BlockScheduler *s, Texture *texture, int nu_pops, double importance) {
+	int nu_island_modes = 1;
+	if (((texture->type == TEXTURE_TYPE_ETC2_RGB8 && s->context->option_modal_etc2 &&
+	s->context->option_allowed_modes_etc2 == - 1) ||
+	texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) &&
+	s->nu_pops >= 8)
+		nu_island_modes = 8;
+	else
+	if ((texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) &&
+	s->nu_pops >= 4)
+		nu_island_modes = 4;
+	int n = (int)floor(nu_pops * importance + 0.5);
+	n -= n % nu_island_modes;
+	if (n < nu_island_modes)
+		n = nu_island_modes;
+	if (n > s->nu_escalation_pops)
+		n = s->nu_escalation_pops;
+	return n;
+}
+
+// Run the GA on a block with nu_pops populations of a worker. attempt is zero for the first run on the block and is
+// increased for each further run, so that each run uses a different random number sequence in deterministic mode.
+// The generation limit and the convergence window are multiplied by effort. With an importance map, the number of
+// populations, the generation limit and the convergence window are also scaled by the importance of the block,
+// and the RMSE threshold is divided by it. Returns the best individual.
+
+static FgenIndividual *run_block_ga(BlockWorker *worker, BlockLevel *l, int block_index, int nu_pops, int attempt,
+int effort) {
+	BlockScheduler *s = worker->scheduler;
+	CompressContext *context = s->context;
+	Texture *texture = l->texture;
+	int x = (block_index % l->nu_blocks_x) * texture->block_width;
+	int y = (block_index / l->nu_blocks_x) * texture->block_height;
+	double importance = get_block_importance(l, block_index);
+	if (importance != 1.0)
+		nu_pops = get_number_of_important_islands(s, texture, nu_pops, importance);
+	// Set up the auxilliary information for each population.
+	for (int i = 0; i < nu_pops; i++) {
+		BlockUserData *user_data = (BlockUserData *)worker->pops[i]->user_data;
+		user_data->x_offset = x;
+		user_data->y_offset = y;
+		user_data->alpha_pixels = worker->alpha_pixels;
+		// In deterministic mode, derive the random number sequence of each island from the image contents
+		// and the block position only, so that the result does not depend on the number of threads or the
+		// order in which blocks are compressed.
+		if (context->option_deterministic)
+			fgen_random_seed_rng(fgen_get_rng(worker->pops[i]), get_block_random_seed(l->image_hash, x, y,
+				i + attempt * s->nu_escalation_pops));
+		// Calculate analytic encodings of the block to seed the population with. They depend on the mode
+		// flags, so islands with the same flags as the previous island share them.
+		BlockUserData *previous = i > 0 ? (BlockUserData *)worker->pops[i - 1]->user_data : NULL;
+		if (previous != NULL && previous->flags == user_data->flags) {
+			user_data->seed_bitstrings = previous->seed_bitstrings;
+			user_data->nu_seed_bitstrings = previous->nu_seed_bitstrings;
+		}
+		else {
+			user_data->seed_bitstrings = &worker->seed_bitstrings[i * MAX_ANALYTIC_SEEDS *
+				(texture->bits_per_block / 8)];
+			user_data->nu_seed_bitstrings = calculate_analytic_seeds(user_data, user_data->seed_bitstrings,
+				MAX_ANALYTIC_SEEDS);
+		}
+		user_data->nu_seeds_used = 0;
+		user_data->nu_evaluations = 0;
+		user_data->nu_invalid = 0;
+		if (user_data->fitness_cache != NULL)
+			reset_fitness_cache(user_data->fitness_cache);
+	}
+	BlockConvergence *c = &worker->convergence;
+	c->best_fitness = 0;
+	c->improvement_fitness = 0;
+	c->improvement_generation = 0;
+	c->generations = 0;
+	c->stop_reason = STOP_REASON_LIMIT;
+	c->max_generations = (int)(context->nu_generations * 2 * effort * importance);
+	c->window = (int)(context->convergence_window * effort * importance);
+	c->rmse_threshold = context->rmse_threshold / importance;
+	int max_generation = s->max_generation;
+	if (max_generation != - 1)
+		max_generation = (int)(max_generation * effort * importance);
+	// Run the genetic algorithm.
+	if (nu_pops == 1)
+		fgen_run(worker->pops[0], max_generation);
+	else
+	if (s->threaded_islands)
+		fgen_run_archipelago_threaded(nu_pops, worker->pops, max_generation);
+	else
+		fgen_run_archipelago(nu_pops, worker->pops, max_generation);
+	if (context->option_verbose == 2 && nu_pops > 1) {
+		pthread_mutex_lock(&s->mutex);
+		for (int i = 0; i < nu_pops; i++) {
+			printf("Block %d: ", block_index);
+			if (texture->type & TEXTURE_TYPE_ETC_BIT) {
+				printf("Modes: ");
+				int modes_allowed = ((BlockUserData *)worker->pops[i]->user_data)->flags;
+				if (modes_allowed & ETC_MODE_ALLOWED_INDIVIDUAL)
+					printf("I");
+				if (modes_allowed & ETC_MODE_ALLOWED_DIFFERENTIAL)
+					printf("D");
+				if (modes_allowed & ETC2_MODE_ALLOWED_T)
+					printf("T");
+				if (modes_allowed & ETC2_MODE_ALLOWED_H)
+					printf("H");
+				if (modes_allowed & ETC2_MODE_ALLOWED_PLANAR)
+					printf("P");
+			}
+			FgenIndividual *best = fgen_best_individual_of_population(worker->pops[i]);
+			double rmse = sqrt((1.0 / best->fitness) / 16);
+			printf(" RMSE per pixel: %lf\n", rmse);
+			if (rmse >= 1.0) {
+				for (int j = 0; j < worker->pops[i]->size; j++) {
+					FgenIndividual *ind = worker->pops[i]->ind[j];
+					printf("  Individual %d: RMSE per pixel: %lf\n", j,
+						sqrt((1.0 / ind->fitness) / 16));
+				}
+			}
+		}
+		pthread_mutex_unlock(&s->mutex);
+	}
+	worker->nu_ga_generations += c->generations;
+	worker->nu_stops[c->stop_reason]++;
+	FgenIndividual *best = fgen_best_individual_of_archipelago(nu_pops, worker->pops);
+	worker->best_island = 0;
+	for (int i = 0; i < nu_pops; i++)
+		if (fgen_best_individual_of_population(worker->pops[i]) == best) {
+			worker->best_island = i;
+			break;
+		}
+	BlockStatistics *stats = get_block_statistics(s, l, block_index);
+	if (stats != NULL) {
+		stats->generations += c->generations;
+		for (int i = 0; i < nu_pops; i++) {
+			BlockUserData *user_data = (BlockUserData *)worker->pops[i]->user_data;
+			stats->nu_evaluations += user_data->nu_evaluations;
+			stats->nu_invalid += user_data->nu_invalid;
+		}
+	}
+	return best;
+}
+
+// Copy the best individual returned by run_block_ga() into bitstring. With index derivation, the fitness of the
+// individual was calculated with the optimal pixel indices for its other bits, which are written into bitstring.
+
+static void copy_best_individual(BlockWorker *worker, FgenIndividual *best, unsigned char *bitstring) {
+	BlockUserData *user_data = (BlockUserData *)worker->pops[worker->best_island]->user_data;
+	memcpy(bitstring, best->bitstring, user_data->texture->bits_per_block / 8);
+	if (user_data->context->derive_indices)
+		calculate_fitness_with_derived_indices(bitstring, user_data);
+}
+
+// Prepare the populations of a worker for a block of a level, and set up block_user_data for the block with the
+// modes allowed on any of the islands.
+
+static void set_up_block(BlockWorker *worker, BlockLevel *l, int block_index, BlockUserData *block_user_data) {
+	BlockScheduler *s = worker->scheduler;
+	Texture *texture = l->texture;
+	int x = (block_index % l->nu_blocks_x) * texture->block_width;
+	int y = (block_index / l->nu_blocks_x) * texture->block_height;
+	// For 1-bit alpha texture, prepare the alpha values of the image block for use in the seeding function.
+	if (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
+		set_alpha_pixels(l->image, x, y, texture->block_width, texture->block_height, worker->alpha_pixels);
+	if (worker->pops == NULL) {
+		set_user_data_image(&worker->user_data, l->image, texture);
+		*block_user_data = worker->user_data;
+	}
+	else {
+		// The populations of a worker are used for the blocks of all levels.
+		for (int i = 0; i < s->nu_escalation_pops; i++)
+			set_user_data_image((BlockUserData *)worker->pops[i]->user_data, l->image, texture);
+		*block_user_data = *(BlockUserData *)worker->pops[0]->user_data;
+		for (int i = 1; i < s->nu_pops; i++)
+			block_user_data->flags |= ((BlockUserData *)worker->pops[i]->user_data)->flags;
+	}
+	// The BPTC island flags are selected for each block by select_island_modes(), the block itself is not
+	// restricted.
+	if (texture->type == TEXTURE_TYPE_BPTC)
+		block_user_data->flags = BPTC_MODE_ALLOWED_ALL | ENCODE_BIT;
+	block_user_data->x_offset = x;
+	block_user_data->y_offset = y;
+	block_user_data->alpha_pixels = worker->alpha_pixels;
+	block_user_data->nu_evaluations = 0;
+	block_user_data->nu_invalid = 0;
+}
+
+// Select the BPTC modes and partitions allowed on each island of a worker for a block of a level, using an analysis
+// of the block. Only used for the first compression of a block; refinement runs start from the current encoding of
+// the block and are not restricted.
+
+static void select_island_modes(BlockWorker *worker, BlockLevel *l, int block_index) {
+	BlockScheduler *s = worker->scheduler;
+	if (!bptc_preselection_used(l->texture, s->seed_func))
+		return;
+	BlockUserData *user_data = (BlockUserData *)worker->pops[0]->user_data;
+	user_data->x_offset = (block_index % l->nu_blocks_x) * l->texture->block_width;
+	user_data->y_offset = (block_index / l->nu_blocks_x) * l->texture->block_height;
+	int *island_flags = (int *)alloca(sizeof(int) * s->nu_escalation_pops);
+	select_bptc_island_flags(user_data, s->nu_escalation_pops, island_flags);
+	for (int i = 0; i < s->nu_escalation_pops; i++)
+		((BlockUserData *)worker->pops[i]->user_data)->flags = island_flags[i];
+}
+
+// Compress a single block of a level with the populations of a worker and store the result in the texture. The
+// number of generations used is returned in generations.
+
+static double compress_block(BlockWorker *worker, BlockLevel *l, int block_index, int *generations) {
+	BlockScheduler *s = worker->scheduler;
+	CompressContext *context = s->context;
+	Texture *texture = l->texture;
+	BlockStatistics *stats = get_block_statistics(s, l, block_index);
+	// Blocks with only one or two different colors are encoded directly when possible, using the modes allowed
+	// on any of the islands. With the exhaustive and instant speed settings, the other blocks are encoded directly
+	// as well; with the instant speed setting, the analytic encoding is refined by local search. When the time
+	// budget runs out before a block is compressed, it gets the cheapest analytic encoding instead of a GA run.
+	BlockUserData few_color_user_data;
+	set_up_block(worker, l, block_index, &few_color_user_data);
+	unsigned char *bitstring = get_compressed_block(texture, block_index);
+	*generations = 0;
+	int method = - 1;
+	if (encode_block_with_few_colors(&few_color_user_data, bitstring) >= 0) {
+		worker->nu_few_color_blocks++;
+		method = BLOCK_METHOD_FEW_COLORS;
+	}
+	else
+	if (context->exhaustive && encode_block_exhaustively(&few_color_user_data, bitstring) >= 0) {
+		worker->nu_exhaustive_blocks++;
+		method = BLOCK_METHOD_EXHAUSTIVE;
+	}
+	else
+	if (context->analytic) {
+		encode_block_analytically(&few_color_user_data, bitstring, MAX_ANALYTIC_SEEDS);
+		worker->nu_analytic_blocks++;
+		method = BLOCK_METHOD_ANALYTIC;
+	}
+	else
+	if (deadline_passed(context) && analytic_encoding_supported(texture->type) &&
+	encode_block_analytically(&few_color_user_data, bitstring, 1) >= 0) {
+		worker->nu_analytic_blocks++;
+		method = BLOCK_METHOD_ANALYTIC;
+	}
+	if (method >= 0) {
+		unsigned int image_buffer[32];
+		texture->decoding_function(bitstring, image_buffer, few_color_user_data.flags);
+		double fitness = texture->comparison_function(image_buffer, &few_color_user_data);
+		if (method == BLOCK_METHOD_ANALYTIC && context->polish_passes > 0 && !deadline_passed(context)) {
+			double polished_fitness = polish_block(&few_color_user_data, bitstring, fitness,
+				context->polish_passes);
+			if (polished_fitness > fitness)
+				worker->nu_polished_blocks++;
+			fitness = polished_fitness;
+		}
+		if (stats != NULL) {
+			stats->method = method;
+			stats->nu_evaluations += few_color_user_data.nu_evaluations;
+			stats->nu_invalid += few_color_user_data.nu_invalid;
+		}
+		return fitness;
+	}
+	worker->nu_ga_blocks++;
+	select_island_modes(worker, l, block_index);
+	// Store the best solution in the texture, refined by local search using the modes allowed on any of the
+	// islands.
+	FgenIndividual *best = run_block_ga(worker, l, block_index, s->nu_pops, 0, 1);
+	*generations = worker->convergence.generations;
+	int island = worker->best_island;
+	copy_best_individual(worker, best, bitstring);
+	double fitness = best->fitness;
+	if (context->polish_passes > 0 && !deadline_passed(context)) {
+		fitness = polish_block(&few_color_user_data, bitstring, best->fitness, context->polish_passes);
+		if (fitness > best->fitness)
+			worker->nu_polished_blocks++;
+	}
+	// With a quality target, a block that misses the target is compressed once more with twice as many islands
+	// and generations, keeping the better result.
+	if (context->target_fitness > 0 && fitness < context->target_fitness && !deadline_passed(context)) {
+		worker->nu_escalated_blocks++;
+		best = run_block_ga(worker, l, block_index, s->nu_escalation_pops, 1, 2);
+		*generations += worker->convergence.generations;
+		unsigned char escalated_bitstring[16];
+		copy_best_individual(worker, best, escalated_bitstring);
+		double escalated_fitness = best->fitness;
+		if (context->polish_passes > 0 && !deadline_passed(context))
+			escalated_fitness = polish_block(&few_color_user_data, escalated_bitstring, best->fitness,
+				context->polish_passes);
+		if (escalated_fitness > fitness) {
+			memcpy(bitstring, escalated_bitstring, texture->bits_per_block / 8);
+			fitness = escalated_fitness;
+			island = worker->best_island;
+		}
+	}
+	if (stats != NULL) {
+		stats->method = BLOCK_METHOD_GA;
+		stats->island = island;
+		// The evaluations of the local search.
+		stats->nu_evaluations += few_color_user_data.nu_evaluations;
+		stats->nu_invalid += few_color_user_data.nu_invalid;
+	}
+	return fitness;
+}
+
+// Run the GA on a block of a level that has already been compressed with the given fitness, and store the result
+// in the texture when it is better. attempt is the number of the refinement run of the block. Returns the fitness
+// of the block.
+
+static double refine_block(BlockWorker *worker, BlockLevel *l, int block_index, double fitness, int attempt) {
+	BlockScheduler *s = worker->scheduler;
+	CompressContext *context = s->context;
+	Texture *texture = l->texture;
+	BlockUserData block_user_data;
+	set_up_block(worker, l, block_index, &block_user_data);
+	worker->nu_ga_blocks++;
+	FgenIndividual *best = run_block_ga(worker, l, block_index, s->nu_pops, attempt, 1);
+	unsigned char bitstring[16];
+	copy_best_individual(worker, best, bitstring);
+	double new_fitness = best->fitness;
+	if (context->polish_passes > 0 && !deadline_passed(context))
+		new_fitness = polish_block(&block_user_data, bitstring, best->fitness, context->polish_passes);
+	BlockStatistics *stats = get_block_statistics(s, l, block_index);
+	if (stats != NULL) {
+		stats->nu_evaluations += block_user_data.nu_evaluations;
+		stats->nu_invalid += block_user_data.nu_invalid;
+	}
+	if (new_fitness <= fitness)
+		return fitness;
+	memcpy(get_compressed_block(texture, block_index), bitstring, texture->bits_per_block / 8);
+	worker->nu_refined_blocks++;
+	if (stats != NULL)
+		stats->island = worker->best_island;
+	return new_fitness;
+}
+
+// Mark a block of a level as completed and add it to the queue of blocks to be reported. Must be called with the
+// scheduler mutex locked.
+
+static void complete_block(BlockScheduler *s, BlockLevel *l, int block_index, double fitness, int generations) {
+	int by = block_index / l->nu_blocks_x;
+	l->block_state[block_index] = BLOCK_DONE;
+	while (l->row_done[by] < l->nu_blocks_x &&
+	l->block_state[by * l->nu_blocks_x + l->row_done[by]] == BLOCK_DONE)
+		l->row_done[by]++;
+	s->completed[s->completed_tail] = block_index;
+	s->completed_level[s->completed_tail] = l - s->levels;
+	s->completed_fitness[s->completed_tail] = fitness;
+	s->completed_generations[s->completed_tail] = generations;
+	s->completed_tail++;
+}
+
+// Main function of a worker thread.
+
+static void *block_worker_thread(void *arg) {
+	BlockWorker *worker = (BlockWorker *)arg;
+	BlockScheduler *s = worker->scheduler;
+	pthread_mutex_lock(&s->mutex);
+	for (;;) {
+		if (s->stop || s->nu_started == s->nu_blocks)
+			break;
+		BlockLevel *l;
+		int block_index = get_next_ready_block(s, &l);
+		if (block_index < 0) {
+			pthread_cond_wait(&s->work_available, &s->mutex);
+			continue;
+		}
+		int by = block_index / l->nu_blocks_x;
+		l->block_state[block_index] = BLOCK_RUNNING;
+		l->row_next[by]++;
+		s->nu_started++;
+		pthread_mutex_unlock(&s->mutex);
+
+		int generations;
+		double start_time = get_time();
+		double fitness = compress_block(worker, l, block_index, &generations);
+		BlockStatistics *stats = get_block_statistics(s, l, block_index);
+		if (stats != NULL)
+			stats->time += get_time() - start_time;
+
+		pthread_mutex_lock(&s->mutex);
+		complete_block(s, l, block_index, fitness, generations);
+		// Blocks with identical source pixels get the same compressed block. The duplicates are never
+		// scheduled themselves.
+		unsigned char *bitstring = get_compressed_block(l->texture, block_index);
+		for (int i = l->next_duplicate[block_index]; i >= 0; i = l->next_duplicate[i]) {
+			memcpy(get_compressed_block(l->texture, i), bitstring, l->texture->bits_per_block / 8);
+			s->nu_started++;
+			complete_block(s, l, i, fitness, generations);
+			if (stats != NULL)
+				get_block_statistics(s, l, i)->method = BLOCK_METHOD_DUPLICATE;
+		}
+		pthread_cond_broadcast(&s->work_available);
+		pthread_cond_signal(&s->block_completed);
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+// Return the priority of a block in the refinement queue. Blocks that have been refined before without much
+// success move down the queue, so that the remaining time is not spent on a single block. With an importance map,
+// important blocks move up the queue.
+
+static double get_refinement_priority(BlockScheduler *s, int i) {
+	return s->block_error[i] * s->block_importance[i] / (s->nu_refinements[i] + 1);
+}
+
+// Add a block to the refinement queue. Must be called with the scheduler mutex locked.
+
+static void push_refinement_queue(BlockScheduler *s, int block) {
+	int i = s->queue_size;
+	s->queue_size++;
+	double priority = get_refinement_priority(s, block);
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		if (get_refinement_priority(s, s->queue[parent]) >= priority)
+			break;
+		s->queue[i] = s->queue[parent];
+		i = parent;
+	}
+	s->queue[i] = block;
+}
+
+// Remove and return the block with the highest priority from the refinement queue. Must be called with the
+// scheduler mutex locked.
+
+static int pop_refinement_queue(BlockScheduler *s) {
+	int block = s->queue[0];
+	s->queue_size--;
+	int last = s->queue[s->queue_size];
+	double priority = get_refinement_priority(s, last);
+	int i = 0;
+	for (;;) {
+		int child = i * 2 + 1;
+		if (child >= s->queue_size)
+			break;
+		if (child + 1 < s->queue_size && get_refinement_priority(s, s->queue[child + 1]) >
+		get_refinement_priority(s, s->queue[child]))
+			child++;
+		if (priority >= get_refinement_priority(s, s->queue[child]))
+			break;
+		s->queue[i] = s->queue[child];
+		i = child;
+	}
+	s->queue[i] = last;
+	return block;
+}
+
+// Return whether a block with the given fitness can still be improved by refinement.
+
+static int block_needs_refinement(CompressContext *context, double fitness) {
+	return !isinf(fitness) && !(context->target_fitness > 0 && fitness >= context->target_fitness);
+}
+
+// Main function of a worker thread refining blocks until the refinement queue is empty or the time budget has run
+// out.
+
+static void *refinement_worker_thread(void *arg) {
+	BlockWorker *worker = (BlockWorker *)arg;
+	BlockScheduler *s = worker->scheduler;
+	pthread_mutex_lock(&s->mutex);
+	while (s->queue_size > 0 && !deadline_passed(s->context)) {
+		int block = pop_refinement_queue(s);
+		BlockLevel *l = &s->levels[0];
+		while (l + 1 < &s->levels[s->nu_levels] && block >= l[1].first_block)
+			l++;
+		int block_index = block - l->first_block;
+		double fitness = 1.0 / s->block_error[block];
+		s->nu_refinements[block]++;
+		// Attempt zero is the first pass, and attempt one can be used by the quality target.
+		int attempt = s->nu_refinements[block] + 1;
+		pthread_mutex_unlock(&s->mutex);
+
+		double start_time = get_time();
+		double new_fitness = refine_block(worker, l, block_index, fitness, attempt);
+		BlockStatistics *stats = get_block_statistics(s, l, block_index);
+		if (stats != NULL)
+			stats->time += get_time() - start_time;
+
+		pthread_mutex_lock(&s->mutex);
+		if (new_fitness > fitness) {
+			s->block_error[block] = 1.0 / new_fitness;
+			unsigned char *bitstring = get_compressed_block(l->texture, block_index);
+			for (int i = l->next_duplicate[block_index]; i >= 0; i = l->next_duplicate[i])
+				memcpy(get_compressed_block(l->texture, i), bitstring, l->texture->bits_per_block / 8);
+		}
+		if (block_needs_refinement(s->context, new_fitness))
+			push_refinement_queue(s, block);
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+// Calculate a hash of the source pixels of a block, including the size of the part of the block that is inside
+// the image.
+
+static uint64_t calculate_block_hash(Image *image, Texture *texture, int x, int y) {
+	int w = texture->width - x < texture->block_width ? texture->width - x : texture->block_width;
+	int h = texture->height - y < texture->block_height ? texture->height - y : texture->block_height;
+	int pixel_size = image->is_half_float ? 8 : 4;
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	hash = (hash ^ (w | (h << 8))) * 0x100000001B3ULL;
+	for (int by = 0; by < texture->block_height; by++) {
+		unsigned char *data = (unsigned char *)image->pixels + ((y + by) * image->extended_width + x) * pixel_size;
+		for (int i = 0; i < texture->block_width * pixel_size; i++)
+			hash = (hash ^ data[i]) * 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+// Return whether the source pixels of two blocks are identical.
+
+static int blocks_are_identical(Image *image, Texture *texture, int x1, int y1, int x2, int y2) {
+	int w1 = texture->width - x1 < texture->block_width ? texture->width - x1 : texture->block_width;
+	int h1 = texture->height - y1 < texture->block_height ? texture->height - y1 : texture->block_height;
+	int w2 = texture->width - x2 < texture->block_width ? texture->width - x2 : texture->block_width;
+	int h2 = texture->height - y2 < texture->block_height ? texture->height - y2 : texture->block_height;
+	if (w1 != w2 || h1 != h2)
+		return 0;
+	int pixel_size = image->is_half_float ? 8 : 4;
+	for (int by = 0; by < texture->block_height; by++)
+		if (memcmp((unsigned char *)image->pixels + ((y1 + by) * image->extended_width + x1) * pixel_size,
+		(unsigned char *)image->pixels + ((y2 + by) * image->extended_width + x2) * pixel_size,
+		texture->block_width * pixel_size) != 0)
+			return 0;
+	return 1;
+}
+
+// Find blocks with identical source pixels (including alpha and the border padding state). Each block that is
+// identical to an earlier block (in raster order) is marked as a duplicate in the block state array, and is
+// linked from the first such block through the next_duplicate array, so that it is only compressed once. Returns
+// the number of duplicate blocks.
+
+static int find_duplicate_blocks(Image *image, Texture *texture, int nu_blocks_x, int nu_blocks_y,
+unsigned char *block_state, int *next_duplicate) {
+	int nu_blocks = nu_blocks_x * nu_blocks_y;
+	int table_size = 1;
+	while (table_size < nu_blocks * 2)
+		table_size *= 2;
+	// Open addressing hash table of the first block with each content, and the last duplicate found for it.
+	int *table = (int *)malloc(sizeof(int) * table_size);
+	uint64_t *table_hash = (uint64_t *)malloc(sizeof(uint64_t) * table_size);
+	int *last_duplicate = (int *)malloc(sizeof(int) * nu_blocks);
+	for (int i = 0; i < table_size; i++)
+		table[i] = - 1;
+	int nu_duplicates = 0;
+	for (int i = 0; i < nu_blocks; i++) {
+		int x = (i % nu_blocks_x) * texture->block_width;
+		int y = (i / nu_blocks_x) * texture->block_height;
+		uint64_t hash = calculate_block_hash(image, texture, x, y);
+		next_duplicate[i] = - 1;
+		last_duplicate[i] = i;
+		int j = hash & (table_size - 1);
+		for (;;) {
+			int k = table[j];
+			if (k < 0) {
+				table[j] = i;
+				table_hash[j] = hash;
+				break;
+			}
+			if (table_hash[j] == hash && blocks_are_identical(image, texture, x, y,
+			(k % nu_blocks_x) * texture->block_width, (k / nu_blocks_x) * texture->block_height)) {
+				next_duplicate[last_duplicate[k]] = i;
+				last_duplicate[k] = i;
+				block_state[i] = BLOCK_DUPLICATE;
+				nu_duplicates++;
+				break;
+			}
+			j = (j + 1) & (table_size - 1);
+		}
+	}
+	free(last_duplicate);
+	free(table_hash);
+	free(table);
+	return nu_duplicates;
+}
+
+// Set a flag for each block of all levels that is one when the block has been completed. Must be called with the
+// scheduler mutex locked.
+
+static void get_completed_blocks(BlockScheduler *s, unsigned char *block_done) {
+	for (int i = 0; i < s->nu_levels; i++) {
+		BlockLevel *l = &s->levels[i];
+		for (int j = 0; j < l->nu_blocks_x * l->nu_blocks_y; j++)
+			block_done[l->first_block + j] = (l->block_state[j] == BLOCK_DONE);
+	}
+}
+
+// Calculate the importance of each block of a level from the importance map, which has the size of the first
+// level. The importance is derived from the average brightness of the area of the map covered by the block.
+
+static float *calculate_level_importance(BlockLevel *l, Image *importance_map) {
+	float *importance = (float *)malloc(sizeof(float) * l->nu_blocks_x * l->nu_blocks_y);
+	Texture *texture = l->texture;
+	for (int by = 0; by < l->nu_blocks_y; by++)
+		for (int bx = 0; bx < l->nu_blocks_x; bx++) {
+			int x0 = bx * texture->block_width * importance_map->width / texture->width;
+			int y0 = by * texture->block_height * importance_map->height / texture->height;
+			int x1 = (bx + 1) * texture->block_width * importance_map->width / texture->width;
+			int y1 = (by + 1) * texture->block_height * importance_map->height / texture->height;
+			if (x1 > importance_map->width)
+				x1 = importance_map->width;
+			if (y1 > importance_map->height)
+				y1 = importance_map->height;
+			if (x0 >= x1)
+				x0 = x1 - 1;
+			if (y0 >= y1)
+				y0 = y1 - 1;
+			int sum = 0;
+			for (int y = y0; y < y1; y++)
+				for (int x = x0; x < x1; x++) {
+					unsigned int pixel = importance_map->pixels[y * importance_map->extended_width + x];
+					sum += pixel_get_r(pixel) + pixel_get_g(pixel) + pixel_get_b(pixel);
+				}
+			double brightness = sum / (3.0 * 255.0 * (x1 - x0) * (y1 - y0));
+			importance[by * l->nu_blocks_x + bx] = pow(IMPORTANCE_MAX_SCALE, brightness * 2.0 - 1.0);
+		}
+	return importance;
 }
 
+// Set up the levels of a block scheduler for the textures of nu_levels images, and find the blocks with identical
+// source pixels. Returns the number of duplicate blocks.
 
-// The fitness function of the genetic algorithm.
+static int set_up_block_levels(BlockScheduler *s, Image *images, Texture *textures, int nu_levels) {
+	s->nu_levels = nu_levels;
+	s->levels = (BlockLevel *)malloc(sizeof(BlockLevel) * nu_levels);
+	s->nu_blocks = 0;
+	int nu_duplicates = 0;
+	for (int i = 0; i < nu_levels; i++) {
+		BlockLevel *l = &s->levels[i];
+		l->image = &images[i];
+		l->texture = &textures[i];
+		l->nu_blocks_x = l->texture->extended_width / l->texture->block_width;
+		l->nu_blocks_y = l->texture->extended_height / l->texture->block_height;
+		int nu_level_blocks = l->nu_blocks_x * l->nu_blocks_y;
+		l->first_block = s->nu_blocks;
+		s->nu_blocks += nu_level_blocks;
+		l->image_hash = s->context->option_deterministic ? calculate_image_hash(l->image) : 0;
+		l->block_state = (unsigned char *)calloc(nu_level_blocks, 1);
+		l->next_duplicate = (int *)malloc(sizeof(int) * nu_level_blocks);
+		nu_duplicates += find_duplicate_blocks(l->image, l->texture, l->nu_blocks_x, l->nu_blocks_y,
+			l->block_state, l->next_duplicate);
+		l->row_next = (int *)calloc(l->nu_blocks_y, sizeof(int));
+		l->row_done = (int *)calloc(l->nu_blocks_y, sizeof(int));
+		l->first_row = 0;
+		l->importance = s->context->importance_map != NULL ?
+			calculate_level_importance(l, s->context->importance_map) : NULL;
+		set_user_data(&l->report_data, s->context, l->image, l->texture);
+	}
+	return nu_duplicates;
+}
 
-static double calculate_fitness(const FgenPopulation *pop, const unsigned char *bitstring) {
-	unsigned int image_buffer[32];	// 16 required for regular pixels, 32 for 64-bit pixel formats like half floats.
-	BlockUserData *user_data = (BlockUserData *)pop->user_data;
-	int flags = user_data->flags;
-	int r = user_data->texture->decoding_function(bitstring, image_buffer, flags);
-	if (r == 0) {
-//		printf("Invalid block.\n");
-		return 0;	// Fitness is zero for invalid blocks.
+static void free_block_levels(BlockScheduler *s) {
+	for (int i = 0; i < s->nu_levels; i++) {
+		free(s->levels[i].row_done);
+		free(s->levels[i].row_next);
+		free(s->levels[i].next_duplicate);
+		free(s->levels[i].block_state);
+		free(s->levels[i].importance);
 	}
-	return user_data->texture->comparison_function(image_buffer, user_data);
+	free(s->levels);
 }
 
-// The generation callback function of the genetic algorithm.
+// Return the number of worker threads to use when at most max_concurrent_blocks blocks can be compressed
+// concurrently, and decide whether the islands of each worker run concurrently.
 
-static void generation_callback(FgenPopulation *pop, int generation) {
-	if (generation == 0)
-		return;
-	if (generation >= nu_generations * 2) {
-		fgen_signal_stop(pop);
-		return;
-	}
-	// Adaptive, if the fitness is above the threshold, stop, otherwise go on for another nu_generations
-	// generations.
-	FgenIndividual *best = fgen_best_individual_of_population(pop);
-	double rmse = sqrt((1.0 / best->fitness) / 16);
-	if (rmse < rmse_threshold)
-		fgen_signal_stop(pop);
+static int get_number_of_block_workers(BlockScheduler *s, int max_concurrent_blocks) {
+	int nu_threads = s->context->option_max_threads;
+	if (nu_threads == - 1)
+		nu_threads = get_number_of_processors();
+	int nu_workers = nu_threads;
+	if (nu_workers > max_concurrent_blocks)
+		nu_workers = max_concurrent_blocks;
+	// When the texture is too small to keep all threads busy, run the islands of each worker concurrently.
+	// This is not done in deterministic mode since the result would depend on the scheduling of the threads.
+	s->threaded_islands = (s->nu_pops > 1 && nu_workers * 2 <= nu_threads && !s->context->option_deterministic);
+	if (!s->context->option_quiet)
+		printf("Using %d worker thread%s.\n", nu_workers, nu_workers == 1 ? "" : "s");
+	return nu_workers;
 }
 
-// Custom seeding function for 128-bit formats for archipelagos where each island is compressing the same block.
+// Set the mode flags of population i of the nu_pops populations of a worker that compress the same block.
 
-static void seed_128bit(FgenPopulation *pop, unsigned char *bitstring) {
-	BlockUserData *user_data = (BlockUserData *)pop->user_data;
-	FgenRNG *rng = fgen_get_rng(pop);
-	int r = fgen_random_8(rng);
-	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
-	// A too high probability results in less diversity in the archipelago.
-	int factor;
-	if (population_size == 128)
-		factor = 1;
-	else	// population_size == 64
-		factor = 2;
-	if (r < 2 * factor && user_data->x_offset > 0) {
-		// Seed with solution to the left with chance 1/128th (1/64th if population size is 64).
-		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height) *
-			(user_data->texture->extended_width / user_data->texture->block_width) +
-			(user_data->x_offset / user_data->texture->block_width) - 1;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
-	}
-	if (r < 4 * factor && user_data->y_offset > 0) {
-		// Seed with solution above with chance 1/128th (1/64th for x == 0).
-		// 1/64th if population size is 64.
-		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height - 1) *
-			(user_data->texture->extended_width / user_data->texture->block_width) +
-			user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+static void set_population_flags(CompressContext *context, Texture *texture, int i, int nu_pops,
+BlockUserData *user_data) {
+	if (nu_pops > 1)
+		set_island_flags(context, texture, i % nu_pops, nu_pops, user_data);
+	else
+	if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC)
+		if (context->option_allowed_modes_etc2 != - 1)
+			user_data->flags = context->option_allowed_modes_etc2 | ENCODE_BIT;
+}
+
+// Create nu_workers workers for a block scheduler, each with its own populations, and start a thread running
+// thread_func for each of them. When every block is encoded without the GA (--instant and --exhaustive), the
+// workers get no populations.
+
+static BlockWorker *start_block_workers(BlockScheduler *s, int nu_workers, FgenSeedFunc seed_func,
+void *(*thread_func)(void *)) {
+	CompressContext *context = s->context;
+	Image *image = s->levels[0].image;
+	Texture *texture = s->levels[0].texture;
+	int nu_pops = s->nu_pops;
+	BlockWorker *workers = (BlockWorker *)malloc(sizeof(BlockWorker) * nu_workers);
+	for (int i = 0; i < nu_workers; i++) {
+		workers[i].scheduler = s;
+		workers[i].alpha_pixels = (unsigned char *)malloc(texture->block_width * texture->block_height);
+		workers[i].seed_bitstrings = (unsigned char *)malloc(s->nu_escalation_pops * MAX_ANALYTIC_SEEDS *
+			(texture->bits_per_block / 8));
+		workers[i].nu_few_color_blocks = 0;
+		workers[i].nu_exhaustive_blocks = 0;
+		workers[i].nu_analytic_blocks = 0;
+		workers[i].nu_ga_blocks = 0;
+		workers[i].nu_ga_generations = 0;
+		workers[i].nu_polished_blocks = 0;
+		workers[i].nu_escalated_blocks = 0;
+		workers[i].nu_refined_blocks = 0;
+		for (int j = 0; j < NU_STOP_REASONS; j++)
+			workers[i].nu_stops[j] = 0;
+		pthread_mutex_init(&workers[i].convergence.mutex, NULL);
+		if (context->analytic || context->exhaustive) {
+			workers[i].pops = NULL;
+			set_user_data(&workers[i].user_data, context, image, texture);
+			workers[i].user_data.convergence = &workers[i].convergence;
+			set_population_flags(context, texture, 0, nu_pops, &workers[i].user_data);
+			continue;
+		}
+		workers[i].pops = (FgenPopulation **)malloc(sizeof(FgenPopulation *) * s->nu_escalation_pops);
+		// The additional populations used to escalate a block repeat the island modes of the first ones.
+		for (int j = 0; j < s->nu_escalation_pops; j++) {
+			workers[i].pops[j] = create_population(context, image, texture, seed_func);
+			BlockUserData *user_data = (BlockUserData *)workers[i].pops[j]->user_data;
+			user_data->convergence = &workers[i].convergence;
+			set_population_flags(context, texture, j, nu_pops, user_data);
+		}
+		if (!context->option_deterministic)
+			fgen_random_seed_with_timer(fgen_get_rng(workers[i].pops[0]));
+		// Give each worker a different random number sequence.
+		if (i > 0)
+			fgen_random_seed_rng(fgen_get_rng(workers[i].pops[0]),
+				fgen_random_32(fgen_get_rng(workers[i - 1].pops[0])));
 	}
-	if (r < 6 * factor && (user_data->x_offset > 0 || user_data->y_offset > 0)) {
-		// Seed with a random already calculated solution with chance 1/128th.
-		// 1/64th if population size is 64.
-		int x, y;
-		if (user_data->y_offset == 0) {
-			x = fgen_random_n(rng, user_data->x_offset / user_data->texture->block_width);
-			y = 0;
+	for (int i = 0; i < nu_workers; i++)
+		pthread_create(&workers[i].thread, NULL, thread_func, &workers[i]);
+	return workers;
+}
+
+// Wait for the worker threads to finish, print their statistics when verbose, and destroy the workers.
+
+static void finish_block_workers(BlockScheduler *s, BlockWorker *workers, int nu_workers) {
+	int nu_few_color_blocks = 0;
+	int nu_exhaustive_blocks = 0;
+	int nu_analytic_blocks = 0;
+	int nu_ga_blocks = 0;
+	int64_t nu_ga_generations = 0;
+	int nu_stops[NU_STOP_REASONS] = { 0 };
+	int nu_polished_blocks = 0;
+	int nu_escalated_blocks = 0;
+	int nu_refined_blocks = 0;
+	for (int i = 0; i < nu_workers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		nu_few_color_blocks += workers[i].nu_few_color_blocks;
+		nu_exhaustive_blocks += workers[i].nu_exhaustive_blocks;
+		nu_analytic_blocks += workers[i].nu_analytic_blocks;
+		nu_ga_blocks += workers[i].nu_ga_blocks;
+		nu_ga_generations += workers[i].nu_ga_generations;
+		nu_polished_blocks += workers[i].nu_polished_blocks;
+		nu_escalated_blocks += workers[i].nu_escalated_blocks;
+		nu_refined_blocks += workers[i].nu_refined_blocks;
+		for (int j = 0; j < NU_STOP_REASONS; j++)
+			nu_stops[j] += workers[i].nu_stops[j];
+		pthread_mutex_destroy(&workers[i].convergence.mutex);
+		if (workers[i].pops != NULL) {
+			for (int j = 0; j < s->nu_escalation_pops; j++)
+				destroy_population(s->context, s->levels[0].texture, s->seed_func, workers[i].pops[j]);
+			free(workers[i].pops);
 		}
+		free(workers[i].alpha_pixels);
+		free(workers[i].seed_bitstrings);
+	}
+	free(workers);
+	if (s->context->option_verbose) {
+		if (!s->refine)
+			printf("Encoded %d blocks with one or two colors directly.\n", nu_few_color_blocks);
+		if (s->context->exhaustive)
+			printf("Encoded %d blocks with the exhaustive encoder.\n", nu_exhaustive_blocks);
+		if (s->context->analytic)
+			printf("Encoded %d blocks with the best analytic encoding.\n", nu_analytic_blocks);
+		else
+		if (nu_analytic_blocks > 0)
+			printf("Encoded %d blocks with the cheapest analytic encoding after the time budget ran out.\n",
+				nu_analytic_blocks);
+		if (nu_ga_blocks > 0)
+			printf("%s %d %s with the GA using %.1lf generations on average (stopped: %d at the "
+				"generation limit, %d at the RMSE threshold, %d converged, %d with zero error).\n",
+				s->refine ? "Ran" : "Compressed", nu_ga_blocks, s->refine ? "refinements" : "blocks",
+				(double)nu_ga_generations / nu_ga_blocks, nu_stops[STOP_REASON_LIMIT],
+				nu_stops[STOP_REASON_THRESHOLD], nu_stops[STOP_REASON_CONVERGED],
+				nu_stops[STOP_REASON_ZERO_ERROR]);
+		if (s->refine)
+			printf("%d refinements improved the block.\n", nu_refined_blocks);
 		else {
-			int i = fgen_random_n(rng, (user_data->y_offset / user_data->texture->block_height) *
-				(user_data->texture->extended_width / user_data->texture->block_width)
-				+ user_data->x_offset / user_data->texture->block_width);
-			x = i % (user_data->texture->extended_width / user_data->texture->block_width);
-			y = i / (user_data->texture->extended_width / user_data->texture->block_width);
+			if (s->context->polish_passes > 0)
+				printf("Improved %d blocks with local search.\n", nu_polished_blocks);
+			if (s->context->target_fitness > 0)
+				printf("Escalated %d blocks that missed the quality target.\n", nu_escalated_blocks);
 		}
-		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
 	}
-	fgen_seed_random(pop, bitstring);
-end :
-	if (user_data->texture->type == TEXTURE_TYPE_DXT3)
-		optimize_block_dxt3(bitstring, user_data->alpha_pixels);
 }
 
-// Seeding function for archipelagos where each island is compressing the same block.
+// Compress all blocks of the textures of nu_levels images using a pool of worker threads, each running nu_pops
+// populations on the same block.
 
-static void seed(FgenPopulation *pop, unsigned char *bitstring) {
-	BlockUserData *user_data = (BlockUserData *)pop->user_data;
-	if (user_data->texture->bits_per_block == 128) {
-		seed_128bit(pop, bitstring);
-		return;
-	}
-	FgenRNG *rng = fgen_get_rng(pop);
-	int r = fgen_random_8(rng);
-	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
-	// A too high probability results in less diversity in the archipelago.
-	int factor;
-	if (population_size == 128)
-		factor = 1;
-	else	// population_size == 64
-		factor = 2;
-	if (r < 2 * factor && user_data->x_offset > 0) {
-		// Seed with solution to the left with chance 1/128th.
-		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height) *
-			(user_data->texture->extended_width / user_data->texture->block_width) +
-			(user_data->x_offset / user_data->texture->block_width) - 1;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
+static void compress_with_block_scheduler(CompressContext *context, Image *images, Texture *textures, int nu_levels,
+int nu_pops, FgenSeedFunc seed_func, int max_generation, int need_left) {
+	BlockScheduler s;
+	s.context = context;
+	int nu_duplicates = set_up_block_levels(&s, images, textures, nu_levels);
+	s.nu_pops = nu_pops;
+	s.nu_escalation_pops = context->target_fitness > 0 || context->importance_map != NULL ? nu_pops * 2 : nu_pops;
+	s.max_generation = max_generation;
+	s.need_left = need_left;
+	s.refine = 0;
+	s.seed_func = seed_func;
+	s.nu_started = 0;
+	int max_concurrent_blocks = 0;
+	for (int i = 0; i < nu_levels; i++) {
+		BlockLevel *l = &s.levels[i];
+		if (need_left)
+			max_concurrent_blocks += l->nu_blocks_x < l->nu_blocks_y ? l->nu_blocks_x : l->nu_blocks_y;
+		else
+			max_concurrent_blocks += l->nu_blocks_x * l->nu_blocks_y;
 	}
-	if (r < 4 * factor && user_data->y_offset > 0) {
-		// Seed with solution above with chance 1/128th (1/64th for x == 0).
-		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height - 1) *
-			(user_data->texture->extended_width / user_data->texture->block_width) +
-			user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
+	int nu_blocks = s.nu_blocks;
+	if (context->option_verbose)
+		printf("Deduplicated %d of %d blocks (%.1lf%%), %d unique blocks are compressed.\n", nu_duplicates,
+			nu_blocks, nu_duplicates * 100.0 / nu_blocks, nu_blocks - nu_duplicates);
+	// When resuming from a checkpoint, the blocks that were completed before are marked as done.
+	unsigned char *block_done = (unsigned char *)malloc(nu_blocks);
+	int nu_restored = 0;
+	for (int i = 0; i < nu_levels; i++) {
+		BlockLevel *l = &s.levels[i];
+		int n = restore_checkpoint_blocks(context, l->texture, &block_done[l->first_block]);
+		if (n == 0)
+			continue;
+		for (int j = 0; j < l->nu_blocks_x * l->nu_blocks_y; j++)
+			if (block_done[l->first_block + j])
+				l->block_state[j] = BLOCK_DONE;
+		for (int by = 0; by < l->nu_blocks_y; by++)
+			while (l->row_done[by] < l->nu_blocks_x &&
+			l->block_state[by * l->nu_blocks_x + l->row_done[by]] == BLOCK_DONE)
+				l->row_done[by]++;
+		nu_restored += n;
 	}
-	if (r < 6 * factor && (user_data->x_offset > 0 || user_data->y_offset > 0)) {
-		// Seed with a random already calculated solution with chance 1/128th.
-		int x, y;
-		if (user_data->y_offset == 0) {
-			x = fgen_random_n(rng, user_data->x_offset / user_data->texture->block_width);
-			y = 0;
+	s.nu_started = nu_restored;
+	if (nu_restored > 0 && !context->option_quiet)
+		printf("Restored %d of %d blocks from the checkpoint.\n", nu_restored, nu_blocks);
+	s.completed = (int *)malloc(sizeof(int) * nu_blocks);
+	s.completed_level = (int *)malloc(sizeof(int) * nu_blocks);
+	s.completed_fitness = (double *)malloc(sizeof(double) * nu_blocks);
+	s.completed_generations = (int *)malloc(sizeof(int) * nu_blocks);
+	s.completed_head = 0;
+	s.completed_tail = 0;
+	s.stop = 0;
+	pthread_mutex_init(&s.mutex, NULL);
+	pthread_cond_init(&s.work_available, NULL);
+	pthread_cond_init(&s.block_completed, NULL);
+
+	int nu_workers = get_number_of_block_workers(&s, max_concurrent_blocks);
+	BlockWorker *workers = start_block_workers(&s, nu_workers, seed_func, block_worker_thread);
+
+	// Report completed blocks from the main thread.
+	int nu_reported = nu_restored;
+	context->progress_start_time = get_time();
+	context->progress_time = 0;
+	context->progress_start_blocks = nu_restored;
+	pthread_mutex_lock(&s.mutex);
+	while (nu_reported < nu_blocks && !s.stop) {
+		if (s.completed_head == s.completed_tail) {
+			pthread_cond_wait(&s.block_completed, &s.mutex);
+			continue;
 		}
-		else {
-			int i = fgen_random_n(rng, (user_data->y_offset / user_data->texture->block_height) *
-				(user_data->texture->extended_width / user_data->texture->block_width)
-				+ user_data->x_offset / user_data->texture->block_width);
-			x = i % (user_data->texture->extended_width / user_data->texture->block_width);
-			y = i / (user_data->texture->extended_width / user_data->texture->block_width);
+		int block_index = s.completed[s.completed_head];
+		BlockLevel *l = &s.levels[s.completed_level[s.completed_head]];
+		double fitness = s.completed_fitness[s.completed_head];
+		int generations = s.completed_generations[s.completed_head];
+		s.completed_head++;
+		pthread_mutex_unlock(&s.mutex);
+		l->report_data.x_offset = (block_index % l->nu_blocks_x) * l->texture->block_width;
+		l->report_data.y_offset = (block_index / l->nu_blocks_x) * l->texture->block_height;
+		nu_reported++;
+		report_solution(get_compressed_block(l->texture, block_index), fitness, generations, nu_reported,
+			nu_blocks, &l->report_data);
+		pthread_mutex_lock(&s.mutex);
+		if (l->report_data.stop_signalled) {
+			s.stop = 1;
+			pthread_cond_broadcast(&s.work_available);
+		}
+		if (checkpoint_due(context)) {
+			// The data of completed blocks does not change anymore, so the checkpoint can be written
+			// while the workers continue.
+			get_completed_blocks(&s, block_done);
+			pthread_mutex_unlock(&s.mutex);
+			for (int i = 0; i < nu_levels; i++)
+				update_checkpoint(context, s.levels[i].texture, &block_done[s.levels[i].first_block],
+					i == nu_levels - 1);
+			pthread_mutex_lock(&s.mutex);
 		}
-		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
 	}
-	fgen_seed_random(pop, bitstring);
-end :
-	if (user_data->texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
-		optimize_block_etc2_punchthrough(bitstring, user_data->alpha_pixels);
+	get_completed_blocks(&s, block_done);
+	pthread_mutex_unlock(&s.mutex);
+	int write = checkpoint_due(context);
+	for (int i = 0; i < nu_levels; i++)
+		update_checkpoint(context, s.levels[i].texture, &block_done[s.levels[i].first_block],
+			write && i == nu_levels - 1);
+	free(block_done);
+
+	finish_block_workers(&s, workers, nu_workers);
+	pthread_cond_destroy(&s.block_completed);
+	pthread_cond_destroy(&s.work_available);
+	pthread_mutex_destroy(&s.mutex);
+	free(s.completed_generations);
+	free(s.completed_fitness);
+	free(s.completed_level);
+	free(s.completed);
+	free_block_levels(&s);
 }
 
-// 128-bit seeding function for archipelagos where each island is compressing a different block (--ultra setting).
-// Population size is assumed to be 256.
+// Refine the blocks of the textures of nu_levels images that have already been compressed until the time budget
+// runs out, using a pool of worker threads each running nu_pops populations on the same block. The blocks with
+// the highest error are refined first.
 
-static void seed2_128bit(FgenPopulation *pop, unsigned char *bitstring) {
-	BlockUserData *user_data = (BlockUserData *)pop->user_data;
-	FgenRNG *rng = fgen_get_rng(pop);
-	int r = fgen_random_8(rng);
-	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
-	// A too high probability results in less diversity in the archipelago.
-	if (r < 3 && user_data->y_offset > 0) {
-		// Seed with solution above with chance 3/256th.
-		int compressed_block_index = (user_data->y_offset / user_data->texture->block_height - 1) *
-			(user_data->texture->extended_width / user_data->texture->block_width) +
-			user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+static void refine_with_block_scheduler(CompressContext *context, Image *images, Texture *textures, int nu_levels,
+int nu_pops, int max_generation) {
+	BlockScheduler s;
+	s.context = context;
+	set_up_block_levels(&s, images, textures, nu_levels);
+	s.nu_pops = nu_pops;
+	s.nu_escalation_pops = context->importance_map != NULL ? nu_pops * 2 : nu_pops;
+	s.max_generation = max_generation;
+	s.need_left = 0;
+	s.refine = 1;
+	s.seed_func = seed_refinement;
+	s.queue = (int *)malloc(sizeof(int) * s.nu_blocks);
+	s.queue_size = 0;
+	s.block_error = (double *)malloc(sizeof(double) * s.nu_blocks);
+	s.block_importance = (float *)malloc(sizeof(float) * s.nu_blocks);
+	s.nu_refinements = (int *)calloc(s.nu_blocks, sizeof(int));
+	// Duplicate blocks are not refined themselves but get the result of the first identical block.
+	for (int i = 0; i < nu_levels; i++) {
+		BlockLevel *l = &s.levels[i];
+		for (int j = 0; j < l->nu_blocks_x * l->nu_blocks_y; j++) {
+			if (l->block_state[j] == BLOCK_DUPLICATE)
+				continue;
+			double fitness = calculate_block_fitness(&l->report_data, j);
+			s.block_error[l->first_block + j] = 1.0 / fitness;
+			s.block_importance[l->first_block + j] = get_block_importance(l, j);
+			if (block_needs_refinement(context, fitness))
+				push_refinement_queue(&s, l->first_block + j);
+		}
 	}
-	if (r < 6 && user_data->y_offset > 0) {
-		// Seed with a random already calculated solution from the area above with chance 3/256th
-		int x, y;
-		int i = fgen_random_n(rng, (user_data->y_offset / user_data->texture->block_height) *
-			(user_data->texture->extended_width / user_data->texture->block_width));
-		x = i % (user_data->texture->extended_width / user_data->texture->block_width);
-		y = i / (user_data->texture->extended_width / user_data->texture->block_width);
-		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 4];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 4 + 1];
-		*(unsigned int *)&bitstring[8] = user_data->texture->pixels[compressed_block_index * 4 + 2];
-		*(unsigned int *)&bitstring[12] = user_data->texture->pixels[compressed_block_index * 4 + 3];
-		goto end;
+	if (s.queue_size > 0 && !deadline_passed(context)) {
+		pthread_mutex_init(&s.mutex, NULL);
+		int nu_workers = get_number_of_block_workers(&s, s.queue_size);
+		BlockWorker *workers = start_block_workers(&s, nu_workers, seed_refinement, refinement_worker_thread);
+		finish_block_workers(&s, workers, nu_workers);
+		pthread_mutex_destroy(&s.mutex);
+		if (!context->option_quiet) {
+			int nu_runs = 0;
+			int nu_refined_blocks = 0;
+			for (int i = 0; i < s.nu_blocks; i++) {
+				nu_runs += s.nu_refinements[i];
+				if (s.nu_refinements[i] > 0)
+					nu_refined_blocks++;
+			}
+			printf("Refined %d blocks in %d GA runs within the time budget.\n", nu_refined_blocks, nu_runs);
+		}
 	}
-	fgen_seed_random(pop, bitstring);
-end : ;
-	if (user_data->texture->type == TEXTURE_TYPE_DXT3)
-		optimize_block_dxt3(bitstring, user_data->alpha_pixels);
+	free(s.nu_refinements);
+	free(s.block_importance);
+	free(s.block_error);
+	free(s.queue);
+	free_block_levels(&s);
 }
 
-// Seeding function for archipelagos where each island is compressing a different block (--ultra setting).
+// Compress within the time budget set with --time-budget. First, all blocks are compressed with a single small
+// population and a few generations. The remaining time is then spent on running the GA again, with nu_pops
+// populations for each block, on the blocks with the highest error. The GA is stopped when the time budget runs
+// out, so that a valid texture is available at the deadline.
 
-static void seed2(FgenPopulation *pop, unsigned char *bitstring) {
-	BlockUserData *user_data = (BlockUserData *)pop->user_data;
-	if (user_data->texture->bits_per_block == 128) {
-		seed2_128bit(pop, bitstring);
-		return;
-	}
-	FgenRNG *rng = fgen_get_rng(pop);
-	int r = fgen_random_8(rng);
-	// The chance of seeding with an already calculated neighbour block should be chosen carefully.
-	// A too high probability results in less diversity in the archipelago.
-	if (r < 3 && user_data->y_offset > 0) {
-		// Seed with solution above with chance 3/256th
-		int compressed_block_index = (user_data->y_offset / 4 - 1) * (user_data->texture->extended_width /
-			user_data->texture->block_width) + user_data->x_offset / user_data->texture->block_width;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
-	}
-	if (r < 6 && user_data->y_offset > 0) {
-		// Seed with a random already calculated solution from the area above with chance 3/256th
-		int x, y;
-		int i = fgen_random_n(rng, (user_data->y_offset / user_data->texture->block_height) *
-			(user_data->texture->extended_width / user_data->texture->block_width));
-		x = i % (user_data->texture->extended_width / user_data->texture->block_width);
-		y = i / (user_data->texture->extended_width / user_data->texture->block_width);
-		int compressed_block_index = y * (user_data->texture->extended_width / user_data->texture->block_width) + x;
-		*(unsigned int *)&bitstring[0] = user_data->texture->pixels[compressed_block_index * 2];
-		*(unsigned int *)&bitstring[4] = user_data->texture->pixels[compressed_block_index * 2 + 1];
-		goto end;
-	}
-	fgen_seed_random(pop, bitstring);
-end : ;
-	if (user_data->texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
-		optimize_block_etc2_punchthrough(bitstring, user_data->alpha_pixels);
+static void compress_with_time_budget(CompressContext *context, Image *images, Texture *textures, int nu_levels,
+int nu_pops, int max_generation) {
+	double start_time = get_time();
+	context->deadline = start_time + context->option_time_budget;
+	int saved_population_size = context->population_size;
+	int saved_nu_generations = context->nu_generations;
+	context->population_size = TIME_BUDGET_POPULATION_SIZE;
+	context->nu_generations = TIME_BUDGET_GENERATIONS;
+	compress_with_block_scheduler(context, images, textures, nu_levels, 1, seed2, context->nu_generations, 0);
+	context->population_size = saved_population_size;
+	context->nu_generations = saved_nu_generations;
+	if (!context->option_quiet)
+		printf("First pass completed in %.2lf seconds.\n", get_time() - start_time);
+	refine_with_block_scheduler(context, images, textures, nu_levels, nu_pops, max_generation);
+	context->deadline = 0;
 }
 
-// Set the auxilliary data field for the GA population.
+// Set the number of generations without significant improvement after which the GA for a block is stopped.
 
-static void set_user_data(BlockUserData *user_data, Image *image, Texture *texture) {
-	user_data->flags = ENCODE_BIT;
-	if (texture->type == TEXTURE_TYPE_ETC1)
-		user_data->flags |= ETC_MODE_ALLOWED_ALL;
-	else
-	if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC)
-		user_data->flags |= ETC2_MODE_ALLOWED_ALL;
-	else
-	if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT)
-		user_data->flags |= BPTC_FLOAT_MODE_ALLOWED_ALL;
-	user_data->image_pixels = image->pixels;
-	if (image->is_half_float)
-		user_data->image_rowstride = image->extended_width * 8;
+static void set_convergence_window(CompressContext *context) {
+	if (context->option_convergence_window != - 1)
+		context->convergence_window = context->option_convergence_window;
 	else
-		user_data->image_rowstride = image->extended_width * 4;
-	user_data->texture = texture;
-	user_data->stop_signalled = 0;
+		context->convergence_window = context->nu_generations / 2;
 }
 
-static char *etc2_modestr = "IDTHP";
+// Compress each block with an archipelago of algorithms running on the same block. The best one is chosen.
+// Multiple blocks are compressed concurrently by the block scheduler.
 
-// Report the given GA solution in store its bitstring in the texture, printing information if required.
+static void compress_with_archipelago(CompressContext *context, Image *images, Texture *textures, int nu_levels) {
+	if (context->option_generations != - 1)
+		context->nu_generations = context->option_generations;
+	if (context->option_polish != - 1)
+		context->polish_passes = context->option_polish;
+	set_convergence_window(context);
+	if (context->option_islands != - 1)
+		context->nu_islands = context->option_islands;
+	if (!context->option_quiet)
+		printf("Running GA archipelago of size %d for each pixel block, %d generations.\n", context->nu_islands,
+			context->nu_generations);
+	if (context->option_time_budget > 0)
+		compress_with_time_budget(context, images, textures, nu_levels, context->nu_islands, - 1);
+	else
+		compress_with_block_scheduler(context, images, textures, nu_levels, context->nu_islands, seed, - 1, 1);
+}
 
-static void report_solution(FgenIndividual *best, BlockUserData *user_data) {
-	Texture *texture = user_data->texture;
-	int x_offset = user_data->x_offset;
-	int y_offset = user_data->y_offset;
-	// Calculate the block index of the block.
-	int compressed_block_index = (y_offset / texture->block_height) * (texture->extended_width / texture->block_width)
-		+ x_offset / texture->block_width;
-	if (texture->bits_per_block == 64) {
-		// Copy the 64-bit block.
-		texture->pixels[compressed_block_index * 2] = *(unsigned int *)best->bitstring;
-		texture->pixels[compressed_block_index * 2 + 1] = *(unsigned int *)&best->bitstring[4];
-	}
-	else {
-		// Copy the 128-bit block.
-		texture->pixels[compressed_block_index * 4] = *(unsigned int *)best->bitstring;
-		texture->pixels[compressed_block_index * 4 + 1] = *(unsigned int *)&best->bitstring[4];
-		texture->pixels[compressed_block_index * 4 + 2] = *(unsigned int *)&best->bitstring[8];
-		texture->pixels[compressed_block_index * 4 + 3] = *(unsigned int *)&best->bitstring[12];
-	}
-	if (option_verbose) {
-		printf("Block %d: ", (y_offset / texture->block_height) * (texture->extended_width / texture->block_width)
-			+ (x_offset / texture->block_width));
-		if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC) {
-			int mode = block4x4_etc2_rgb8_get_mode(best->bitstring);
-			printf("Mode: %c ", etc2_modestr[mode]);
-			mode_statistics[mode]++;
-		}
-		else
-		if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) {
-			int mode = block4x4_bptc_float_get_mode(best->bitstring);
-			printf("Mode: %d ", mode);
-			mode_statistics[mode]++;
-		}
-		printf("Combined: ");
-		printf("RMSE per pixel: %lf\n", sqrt((1.0 / best->fitness) / 16));
-	}
-	if (option_progress) {
-		int n = (texture->extended_width / texture->block_width) * (texture->extended_height / texture->block_height);
-		int old_percentage = (compressed_block_index - 1) * 100 / n;
-		int new_percentage = compressed_block_index * 100 / n;
-		if (new_percentage == 99 && old_percentage == 98)
-			printf("99%%\n");
-		else
-		if (new_percentage != old_percentage)
-			printf("%d%% ", new_percentage);
-		fflush(stdout);
-	}
-	compress_callback_func(user_data);
-}
-
-// Compress each block with a single GA population. Unused.
-
-static void compress_with_single_population(Image *image, Texture *texture) {
-	if (!option_quiet)
-		printf("Running single GA for each pixel block.\n");
-	FgenPopulation *pop = fgen_create(
-		population_size,		// Population size.
-		texture->bits_per_block,	// Number of bits.
-		1,				// Data element size.
-		generation_callback,
-		calculate_fitness,
-		fgen_seed_random,
-		fgen_mutation_per_bit_fast,
-		fgen_crossover_uniform_per_bit
-		);
-	fgen_set_parameters(
-		pop,
-		FGEN_ELITIST_SUS,
-		FGEN_SUBTRACT_MIN_FITNESS,
-		crossover_probability,	// Crossover prob.
-		mutation_probability,	// Mutation prob. per bit
-		0		// Macro-mutation prob.
-		);
-	fgen_set_generation_callback_interval(pop, nu_generations);
-	if (!option_deterministic)
-		fgen_random_seed_with_timer(fgen_get_rng(pop));
-//	fgen_random_seed_rng(fgen_get_rng(pop), 0);
-	pop->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
-	set_user_data((BlockUserData *)pop->user_data, image, texture);
-	for (int y = 0; y < image->extended_height; y += texture->block_height)
-		for (int x = 0; x < image->extended_width; x+= texture->block_width) {
-			BlockUserData *user_data = (BlockUserData *)pop->user_data;
-			user_data->x_offset = x;
-			user_data->y_offset = y;
-			// Threading a single population doesn't work well in this case because the of the relatively quick
-			// fitness function, which causes too much overhead caused by threading.
-//			if (use_threading)
-//				fgen_run_threaded(pop, nu_generations);
-//			else
-				fgen_run(pop, nu_generations);
-			report_solution(fgen_best_individual_of_population(pop), user_data);
-			if (user_data->stop_signalled)
-				goto end;
-		}
-end :
-	free(pop->user_data);
-	fgen_destroy(pop);
+// Compress multiple blocks concurrently, with a single population for each block. Used by --ultra setting. Note
+// that larger population size used in this case.
+
+static void compress_multiple_blocks_concurrently(CompressContext *context, Image *images, Texture *textures,
+int nu_levels) {
+	if (context->option_generations != - 1)
+		context->nu_generations = context->option_generations;
+	if (context->option_polish != - 1)
+		context->polish_passes = context->option_polish;
+	set_convergence_window(context);
+	if (!context->option_quiet)
+		printf("Running single GA for each pixel block, generations = %d.\n", context->nu_generations);
+	if (context->option_time_budget > 0)
+		compress_with_time_budget(context, images, textures, nu_levels, 1, context->nu_generations);
+	else
+		compress_with_block_scheduler(context, images, textures, nu_levels, 1, seed2, context->nu_generations, 0);
 }
 
-// Compress each block with an archipelago of algorithms running on the same block. The best one is chosen.
+// Encode all blocks of the textures of nu_levels images without the GA, for the instant speed setting. Blocks with
+// one or two colors are encoded directly, other blocks get the best analytic encoding (principal axis or bounding
+// box endpoints for DXTn and RGTC, the best modifier tables for ETC1/ETC2, mode 6 for BPTC), refined by a short
+// local search. Like compress_exhaustively(), the block scheduler distributes the blocks over the worker threads
+// and takes care of duplicate blocks and checkpoints; the populations of the workers are not run.
 
-static void compress_with_archipelago(Image *image, Texture *texture) {
-	unsigned char *alpha_pixels = (unsigned char *)alloca(texture->block_width * texture->block_height);
-	if (option_generations != - 1)
-		nu_generations = option_generations;
-	if (option_islands != - 1)
-		nu_islands = option_islands;
-	FgenPopulation **pops = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_islands);
-	if (!option_quiet)
-		printf("Running GA archipelago of size %d for each pixel block, %d generations.\n", nu_islands,
-			nu_generations);
-	for (int i = 0; i < nu_islands; i++) {
-		pops[i] = fgen_create(
-			population_size,		// Population size.
-			texture->bits_per_block,	// Number of bits.
-			1,				// Data element size.
-			generation_callback,
-			calculate_fitness,
-			seed,
-			fgen_mutation_per_bit_fast,
-			fgen_crossover_uniform_per_bit
-			);
-		fgen_set_parameters(
-			pops[i],
-			FGEN_ELITIST_SUS,
-			FGEN_SUBTRACT_MIN_FITNESS,
-			crossover_probability,	// Crossover prob.
-			mutation_probability,	// Mutation prob. per bit
-			0		// Macro-mutation prob.
-			);
-		fgen_set_generation_callback_interval(pops[i], nu_generations);
-		fgen_set_migration_interval(pops[i], 0);	// No migration.
-		fgen_set_migration_probability(pops[i], 0.01);
-		pops[i]->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
-		set_user_data((BlockUserData *)pops[i]->user_data, image, texture);
-		if (texture->type == TEXTURE_TYPE_ETC2_RGB8) {
-			if (option_allowed_modes_etc2 !=  - 1)
-				((BlockUserData *)pops[i]->user_data)->flags = option_allowed_modes_etc2 |
-					ENCODE_BIT;
-			else
-			if (option_modal_etc2 && nu_islands >= 8) {
-				switch (i & 7) {
-				case 0 :
-				case 1 :
-				case 2 :
-					((BlockUserData *)pops[i]->user_data)->flags =
-						ETC_MODE_ALLOWED_INDIVIDUAL | ENCODE_BIT;
-					break;
-				case 3 :
-				case 4 :
-					((BlockUserData *)pops[i]->user_data)->flags =
-						ETC_MODE_ALLOWED_DIFFERENTIAL | ENCODE_BIT;
-					break;
-				case 5 :
-					((BlockUserData *)pops[i]->user_data)->flags =
-						ETC2_MODE_ALLOWED_T | ENCODE_BIT;
-					break;
-				case 6 :
-					((BlockUserData *)pops[i]->user_data)->flags =
-						ETC2_MODE_ALLOWED_H | ENCODE_BIT;
-					break;
-				case 7 :
-					((BlockUserData *)pops[i]->user_data)->flags =
-						ETC2_MODE_ALLOWED_PLANAR | ENCODE_BIT;
-					break;
-				}
-			}
-		}
-		if (texture->type == TEXTURE_TYPE_BPTC_FLOAT || texture->type == TEXTURE_TYPE_BPTC_SIGNED_FLOAT) {
-			if (/* option_modal_etc2 && */ nu_islands >= 8) {
-				switch (i & 7) {
-				case 0 :
-				case 1 :	// Mode 0 (very common).
-					((BlockUserData *)pops[i]->user_data)->flags = 0x1 | ENCODE_BIT;
-					break;
-				case 2 :	// Modes 5 (common) and 9.
-					((BlockUserData *)pops[i]->user_data)->flags = (1 << 5) | (1 << 9) | ENCODE_BIT;
-					break;
-				case 3 :	// Modes 2 and 6 (common).
-					((BlockUserData *)pops[i]->user_data)->flags = (1 << 2) | (1 << 6) | ENCODE_BIT;
-					break;
-				case 4 : 	// Modes 3 and 7 (common).
-					((BlockUserData *)pops[i]->user_data)->flags = (1 << 3) | (1 << 7) | ENCODE_BIT;
-					break;
-				case 5 :	// Modes 1, 4, 8 (common).
-					((BlockUserData *)pops[i]->user_data)->flags = (1 << 1) | (1 << 4) | (1 << 8)
-						| ENCODE_BIT;
-					break;
-				case 6 :	// Mode 11.
-					((BlockUserData *)pops[i]->user_data)->flags = (1 << 11) | ENCODE_BIT;
-					break;
-				case 7 :	// Modes 10, 11, 12, 13.
-					((BlockUserData *)pops[i]->user_data)->flags = (0xF << 10) | ENCODE_BIT;
-					break;
-				}
-			}
-			else
-			if (/* option_modal_etc2 && */ nu_islands >= 4) {
-				switch (i & 3) {
-				case 0 :	// Mode 0.
-					((BlockUserData *)pops[i]->user_data)->flags = 0x1 | ENCODE_BIT;
-					break;
-				case 1 :	// Modes 2, 4, 6 (common), 8 (common), 9.
-					((BlockUserData *)pops[i]->user_data)->flags = (1 << 2) | (1 << 4) |
-						(1 << 6) | (1 << 8) | (1 << 9) | ENCODE_BIT;
-					break;
-				case 2 :	// Modes 1, 3, 5 (common), 7 (common).
-					((BlockUserData *)pops[i]->user_data)->flags = (1 << 1) | (1 << 3) |
-						(1 << 5) | (1 << 7) | ENCODE_BIT;
-					break;
-				case 3 :	// Modes 10, 11, 12, 13.
-					((BlockUserData *)pops[i]->user_data)->flags = (0xF << 10) | ENCODE_BIT;
-					break;
-				}
-			}
-		} 
-	}
-	if (!option_deterministic)
-		fgen_random_seed_with_timer(fgen_get_rng(pops[0]));
-//	fgen_random_seed_rng(fgen_get_rng(pops[0]), 0);
+static void compress_analytically(CompressContext *context, Image *images, Texture *textures, int nu_levels) {
+	context->population_size = 256;
+	context->nu_generations = 100;
+	context->polish_passes = 1;
+	if (context->option_polish != - 1)
+		context->polish_passes = context->option_polish;
+	set_convergence_window(context);
+	if (!context->option_quiet)
+		printf("Encoding blocks without the GA, local search passes = %d.\n", context->polish_passes);
+	compress_with_block_scheduler(context, images, textures, nu_levels, 1, seed2, context->nu_generations, 0);
+}
 
-	for (int y = 0; y < image->extended_height; y += texture->block_height)
-		for (int x = 0; x < image->extended_width; x+= texture->block_width) {
-			// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
-			// seeding function.
-			if (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH)
-				set_alpha_pixels(image, x, y, texture->block_width, texture->block_height, alpha_pixels);
-			// Set up the auxilliary information for each population.
-			for (int i = 0; i < nu_islands; i++) {
-				BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-				user_data->x_offset = x;
-				user_data->y_offset = y;
-				user_data->alpha_pixels = alpha_pixels;
-			}
-			// Run the genetic algorithm.
-			if (option_max_threads != -1 && option_max_threads < nu_islands)
-				fgen_run_archipelago(nu_islands, pops, - 1);
-			else
-				fgen_run_archipelago_threaded(nu_islands, pops, - 1);
-			if (option_verbose == 2)
-				for (int i = 0; i < nu_islands; i++) {
-					printf("Block %d: ", (y / texture->block_height) * (texture->extended_width /
-						texture->block_width) + (x / texture->block_width));
-					if (texture->type & TEXTURE_TYPE_ETC_BIT) {
-						printf("Modes: ");
-						int modes_allowed = ((BlockUserData *)pops[i]->user_data)->flags;
-						if (modes_allowed & ETC_MODE_ALLOWED_INDIVIDUAL)
-							printf("I");
-						if (modes_allowed & ETC_MODE_ALLOWED_DIFFERENTIAL)
-						printf("D");
-						if (modes_allowed & ETC2_MODE_ALLOWED_T)
-							printf("T");
-						if (modes_allowed & ETC2_MODE_ALLOWED_H)
-							printf("H");
-						if (modes_allowed & ETC2_MODE_ALLOWED_PLANAR)
-							printf("P");
-					}
-					FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-					double rmse = sqrt((1.0 / best->fitness) / 16);
-					printf(" RMSE per pixel: %lf\n", rmse);
-					if (rmse >= 1.0) {
-						for (int j = 0; j < pops[i]->size; j++) {
-							FgenIndividual *ind = pops[i]->ind[j];
-							printf("  Individual %d: RMSE per pixel: %lf\n", j,
-								sqrt((1.0 / ind->fitness) / 16));
-						}
-					}
-				}
-			// Report the best solution.
-			FgenIndividual *best = fgen_best_individual_of_archipelago(nu_islands, pops);
-			report_solution(best, (BlockUserData *)pops[0]->user_data);
-			if (((BlockUserData *)pops[0]->user_data)->stop_signalled)
-				goto end;
-		}
-end :
-	for (int i = 0; i < nu_islands; i++) {
-		free(pops[i]->user_data);
-		fgen_destroy(pops[i]);
-	}
-}
-
-// Compress multiple blocks concurrently. Used by --ultra setting. Note that larger population size used in this case.
-
-static void compress_multiple_blocks_concurrently(Image *image, Texture *texture) {
-	unsigned char *alpha_pixels = (unsigned char *)alloca(texture->block_width * texture->block_height * nu_islands);
-	if (option_generations != - 1)
-		nu_generations = option_generations;
-	if (option_islands != - 1)
-		nu_islands = option_islands;
-	FgenPopulation **pops = (FgenPopulation **)alloca(sizeof(FgenPopulation *) * nu_islands);
-	if (!option_quiet)
-		printf("Running single GA for each pixel block, %d concurrently, generations = %d.\n",
-			nu_islands, nu_generations);
-	for (int i = 0; i < nu_islands; i++) {
-		pops[i] = fgen_create(
-			population_size,		// Population size.
-			texture->bits_per_block,	// Number of bits.
-			1,				// Data element size.
-			generation_callback,
-			calculate_fitness,
-			seed2,
-			fgen_mutation_per_bit_fast,
-			fgen_crossover_uniform_per_bit
-			);
-		fgen_set_parameters(
-			pops[i],
-			FGEN_ELITIST_SUS,
-			FGEN_SUBTRACT_MIN_FITNESS,
-			crossover_probability,	// Crossover prob.
-			mutation_probability,	// Mutation prob. per bit
-			0		// Macro-mutation prob.
-			);
-		fgen_set_generation_callback_interval(pops[i], nu_generations);
-		fgen_set_migration_interval(pops[i], 0);	// No migration.
-		fgen_set_migration_probability(pops[i], 0.01);
-		pops[i]->user_data = (BlockUserData *)malloc(sizeof(BlockUserData));
-		set_user_data((BlockUserData *)pops[i]->user_data, image, texture);
-		if (texture->type == TEXTURE_TYPE_ETC2_RGB8 || texture->type == TEXTURE_TYPE_ETC2_EAC)
-			if (option_allowed_modes_etc2 != - 1)
-				((BlockUserData *)pops[i]->user_data)->flags =
-					option_allowed_modes_etc2 | ENCODE_BIT;
-	}
-	if (!option_deterministic)
-		fgen_random_seed_with_timer(fgen_get_rng(pops[0]));
-	// Calculate the number of full archipelagos of nu_islands that fit on each each row.
-	int nu_full_archipelagos_per_row = image->extended_width / (nu_islands * texture->block_width);
-	int x_marker = nu_full_archipelagos_per_row * nu_islands * texture->block_width;
-	for (int y = 0; y < image->extended_height; y += texture->block_height) {
-		// Handle nu_islands horizontal blocks at a time.
-		for (int x = 0; x < x_marker; x+= nu_islands * texture->block_width) {
-			for (int i = 0; i < nu_islands; i++) {
-				BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-				user_data->x_offset = x + i * texture->block_width;
-				user_data->y_offset = y;
-				// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
-				// seeding function.
-				if (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH) {
-					set_alpha_pixels(image, x + i * texture->block_width, y, texture->block_width,
-						texture->block_height, &alpha_pixels[i * 16]);
-					user_data->alpha_pixels = &alpha_pixels[i * 16];
-				}
-			}
-			// Run with a seperate population on each island for different blocks.
-			fgen_run_archipelago_threaded(nu_islands, pops, nu_generations);
-			for (int i = 0; i < nu_islands; i++) {
-				FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-				report_solution(best, (BlockUserData *)pops[i]->user_data);
-				if (((BlockUserData *)pops[i]->user_data)->stop_signalled)
-					goto end;
-			}
-		}
-		// Handle the remaining blocks on the row.
-		int nu_blocks_left = (image->extended_width - x_marker + texture->block_width - 1) / texture->block_width;
-		int x = x_marker;
-		for (int i = 0; i < nu_blocks_left; i++) {
-			BlockUserData *user_data = (BlockUserData *)pops[i]->user_data;
-			user_data->x_offset = x + i * texture->block_width;
-			user_data->y_offset = y;
-			// For 1-bit alpha texture, prepare the alpha values of the image block for use in the
-			// seeding function.
-			if (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_ETC2_PUNCHTHROUGH) {
-				set_alpha_pixels(image, x + i * texture->block_width, y, texture->block_width,
-					texture->block_height, &alpha_pixels[i * texture->block_width *
-					texture->block_height]);
-				user_data->alpha_pixels = &alpha_pixels[i * texture->block_width * texture->block_height];
-			}
-		}
-		if (nu_blocks_left > 0) {
-			if (nu_blocks_left > 1)
-				fgen_run_archipelago_threaded(nu_blocks_left, pops, - 1);
-			else
-				fgen_run(pops[0], - 1);
-		}
-		for (int i = 0; i < nu_blocks_left; i++) {
-			FgenIndividual *best = fgen_best_individual_of_population(pops[i]);
-			report_solution(best, (BlockUserData *)pops[i]->user_data);
-			if (((BlockUserData *)pops[i]->user_data)->stop_signalled)
-				goto end;
-		}
-	}
-end :
-	for (int i = 0; i < nu_islands; i++) {
-		free(pops[i]->user_data);
-		fgen_destroy(pops[i]);
-	}
+// Encode all blocks of the textures of nu_levels images with the exhaustive encoder of the format, for the
+// exhaustive speed setting or when the exhaustive encoder is optimal. The block scheduler distributes the blocks
+// over the worker threads and takes care of duplicate blocks and checkpoints; the populations of the workers are
+// created as for --ultra but are not run.
+
+static void compress_exhaustively(CompressContext *context, Image *images, Texture *textures, int nu_levels) {
+	context->population_size = 256;
+	context->nu_generations = 100;
+	context->polish_passes = 0;
+	set_convergence_window(context);
+	if (!context->option_quiet)
+		printf("Encoding blocks by exhaustive search without the GA.\n");
+	compress_with_block_scheduler(context, images, textures, nu_levels, 1, seed2, context->nu_generations, 0);
 }
 
 // Copy the alpha pixel values of a block into an array.
@@ -941,15 +2375,36 @@ static void optimize_alpha(Image *image, Texture *texture) {
 		}
 }
 
+// Calculate a 64-bit FNV-1a hash of the image dimensions and pixel data. Different mipmap levels have different
+// dimensions and therefore different hashes.
+
+uint64_t calculate_image_hash(Image *image) {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	size_t size = (size_t)image->extended_height * image->extended_width * (image->is_half_float ? 8 : 4);
+	unsigned char *data = (unsigned char *)image->pixels;
+	int dimensions[2] = { image->width, image->height };
+	for (int i = 0; i < (int)sizeof(dimensions); i++) {
+		h ^= ((unsigned char *)dimensions)[i];
+		h *= 0x100000001B3ULL;
+	}
+	for (size_t i = 0; i < size; i++) {
+		h ^= data[i];
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
 // Calculate the RMSE threshold for adaptive block optimization.
 
-static double get_rmse_threshold(Texture *texture, int speed, Image *source_image) {
+static double get_rmse_threshold(Texture *texture, int speed, int hdr, Image *source_image) {
+	// Speeds without a GA threshold of their own (--instant and --exhaustive) use the one of --ultra.
 	double threshold;
 	if (!(texture->type & TEXTURE_TYPE_128BIT_BIT)) {
 		// 64-bit texture formats.
 		if (texture->type & TEXTURE_TYPE_ETC_BIT)
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 13.0;
 				break;
 			case SPEED_FAST :
@@ -967,6 +2422,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 			// R11_EAC and SIGNED_RGTC1
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 1100;
 				break;
 			case SPEED_FAST :
@@ -984,6 +2440,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 			// RGTC1, one 8-bit component.
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 6.0;
 				break;
 			case SPEED_FAST :
@@ -999,6 +2456,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 		else	// DXT1/DXT1A
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 11.5;
 				break;
 			case SPEED_FAST :
@@ -1017,6 +2475,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 		if (texture->type == TEXTURE_TYPE_BPTC)
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 10.5;
 				break;
 			case SPEED_FAST :
@@ -1031,9 +2490,10 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 			}
 		else
 		if (texture->type & TEXTURE_TYPE_HALF_FLOAT_BIT)
-			if (option_hdr)
+			if (hdr)
 				switch (speed) {
 				case SPEED_ULTRA :
+				default :
 					threshold = 0.35;
 					break;
 				case SPEED_FAST :
@@ -1049,6 +2509,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 			else
 				switch (speed) {
 				case SPEED_ULTRA :
+				default :
 					threshold = 0.060;
 					break;
 				case SPEED_FAST :
@@ -1066,6 +2527,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 			// RG11_EAC, SIGNED_RGTC2
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 2000;
 				break;
 			case SPEED_FAST :
@@ -1083,6 +2545,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 			// RGTC2, two 16-bit components.
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 13.0;
 				break;
 			case SPEED_FAST :
@@ -1098,6 +2561,7 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 		else	// 128-bit alpha formats ETC2_EAC, DXT3, DXT5
 			switch (speed) {
 			case SPEED_ULTRA :
+			default :
 				threshold = 11.5;
 				break;
 			case SPEED_FAST :
@@ -1121,3 +2585,145 @@ static double get_rmse_threshold(Texture *texture, int speed, Image *source_imag
 	return threshold;
 }
 
+
+// Return the range of the pixel component values of an image, as used for the PSNR.
+
+static double get_component_range(Image *image) {
+	if (image->is_half_float)
+		return 1.0;
+	if (image->bits_per_component == 16)
+		return 65535.0;
+	return 255.0;
+}
+
+// Return the number of components compared between the source image and the texture.
+
+static int get_compared_components(Texture *texture, Image *image) {
+	if (image->nu_components < texture->info->nu_components)
+		return image->nu_components;
+	return texture->info->nu_components;
+}
+
+// Return the RMSE per pixel of the quality target set with --target-rmse or --target-psnr, or zero when there is
+// no target. The PSNR is calculated like compare_images does.
+
+static double get_target_rmse(CompressContext *context, Texture *texture, Image *image) {
+	if (context->option_target_rmse > 0)
+		return context->option_target_rmse;
+	if (context->option_target_psnr > 0) {
+		double range = get_component_range(image);
+		return sqrt(get_compared_components(texture, image) * range * range /
+			pow(10.0, context->option_target_psnr / 10.0));
+	}
+	return 0;
+}
+
+// Return the fitness that a block must reach to meet the quality target, or zero when there is no target. The
+// fitness is the inverse of the sum of the squared error of the 16 pixels.
+
+static double get_target_fitness(CompressContext *context, Texture *texture, Image *image) {
+	double target_rmse = get_target_rmse(context, texture, image);
+	if (target_rmse == 0)
+		return 0;
+	return 1.0 / (target_rmse * target_rmse * 16);
+}
+
+// Print the achieved error of each compressed level against the quality target, and the number of blocks that
+// missed it.
+
+static void report_target_quality(CompressContext *context, Image *images, Texture *textures, int nu_levels) {
+	double target_rmse = get_target_rmse(context, &textures[0], &images[0]);
+	printf("Quality target: RMSE per pixel %lf", target_rmse);
+	if (context->option_target_psnr > 0 && context->option_target_rmse <= 0)
+		printf(" (PSNR %.2lf)", context->option_target_psnr);
+	printf("\n");
+	for (int i = 0; i < nu_levels; i++) {
+		Texture *texture = &textures[i];
+		BlockUserData user_data;
+		set_user_data(&user_data, context, &images[i], texture);
+		int nu_blocks = (texture->extended_width / texture->block_width) *
+			(texture->extended_height / texture->block_height);
+		double error = 0;
+		int nu_missed = 0;
+		for (int j = 0; j < nu_blocks; j++) {
+			double fitness = calculate_block_fitness(&user_data, j);
+			error += 1.0 / fitness;
+			if (fitness < context->target_fitness)
+				nu_missed++;
+		}
+		int n = images[i].width * images[i].height;
+		double range = get_component_range(&images[i]);
+		double psnr = 10.0 * log10(range * range / (error / (get_compared_components(texture, &images[i]) * n)));
+		printf("Level %d: RMSE per pixel %lf, PSNR %.2lf, target %s, %d of %d blocks above the target error.\n", i,
+			sqrt(error / n), psnr, sqrt(error / n) <= target_rmse ? "met" : "missed", nu_missed, nu_blocks);
+	}
+}
+
+// Allocate the statistics of the blocks of the textures of nu_levels images. Blocks that are not compressed (or
+// copied from a duplicate) are the blocks restored from a checkpoint.
+
+static BlockStatistics *create_block_statistics(Texture *textures, int nu_levels) {
+	int nu_blocks = 0;
+	for (int i = 0; i < nu_levels; i++)
+		nu_blocks += (textures[i].extended_width / textures[i].block_width) *
+			(textures[i].extended_height / textures[i].block_height);
+	BlockStatistics *stats = (BlockStatistics *)calloc(nu_blocks, sizeof(BlockStatistics));
+	for (int i = 0; i < nu_blocks; i++) {
+		stats[i].method = BLOCK_METHOD_RESTORED;
+		stats[i].mode = - 1;
+		stats[i].partition = - 1;
+		stats[i].island = - 1;
+	}
+	return stats;
+}
+
+// Determine the mode and the partition of a compressed block, when the format has them. For ETC1 and ETC2, the
+// partition is the orientation of the sub-blocks (the flip bit) of the individual and differential modes.
+
+static void get_block_mode(Texture *texture, const unsigned char *bitstring, int *mode, int *partition) {
+	*mode = - 1;
+	*partition = - 1;
+	switch (texture->type) {
+	case TEXTURE_TYPE_ETC2_EAC :
+	case TEXTURE_TYPE_ETC2_SRGB_EAC :
+		// The color part follows the alpha part.
+		bitstring += 8;
+		// Fall through.
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+		*mode = block4x4_etc2_rgb8_get_mode(bitstring);
+		if (*mode <= 1)
+			*partition = bitstring[3] & 1;
+		break;
+	case TEXTURE_TYPE_BPTC :
+		*mode = block4x4_bptc_get_mode(bitstring);
+		*partition = block4x4_bptc_get_partition(bitstring);
+		break;
+	case TEXTURE_TYPE_BPTC_FLOAT :
+	case TEXTURE_TYPE_BPTC_SIGNED_FLOAT :
+		*mode = block4x4_bptc_float_get_mode(bitstring);
+		*partition = block4x4_bptc_float_get_partition(bitstring);
+		break;
+	}
+}
+
+// Complete the statistics of the blocks of all levels with the error, the mode and the partition of the final
+// compressed blocks.
+
+static void finish_block_statistics(CompressContext *context, Image *images, Texture *textures, int nu_levels) {
+	BlockStatistics *stats = context->block_statistics;
+	for (int i = 0; i < nu_levels; i++) {
+		Texture *texture = &textures[i];
+		BlockUserData user_data;
+		set_user_data(&user_data, context, &images[i], texture);
+		int nu_blocks = (texture->extended_width / texture->block_width) *
+			(texture->extended_height / texture->block_height);
+		for (int j = 0; j < nu_blocks; j++) {
+			double fitness = calculate_block_fitness(&user_data, j);
+			stats[j].rmse = sqrt((1.0 / fitness) / 16);
+			get_block_mode(texture, get_compressed_block(texture, j), &stats[j].mode, &stats[j].partition);
+		}
+		stats += nu_blocks;
+	}
+}
@@ -32,6 +32,12 @@
 #define ETC_MODE_ALLOWED_ALL		3
 #define ETC2_MODE_ALLOWED_ALL		31
 #define BPTC_FLOAT_MODE_ALLOWED_ALL	0x3FFF
+// BPTC flags, only checked when encoding: allowed modes (bit 0 to 7) and, when partitions are restricted, the only
+// allowed partition of the modes with two and with three subsets.
+#define BPTC_MODE_ALLOWED_ALL		0xFF
+#define BPTC_PARTITION_RESTRICTED	0x100
+#define BPTC_PARTITION2_SHIFT		9
+#define BPTC_PARTITION3_SHIFT		17
 #define ENCODE_BIT			0x10000
 
 // Functions defined in etc2.c.
@@ -49,6 +55,9 @@ int draw_block4x4_signed_rg11_eac(const unsigned char *bitstring, unsigned int *
 int block4x4_etc2_rgb8_get_mode(const unsigned char *bitstring);
 // "Manual" optimization function.
 void optimize_block_etc2_punchthrough(unsigned char *bitstring, unsigned char *alpha_values);
+// Modifier tables of the ETC1/ETC2 and EAC formats.
+extern int etc_modifier_table[8][4];
+extern char eac_modifier_table[16][8];
 
 // Functions defined in dxtc.c.
 
@@ -63,7 +72,7 @@ void optimize_block_dxt3(unsigned char *bitstring, unsigned char *alpha_values);
 int draw_block_rgba_astc(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 void convert_astc_texture_to_image(Texture *texture, Image *image);
 void decompress_astc_file(const char *filename, Image *image);
-void compress_image_to_astc_texture(Image *image, int texture_type, Texture *exture);
+void compress_image_to_astc_texture(Image *image, int texture_type, int speed, Texture *exture);
 int match_astc_block_size(int w, int h);
 int get_astc_block_size_width(int astc_block_type);
 int get_astc_block_size_height(int astc_block_type);
@@ -74,6 +83,20 @@ int draw_block4x4_bptc(const unsigned char *bitstring, unsigned int *image_buffe
 int draw_block4x4_bptc_float(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 int draw_block4x4_bptc_signed_float(const unsigned char *bitstring, unsigned int *image_buffer, int flags);
 int block4x4_bptc_float_get_mode(const unsigned char *bitstring);
+// Return the mode of a BPTC block (0 to 7), or - 1 for an invalid block.
+int block4x4_bptc_get_mode(const unsigned char *bitstring);
+// Return the partition set of a BPTC or BPTC float block, or - 1 when the mode has a single subset.
+int block4x4_bptc_get_partition(const unsigned char *bitstring);
+int block4x4_bptc_float_get_partition(const unsigned char *bitstring);
+// Return the anchor pixels (one bit each) of a BPTC partition set, whose indices have an implicit zero high bit.
+int block4x4_bptc_get_anchor_pixels(int nu_subsets, int partition_set_id);
+// Set the mode of a BPTC block, and its partition when the flags restrict it. The other bits are not changed.
+void set_block4x4_bptc_mode(unsigned char *bitstring, int mode, int flags);
+// Subset of each pixel for the 64 partitions with two and with three subsets.
+extern char table_P2[64 * 16];
+extern char table_P3[64 * 16];
+// Interpolation weights for 4-bit indices.
+extern uint16_t aWeight4[16];
 
 // Functions defined in rgtc.c
 
@@ -0,0 +1,2744 @@
+/*
+    encode.c -- part of texgenpack, a texture compressor using fgen.
+
+    texgenpack -- a genetic algorithm texture compressor.
+    Copyright 2013 Harm Hanemaaijer
+
+    This file is part of texgenpack.
+
+    texgenpack is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    texgenpack is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with texgenpack.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Analytic (non-GA) encoding functions. These are used to calculate good candidate encodings that are injected
+// into the initial population of the genetic algorithm.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include "texgenpack.h"
+#include "decode.h"
+#include "packing.h"
+
+// Per-pixel error metrics, corresponding to the block comparison functions in compare.c.
+
+#define METRIC_NONE				0
+#define METRIC_RGB				1
+#define METRIC_RGBA				2
+#define METRIC_8_BIT_COMPONENTS			3
+#define METRIC_SIGNED_8_BIT_COMPONENTS		4
+#define METRIC_8_BIT_COMPONENTS_WITH_16_BIT	5
+#define METRIC_SIGNED_8_BIT_COMPONENTS_WITH_16_BIT 6
+#define METRIC_R16				7
+#define METRIC_RG16				8
+#define METRIC_R16_SIGNED			9
+#define METRIC_RG16_SIGNED			10
+
+static int get_pixel_metric(Texture *texture) {
+	TextureComparisonFunction f = texture->comparison_function;
+	if (f == compare_block_4x4_rgb)
+		return METRIC_RGB;
+	if (f == compare_block_4x4_rgba)
+		return METRIC_RGBA;
+	if (f == compare_block_4x4_8_bit_components)
+		return METRIC_8_BIT_COMPONENTS;
+	if (f == compare_block_4x4_signed_8_bit_components)
+		return METRIC_SIGNED_8_BIT_COMPONENTS;
+	if (f == compare_block_4x4_8_bit_components_with_16_bit)
+		return METRIC_8_BIT_COMPONENTS_WITH_16_BIT;
+	if (f == compare_block_4x4_signed_8_bit_components_with_16_bit)
+		return METRIC_SIGNED_8_BIT_COMPONENTS_WITH_16_BIT;
+	if (f == compare_block_4x4_r16)
+		return METRIC_R16;
+	if (f == compare_block_4x4_rg16)
+		return METRIC_RG16;
+	if (f == compare_block_4x4_r16_signed)
+		return METRIC_R16_SIGNED;
+	if (f == compare_block_4x4_rg16_signed)
+		return METRIC_RG16_SIGNED;
+	return METRIC_NONE;
+}
+
+// Calculate the error between a decoded pixel and a source image pixel.
+
+static double get_pixel_error(int metric, int nu_components, unsigned int pixel1, unsigned int pixel2) {
+	int64_t d;
+	int64_t error = 0;
+	switch (metric) {
+	case METRIC_RGBA :
+		{
+		int a1 = pixel_get_a(pixel1);
+		int a2 = pixel_get_a(pixel2);
+		// When both alpha values are zero, the RGB values don't matter.
+		if ((a1 | a2) == 0)
+			return 0;
+		error = (a1 - a2) * (a1 - a2);
+		}
+		// Fall through.
+	case METRIC_RGB :
+		d = pixel_get_r(pixel1) - pixel_get_r(pixel2);
+		error += d * d;
+		d = pixel_get_g(pixel1) - pixel_get_g(pixel2);
+		error += d * d;
+		d = pixel_get_b(pixel1) - pixel_get_b(pixel2);
+		error += d * d;
+		break;
+	case METRIC_8_BIT_COMPONENTS :
+		d = pixel_get_r(pixel1) - pixel_get_r(pixel2);
+		error = d * d;
+		if (nu_components >= 2) {
+			d = pixel_get_g(pixel1) - pixel_get_g(pixel2);
+			error += d * d;
+		}
+		if (nu_components >= 3) {
+			d = pixel_get_b(pixel1) - pixel_get_b(pixel2);
+			error += d * d;
+		}
+		if (nu_components >= 4) {
+			d = pixel_get_a(pixel1) - pixel_get_a(pixel2);
+			error += d * d;
+		}
+		break;
+	case METRIC_SIGNED_8_BIT_COMPONENTS :
+		d = pixel_get_signed_r8(pixel1) - pixel_get_signed_r8(pixel2);
+		error = d * d;
+		if (nu_components >= 2) {
+			d = pixel_get_signed_g8(pixel1) - pixel_get_signed_g8(pixel2);
+			error += d * d;
+		}
+		break;
+	case METRIC_8_BIT_COMPONENTS_WITH_16_BIT :
+		d = pixel_get_r(pixel1) * 65535 / 255 - (int)pixel_get_r16(pixel2);
+		error = d * d;
+		if (nu_components >= 2) {
+			d = pixel_get_g(pixel1) * 65535 / 255 - (int)pixel_get_g16(pixel2);
+			error += d * d;
+		}
+		break;
+	case METRIC_SIGNED_8_BIT_COMPONENTS_WITH_16_BIT :
+		d = (pixel_get_signed_r8(pixel1) + 128) * 65535 / 255 - 32768 - pixel_get_signed_r16(pixel2);
+		error = d * d;
+		if (nu_components >= 2) {
+			d = (pixel_get_signed_g8(pixel1) + 128) * 65535 / 255 - 32768 - pixel_get_signed_g16(pixel2);
+			error += d * d;
+		}
+		break;
+	case METRIC_RG16 :
+		d = (int64_t)pixel_get_g16(pixel1) - pixel_get_g16(pixel2);
+		error = d * d;
+		// Fall through.
+	case METRIC_R16 :
+		d = (int64_t)pixel_get_r16(pixel1) - pixel_get_r16(pixel2);
+		error += d * d;
+		break;
+	case METRIC_RG16_SIGNED :
+		d = pixel_get_signed_g16(pixel1) - pixel_get_signed_g16(pixel2);
+		error = d * d;
+		// Fall through.
+	case METRIC_R16_SIGNED :
+		d = pixel_get_signed_r16(pixel1) - pixel_get_signed_r16(pixel2);
+		error += d * d;
+		break;
+	}
+	return (double)error;
+}
+
+// Calculate the error of each pixel of a decoded 4x4 block compared to the source image, using the same metric as
+// the comparison function of the texture. Pixels that fall outside the image have zero error. Returns 0 if the
+// comparison function of the texture is not supported.
+
+int calculate_block_pixel_errors(unsigned int *image_buffer, BlockUserData *user_data, double *pixel_error) {
+	Texture *texture = user_data->texture;
+	int metric = get_pixel_metric(texture);
+	if (metric == METRIC_NONE)
+		return 0;
+	int w = texture->width - user_data->x_offset;
+	if (w > 4)
+		w = 4;
+	int h = texture->height - user_data->y_offset;
+	if (h > 4)
+		h = 4;
+	unsigned int *pix2 = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
+		user_data->x_offset;
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++)
+			if (x < w && y < h)
+				pixel_error[y * 4 + x] = get_pixel_error(metric, texture->info->nu_components,
+					image_buffer[y * 4 + x], pix2[y * (user_data->image_rowstride / 4) + x]);
+			else
+				pixel_error[y * 4 + x] = 0;
+	return 1;
+}
+
+// Index planes. An index plane is a set of per-pixel indices within a compressed block that can be chosen
+// independently for each pixel once the other bits (endpoints, base colors, modes) are fixed.
+
+#define INDEX_PLANE_DXT		0	// 2-bit indices, row-major, little-endian, in bytes 4-7.
+#define INDEX_PLANE_ALPHA3	1	// 3-bit indices, row-major, little-endian, starting at byte 2 (DXT5 alpha, RGTC).
+#define INDEX_PLANE_ETC		2	// 2-bit indices, column-major, split in LSB and MSB halves in bytes 4-7.
+#define INDEX_PLANE_EAC		3	// 3-bit indices, column-major, big-endian, in bytes 2-7.
+#define INDEX_PLANE_BPTC	4	// 2, 3 or 4-bit indices at the end of a BPTC block, anchor indices have one bit less.
+
+typedef struct {
+	int type;
+	int offset;		// Byte offset of the 64-bit half of the block containing the plane.
+	int nu_values;		// Number of different index values.
+	int anchors;		// BPTC: pixels (one bit each) whose index has an implicit zero high bit.
+	unsigned char shift[17];	// BPTC: bit position of the index of each pixel in the second 64-bit half.
+} IndexPlane;
+
+// Number of subsets of each BPTC mode, endpoint precision in bits (including the p-bit) of the color and alpha
+// components, and the number of index values of the color and the separate (alpha) index planes.
+static const char bptc_nu_subsets[8] = { 3, 2, 3, 2, 1, 1, 1, 2 };
+static const char bptc_color_precision[8] = { 5, 7, 5, 8, 5, 7, 8, 6 };
+static const char bptc_alpha_precision[8] = { 0, 0, 0, 0, 6, 8, 8, 6 };
+static const char bptc_color_index_values[8] = { 8, 8, 4, 4, 4, 4, 16, 4 };
+static const char bptc_alpha_index_values[8] = { 0, 0, 0, 0, 8, 4, 0, 0 };
+
+// Return whether the ETC2 RGB8 (or punchthrough) block is in planar mode, which has no pixel indices.
+
+static int etc2_block_is_planar(const unsigned char *bitstring) {
+	unsigned char tmp[8];
+	memcpy(tmp, bitstring, 8);
+	// Test the mode as if the differential bit is set (for punchthrough, it is the opaque bit).
+	tmp[3] |= 2;
+	return block4x4_etc2_rgb8_get_mode(tmp) == 4;
+}
+
+// Set up a BPTC index plane with the given number of index values and anchor pixels. The indices are stored in
+// pixel order at the end of the block, the anchor indices with one bit less.
+
+static void set_bptc_index_plane(IndexPlane *plane, int nu_values, int anchors) {
+	int bits = nu_values == 16 ? 4 : (nu_values == 8 ? 3 : 2);
+	plane->type = INDEX_PLANE_BPTC;
+	plane->offset = 0;
+	plane->nu_values = nu_values;
+	plane->anchors = anchors;
+	plane->shift[16] = 64;
+	for (int i = 15; i >= 0; i--)
+		plane->shift[i] = plane->shift[i + 1] - bits + ((anchors >> i) & 1);
+}
+
+// Determine the index planes of the compressed block. Returns the number of planes, or - 1 if the texture format
+// is not supported.
+
+static int get_index_planes(int texture_type, const unsigned char *bitstring, IndexPlane *planes) {
+	int n = 0;
+	switch (texture_type) {
+	case TEXTURE_TYPE_DXT1 :
+	case TEXTURE_TYPE_DXT1A :
+		planes[n].type = INDEX_PLANE_DXT;
+		planes[n].offset = 0;
+		planes[n++].nu_values = 4;
+		break;
+	case TEXTURE_TYPE_DXT3 :
+	case TEXTURE_TYPE_DXT5 :
+		planes[n].type = INDEX_PLANE_DXT;
+		planes[n].offset = 8;
+		planes[n++].nu_values = 4;
+		if (texture_type == TEXTURE_TYPE_DXT5) {
+			planes[n].type = INDEX_PLANE_ALPHA3;
+			planes[n].offset = 0;
+			planes[n++].nu_values = 8;
+		}
+		break;
+	case TEXTURE_TYPE_RGTC2 :
+	case TEXTURE_TYPE_SIGNED_RGTC2 :
+		planes[n].type = INDEX_PLANE_ALPHA3;
+		planes[n].offset = 8;
+		planes[n++].nu_values = 8;
+		// Fall through.
+	case TEXTURE_TYPE_RGTC1 :
+	case TEXTURE_TYPE_SIGNED_RGTC1 :
+		planes[n].type = INDEX_PLANE_ALPHA3;
+		planes[n].offset = 0;
+		planes[n++].nu_values = 8;
+		break;
+	case TEXTURE_TYPE_ETC1 :
+		planes[n].type = INDEX_PLANE_ETC;
+		planes[n].offset = 0;
+		planes[n++].nu_values = 4;
+		break;
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+	case TEXTURE_TYPE_ETC2_PUNCHTHROUGH :
+	case TEXTURE_TYPE_ETC2_SRGB_PUNCHTHROUGH :
+		if (!etc2_block_is_planar(bitstring)) {
+			planes[n].type = INDEX_PLANE_ETC;
+			planes[n].offset = 0;
+			planes[n++].nu_values = 4;
+		}
+		break;
+	case TEXTURE_TYPE_ETC2_EAC :
+	case TEXTURE_TYPE_ETC2_SRGB_EAC :
+		if (!etc2_block_is_planar(&bitstring[8])) {
+			planes[n].type = INDEX_PLANE_ETC;
+			planes[n].offset = 8;
+			planes[n++].nu_values = 4;
+		}
+		planes[n].type = INDEX_PLANE_EAC;
+		planes[n].offset = 0;
+		planes[n++].nu_values = 8;
+		break;
+	case TEXTURE_TYPE_RG11_EAC :
+	case TEXTURE_TYPE_SIGNED_RG11_EAC :
+		planes[n].type = INDEX_PLANE_EAC;
+		planes[n].offset = 8;
+		planes[n++].nu_values = 8;
+		// Fall through.
+	case TEXTURE_TYPE_R11_EAC :
+	case TEXTURE_TYPE_SIGNED_R11_EAC :
+		planes[n].type = INDEX_PLANE_EAC;
+		planes[n].offset = 0;
+		planes[n++].nu_values = 8;
+		break;
+	case TEXTURE_TYPE_BPTC :
+		{
+		// Modes 4 and 5, which have separate color and alpha indices, are not supported.
+		int mode = block4x4_bptc_get_mode(bitstring);
+		if (mode < 0 || mode == 4 || mode == 5)
+			return - 1;
+		int anchors = 1;
+		if (bptc_nu_subsets[mode] > 1)
+			anchors = block4x4_bptc_get_anchor_pixels(bptc_nu_subsets[mode],
+				block4x4_bptc_get_partition(bitstring));
+		set_bptc_index_plane(&planes[n++], bptc_color_index_values[mode], anchors);
+		break;
+		}
+	default :
+		return - 1;
+	}
+	return n;
+}
+
+// Return whether index value can be encoded for pixel i (row-major) in the index plane.
+
+static int pixel_index_allowed(const IndexPlane *plane, int i, int index) {
+	if (plane->type == INDEX_PLANE_BPTC && (plane->anchors & (1 << i)))
+		// The anchor index has an implicit zero high bit.
+		return index < plane->nu_values / 2;
+	return 1;
+}
+
+
+// Set the index of pixel i (row-major order) in an index plane.
+
+static void set_pixel_index(const IndexPlane *plane, unsigned char *bitstring, int i, int index) {
+	unsigned char *data = &bitstring[plane->offset];
+	switch (plane->type) {
+	case INDEX_PLANE_DXT :
+		{
+		unsigned int pixels = *(unsigned int *)&data[4];
+		pixels &= ~(0x3 << (i * 2));
+		pixels |= index << (i * 2);
+		*(unsigned int *)&data[4] = pixels;
+		break;
+		}
+	case INDEX_PLANE_ALPHA3 :
+		{
+		uint64_t bits = *(uint64_t *)&data[0];
+		bits &= ~((uint64_t)0x7 << (16 + i * 3));
+		bits |= (uint64_t)index << (16 + i * 3);
+		*(uint64_t *)&data[0] = bits;
+		break;
+		}
+	case INDEX_PLANE_ETC :
+		{
+		int j = (i & 3) * 4 + (i >> 2);		// Column-major pixel number.
+		unsigned int pixel_index_word = ((unsigned int)data[4] << 24) | ((unsigned int)data[5] << 16) |
+			((unsigned int)data[6] << 8) | data[7];
+		pixel_index_word &= ~((1 << j) | (0x10000 << j));
+		pixel_index_word |= ((index & 1) << j) | ((index & 2) << (16 + j - 1));
+		data[4] = pixel_index_word >> 24;
+		data[5] = pixel_index_word >> 16;
+		data[6] = pixel_index_word >> 8;
+		data[7] = pixel_index_word;
+		break;
+		}
+	case INDEX_PLANE_EAC :
+		{
+		int j = (i & 3) * 4 + (i >> 2);		// Column-major pixel number.
+		uint64_t pixels = ((uint64_t)data[2] << 40) | ((uint64_t)data[3] << 32) | ((uint64_t)data[4] << 24)
+			| ((uint64_t)data[5] << 16) | ((uint64_t)data[6] << 8) | data[7];
+		pixels &= ~((uint64_t)0x7 << (45 - j * 3));
+		pixels |= (uint64_t)index << (45 - j * 3);
+		for (int k = 0; k < 6; k++)
+			data[2 + k] = pixels >> (40 - k * 8);
+		break;
+		}
+	case INDEX_PLANE_BPTC :
+		{
+		uint64_t data1 = *(uint64_t *)&data[8];
+		int shift = plane->shift[i];
+		int mask = (1 << (plane->shift[i + 1] - shift)) - 1;
+		data1 &= ~((uint64_t)mask << shift);
+		data1 |= (uint64_t)(index & mask) << shift;
+		*(uint64_t *)&data[8] = data1;
+		break;
+		}
+	}
+}
+
+// Set the indices of all pixels in an index plane to the same value (when allowed for the pixel).
+
+static void set_all_pixel_indices(const IndexPlane *plane, unsigned char *bitstring, int index) {
+	for (int i = 0; i < 16; i++)
+		if (pixel_index_allowed(plane, i, index))
+			set_pixel_index(plane, bitstring, i, index);
+}
+
+// Get the indices of all pixels (row-major order) in an index plane.
+
+static void get_pixel_indices(const IndexPlane *plane, const unsigned char *bitstring, int *indices) {
+	const unsigned char *data = &bitstring[plane->offset];
+	switch (plane->type) {
+	case INDEX_PLANE_DXT :
+		{
+		unsigned int pixels = *(unsigned int *)&data[4];
+		for (int i = 0; i < 16; i++)
+			indices[i] = (pixels >> (i * 2)) & 0x3;
+		break;
+		}
+	case INDEX_PLANE_ALPHA3 :
+		{
+		uint64_t bits = *(uint64_t *)&data[0] >> 16;
+		for (int i = 0; i < 16; i++)
+			indices[i] = (bits >> (i * 3)) & 0x7;
+		break;
+		}
+	case INDEX_PLANE_ETC :
+		{
+		unsigned int pixel_index_word = ((unsigned int)data[4] << 24) | ((unsigned int)data[5] << 16) |
+			((unsigned int)data[6] << 8) | data[7];
+		for (int j = 0; j < 16; j++)
+			indices[(j & 3) * 4 + (j >> 2)] = ((pixel_index_word >> j) & 1) |
+				((pixel_index_word >> (16 + j - 1)) & 2);
+		break;
+		}
+	case INDEX_PLANE_EAC :
+		{
+		uint64_t pixels = ((uint64_t)data[2] << 40) | ((uint64_t)data[3] << 32) | ((uint64_t)data[4] << 24)
+			| ((uint64_t)data[5] << 16) | ((uint64_t)data[6] << 8) | data[7];
+		for (int j = 0; j < 16; j++)
+			indices[(j & 3) * 4 + (j >> 2)] = (pixels >> (45 - j * 3)) & 0x7;
+		break;
+		}
+	case INDEX_PLANE_BPTC :
+		{
+		uint64_t data1 = *(uint64_t *)&data[8];
+		for (int i = 0; i < 16; i++)
+			indices[i] = (data1 >> plane->shift[i]) & ((1 << (plane->shift[i + 1] - plane->shift[i])) - 1);
+		break;
+		}
+	}
+}
+
+// Clear all index bits of an index plane.
+
+static void clear_pixel_indices(const IndexPlane *plane, unsigned char *bitstring) {
+	unsigned char *data = &bitstring[plane->offset];
+	switch (plane->type) {
+	case INDEX_PLANE_DXT :
+	case INDEX_PLANE_ETC :
+		memset(&data[4], 0, 4);
+		break;
+	case INDEX_PLANE_ALPHA3 :
+	case INDEX_PLANE_EAC :
+		memset(&data[2], 0, 6);
+		break;
+	case INDEX_PLANE_BPTC :
+		// Keep the bits before the first index.
+		*(uint64_t *)&data[8] &= ((uint64_t)1 << plane->shift[0]) - 1;
+		break;
+	}
+}
+
+// Return whether the error of each pixel of the block is the sum of the errors of its components. With the RGBA
+// metric, this is not the case for fully transparent source pixels, whose color doesn't matter when the decoded
+// alpha is zero as well.
+
+static int pixel_error_is_separable(BlockUserData *user_data) {
+	Texture *texture = user_data->texture;
+	if (get_pixel_metric(texture) != METRIC_RGBA)
+		return 1;
+	unsigned int *pix = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
+		user_data->x_offset;
+	for (int y = 0; y < 4 && user_data->y_offset + y < texture->height; y++)
+		for (int x = 0; x < 4 && user_data->x_offset + x < texture->width; x++)
+			if (pixel_get_a(pix[y * (user_data->image_rowstride / 4) + x]) == 0)
+				return 0;
+	return 1;
+}
+
+// Given the non-index bits (endpoints, base colors and modes) of a compressed block, choose the index of each
+// pixel that minimizes the error. Because the indices of different pixels are independent, the block is evaluated
+// for each index value of the index planes (with all pixels set to that value) in a single batch, after which the
+// best combination is chosen for each pixel. Two index planes always belong to different components (color and
+// alpha, or red and green). When the error of a pixel is the sum of the errors of its components, the error of
+// each combination follows exactly from the candidates that vary one plane while the other is at index zero, so
+// that n0 + n1 - 1 decoded blocks are needed instead of n0 * n1. The error of each pixel is stored in pixel_error
+// if it is not NULL. Returns the total error, or - 1 if the block is invalid or the texture format or comparison
+// function is not supported.
+
+double derive_block_indices(unsigned char *bitstring, BlockUserData *user_data, double *pixel_error) {
+	Texture *texture = user_data->texture;
+	IndexPlane planes[2];
+	int nu_planes = get_index_planes(texture->type, bitstring, planes);
+	if (nu_planes < 0 || get_pixel_metric(texture) == METRIC_NONE)
+		return - 1.0;
+	int bytes_per_block = texture->bits_per_block / 8;
+	int n0 = nu_planes >= 1 ? planes[0].nu_values : 1;
+	int n1 = nu_planes >= 2 ? planes[1].nu_values : 1;
+	// When separable, candidate k0 has index k0 in the first plane and candidate n0 + k1 - 1 (k1 > 0) has index
+	// k1 in the second plane, with the other plane at index zero. Otherwise, candidate k0 * n1 + k1 has the
+	// combination (k0, k1).
+	int separable = nu_planes < 2 || pixel_error_is_separable(user_data);
+	unsigned char candidates[32 * 16];
+	double fitness[32];
+	double error[32 * 16];
+	int nu_candidates = separable ? n0 + n1 - 1 : n0 * n1;
+	for (int j = 0; j < nu_candidates; j++) {
+		int k0 = separable ? (j < n0 ? j : 0) : j / n1;
+		int k1 = separable ? (j < n0 ? 0 : j - n0 + 1) : j % n1;
+		if (nu_planes >= 1)
+			set_all_pixel_indices(&planes[0], bitstring, k0);
+		if (nu_planes >= 2)
+			set_all_pixel_indices(&planes[1], bitstring, k1);
+		memcpy(&candidates[j * bytes_per_block], bitstring, bytes_per_block);
+	}
+	calculate_fitness_batch(user_data, candidates, nu_candidates, fitness, error);
+	// Validity doesn't depend on the pixel indices.
+	if (fitness[0] == 0)
+		return - 1.0;
+	double best_error[16];
+	int best_index[2][16];
+	for (int i = 0; i < 16; i++)
+		best_error[i] = HUGE_VAL;
+	for (int k0 = 0; k0 < n0; k0++)
+		for (int k1 = 0; k1 < n1; k1++)
+			for (int i = 0; i < 16; i++) {
+				if (nu_planes >= 1 && !pixel_index_allowed(&planes[0], i, k0))
+					continue;
+				double e;
+				if (!separable)
+					e = error[(k0 * n1 + k1) * 16 + i];
+				else {
+					// The pixel errors are integers, so the sum is exact.
+					e = error[k0 * 16 + i];
+					if (k1 > 0)
+						e += error[(n0 + k1 - 1) * 16 + i] - error[i];
+				}
+				if (e < best_error[i]) {
+					best_error[i] = e;
+					best_index[0][i] = k0;
+					best_index[1][i] = k1;
+				}
+			}
+	double total_error = 0;
+	for (int i = 0; i < 16; i++) {
+		for (int j = 0; j < nu_planes; j++)
+			set_pixel_index(&planes[j], bitstring, i, best_index[j][i]);
+		total_error += best_error[i];
+		if (pixel_error != NULL)
+			pixel_error[i] = best_error[i];
+	}
+	return total_error;
+}
+
+// Return the maximum number of candidate blocks that derive_block_indices() evaluates for a block of the texture,
+// or zero if the pixel indices of the texture can't be derived.
+
+int get_index_derivation_cost(Texture *texture) {
+	if (get_pixel_metric(texture) == METRIC_NONE)
+		return 0;
+	unsigned char bitstring[16];
+	IndexPlane planes[2];
+	// Use a BPTC mode 6 block, the BPTC mode with the most index values. For the ETC2 formats this is a block in
+	// differential mode.
+	memset(bitstring, 0, 16);
+	bitstring[0] = 0x40;
+	int nu_planes = get_index_planes(texture->type, bitstring, planes);
+	if (nu_planes < 0)
+		return 0;
+	int cost = 1;
+	for (int i = 0; i < nu_planes; i++)
+		cost *= planes[i].nu_values;
+	return cost;
+}
+
+// Replace the pixel indices of a block by the optimal ones for its other bits, and return the fitness of the
+// resulting block (the inverse of the error, zero when the block is invalid). This is the fitness function of the
+// GA with index derivation, for which the pixel index bits of the individuals don't matter. Blocks in a mode
+// without index planes (BPTC modes 4 and 5) are evaluated as they are.
+
+double calculate_fitness_with_derived_indices(unsigned char *bitstring, BlockUserData *user_data) {
+	Texture *texture = user_data->texture;
+	IndexPlane planes[2];
+	if (get_index_planes(texture->type, bitstring, planes) < 0) {
+		unsigned int image_buffer[32];
+		if (!texture->decoding_function(bitstring, image_buffer, user_data->flags))
+			return 0;
+		return texture->comparison_function(image_buffer, user_data);
+	}
+	int bytes_per_block = texture->bits_per_block / 8;
+	unsigned char derived[16];
+	memcpy(derived, bitstring, bytes_per_block);
+	double error = derive_block_indices(derived, user_data, NULL);
+	if (error < 0)
+		return 0;
+	memcpy(bitstring, derived, bytes_per_block);
+	return 1.0 / error;
+}
+
+// Source block representation used by the analytic encoders. Component values are in the domain of the
+// comparison function (8-bit, or unsigned or signed 16-bit).
+
+typedef struct {
+	int value[16][4];
+	unsigned int pixel[16];		// The original source pixels.
+	unsigned char valid[16];	// Whether the pixel is inside the image.
+	unsigned char color_valid[16];	// Whether the color of the pixel matters (not fully transparent).
+	int nu_components;
+} SourceBlock;
+
+// Fill in the source block for the block described by user_data. Returns 0 if the source image format is not
+// supported.
+
+static int get_source_block(BlockUserData *user_data, SourceBlock *block) {
+	Texture *texture = user_data->texture;
+	int metric = get_pixel_metric(texture);
+	if (metric == METRIC_NONE)
+		return 0;
+	unsigned int *pix = user_data->image_pixels + user_data->y_offset * (user_data->image_rowstride / 4) +
+		user_data->x_offset;
+	int nu_valid_colors = 0;
+	block->nu_components = texture->info->nu_components;
+	for (int y = 0; y < 4; y++)
+		for (int x = 0; x < 4; x++) {
+			int i = y * 4 + x;
+			int valid = user_data->x_offset + x < texture->width && user_data->y_offset + y < texture->height;
+			// Pixels outside the image are not read, because they can lie beyond the end of the image data.
+			unsigned int pixel = 0;
+			if (valid)
+				pixel = pix[y * (user_data->image_rowstride / 4) + x];
+			int *v = block->value[i];
+			block->pixel[i] = pixel;
+			switch (metric) {
+			case METRIC_RGB :
+			case METRIC_RGBA :
+			case METRIC_8_BIT_COMPONENTS :
+				v[0] = pixel_get_r(pixel);
+				v[1] = pixel_get_g(pixel);
+				v[2] = pixel_get_b(pixel);
+				v[3] = pixel_get_a(pixel);
+				break;
+			case METRIC_SIGNED_8_BIT_COMPONENTS :
+				v[0] = pixel_get_signed_r8(pixel);
+				v[1] = pixel_get_signed_g8(pixel);
+				v[2] = v[3] = 0;
+				break;
+			case METRIC_8_BIT_COMPONENTS_WITH_16_BIT :
+				v[0] = pixel_get_r16(pixel) >> 8;
+				v[1] = pixel_get_g16(pixel) >> 8;
+				v[2] = v[3] = 0;
+				break;
+			case METRIC_SIGNED_8_BIT_COMPONENTS_WITH_16_BIT :
+				v[0] = pixel_get_signed_r16(pixel) >> 8;
+				v[1] = pixel_get_signed_g16(pixel) >> 8;
+				v[2] = v[3] = 0;
+				break;
+			case METRIC_R16 :
+			case METRIC_RG16 :
+				v[0] = pixel_get_r16(pixel);
+				v[1] = pixel_get_g16(pixel);
+				v[2] = v[3] = 0;
+				break;
+			case METRIC_R16_SIGNED :
+			case METRIC_RG16_SIGNED :
+				v[0] = pixel_get_signed_r16(pixel);
+				v[1] = pixel_get_signed_g16(pixel);
+				v[2] = v[3] = 0;
+				break;
+			}
+			block->valid[i] = valid;
+			block->color_valid[i] = block->valid[i];
+			if (metric == METRIC_RGBA && v[3] == 0)
+				block->color_valid[i] = 0;
+			nu_valid_colors += block->color_valid[i];
+		}
+	if (nu_valid_colors == 0)
+		// All pixels are transparent; use the colors of the pixels inside the image.
+		memcpy(block->color_valid, block->valid, 16);
+	return 1;
+}
+
+static int clampi(int x, int min, int max) {
+	if (x < min)
+		return min;
+	if (x > max)
+		return max;
+	return x;
+}
+
+// Calculate two endpoints for the RGB components of the block along the principal axis of the color
+// distribution (when use_pca is set), or along the diagonal of the bounding box.
+
+static void calculate_color_endpoints(const SourceBlock *block, int use_pca, float *endpoint0, float *endpoint1) {
+	float mean[3] = { 0, 0, 0 };
+	float min[3] = { 255.0, 255.0, 255.0 };
+	float max[3] = { 0, 0, 0 };
+	int n = 0;
+	for (int i = 0; i < 16; i++) {
+		if (!block->color_valid[i])
+			continue;
+		for (int c = 0; c < 3; c++) {
+			float v = block->value[i][c];
+			mean[c] += v;
+			if (v < min[c])
+				min[c] = v;
+			if (v > max[c])
+				max[c] = v;
+		}
+		n++;
+	}
+	if (n == 0)
+		n = 1;
+	for (int c = 0; c < 3; c++)
+		mean[c] /= n;
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };	// rr, rg, rb, gg, gb, bb
+	for (int i = 0; i < 16; i++) {
+		if (!block->color_valid[i])
+			continue;
+		float r = block->value[i][0] - mean[0];
+		float g = block->value[i][1] - mean[1];
+		float b = block->value[i][2] - mean[2];
+		cov[0] += r * r;
+		cov[1] += r * g;
+		cov[2] += r * b;
+		cov[3] += g * g;
+		cov[4] += g * b;
+		cov[5] += b * b;
+	}
+	if (!use_pca) {
+		// Use the bounding box. Flip the diagonal for components that are negatively correlated with the
+		// component with the largest variance.
+		int largest = 0;
+		if (cov[3] > cov[0])
+			largest = 1;
+		if (cov[5] > cov[largest == 0 ? 0 : 3])
+			largest = 2;
+		float corr[3];
+		if (largest == 0) {
+			corr[0] = 1.0;
+			corr[1] = cov[1];
+			corr[2] = cov[2];
+		}
+		else
+		if (largest == 1) {
+			corr[0] = cov[1];
+			corr[1] = 1.0;
+			corr[2] = cov[4];
+		}
+		else {
+			corr[0] = cov[2];
+			corr[1] = cov[4];
+			corr[2] = 1.0;
+		}
+		for (int c = 0; c < 3; c++)
+			if (corr[c] < 0) {
+				endpoint0[c] = min[c];
+				endpoint1[c] = max[c];
+			}
+			else {
+				endpoint0[c] = max[c];
+				endpoint1[c] = min[c];
+			}
+		return;
+	}
+	// Determine the principal axis using power iteration, starting with the bounding box diagonal.
+	float axis[3] = { max[0] - min[0], max[1] - min[1], max[2] - min[2] };
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float v[3];
+		v[0] = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		v[1] = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		v[2] = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length < 0.0001)
+			break;
+		for (int c = 0; c < 3; c++)
+			axis[c] = v[c] / length;
+	}
+	float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (length < 0.0001) {
+		for (int c = 0; c < 3; c++)
+			endpoint0[c] = endpoint1[c] = mean[c];
+		return;
+	}
+	for (int c = 0; c < 3; c++)
+		axis[c] /= length;
+	float t_min = HUGE_VAL;
+	float t_max = - HUGE_VAL;
+	for (int i = 0; i < 16; i++) {
+		if (!block->color_valid[i])
+			continue;
+		float t = (block->value[i][0] - mean[0]) * axis[0] + (block->value[i][1] - mean[1]) * axis[1] +
+			(block->value[i][2] - mean[2]) * axis[2];
+		if (t < t_min)
+			t_min = t;
+		if (t > t_max)
+			t_max = t;
+	}
+	for (int c = 0; c < 3; c++) {
+		endpoint0[c] = mean[c] + t_max * axis[c];
+		endpoint1[c] = mean[c] + t_min * axis[c];
+	}
+}
+
+// Encode the two 5-6-5 DXT colors into the 32-bit word at the start of bitstring. Four-color mode (color0 >
+// color1) is used unless the colors are equal and allow_equal is set.
+
+static void set_dxt_colors(unsigned char *bitstring, const float *endpoint0, const float *endpoint1,
+int allow_equal) {
+	unsigned int color[2];
+	const float *endpoint[2] = { endpoint0, endpoint1 };
+	for (int i = 0; i < 2; i++) {
+		int r = clampi((int)floorf(endpoint[i][0] / 8.0 + 0.5), 0, 31);
+		int g = clampi((int)floorf(endpoint[i][1] / 4.0 + 0.5), 0, 63);
+		int b = clampi((int)floorf(endpoint[i][2] / 8.0 + 0.5), 0, 31);
+		color[i] = (r << 11) | (g << 5) | b;
+	}
+	if (color[0] < color[1]) {
+		unsigned int tmp = color[0];
+		color[0] = color[1];
+		color[1] = tmp;
+	}
+	else
+	if (color[0] == color[1] && !allow_equal) {
+		if (color[1] > 0)
+			color[1]--;
+		else
+			color[0]++;
+	}
+	*(unsigned int *)&bitstring[0] = color[0] | (color[1] << 16);
+}
+
+// Set the two endpoints of a DXT5 alpha or RGTC channel (stored in the first two bytes of bitstring) using
+// the minimum and maximum values of component c. When signed_values is set, the values are signed 16-bit and
+// are mapped to the signed RGTC range [-127, 127].
+
+static void set_alpha3_endpoints(unsigned char *bitstring, const SourceBlock *block, int c, int signed_values) {
+	int min = INT_MAX;
+	int max = - INT_MAX;
+	for (int i = 0; i < 16; i++) {
+		if (!block->valid[i])
+			continue;
+		int v = block->value[i][c];
+		if (signed_values)
+			v = clampi((int)floor((v + 32768) * 254.0 / 65535.0 + 0.5) - 127, - 127, 127);
+		if (v < min)
+			min = v;
+		if (v > max)
+			max = v;
+	}
+	if (min > max)
+		min = max = 0;
+	// Use the eight value mode (first endpoint larger).
+	bitstring[0] = (unsigned char)max;
+	bitstring[1] = (unsigned char)min;
+}
+
+// Calculate the base codeword, multiplier and table of an EAC block using the minimum and maximum values of
+// component c, choosing the table that covers the range best. The block is stored in the first two bytes of
+// bitstring. For eleven_bit formats the values are unsigned (or signed) 16-bit, otherwise 8-bit.
+
+static void set_eac_parameters(unsigned char *bitstring, const SourceBlock *block, int c, int eleven_bit,
+int signed_values) {
+	int min = INT_MAX;
+	int max = - INT_MAX;
+	for (int i = 0; i < 16; i++) {
+		if (!block->valid[i])
+			continue;
+		int v = block->value[i][c];
+		if (v < min)
+			min = v;
+		if (v > max)
+			max = v;
+	}
+	if (min > max)
+		min = max = 0;
+	// Convert to the units of the base codeword.
+	float lo, hi;
+	if (eleven_bit) {
+		lo = (min >> 5) / 8.0;
+		hi = (max >> 5) / 8.0;
+		if (!signed_values) {
+			lo -= 0.5;
+			hi -= 0.5;
+		}
+	}
+	else {
+		lo = min;
+		hi = max;
+	}
+	float best_error = HUGE_VAL;
+	for (int t = 0; t < 16; t++) {
+		float mod_min = eac_modifier_table[t][3];
+		float mod_max = eac_modifier_table[t][7];
+		int multiplier = clampi((int)floorf((hi - lo) / (mod_max - mod_min) + 0.5), 1, 15);
+		float base = (lo + hi) / 2 - (mod_min + mod_max) * multiplier / 2;
+		int base_codeword;
+		if (signed_values)
+			base_codeword = clampi((int)floorf(base + 0.5), - 127, 127);
+		else
+			base_codeword = clampi((int)floorf(base + 0.5), 0, 255);
+		// Estimate the quality of the table by the error at the two extremes and the center.
+		float error = 0;
+		float targets[3] = { lo, hi, (lo + hi) / 2 };
+		for (int j = 0; j < 3; j++) {
+			float best = HUGE_VAL;
+			for (int k = 0; k < 8; k++) {
+				float d = base_codeword + eac_modifier_table[t][k] * multiplier - targets[j];
+				if (d * d < best)
+					best = d * d;
+			}
+			error += best;
+		}
+		if (error < best_error) {
+			best_error = error;
+			bitstring[0] = (unsigned char)base_codeword;
+			bitstring[1] = (multiplier << 4) | t;
+		}
+	}
+}
+
+// Calculate the 4-bit (individual mode) or 5-bit (differential mode) base colors of an ETC1 block with the given
+// flip bit, using the average color of each sub-block. Returns 0 if the differential mode colors cannot be
+// represented.
+
+static int set_etc1_base_colors(unsigned char *bitstring, const SourceBlock *block, int flipbit, int differential) {
+	float average[2][3];
+	int count[2] = { 0, 0 };
+	for (int s = 0; s < 2; s++)
+		for (int c = 0; c < 3; c++)
+			average[s][c] = 0;
+	for (int i = 0; i < 16; i++) {
+		if (!block->color_valid[i])
+			continue;
+		int x = i & 3;
+		int y = i >> 2;
+		int s;
+		if (flipbit)
+			s = y >= 2;
+		else
+			s = x >= 2;
+		for (int c = 0; c < 3; c++)
+			average[s][c] += block->value[i][c];
+		count[s]++;
+	}
+	for (int s = 0; s < 2; s++)
+		if (count[s] > 0)
+			for (int c = 0; c < 3; c++)
+				average[s][c] /= count[s];
+	// When a sub-block has no pixels inside the image, use the color of the other sub-block.
+	if (count[0] == 0)
+		memcpy(average[0], average[1], sizeof(float) * 3);
+	if (count[1] == 0)
+		memcpy(average[1], average[0], sizeof(float) * 3);
+	for (int c = 0; c < 3; c++) {
+		if (differential) {
+			int q0 = clampi((int)floorf(average[0][c] * 31.0 / 255.0 + 0.5), 0, 31);
+			int q1 = clampi((int)floorf(average[1][c] * 31.0 / 255.0 + 0.5), 0, 31);
+			int d = clampi(q1 - q0, - 4, 3);
+			if (q0 + d < 0 || q0 + d > 31)
+				return 0;
+			bitstring[c] = (q0 << 3) | (d & 7);
+		}
+		else {
+			int q0 = clampi((int)floorf(average[0][c] * 15.0 / 255.0 + 0.5), 0, 15);
+			int q1 = clampi((int)floorf(average[1][c] * 15.0 / 255.0 + 0.5), 0, 15);
+			bitstring[c] = (q0 << 4) | q1;
+		}
+	}
+	bitstring[3] = (differential ? 2 : 0) | flipbit;
+	return 1;
+}
+
+// Choose the best modifier table for each of the two sub-blocks of an ETC1 style block (base colors already set)
+// and derive the pixel indices. Returns the error or - 1 if the block is invalid.
+
+static double optimize_etc1_tables(unsigned char *bitstring, int etc_offset, BlockUserData *user_data) {
+	unsigned char *etc = &bitstring[etc_offset];
+	int flipbit = etc[3] & 1;
+	double best_error[2] = { HUGE_VAL, HUGE_VAL };
+	int best_table[2] = { 0, 0 };
+	for (int t = 0; t < 8; t++) {
+		etc[3] = (etc[3] & 3) | (t << 5) | (t << 2);
+		double pixel_error[16];
+		if (derive_block_indices(bitstring, user_data, pixel_error) < 0)
+			return - 1.0;
+		double error[2] = { 0, 0 };
+		for (int i = 0; i < 16; i++) {
+			int s;
+			if (flipbit)
+				s = (i >> 2) >= 2;
+			else
+				s = (i & 3) >= 2;
+			error[s] += pixel_error[i];
+		}
+		for (int s = 0; s < 2; s++)
+			if (error[s] < best_error[s]) {
+				best_error[s] = error[s];
+				best_table[s] = t;
+			}
+	}
+	etc[3] = (etc[3] & 3) | (best_table[0] << 5) | (best_table[1] << 2);
+	return derive_block_indices(bitstring, user_data, NULL);
+}
+
+// Find the best ETC1 style individual or differential mode encodings for the block, trying both flip bit values.
+// Candidates are added to the seeds array, up to a total of max_seeds. Returns the new number of seeds.
+
+static int add_etc1_seeds(const SourceBlock *block, BlockUserData *user_data, int etc_offset,
+unsigned char *bitstrings, int nu_seeds, int max_seeds, int bytes_per_block) {
+	for (int differential = 0; differential < 2 && nu_seeds < max_seeds; differential++) {
+		if (differential && !(user_data->flags & ETC_MODE_ALLOWED_DIFFERENTIAL))
+			continue;
+		if (!differential && !(user_data->flags & ETC_MODE_ALLOWED_INDIVIDUAL))
+			continue;
+		for (int flipbit = 0; flipbit < 2 && nu_seeds < max_seeds; flipbit++) {
+			unsigned char *bitstring = &bitstrings[nu_seeds * bytes_per_block];
+			if (nu_seeds > 0)
+				// Keep the non-ETC part of the block (EAC alpha) of the previous seed.
+				memcpy(bitstring, &bitstrings[(nu_seeds - 1) * bytes_per_block], bytes_per_block);
+			if (!set_etc1_base_colors(&bitstring[etc_offset], block, flipbit, differential))
+				continue;
+			if (optimize_etc1_tables(bitstring, etc_offset, user_data) >= 0)
+				nu_seeds++;
+		}
+	}
+	return nu_seeds;
+}
+
+// Calculate BPTC mode 6 encodings using the bounding box of the RGBA values of the block, up to a total of max_seeds.
+
+static int add_bptc_mode6_seeds(const SourceBlock *block, BlockUserData *user_data, unsigned char *bitstrings,
+int nu_seeds, int max_seeds) {
+	float endpoint[2][4];
+	calculate_color_endpoints(block, 1, endpoint[0], endpoint[1]);
+	int alpha_min = 255;
+	int alpha_max = 0;
+	for (int i = 0; i < 16; i++)
+		if (block->valid[i]) {
+			if (block->value[i][3] < alpha_min)
+				alpha_min = block->value[i][3];
+			if (block->value[i][3] > alpha_max)
+				alpha_max = block->value[i][3];
+		}
+	if (alpha_min > alpha_max)
+		alpha_min = alpha_max = 255;
+	endpoint[0][3] = alpha_max;
+	endpoint[1][3] = alpha_min;
+	for (int swap = 0; swap < 2 && nu_seeds < max_seeds; swap++) {
+		unsigned char *bitstring = &bitstrings[nu_seeds * 16];
+		uint64_t data0 = 0x40;		// Mode 6.
+		uint64_t data1 = 0;
+		int e[2][4];
+		// The first endpoint has a p-bit shared by its components, choose the one that fits best.
+		float *ep0 = endpoint[swap];
+		float *ep1 = endpoint[1 - swap];
+		float best_error = HUGE_VAL;
+		int pbit = 0;
+		for (int p = 0; p < 2; p++) {
+			float error = 0;
+			for (int c = 0; c < 4; c++) {
+				int q = clampi((int)floorf((ep0[c] - p) / 2.0 + 0.5), 0, 127);
+				float d = q * 2 + p - ep0[c];
+				error += d * d;
+			}
+			if (error < best_error) {
+				best_error = error;
+				pbit = p;
+			}
+		}
+		for (int c = 0; c < 4; c++) {
+			e[0][c] = clampi((int)floorf((ep0[c] - pbit) / 2.0 + 0.5), 0, 127);
+			// The second p-bit is always zero.
+			e[1][c] = clampi((int)floorf(ep1[c] / 2.0 + 0.5), 0, 127);
+		}
+		int bit = 7;
+		for (int c = 0; c < 4; c++)
+			for (int j = 0; j < 2; j++) {
+				data0 |= (uint64_t)e[j][c] << bit;
+				bit += 7;
+			}
+		data0 |= (uint64_t)pbit << 63;
+		*(uint64_t *)&bitstring[0] = data0;
+		*(uint64_t *)&bitstring[8] = data1;
+		if (derive_block_indices(bitstring, user_data, NULL) >= 0)
+			nu_seeds++;
+	}
+	return nu_seeds;
+}
+
+// Quantize an 8-bit component value to an endpoint code of the given number of bits (including the p-bit when
+// pbit is not - 1, in which case the lowest bit of the code is pbit). Returns the code; the squared error of the
+// decoded value is added to error.
+
+static int quantize_bptc_component(float value, int bits, int pbit, float *error) {
+	int max_code = (1 << bits) - 1;
+	int center = (int)floorf(value * max_code / 255.0f + 0.5f);
+	int best_code = 0;
+	float best_error = HUGE_VALF;
+	for (int code = center - 1; code <= center + 1; code++) {
+		if (code < 0 || code > max_code || (pbit >= 0 && (code & 1) != pbit))
+			continue;
+		int decoded = (code << (8 - bits)) | (code >> (2 * bits - 8));
+		float d = decoded - value;
+		if (d * d < best_error) {
+			best_error = d * d;
+			best_code = code;
+		}
+	}
+	*error += best_error;
+	return best_code;
+}
+
+// Append nu_bits bits of value to a 128-bit BPTC block at bit position *pos.
+
+static void put_bptc_bits(uint64_t *data, int *pos, unsigned int value, int nu_bits) {
+	for (int i = 0; i < nu_bits; i++, (*pos)++)
+		if (value & (1 << i))
+			data[*pos >> 6] |= (uint64_t)1 << (*pos & 63);
+}
+
+// Calculate BPTC encodings in the modes with two or three subsets, for the partitions allowed by the mode
+// pre-selection (see select_bptc_island_flags()). The endpoints of each subset are the extremes of its colors
+// along their principal axis, oriented so that the anchor pixel is closest to the first endpoint. When the anchor
+// pixel is outside the image, its index doesn't matter and the endpoints are kept in their original order. At most
+// max_seeds seeds are stored in total.
+
+static int add_bptc_partition_seeds(const SourceBlock *block, BlockUserData *user_data, unsigned char *bitstrings,
+int nu_seeds, int max_seeds) {
+	int flags = user_data->flags;
+	if (!(flags & BPTC_PARTITION_RESTRICTED))
+		return nu_seeds;
+	for (int mode = 0; mode < 8; mode++) {
+		int nu_subsets = bptc_nu_subsets[mode];
+		if (!(flags & (1 << mode)) || nu_subsets == 1 || nu_seeds == max_seeds)
+			continue;
+		int partition = (flags >> (nu_subsets == 2 ? BPTC_PARTITION2_SHIFT : BPTC_PARTITION3_SHIFT)) & 0x3F;
+		int anchors = block4x4_bptc_get_anchor_pixels(nu_subsets, partition);
+		// Calculate the RGBA endpoints of each subset.
+		float endpoint[3][2][4];
+		for (int s = 0; s < nu_subsets; s++) {
+			SourceBlock subset = *block;
+			int anchor = 0;
+			int n = 0;
+			for (int i = 0; i < 16; i++) {
+				if ((nu_subsets == 2 ? table_P2 : table_P3)[partition * 16 + i] != s) {
+					subset.valid[i] = 0;
+					subset.color_valid[i] = 0;
+				}
+				else
+				if (anchors & (1 << i))
+					anchor = i;
+				n += subset.color_valid[i];
+			}
+			if (n == 0) {
+				memset(endpoint[s], 0, sizeof(endpoint[s]));
+				continue;
+			}
+			calculate_color_endpoints(&subset, 1, endpoint[s][0], endpoint[s][1]);
+			endpoint[s][0][3] = 0;
+			endpoint[s][1][3] = 255;
+			for (int i = 0; i < 16; i++)
+				if (subset.valid[i]) {
+					endpoint[s][0][3] = fmaxf(endpoint[s][0][3], subset.value[i][3]);
+					endpoint[s][1][3] = fminf(endpoint[s][1][3], subset.value[i][3]);
+				}
+			float d[2] = { 0, 0 };
+			for (int e = 0; e < 2; e++)
+				for (int c = 0; c < 4; c++) {
+					endpoint[s][e][c] = fminf(fmaxf(endpoint[s][e][c], 0), 255.0f);
+					float diff = endpoint[s][e][c] - block->value[anchor][c];
+					d[e] += diff * diff;
+				}
+			if (block->valid[anchor] && d[1] < d[0])
+				for (int c = 0; c < 4; c++) {
+					float t = endpoint[s][0][c];
+					endpoint[s][0][c] = endpoint[s][1][c];
+					endpoint[s][1][c] = t;
+				}
+		}
+		// Quantize the endpoints, choosing the p-bits (one per endpoint, or one per subset for mode 1) that fit
+		// best.
+		int nu_components = mode == 7 ? 4 : 3;
+		int bits = bptc_color_precision[mode];
+		int has_pbits = mode != 2;
+		int code[3][2][4];
+		int pbit[3][2];
+		for (int s = 0; s < nu_subsets; s++) {
+			float best_error = HUGE_VALF;
+			for (int p = 0; p < (has_pbits ? 4 : 1); p++) {
+				if (mode == 1 && (p & 1) != (p >> 1))
+					continue;
+				int c_try[2][4];
+				float error = 0;
+				for (int e = 0; e < 2; e++)
+					for (int c = 0; c < nu_components; c++)
+						c_try[e][c] = quantize_bptc_component(endpoint[s][e][c], bits,
+							has_pbits ? (p >> e) & 1 : - 1, &error);
+				if (error < best_error) {
+					best_error = error;
+					memcpy(code[s], c_try, sizeof(c_try));
+					pbit[s][0] = p & 1;
+					pbit[s][1] = p >> 1;
+				}
+			}
+		}
+		// Pack the block; the pixel indices are derived afterwards.
+		unsigned char *bitstring = &bitstrings[nu_seeds * 16];
+		uint64_t data[2] = { 0, 0 };
+		int pos = 0;
+		put_bptc_bits(data, &pos, 1 << mode, mode + 1);
+		put_bptc_bits(data, &pos, partition, mode == 0 ? 4 : 6);
+		int code_bits = has_pbits ? bits - 1 : bits;
+		for (int c = 0; c < nu_components; c++)
+			for (int s = 0; s < nu_subsets; s++)
+				for (int e = 0; e < 2; e++)
+					put_bptc_bits(data, &pos, has_pbits ? code[s][e][c] >> 1 : code[s][e][c],
+						code_bits);
+		if (mode == 1)
+			for (int s = 0; s < nu_subsets; s++)
+				put_bptc_bits(data, &pos, pbit[s][0], 1);
+		else
+		if (has_pbits)
+			for (int s = 0; s < nu_subsets; s++)
+				for (int e = 0; e < 2; e++)
+					put_bptc_bits(data, &pos, pbit[s][e], 1);
+		*(uint64_t *)&bitstring[0] = data[0];
+		*(uint64_t *)&bitstring[8] = data[1];
+		if (derive_block_indices(bitstring, user_data, NULL) >= 0)
+			nu_seeds++;
+	}
+	return nu_seeds;
+}
+
+// Calculate analytic encodings of the block described by user_data, for use as seeds of the genetic algorithm.
+// Candidates are calculated with methods specific to the texture format (bounding box or principal component
+// endpoints for DXTn and RGTC, average color base colors with the best modifier tables for ETC1/ETC2, endpoints
+// derived from the color distribution for BPTC mode 6 and the pre-selected BPTC partitions) after which the
+// optimal pixel indices are derived. The bitstrings are stored consecutively in bitstrings, which must have room
+// for MAX_ANALYTIC_SEEDS blocks. At most max_seeds (1 to MAX_ANALYTIC_SEEDS) seeds are calculated, the cheapest
+// ones first. Returns the number of seeds.
+
+int calculate_analytic_seeds(BlockUserData *user_data, unsigned char *bitstrings, int max_seeds) {
+	Texture *texture = user_data->texture;
+	SourceBlock block;
+	if (!get_source_block(user_data, &block))
+		return 0;
+	int bytes_per_block = texture->bits_per_block / 8;
+	int nu_seeds = 0;
+	memset(bitstrings, 0, MAX_ANALYTIC_SEEDS * bytes_per_block);
+	switch (texture->type) {
+	case TEXTURE_TYPE_DXT1 :
+	case TEXTURE_TYPE_DXT1A :
+	case TEXTURE_TYPE_DXT3 :
+	case TEXTURE_TYPE_DXT5 :
+		{
+		int color_offset = (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_DXT5) ? 8 : 0;
+		for (int use_pca = 1; use_pca >= 0 && nu_seeds < max_seeds; use_pca--) {
+			unsigned char *bitstring = &bitstrings[nu_seeds * bytes_per_block];
+			float endpoint0[3], endpoint1[3];
+			calculate_color_endpoints(&block, use_pca, endpoint0, endpoint1);
+			set_dxt_colors(&bitstring[color_offset], endpoint0, endpoint1, color_offset == 0);
+			if (texture->type == TEXTURE_TYPE_DXT5)
+				set_alpha3_endpoints(bitstring, &block, 3, 0);
+			if (texture->type == TEXTURE_TYPE_DXT3)
+				optimize_block_dxt3(bitstring, user_data->alpha_pixels);
+			if (derive_block_indices(bitstring, user_data, NULL) >= 0)
+				nu_seeds++;
+		}
+		break;
+		}
+	case TEXTURE_TYPE_RGTC1 :
+	case TEXTURE_TYPE_RGTC2 :
+	case TEXTURE_TYPE_SIGNED_RGTC1 :
+	case TEXTURE_TYPE_SIGNED_RGTC2 :
+		{
+		int signed_values = (texture->type & TEXTURE_TYPE_SIGNED_BIT) != 0;
+		unsigned char *bitstring = &bitstrings[0];
+		set_alpha3_endpoints(bitstring, &block, 0, signed_values);
+		if (texture->info->nu_components == 2)
+			set_alpha3_endpoints(&bitstring[8], &block, 1, signed_values);
+		if (derive_block_indices(bitstring, user_data, NULL) >= 0)
+			nu_seeds++;
+		break;
+		}
+	case TEXTURE_TYPE_R11_EAC :
+	case TEXTURE_TYPE_RG11_EAC :
+	case TEXTURE_TYPE_SIGNED_R11_EAC :
+	case TEXTURE_TYPE_SIGNED_RG11_EAC :
+		{
+		int signed_values = (texture->type & TEXTURE_TYPE_SIGNED_BIT) != 0;
+		unsigned char *bitstring = &bitstrings[0];
+		set_eac_parameters(bitstring, &block, 0, 1, signed_values);
+		if (texture->info->nu_components == 2)
+			set_eac_parameters(&bitstring[8], &block, 1, 1, signed_values);
+		if (derive_block_indices(bitstring, user_data, NULL) >= 0)
+			nu_seeds++;
+		break;
+		}
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+		nu_seeds = add_etc1_seeds(&block, user_data, 0, bitstrings, 0, max_seeds, bytes_per_block);
+		break;
+	case TEXTURE_TYPE_ETC2_EAC :
+	case TEXTURE_TYPE_ETC2_SRGB_EAC :
+		set_eac_parameters(bitstrings, &block, 3, 0, 0);
+		nu_seeds = add_etc1_seeds(&block, user_data, 8, bitstrings, 0, max_seeds, bytes_per_block);
+		break;
+	case TEXTURE_TYPE_BPTC :
+		nu_seeds = add_bptc_mode6_seeds(&block, user_data, bitstrings, 0, max_seeds);
+		nu_seeds = add_bptc_partition_seeds(&block, user_data, bitstrings, nu_seeds, max_seeds);
+		break;
+	}
+	return nu_seeds;
+}
+
+// Return whether calculate_analytic_seeds() supports the texture format, so that blocks can be encoded without the
+// genetic algorithm.
+
+int analytic_encoding_supported(int texture_type) {
+	switch (texture_type) {
+	case TEXTURE_TYPE_DXT1 :
+	case TEXTURE_TYPE_DXT1A :
+	case TEXTURE_TYPE_DXT3 :
+	case TEXTURE_TYPE_DXT5 :
+	case TEXTURE_TYPE_RGTC1 :
+	case TEXTURE_TYPE_RGTC2 :
+	case TEXTURE_TYPE_SIGNED_RGTC1 :
+	case TEXTURE_TYPE_SIGNED_RGTC2 :
+	case TEXTURE_TYPE_R11_EAC :
+	case TEXTURE_TYPE_RG11_EAC :
+	case TEXTURE_TYPE_SIGNED_R11_EAC :
+	case TEXTURE_TYPE_SIGNED_RG11_EAC :
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+	case TEXTURE_TYPE_ETC2_EAC :
+	case TEXTURE_TYPE_ETC2_SRGB_EAC :
+	case TEXTURE_TYPE_BPTC :
+		return 1;
+	}
+	return 0;
+}
+
+// Encode a block without the genetic algorithm, using the analytic encoding with the lowest error among the first
+// max_seeds ones. Returns the error of the encoding stored in bitstring, or - 1 if the texture format is not
+// supported.
+
+double encode_block_analytically(BlockUserData *user_data, unsigned char *bitstring, int max_seeds) {
+	int bytes_per_block = user_data->texture->bits_per_block / 8;
+	unsigned char seeds[MAX_ANALYTIC_SEEDS * 16];
+	int nu_seeds = calculate_analytic_seeds(user_data, seeds, max_seeds);
+	double best_error = - 1.0;
+	for (int j = 0; j < nu_seeds; j++) {
+		double error = derive_block_indices(&seeds[j * bytes_per_block], user_data, NULL);
+		if (error >= 0 && (best_error < 0 || error < best_error)) {
+			best_error = error;
+			memcpy(bitstring, &seeds[j * bytes_per_block], bytes_per_block);
+		}
+	}
+	return best_error;
+}
+
+// BPTC mode pre-selection. Before the genetic algorithm runs on a BPTC block, a cheap analysis estimates the error
+// of each mode and partition: the distance of the pixels of each subset to the principal axis of their colors,
+// plus the expected quantization error of the pixel indices along that axis and of the endpoints. Only the modes
+// whose estimate is close to the best one are allowed, and each island is given one of the best partitions with
+// two and with three subsets. The restriction is passed to the decoder in the flags, so that bitstrings with
+// other modes or partitions are invalid. Mode 6, used by the analytic seeds, is always allowed.
+
+#define BPTC_MODE_SELECTION_MARGIN	1.5	// Allow modes with an estimated error within this factor of the best.
+#define BPTC_MODE_SELECTION_SLACK	16.0	// Absolute margin, one unit of squared error per pixel.
+
+typedef struct {
+	int n;			// Number of pixels.
+	int nu_components;
+	float fit_error;	// Squared distance of the pixels to the principal axis.
+	float extent;		// Length of the range of the pixels along the principal axis.
+} BptcSubsetFit;
+
+// Fit a line through the components in component_mask (one bit per component) of the pixels in pixel_mask (one bit
+// per pixel).
+
+static void fit_bptc_subset(const SourceBlock *block, int pixel_mask, int component_mask, BptcSubsetFit *fit) {
+	int comp[4];
+	int nc = 0;
+	for (int c = 0; c < 4; c++)
+		if (component_mask & (1 << c))
+			comp[nc++] = c;
+	fit->nu_components = nc;
+	fit->n = 0;
+	fit->fit_error = 0;
+	fit->extent = 0;
+	float mean[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; i++)
+		if (pixel_mask & (1 << i)) {
+			for (int j = 0; j < nc; j++)
+				mean[j] += block->value[i][comp[j]];
+			fit->n++;
+		}
+	if (fit->n == 0)
+		return;
+	for (int j = 0; j < nc; j++)
+		mean[j] /= fit->n;
+	float cov[4][4];
+	memset(cov, 0, sizeof(cov));
+	for (int i = 0; i < 16; i++)
+		if (pixel_mask & (1 << i)) {
+			float d[4];
+			for (int j = 0; j < nc; j++)
+				d[j] = block->value[i][comp[j]] - mean[j];
+			for (int j = 0; j < nc; j++)
+				for (int k = j; k < nc; k++)
+					cov[j][k] += d[j] * d[k];
+		}
+	float trace = 0;
+	int largest = 0;
+	for (int j = 0; j < nc; j++) {
+		for (int k = 0; k < j; k++)
+			cov[j][k] = cov[k][j];
+		trace += cov[j][j];
+		if (cov[j][j] > cov[largest][largest])
+			largest = j;
+	}
+	if (trace <= 0)
+		return;
+	// Determine the principal axis using power iteration, starting with the covariances of the component with the
+	// largest variance. With a unit axis, the length of the product is the estimate of the largest eigenvalue.
+	float axis[4];
+	for (int j = 0; j < nc; j++)
+		axis[j] = cov[largest][j];
+	float eigenvalue = 0;
+	for (int iteration = 0; iteration < 6; iteration++) {
+		float v[4];
+		float length = 0;
+		for (int j = 0; j < nc; j++) {
+			v[j] = 0;
+			for (int k = 0; k < nc; k++)
+				v[j] += cov[j][k] * axis[k];
+			length += v[j] * v[j];
+		}
+		if (length == 0)
+			break;
+		length = sqrtf(length);
+		for (int j = 0; j < nc; j++)
+			axis[j] = v[j] / length;
+		eigenvalue = length;
+	}
+	fit->fit_error = fmaxf(trace - eigenvalue, 0);
+	float min = HUGE_VALF;
+	float max = - HUGE_VALF;
+	for (int i = 0; i < 16; i++)
+		if (pixel_mask & (1 << i)) {
+			float t = 0;
+			for (int j = 0; j < nc; j++)
+				t += (block->value[i][comp[j]] - mean[j]) * axis[j];
+			min = fminf(min, t);
+			max = fmaxf(max, t);
+		}
+	fit->extent = max - min;
+}
+
+// Estimate the error of encoding a fitted subset with the given number of evenly spaced index values and endpoint
+// precision. Both quantization errors are modeled as uniformly distributed.
+
+static float estimate_bptc_subset_error(const BptcSubsetFit *fit, int nu_index_values, int precision) {
+	float index_step = fit->extent / (nu_index_values - 1);
+	float endpoint_step = 256.0f / (1 << precision);
+	return fit->fit_error + fit->n * (index_step * index_step + fit->nu_components * endpoint_step *
+		endpoint_step) / 12.0f;
+}
+
+// Store the indices of the n partitions (of 64) with the lowest error in partition, best first.
+
+static void select_best_bptc_partitions(const float *error, int n, int *partition) {
+	unsigned char used[64];
+	memset(used, 0, 64);
+	for (int i = 0; i < n; i++) {
+		int best = 0;
+		while (used[best])
+			best++;
+		for (int p = best + 1; p < 64; p++)
+			if (!used[p] && error[p] < error[best])
+				best = p;
+		used[best] = 1;
+		partition[i] = best;
+	}
+}
+
+// Analyse a BPTC block and store the decoder flags for each of nu_islands islands compressing it in island_flags.
+// All islands are allowed the same modes; island i is given the partitions with two and three subsets ranked i
+// (modulo the number of partitions).
+
+void select_bptc_island_flags(BlockUserData *user_data, int nu_islands, int *island_flags) {
+	SourceBlock block;
+	if (!get_source_block(user_data, &block)) {
+		for (int i = 0; i < nu_islands; i++)
+			island_flags[i] = BPTC_MODE_ALLOWED_ALL | ENCODE_BIT;
+		return;
+	}
+	int pixel_mask = 0;
+	float alpha_error = 0;	// Additional error of the modes without alpha.
+	for (int i = 0; i < 16; i++)
+		if (block.color_valid[i]) {
+			pixel_mask |= 1 << i;
+			alpha_error += (255 - block.value[i][3]) * (255 - block.value[i][3]);
+		}
+	int rgba_mask = alpha_error > 0 ? 0xF : 0x7;
+	float mode_error[8];
+	BptcSubsetFit fit;
+	fit_bptc_subset(&block, pixel_mask, rgba_mask, &fit);
+	mode_error[6] = estimate_bptc_subset_error(&fit, 16, 8);
+	// Modes 4 and 5 encode one component, selected by the rotation, with separate indices. Mode 4 can swap the
+	// 2-bit and 3-bit index planes.
+	mode_error[4] = mode_error[5] = HUGE_VALF;
+	for (int rotation = 0; rotation < 4; rotation++) {
+		int separate = rotation == 0 ? 3 : rotation - 1;
+		BptcSubsetFit separate_fit;
+		fit_bptc_subset(&block, pixel_mask, 1 << separate, &separate_fit);
+		fit_bptc_subset(&block, pixel_mask, rgba_mask & ~(1 << separate), &fit);
+		for (int m = 4; m <= 5; m++) {
+			float error = estimate_bptc_subset_error(&fit, bptc_color_index_values[m],
+				bptc_color_precision[m]) + estimate_bptc_subset_error(&separate_fit,
+				bptc_alpha_index_values[m], bptc_alpha_precision[m]);
+			if (m == 4)
+				error = fminf(error, estimate_bptc_subset_error(&fit, 8, bptc_color_precision[m]) +
+					estimate_bptc_subset_error(&separate_fit, 4, bptc_alpha_precision[m]));
+			mode_error[m] = fminf(mode_error[m], error);
+		}
+	}
+	// Modes with two or three subsets, for each partition. Modes 0 to 3 have no alpha, mode 0 only has the first
+	// 16 partitions.
+	float partition_error[8][64];
+	for (int m = 0; m < 8; m++) {
+		if (bptc_nu_subsets[m] == 1)
+			continue;
+		mode_error[m] = HUGE_VALF;
+		for (int p = 0; p < 64; p++)
+			partition_error[m][p] = m < 4 ? alpha_error : 0;
+	}
+	for (int p = 0; p < 64; p++)
+		for (int nu_subsets = 2; nu_subsets <= 3; nu_subsets++)
+			for (int s = 0; s < nu_subsets; s++) {
+				int mask = 0;
+				for (int i = 0; i < 16; i++)
+					if ((nu_subsets == 2 ? table_P2 : table_P3)[p * 16 + i] == s)
+						mask |= 1 << i;
+				BptcSubsetFit rgb_fit;
+				fit_bptc_subset(&block, mask & pixel_mask, 0x7, &rgb_fit);
+				if (nu_subsets == 2)
+					fit_bptc_subset(&block, mask & pixel_mask, rgba_mask, &fit);
+				for (int m = 0; m < 8; m++)
+					if (bptc_nu_subsets[m] == nu_subsets)
+						partition_error[m][p] += estimate_bptc_subset_error(m == 7 ? &fit :
+							&rgb_fit, bptc_color_index_values[m], bptc_color_precision[m]);
+			}
+	for (int p = 16; p < 64; p++)
+		partition_error[0][p] = HUGE_VALF;
+	for (int m = 0; m < 8; m++)
+		if (bptc_nu_subsets[m] > 1)
+			for (int p = 0; p < 64; p++)
+				mode_error[m] = fminf(mode_error[m], partition_error[m][p]);
+	// Allow the modes with an estimated error close to the best one.
+	float best_error = HUGE_VALF;
+	for (int m = 0; m < 8; m++)
+		best_error = fminf(best_error, mode_error[m]);
+	int modes = 1 << 6;
+	for (int m = 0; m < 8; m++)
+		if (mode_error[m] <= best_error * BPTC_MODE_SELECTION_MARGIN + BPTC_MODE_SELECTION_SLACK)
+			modes |= 1 << m;
+	// Rank the partitions with two and three subsets by their error with the best allowed mode.
+	int nu_candidates = nu_islands < 64 ? nu_islands : 64;
+	int partition[2][64];
+	for (int nu_subsets = 2; nu_subsets <= 3; nu_subsets++) {
+		float error[64];
+		for (int p = 0; p < 64; p++) {
+			error[p] = HUGE_VALF;
+			for (int m = 0; m < 8; m++)
+				if ((modes & (1 << m)) && bptc_nu_subsets[m] == nu_subsets)
+					error[p] = fminf(error[p], partition_error[m][p]);
+		}
+		select_best_bptc_partitions(error, nu_candidates, partition[nu_subsets - 2]);
+	}
+	for (int i = 0; i < nu_islands; i++) {
+		int partition2 = partition[0][i % nu_candidates];
+		int partition3 = partition[1][i % nu_candidates];
+		int flags = modes;
+		if (partition3 >= 16)
+			flags &= ~1;
+		island_flags[i] = flags | BPTC_PARTITION_RESTRICTED | (partition2 << BPTC_PARTITION2_SHIFT) |
+			(partition3 << BPTC_PARTITION3_SHIFT) | ENCODE_BIT;
+	}
+}
+
+// Exhaustive encoders. For some formats, the bits of a block that are not pixel indices (the header) span a search
+// space that is small enough to search directly, since the best pixel indices for a given header follow from
+// derive_block_indices(). encode_block_exhaustively() searches the header space of these formats and is used
+// instead of the genetic algorithm with the exhaustive speed setting.
+//
+// ETC1: once the flip bit, the base color and the modifier table of a 2x4 sub-block are fixed, the best modifier
+// of each pixel is independent of the other pixels, and the two sub-blocks are independent except for the
+// limited difference of the base colors in differential mode. For each flip bit and sub-block, all base colors in
+// a box around the quantized average color of the sub-block are tried with all eight modifier tables. The
+// individual mode takes the best base color of each sub-block, the differential mode the best pair of base colors
+// whose difference can be represented.
+//
+// One-component formats (R11/RG11 EAC and RGTC1/2, signed and unsigned): each component is stored in a separate
+// 64-bit half with a 16-bit header, and the best index of each pixel is simply the nearest value of the palette
+// defined by the header. The whole header space of each half is searched, so the result is optimal.
+
+#define ETC1_INDIVIDUAL_SEARCH_RADIUS	3	// In 4-bit base color units.
+#define ETC1_DIFFERENTIAL_SEARCH_RADIUS	5	// In 5-bit base color units.
+#define ETC1_MAX_SEARCH_BOX		((ETC1_DIFFERENTIAL_SEARCH_RADIUS * 2 + 1) * (ETC1_DIFFERENTIAL_SEARCH_RADIUS * 2 + \
+	1) * (ETC1_DIFFERENTIAL_SEARCH_RADIUS * 2 + 1))
+
+typedef struct {
+	int nu_pixels;
+	int value[8][3];
+	float average[3];
+} Etc1SubBlock;
+
+// Collect the pixels of sub-block s of an ETC1 block with the given flip bit that are inside the image.
+
+static void get_etc1_sub_block(const SourceBlock *block, int flipbit, int s, Etc1SubBlock *sub) {
+	sub->nu_pixels = 0;
+	for (int c = 0; c < 3; c++)
+		sub->average[c] = 0;
+	for (int i = 0; i < 16; i++) {
+		if (!block->color_valid[i])
+			continue;
+		if ((flipbit ? (i >> 2) >= 2 : (i & 3) >= 2) != s)
+			continue;
+		for (int c = 0; c < 3; c++) {
+			sub->value[sub->nu_pixels][c] = block->value[i][c];
+			sub->average[c] += block->value[i][c];
+		}
+		sub->nu_pixels++;
+	}
+	if (sub->nu_pixels > 0)
+		for (int c = 0; c < 3; c++)
+			sub->average[c] /= sub->nu_pixels;
+}
+
+// Calculate the error of a sub-block with the given 8-bit base color and modifier table, using the best modifier
+// for each pixel. The calculation stops as soon as the error reaches limit.
+
+static int get_etc1_sub_block_error(const Etc1SubBlock *sub, const int *base, int table, int limit) {
+	int error = 0;
+	for (int i = 0; i < sub->nu_pixels && error < limit; i++) {
+		int best = INT_MAX;
+		for (int k = 0; k < 4; k++) {
+			int modifier = etc_modifier_table[table][k];
+			int e = 0;
+			for (int c = 0; c < 3; c++) {
+				int d = clampi(base[c] + modifier, 0, 255) - sub->value[i][c];
+				e += d * d;
+			}
+			if (e < best)
+				best = e;
+		}
+		error += best;
+	}
+	return error;
+}
+
+// Try all base colors with the given number of bits per component within radius of center, with all modifier
+// tables, for a sub-block. For each base color in the search box (ordered by red, green and blue offset), the
+// smallest error is stored in error and the corresponding table in table.
+
+static void search_etc1_base_colors(const Etc1SubBlock *sub, int bits, int radius, const int *center, int *error,
+unsigned char *table) {
+	int max = (1 << bits) - 1;
+	int size = radius * 2 + 1;
+	for (int dr = 0; dr < size; dr++)
+		for (int dg = 0; dg < size; dg++)
+			for (int db = 0; db < size; db++) {
+				int j = (dr * size + dg) * size + db;
+				int q[3] = { center[0] - radius + dr, center[1] - radius + dg, center[2] - radius + db };
+				error[j] = INT_MAX;
+				table[j] = 0;
+				if (q[0] < 0 || q[0] > max || q[1] < 0 || q[1] > max || q[2] < 0 || q[2] > max)
+					continue;
+				int base[3];
+				for (int c = 0; c < 3; c++)
+					if (bits == 4)
+						base[c] = (q[c] << 4) | q[c];
+					else
+						base[c] = (q[c] << 3) | (q[c] >> 2);
+				for (int t = 0; t < 8; t++) {
+					int e = get_etc1_sub_block_error(sub, base, t, error[j]);
+					if (e < error[j]) {
+						error[j] = e;
+						table[j] = t;
+					}
+				}
+			}
+}
+
+// Return the center of the base color search box of a sub-block, the average color quantized to the given number
+// of bits per component. When the sub-block has no pixels inside the image, the average of the other sub-block is
+// used.
+
+static void get_etc1_search_center(const Etc1SubBlock *sub, const Etc1SubBlock *other, int bits, int *center) {
+	const float *average = sub->nu_pixels > 0 ? sub->average : other->average;
+	int max = (1 << bits) - 1;
+	for (int c = 0; c < 3; c++)
+		center[c] = clampi((int)floorf(average[c] * max / 255.0 + 0.5), 0, max);
+}
+
+// Search the individual or differential mode encodings of an ETC1 block with the given flip bit. The best one is
+// stored in bitstring (without pixel indices). Returns its error, or - 1 when the mode cannot represent the block.
+
+static int search_etc1_mode(const SourceBlock *block, int flipbit, int differential, unsigned char *bitstring) {
+	Etc1SubBlock sub[2];
+	for (int s = 0; s < 2; s++)
+		get_etc1_sub_block(block, flipbit, s, &sub[s]);
+	int bits = differential ? 5 : 4;
+	int radius = differential ? ETC1_DIFFERENTIAL_SEARCH_RADIUS : ETC1_INDIVIDUAL_SEARCH_RADIUS;
+	int size = radius * 2 + 1;
+	int center[2][3];
+	int error[2][ETC1_MAX_SEARCH_BOX];
+	unsigned char table[2][ETC1_MAX_SEARCH_BOX];
+	for (int s = 0; s < 2; s++) {
+		get_etc1_search_center(&sub[s], &sub[1 - s], bits, center[s]);
+		search_etc1_base_colors(&sub[s], bits, radius, center[s], error[s], table[s]);
+	}
+	int best_error = INT_MAX;
+	int best[2] = { 0, 0 };
+	if (!differential)
+		// The sub-blocks are independent.
+		for (int s = 0; s < 2; s++) {
+			int e = INT_MAX;
+			for (int j = 0; j < size * size * size; j++)
+				if (error[s][j] < e) {
+					e = error[s][j];
+					best[s] = j;
+				}
+			best_error = s == 0 ? e : best_error + e;
+		}
+	else
+		// The base color of the second sub-block must be within - 4 to 3 of the first one for each component.
+		for (int j0 = 0; j0 < size * size * size; j0++) {
+			if (error[0][j0] >= best_error)
+				continue;
+			int q0[3] = { center[0][0] - radius + j0 / (size * size), center[0][1] - radius + (j0 / size) % size,
+				center[0][2] - radius + j0 % size };
+			int lo[3], hi[3];
+			for (int c = 0; c < 3; c++) {
+				lo[c] = clampi(q0[c] - 4 - (center[1][c] - radius), 0, size);
+				hi[c] = clampi(q0[c] + 3 - (center[1][c] - radius), - 1, size - 1);
+			}
+			for (int dr = lo[0]; dr <= hi[0]; dr++)
+				for (int dg = lo[1]; dg <= hi[1]; dg++)
+					for (int db = lo[2]; db <= hi[2]; db++) {
+						int j1 = (dr * size + dg) * size + db;
+						if (error[1][j1] == INT_MAX)
+							continue;
+						int e = error[0][j0] + error[1][j1];
+						if (e < best_error) {
+							best_error = e;
+							best[0] = j0;
+							best[1] = j1;
+						}
+					}
+		}
+	if (best_error == INT_MAX)
+		return - 1;
+	int q[2][3];
+	for (int s = 0; s < 2; s++) {
+		q[s][0] = center[s][0] - radius + best[s] / (size * size);
+		q[s][1] = center[s][1] - radius + (best[s] / size) % size;
+		q[s][2] = center[s][2] - radius + best[s] % size;
+	}
+	for (int c = 0; c < 3; c++)
+		if (differential)
+			bitstring[c] = (q[0][c] << 3) | ((q[1][c] - q[0][c]) & 7);
+		else
+			bitstring[c] = (q[0][c] << 4) | q[1][c];
+	bitstring[3] = (table[0][best[0]] << 5) | (table[1][best[1]] << 2) | (differential ? 2 : 0) | flipbit;
+	memset(&bitstring[4], 0, 4);
+	return best_error;
+}
+
+// Encode an ETC1 block with the best individual or differential mode encoding found by searching the base colors
+// of both flip bit orientations. Returns the error, or - 1 if no mode is allowed.
+
+static double encode_block_etc1_exhaustively(BlockUserData *user_data, const SourceBlock *block,
+unsigned char *bitstring) {
+	int best_error = INT_MAX;
+	for (int differential = 0; differential < 2; differential++) {
+		if (!(user_data->flags & (differential ? ETC_MODE_ALLOWED_DIFFERENTIAL : ETC_MODE_ALLOWED_INDIVIDUAL)))
+			continue;
+		for (int flipbit = 0; flipbit < 2; flipbit++) {
+			unsigned char candidate[8];
+			int error = search_etc1_mode(block, flipbit, differential, candidate);
+			if (error >= 0 && error < best_error) {
+				best_error = error;
+				memcpy(bitstring, candidate, 8);
+			}
+		}
+	}
+	if (best_error == INT_MAX)
+		return - 1.0;
+	return derive_block_indices(bitstring, user_data, NULL);
+}
+
+// The source values of one component of a block, sorted, in the domain of the comparison function.
+
+typedef struct {
+	int nu_values;
+	int64_t value[16];
+} ComponentValues;
+
+static void get_component_values(const SourceBlock *block, int metric, int c, ComponentValues *values) {
+	values->nu_values = 0;
+	for (int i = 0; i < 16; i++) {
+		if (!block->valid[i])
+			continue;
+		unsigned int pixel = block->pixel[i];
+		int64_t v;
+		switch (metric) {
+		case METRIC_8_BIT_COMPONENTS :
+			v = c == 0 ? pixel_get_r(pixel) : pixel_get_g(pixel);
+			break;
+		case METRIC_8_BIT_COMPONENTS_WITH_16_BIT :
+		case METRIC_R16 :
+		case METRIC_RG16 :
+			v = c == 0 ? pixel_get_r16(pixel) : pixel_get_g16(pixel);
+			break;
+		default :	// METRIC_R16_SIGNED, METRIC_RG16_SIGNED
+			v = c == 0 ? pixel_get_signed_r16(pixel) : pixel_get_signed_g16(pixel);
+			break;
+		}
+		// Insertion sort.
+		int j = values->nu_values;
+		for (; j > 0 && values->value[j - 1] > v; j--)
+			values->value[j] = values->value[j - 1];
+		values->value[j] = v;
+		values->nu_values++;
+	}
+}
+
+// Calculate the error of the component values when each one is represented by the nearest entry of a sorted
+// palette. The calculation stops as soon as the error reaches limit.
+
+static int64_t get_palette_error(const ComponentValues *values, const int64_t *palette, int nu_entries,
+int64_t limit) {
+	int64_t error = 0;
+	int k = 0;
+	for (int i = 0; i < values->nu_values && error < limit; i++) {
+		int64_t v = values->value[i];
+		// Since the values are sorted as well, the nearest palette entry never moves back.
+		while (k < nu_entries - 1 && palette[k + 1] <= v)
+			k++;
+		int64_t d = v - palette[k];
+		if (k < nu_entries - 1 && palette[k + 1] - v < (d < 0 ? - d : d))
+			d = palette[k + 1] - v;
+		error += d * d;
+	}
+	return error;
+}
+
+// Return a lower bound of the palette error of the component values below x (when below is set) or above x
+// (otherwise), where x is the lowest or highest palette value that depends on the header. When the palette also
+// contains the fixed values min and max, the distance to those is taken into account.
+
+static int64_t get_out_of_range_error(const ComponentValues *values, int64_t x, int below, int fixed_values,
+int64_t min, int64_t max) {
+	int64_t error = 0;
+	if (below)
+		for (int i = 0; i < values->nu_values && values->value[i] < x; i++) {
+			int64_t d = x - values->value[i];
+			if (fixed_values && values->value[i] - min < d)
+				d = values->value[i] - min;
+			error += d * d;
+		}
+	else
+		for (int i = values->nu_values - 1; i >= 0 && values->value[i] > x; i--) {
+			int64_t d = values->value[i] - x;
+			if (fixed_values && max - values->value[i] < d)
+				d = max - values->value[i];
+			error += d * d;
+		}
+	return error;
+}
+
+// Map a decoded RGTC value (0 to 255, or - 127 to 127 for signed formats) to the domain of the comparison
+// function, as the decoder and comparison function do.
+
+static int64_t map_rgtc_value(int v, int metric) {
+	switch (metric) {
+	case METRIC_8_BIT_COMPONENTS :
+		return v;
+	case METRIC_8_BIT_COMPONENTS_WITH_16_BIT :
+		return v * 65535 / 255;
+	default :	// Signed.
+		return (v + 127) * 65535 / 254 - 32768;
+	}
+}
+
+// Search all endpoint pairs of an RGTC (or DXT5 alpha) component for both the eight value mode (first endpoint
+// larger) and the six value mode. Pairs are skipped when the values outside the range of the endpoints already
+// cause a larger error than the best pair so far. The best endpoints are stored in the first two bytes of
+// bitstring. Returns the error.
+
+static int64_t search_rgtc_endpoints(const ComponentValues *values, int metric, int signed_values,
+unsigned char *bitstring) {
+	int min = signed_values ? - 127 : 0;
+	int max = signed_values ? 127 : 255;
+	int n = max - min + 1;
+	int64_t mapped[256];
+	int64_t below_error[2][256], above_error[2][256];
+	for (int v = min; v <= max; v++)
+		mapped[v - min] = map_rgtc_value(v, metric);
+	for (int six_values = 0; six_values < 2; six_values++)
+		for (int j = 0; j < n; j++) {
+			below_error[six_values][j] = get_out_of_range_error(values, mapped[j], 1, six_values, mapped[0],
+				mapped[n - 1]);
+			above_error[six_values][j] = get_out_of_range_error(values, mapped[j], 0, six_values, mapped[0],
+				mapped[n - 1]);
+		}
+	int64_t best_error = INT64_MAX;
+	for (int six_values = 0; six_values < 2; six_values++)
+		for (int lo = min; lo <= max; lo++) {
+			if (below_error[six_values][lo - min] >= best_error)
+				continue;
+			// The endpoints may be equal only in the six value mode.
+			for (int hi = six_values ? lo : lo + 1; hi <= max; hi++) {
+				if (below_error[six_values][lo - min] + above_error[six_values][hi - min] >= best_error)
+					continue;
+				// Calculate the palette in ascending order, with the same rounding as the decoder.
+				int64_t palette[8];
+				if (six_values) {
+					palette[0] = mapped[0];
+					for (int k = 0; k < 6; k++)
+						palette[k + 1] = mapped[(k * hi + (5 - k) * lo) / 5 - min];
+					palette[7] = mapped[n - 1];
+				}
+				else
+					for (int k = 0; k < 8; k++)
+						palette[k] = mapped[(k * hi + (7 - k) * lo) / 7 - min];
+				int64_t error = get_palette_error(values, palette, 8, best_error);
+				if (error < best_error) {
+					best_error = error;
+					bitstring[0] = (unsigned char)(six_values ? lo : hi);
+					bitstring[1] = (unsigned char)(six_values ? hi : lo);
+				}
+			}
+		}
+	return best_error;
+}
+
+// Return the decoded value of an 11-bit EAC pixel with the given base codeword, multiplier and modifier, extended to
+// 16 bits as the decoder does.
+
+static int64_t get_eac_value(int base, int multiplier, int modifier, int signed_values) {
+	// A multiplier of zero uses the modifier as it is.
+	int v = modifier * (multiplier == 0 ? 1 : multiplier * 8);
+	if (!signed_values) {
+		v = clampi(base * 8 + 4 + v, 0, 2047);
+		return (v << 5) | (v >> 6);
+	}
+	v = clampi(base * 8 + v, - 1023, 1023);
+	if (v >= 0)
+		return (v << 5) | (v >> 5);
+	return - (((- v) << 5) | ((- v) >> 5));
+}
+
+// Search all base codewords, multipliers and modifier tables of an 11-bit EAC component. Headers are skipped when
+// the values outside the range of the palette already cause a larger error than the best header so far. The best
+// header is stored in the first two bytes of bitstring. Returns the error.
+
+static int64_t search_eac_header(const ComponentValues *values, int signed_values, unsigned char *bitstring) {
+	// The modifiers of each table in ascending order, which is also the order of the decoded values.
+	int modifier[16][8];
+	for (int t = 0; t < 16; t++)
+		for (int k = 0; k < 8; k++) {
+			int j = k;
+			for (; j > 0 && modifier[t][j - 1] > eac_modifier_table[t][k]; j--)
+				modifier[t][j] = modifier[t][j - 1];
+			modifier[t][j] = eac_modifier_table[t][k];
+		}
+	int min = signed_values ? - 127 : 0;	// A signed base codeword of - 128 is not allowed.
+	int max = signed_values ? 127 : 255;
+	int64_t best_error = INT64_MAX;
+	for (int multiplier = 0; multiplier < 16; multiplier++)
+		for (int t = 0; t < 16; t++)
+			for (int base = min; base <= max; base++) {
+				int64_t palette[8];
+				for (int k = 0; k < 8; k++)
+					palette[k] = get_eac_value(base, multiplier, modifier[t][k], signed_values);
+				if (get_out_of_range_error(values, palette[0], 1, 0, 0, 0) +
+				get_out_of_range_error(values, palette[7], 0, 0, 0, 0) >= best_error)
+					continue;
+				int64_t error = get_palette_error(values, palette, 8, best_error);
+				if (error < best_error) {
+					best_error = error;
+					bitstring[0] = (unsigned char)base;
+					bitstring[1] = (multiplier << 4) | t;
+				}
+			}
+	return best_error;
+}
+
+// Encode a block of a one-component format with the optimal header for each component. Returns the error, or - 1
+// if the comparison function is not supported.
+
+static double encode_block_one_component_exhaustively(BlockUserData *user_data, const SourceBlock *block,
+unsigned char *bitstring) {
+	Texture *texture = user_data->texture;
+	int metric = get_pixel_metric(texture);
+	int signed_values = (texture->type & TEXTURE_TYPE_SIGNED_BIT) != 0;
+	int rgtc = (texture->type == TEXTURE_TYPE_RGTC1 || texture->type == TEXTURE_TYPE_RGTC2 ||
+		texture->type == TEXTURE_TYPE_SIGNED_RGTC1 || texture->type == TEXTURE_TYPE_SIGNED_RGTC2);
+	memset(bitstring, 0, texture->bits_per_block / 8);
+	for (int c = 0; c < texture->info->nu_components; c++) {
+		ComponentValues values;
+		get_component_values(block, metric, c, &values);
+		if (rgtc)
+			search_rgtc_endpoints(&values, metric, signed_values, &bitstring[c * 8]);
+		else
+			search_eac_header(&values, signed_values, &bitstring[c * 8]);
+	}
+	return derive_block_indices(bitstring, user_data, NULL);
+}
+
+// Return whether encode_block_exhaustively() supports the texture format.
+
+int exhaustive_encoding_supported(int texture_type) {
+	switch (texture_type) {
+	case TEXTURE_TYPE_ETC1 :
+		return 1;
+	}
+	return exhaustive_encoding_is_optimal(texture_type);
+}
+
+// Return whether encode_block_exhaustively() searches the complete header space of the texture format, so that
+// the encoding is optimal and the genetic algorithm can't improve on it.
+
+int exhaustive_encoding_is_optimal(int texture_type) {
+	switch (texture_type) {
+	case TEXTURE_TYPE_R11_EAC :
+	case TEXTURE_TYPE_RG11_EAC :
+	case TEXTURE_TYPE_SIGNED_R11_EAC :
+	case TEXTURE_TYPE_SIGNED_RG11_EAC :
+	case TEXTURE_TYPE_RGTC1 :
+	case TEXTURE_TYPE_RGTC2 :
+	case TEXTURE_TYPE_SIGNED_RGTC1 :
+	case TEXTURE_TYPE_SIGNED_RGTC2 :
+		return 1;
+	}
+	return 0;
+}
+
+// Encode a block by searching the header space of the texture format, without the genetic algorithm. Returns the
+// error of the encoding stored in bitstring, or - 1 if the texture format is not supported.
+
+double encode_block_exhaustively(BlockUserData *user_data, unsigned char *bitstring) {
+	SourceBlock block;
+	if (!get_source_block(user_data, &block))
+		return - 1.0;
+	switch (user_data->texture->type) {
+	case TEXTURE_TYPE_ETC1 :
+		return encode_block_etc1_exhaustively(user_data, &block, bitstring);
+	}
+	if (exhaustive_encoding_is_optimal(user_data->texture->type))
+		return encode_block_one_component_exhaustively(user_data, &block, bitstring);
+	return - 1.0;
+}
+
+// Single color lookup tables for the DXT formats. For each 8-bit component value, they contain the pair of 5-bit
+// or 6-bit endpoint values for which the interpolated color (2 * color0 + color1) / 3 (four-color mode) or
+// (color0 + color1) / 2 (three-color mode) is closest to the value.
+
+static unsigned char dxt_single_color_table[2][2][256][2];	// [mode][5 or 6 bits][value][endpoint]
+
+void init_single_color_tables() {
+	for (int mode = 0; mode < 2; mode++)
+		for (int bits = 0; bits < 2; bits++) {
+			int n = bits == 0 ? 32 : 64;
+			int shift = bits == 0 ? 3 : 2;
+			for (int v = 0; v < 256; v++) {
+				int best_error = INT_MAX;
+				for (int e0 = 0; e0 < n; e0++)
+					for (int e1 = 0; e1 < n; e1++) {
+						int c0 = e0 << shift;
+						int c1 = e1 << shift;
+						int c;
+						if (mode == 0)
+							c = (2 * c0 + c1) / 3;
+						else
+							c = (c0 + c1) / 2;
+						int error = abs(c - v) * 2;
+						// Prefer different endpoints, equal colors are not always allowed.
+						if (e0 == e1)
+							error++;
+						if (error < best_error) {
+							best_error = error;
+							dxt_single_color_table[mode][bits][v][0] = e0;
+							dxt_single_color_table[mode][bits][v][1] = e1;
+						}
+					}
+			}
+		}
+}
+
+#define MAX_SINGLE_COLOR_CANDIDATES 4
+
+// Calculate DXT color candidates for a single color using the single color tables, and with the color itself
+// as an endpoint. Returns the number of candidates.
+
+static int get_single_color_candidates_dxt(const int *value, int three_color_mode_allowed,
+unsigned int *colors) {
+	int n = 0;
+	for (int mode = 0; mode < 2; mode++) {
+		if (mode == 1 && !three_color_mode_allowed)
+			continue;
+		unsigned int color[2];
+		for (int i = 0; i < 2; i++)
+			color[i] = (dxt_single_color_table[mode][0][value[0]][i] << 11) |
+				(dxt_single_color_table[mode][1][value[1]][i] << 5) |
+				dxt_single_color_table[mode][0][value[2]][i];
+		// The interpolated color is at index 2 when color0 > color1 (four-color mode), and when
+		// color0 <= color1 (three-color mode). Swapping the colors moves it to index 3 in four-color mode.
+		if ((mode == 0 && color[0] < color[1]) || (mode == 1 && color[0] > color[1])) {
+			unsigned int tmp = color[0];
+			color[0] = color[1];
+			color[1] = tmp;
+		}
+		colors[n++] = color[0] | (color[1] << 16);
+	}
+	// Use the color itself as the first endpoint (index 0), with a slightly different second endpoint.
+	unsigned int color0 = (clampi((value[0] + 4) >> 3, 0, 31) << 11) | (clampi((value[1] + 2) >> 2, 0, 63) << 5) |
+		clampi((value[2] + 4) >> 3, 0, 31);
+	if (color0 == 0)
+		// Black is obtained with index 1.
+		colors[n++] = 1;
+	else
+		colors[n++] = color0 | ((color0 - 1) << 16);
+	return n;
+}
+
+// Find the best base codeword, multiplier and modifier table to represent a single value with an EAC block.
+// The value is 8-bit (alpha) when eleven_bit is zero, otherwise unsigned or signed 16-bit. The parameters are
+// stored in the first two bytes of bitstring.
+
+static void set_eac_single_value(unsigned char *bitstring, int value, int eleven_bit, int signed_values) {
+	int64_t best_error = INT64_MAX;
+	// Approximate target value in units of the 11-bit value.
+	float target11;
+	if (signed_values)
+		target11 = value / 32.0;
+	else
+		target11 = value * 2047.0 / 65535.0;
+	for (int t = 0; t < 16; t++)
+		for (int k = 0; k < 8; k++) {
+			int modifier = eac_modifier_table[t][k];
+			for (int m = eleven_bit ? 0 : 1; m < 16; m++) {
+				int base_guess;
+				if (!eleven_bit)
+					base_guess = value - modifier * m;
+				else {
+					int modifier_times_multiplier = m == 0 ? modifier : modifier * m * 8;
+					base_guess = (int)floorf((target11 - (signed_values ? 0 : 4) -
+						modifier_times_multiplier) / 8.0 + 0.5);
+				}
+				for (int base = base_guess - 1; base <= base_guess + 1; base++) {
+					int decoded;
+					if (!eleven_bit) {
+						if (base < 0 || base > 255)
+							continue;
+						decoded = clampi(base + modifier * m, 0, 255);
+					}
+					else
+					if (!signed_values) {
+						if (base < 0 || base > 255)
+							continue;
+						int v = clampi(base * 8 + 4 + (m == 0 ? modifier : modifier * m * 8), 0, 2047);
+						decoded = (v << 5) | (v >> 6);
+					}
+					else {
+						if (base < - 127 || base > 127)
+							continue;
+						int v = clampi(base * 8 + (m == 0 ? modifier : modifier * m * 8), - 1023, 1023);
+						if (v >= 0)
+							decoded = (v << 5) | (v >> 5);
+						else
+							decoded = - (((- v) << 5) | ((- v) >> 5));
+					}
+					int64_t error = (int64_t)(decoded - value) * (decoded - value);
+					if (error < best_error) {
+						best_error = error;
+						bitstring[0] = (unsigned char)base;
+						bitstring[1] = (m << 4) | t;
+					}
+				}
+			}
+		}
+}
+
+// Set the base colors and modifier tables of an ETC1 style block for a single color, in individual or
+// differential mode. Both sub-blocks are identical. When punchthrough is set, the modifiers of the ETC2
+// punchthrough format with the opaque bit cleared are used. Returns the error of the color.
+
+static int set_etc_single_color(unsigned char *bitstring, const int *value, int differential, int punchthrough) {
+	int best_error = INT_MAX;
+	int best_table = 0;
+	int best_base[3] = { 0, 0, 0 };
+	for (int t = 0; t < 8; t++)
+		for (int k = 0; k < 4; k++) {
+			if (punchthrough && k == 2)
+				// Transparent pixel.
+				continue;
+			int modifier = (punchthrough && k == 0) ? 0 : etc_modifier_table[t][k];
+			int error = 0;
+			int base[3];
+			for (int c = 0; c < 3; c++) {
+				int best_component_error = INT_MAX;
+				for (int b = 0; b < (differential ? 32 : 16); b++) {
+					int expanded = differential ? (b << 3) | (b >> 2) : (b << 4) | b;
+					int d = clampi(expanded + modifier, 0, 255) - value[c];
+					if (d * d < best_component_error) {
+						best_component_error = d * d;
+						base[c] = b;
+					}
+				}
+				error += best_component_error;
+			}
+			if (error < best_error) {
+				best_error = error;
+				best_table = t;
+				memcpy(best_base, base, sizeof(int) * 3);
+			}
+		}
+	for (int c = 0; c < 3; c++)
+		if (differential)
+			bitstring[c] = best_base[c] << 3;
+		else
+			bitstring[c] = (best_base[c] << 4) | best_base[c];
+	bitstring[3] = (best_table << 5) | (best_table << 2) | (differential ? 2 : 0);
+	return best_error;
+}
+
+// Set the endpoints of a BPTC mode 6 block for a single RGBA color. All pixels use the same index, which is
+// chosen together with the p-bit of the first endpoint.
+
+static void set_bptc_mode6_single_color(unsigned char *bitstring, const int *value) {
+	int best_error = INT_MAX;
+	int best_endpoint[2][4];
+	int best_pbit = 0;
+	// The anchor pixel index is limited to three bits.
+	for (int index = 0; index < 8; index++) {
+		int w = aWeight4[index];
+		for (int pbit = 0; pbit < 2; pbit++) {
+			int error = 0;
+			int endpoint[2][4];
+			for (int c = 0; c < 4; c++) {
+				int best_component_error = INT_MAX;
+				for (int e0 = 0; e0 < 128; e0++) {
+					int c0 = e0 * 2 + pbit;
+					// The second p-bit is always zero.
+					int e1_guess = w == 0 ? 0 : ((value[c] * 64 - (64 - w) * c0) / w) / 2;
+					for (int e1 = e1_guess - 1; e1 <= e1_guess + 1; e1++) {
+						if (e1 < 0 || e1 > 127)
+							continue;
+						int d = (((64 - w) * c0 + w * e1 * 2 + 32) >> 6) - value[c];
+						if (d * d < best_component_error) {
+							best_component_error = d * d;
+							endpoint[0][c] = e0;
+							endpoint[1][c] = e1;
+						}
+					}
+				}
+				error += best_component_error;
+			}
+			if (error < best_error) {
+				best_error = error;
+				best_pbit = pbit;
+				memcpy(best_endpoint, endpoint, sizeof(endpoint));
+			}
+		}
+	}
+	uint64_t data0 = 0x40;		// Mode 6.
+	int bit = 7;
+	for (int c = 0; c < 4; c++)
+		for (int j = 0; j < 2; j++) {
+			data0 |= (uint64_t)best_endpoint[j][c] << bit;
+			bit += 7;
+		}
+	data0 |= (uint64_t)best_pbit << 63;
+	*(uint64_t *)&bitstring[0] = data0;
+	*(uint64_t *)&bitstring[8] = 0;
+}
+
+// Calculate candidate encodings of a block in which every pixel has the color of source pixel i. The pixel
+// indices are not set. Returns the number of candidates.
+
+static int get_single_color_candidates(BlockUserData *user_data, const SourceBlock *block, int i,
+unsigned char *bitstrings) {
+	Texture *texture = user_data->texture;
+	int metric = get_pixel_metric(texture);
+	int bytes_per_block = texture->bits_per_block / 8;
+	const int *value = block->value[i];
+	int n = 0;
+	memset(bitstrings, 0, MAX_SINGLE_COLOR_CANDIDATES * bytes_per_block);
+	switch (texture->type) {
+	case TEXTURE_TYPE_DXT1 :
+	case TEXTURE_TYPE_DXT1A :
+	case TEXTURE_TYPE_DXT3 :
+	case TEXTURE_TYPE_DXT5 :
+		{
+		int color_offset = (texture->type == TEXTURE_TYPE_DXT3 || texture->type == TEXTURE_TYPE_DXT5) ? 8 : 0;
+		unsigned int colors[MAX_SINGLE_COLOR_CANDIDATES];
+		n = get_single_color_candidates_dxt(value, color_offset == 0, colors);
+		if (texture->type == TEXTURE_TYPE_DXT1A)
+			// Transparent black with index 3 in three-color mode.
+			colors[n++] = 0;
+		for (int j = 0; j < n; j++) {
+			unsigned char *bitstring = &bitstrings[j * bytes_per_block];
+			*(unsigned int *)&bitstring[color_offset] = colors[j];
+			if (texture->type == TEXTURE_TYPE_DXT5) {
+				// The six value mode (alpha0 <= alpha1) has the exact alpha value at index 0.
+				bitstring[0] = value[3];
+				bitstring[1] = value[3];
+			}
+			if (texture->type == TEXTURE_TYPE_DXT3)
+				optimize_block_dxt3(bitstring, user_data->alpha_pixels);
+		}
+		break;
+		}
+	case TEXTURE_TYPE_RGTC1 :
+	case TEXTURE_TYPE_RGTC2 :
+	case TEXTURE_TYPE_SIGNED_RGTC1 :
+	case TEXTURE_TYPE_SIGNED_RGTC2 :
+		{
+		int signed_values = (texture->type & TEXTURE_TYPE_SIGNED_BIT) != 0;
+		for (int c = 0; c < texture->info->nu_components; c++) {
+			// Find the 8-bit value closest to the source value (the other component does not affect the
+			// choice), and use it for both endpoints (six value mode, index 0).
+			double best_error = HUGE_VAL;
+			int best_v = 0;
+			for (int v = signed_values ? - 127 : 0; v <= (signed_values ? 127 : 255); v++) {
+				unsigned int decoded;
+				if (signed_values)
+					// Signed RGTC is decoded to signed 16-bit components.
+					decoded = (unsigned int)(uint16_t)((v + 127) * 65535 / 254 - 32768) << (c * 16);
+				else
+					decoded = (unsigned int)v << (c * 8);
+				double error = get_pixel_error(metric, texture->info->nu_components, decoded,
+					block->pixel[i]);
+				if (error < best_error) {
+					best_error = error;
+					best_v = v;
+				}
+			}
+			bitstrings[c * 8] = (unsigned char)best_v;
+			bitstrings[c * 8 + 1] = (unsigned char)best_v;
+		}
+		n = 1;
+		break;
+		}
+	case TEXTURE_TYPE_R11_EAC :
+	case TEXTURE_TYPE_RG11_EAC :
+	case TEXTURE_TYPE_SIGNED_R11_EAC :
+	case TEXTURE_TYPE_SIGNED_RG11_EAC :
+		{
+		int signed_values = (texture->type & TEXTURE_TYPE_SIGNED_BIT) != 0;
+		for (int c = 0; c < texture->info->nu_components; c++)
+			set_eac_single_value(&bitstrings[c * 8], value[c], 1, signed_values);
+		n = 1;
+		break;
+		}
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+	case TEXTURE_TYPE_ETC2_EAC :
+	case TEXTURE_TYPE_ETC2_SRGB_EAC :
+		{
+		int etc_offset = (texture->type == TEXTURE_TYPE_ETC2_EAC || texture->type == TEXTURE_TYPE_ETC2_SRGB_EAC) ?
+			8 : 0;
+		for (int differential = 0; differential < 2; differential++) {
+			if (!(user_data->flags & (differential ? ETC_MODE_ALLOWED_DIFFERENTIAL : ETC_MODE_ALLOWED_INDIVIDUAL)))
+				continue;
+			unsigned char *bitstring = &bitstrings[n * bytes_per_block];
+			set_etc_single_color(&bitstring[etc_offset], value, differential, 0);
+			if (etc_offset == 8)
+				set_eac_single_value(bitstring, value[3], 0, 0);
+			n++;
+		}
+		break;
+		}
+	case TEXTURE_TYPE_ETC2_PUNCHTHROUGH :
+	case TEXTURE_TYPE_ETC2_SRGB_PUNCHTHROUGH :
+		// Always differential mode, with the opaque bit set or not.
+		for (int opaque = 0; opaque < 2; opaque++) {
+			unsigned char *bitstring = &bitstrings[n * bytes_per_block];
+			set_etc_single_color(bitstring, value, 1, !opaque);
+			if (!opaque)
+				bitstring[3] &= ~2;
+			n++;
+		}
+		break;
+	case TEXTURE_TYPE_BPTC :
+		set_bptc_mode6_single_color(bitstrings, value);
+		n = 1;
+		break;
+	}
+	return n;
+}
+
+// Encode the block with the best encoding for the single color of source pixel i, where the error is only counted
+// for the pixels for which mask is set (all pixels if mask is NULL). Returns the error, or - 1 if the texture
+// format is not supported.
+
+static double encode_single_color(BlockUserData *user_data, const SourceBlock *block, int i,
+const unsigned char *mask, unsigned char *bitstring) {
+	int bytes_per_block = user_data->texture->bits_per_block / 8;
+	unsigned char candidates[MAX_SINGLE_COLOR_CANDIDATES * 16];
+	int n = get_single_color_candidates(user_data, block, i, candidates);
+	double best_error = - 1.0;
+	for (int j = 0; j < n; j++) {
+		unsigned char *candidate = &candidates[j * bytes_per_block];
+		double pixel_error[16];
+		if (derive_block_indices(candidate, user_data, pixel_error) < 0)
+			continue;
+		double error = 0;
+		for (int k = 0; k < 16; k++)
+			if (mask == NULL || mask[k])
+				error += pixel_error[k];
+		if (best_error < 0 || error < best_error) {
+			best_error = error;
+			memcpy(bitstring, candidate, bytes_per_block);
+		}
+	}
+	return best_error;
+}
+
+// Directly encode a block that has only one or two different colors (pixels that compare with zero error are
+// considered to have the same color). A single color block gets the optimal encoding derived from single color
+// lookup tables. For a block with two colors, the analytic encodings are used when they reach the lower bound
+// given by the optimal single color encodings of each color. Returns the error of the encoding stored in bitstring,
+// or - 1 if the block could not be encoded directly.
+
+double encode_block_with_few_colors(BlockUserData *user_data, unsigned char *bitstring) {
+	Texture *texture = user_data->texture;
+	SourceBlock block;
+	if (!get_source_block(user_data, &block))
+		return - 1.0;
+	int metric = get_pixel_metric(texture);
+	int color_pixel[2];
+	unsigned char mask[2][16];
+	int nu_colors = 0;
+	memset(mask, 0, sizeof(mask));
+	for (int i = 0; i < 16; i++) {
+		if (!block.valid[i])
+			continue;
+		int j;
+		for (j = 0; j < nu_colors; j++)
+			if (get_pixel_error(metric, texture->info->nu_components, block.pixel[i],
+			block.pixel[color_pixel[j]]) == 0)
+				break;
+		if (j == nu_colors) {
+			if (nu_colors == 2)
+				return - 1.0;
+			color_pixel[nu_colors++] = i;
+		}
+		mask[j][i] = 1;
+	}
+	if (nu_colors == 1)
+		return encode_single_color(user_data, &block, color_pixel[0], NULL, bitstring);
+	unsigned char tmp[16];
+	double bound = 0;
+	for (int j = 0; j < 2; j++) {
+		double error = encode_single_color(user_data, &block, color_pixel[j], mask[j], tmp);
+		if (error < 0)
+			return - 1.0;
+		bound += error;
+	}
+	int bytes_per_block = texture->bits_per_block / 8;
+	unsigned char seeds[MAX_ANALYTIC_SEEDS * 16];
+	int nu_seeds = calculate_analytic_seeds(user_data, seeds, MAX_ANALYTIC_SEEDS);
+	for (int j = 0; j < nu_seeds; j++) {
+		double error = derive_block_indices(&seeds[j * bytes_per_block], user_data, NULL);
+		if (error >= 0 && error <= bound) {
+			memcpy(bitstring, &seeds[j * bytes_per_block], bytes_per_block);
+			return error;
+		}
+	}
+	return - 1.0;
+}
+
+// Incremental fitness evaluation. Offspring in the GA may differ from their parents only in pixel index bits.
+// For each combination of non-index bits (endpoints, base colors, modes) that has recently been evaluated, the
+// cache stores the error of each pixel for each index value that has been seen for that pixel. When a bitstring
+// has the same non-index bits as a cached entry and the errors of all its pixel indices are known, the fitness
+// is the sum of the cached errors and the block is not decoded. Otherwise the block is decoded and the errors of
+// its pixels are added to the cache. The result is always identical to a full evaluation.
+//
+// Because the GA operators work on individual bits without regard to the block layout, how often the cache hits
+// depends strongly on the format and the state of the population. The hit rate is sampled periodically, and
+// when it is too low to pay for the bookkeeping, the cache is bypassed for a while.
+
+#define FITNESS_CACHE_SIZE		32	// Must be a power of two.
+#define FITNESS_CACHE_SAMPLE_SIZE	1024	// Number of lookups over which the hit rate is measured.
+#define FITNESS_CACHE_BYPASS_COUNT	8192	// Number of evaluations for which a low hit rate cache is bypassed.
+
+typedef struct {
+	unsigned char key[16];		// The bitstring with all index bits cleared.
+	int used;
+	int valid;			// Whether the block is valid with these non-index bits.
+	unsigned short known[16];	// For each pixel, bit mask of the index values with a known error.
+	double error[16][16];		// Error of each pixel for each index value.
+} FitnessCacheEntry;
+
+struct FitnessCache_t {
+	FitnessCacheEntry entry[FITNESS_CACHE_SIZE];
+	int nu_lookups;
+	int nu_hits;
+	int bypass_count;
+};
+
+FitnessCache *create_fitness_cache() {
+	FitnessCache *cache = (FitnessCache *)malloc(sizeof(FitnessCache));
+	reset_fitness_cache(cache);
+	return cache;
+}
+
+void destroy_fitness_cache(FitnessCache *cache) {
+	free(cache);
+}
+
+// Invalidate all cache entries. Must be called when the block that is compressed or the mode flags change.
+
+void reset_fitness_cache(FitnessCache *cache) {
+	for (int i = 0; i < FITNESS_CACHE_SIZE; i++)
+		cache->entry[i].used = 0;
+	cache->nu_lookups = 0;
+	cache->nu_hits = 0;
+	cache->bypass_count = 0;
+}
+
+// Return whether incremental fitness evaluation is supported for the texture. It requires a format with a single
+// index plane and a comparison function that has an equivalent per-pixel error metric.
+
+int fitness_cache_supported(Texture *texture) {
+	if (get_pixel_metric(texture) == METRIC_NONE)
+		return 0;
+	switch (texture->type) {
+	case TEXTURE_TYPE_DXT1 :
+	case TEXTURE_TYPE_DXT1A :
+	case TEXTURE_TYPE_DXT3 :
+	case TEXTURE_TYPE_RGTC1 :
+	case TEXTURE_TYPE_SIGNED_RGTC1 :
+	case TEXTURE_TYPE_ETC1 :
+	case TEXTURE_TYPE_ETC2_RGB8 :
+	case TEXTURE_TYPE_ETC2_SRGB8 :
+	case TEXTURE_TYPE_ETC2_PUNCHTHROUGH :
+	case TEXTURE_TYPE_ETC2_SRGB_PUNCHTHROUGH :
+	case TEXTURE_TYPE_R11_EAC :
+	case TEXTURE_TYPE_SIGNED_R11_EAC :
+	case TEXTURE_TYPE_BPTC :
+		return 1;
+	}
+	return 0;
+}
+
+static double calculate_fitness_without_cache(const unsigned char *bitstring, BlockUserData *user_data) {
+	unsigned int image_buffer[32];
+	if (!user_data->texture->decoding_function(bitstring, image_buffer, user_data->flags))
+		return 0;
+	return user_data->texture->comparison_function(image_buffer, user_data);
+}
+
+// Calculate the fitness of a bitstring (the inverse of the error, zero for invalid blocks), using the cache when
+// possible. Only textures for which fitness_cache_supported() returns true are allowed; blocks that do not have
+// a single index plane (for example BPTC modes 4 and 5) are always fully evaluated.
+
+double calculate_fitness_with_cache(FitnessCache *cache, const unsigned char *bitstring, BlockUserData *user_data) {
+	if (cache->bypass_count > 0) {
+		cache->bypass_count--;
+		return calculate_fitness_without_cache(bitstring, user_data);
+	}
+	if (cache->nu_lookups == FITNESS_CACHE_SAMPLE_SIZE) {
+		// Bypass the cache when fewer than a quarter of the lookups hit.
+		if (cache->nu_hits * 4 < cache->nu_lookups)
+			cache->bypass_count = FITNESS_CACHE_BYPASS_COUNT;
+		cache->nu_lookups = 0;
+		cache->nu_hits = 0;
+	}
+	Texture *texture = user_data->texture;
+	int bytes_per_block = texture->bits_per_block / 8;
+	IndexPlane planes[2];
+	int nu_planes = get_index_planes(texture->type, bitstring, planes);
+	if (nu_planes < 0 || nu_planes > 1)
+		return calculate_fitness_without_cache(bitstring, user_data);
+	cache->nu_lookups++;
+	unsigned char key[16];
+	memcpy(key, bitstring, bytes_per_block);
+	int indices[16];
+	if (nu_planes == 1) {
+		clear_pixel_indices(&planes[0], key);
+		get_pixel_indices(&planes[0], bitstring, indices);
+	}
+	else
+		// Blocks without index bits (ETC2 planar mode) are cached as a whole.
+		memset(indices, 0, sizeof(indices));
+	// Hash the key (FNV-1a) to select the cache entry.
+	unsigned int hash = 2166136261u;
+	for (int i = 0; i < bytes_per_block; i++)
+		hash = (hash ^ key[i]) * 16777619u;
+	FitnessCacheEntry *entry = &cache->entry[(hash ^ (hash >> 16)) & (FITNESS_CACHE_SIZE - 1)];
+	if (entry->used && memcmp(entry->key, key, bytes_per_block) == 0) {
+		if (!entry->valid) {
+			cache->nu_hits++;
+			return 0;
+		}
+		double error = 0;
+		int i;
+		for (i = 0; i < 16; i++) {
+			if (!(entry->known[i] & (1 << indices[i])))
+				break;
+			error += entry->error[i][indices[i]];
+		}
+		if (i == 16) {
+			cache->nu_hits++;
+			return (double)1 / error;
+		}
+	}
+	else {
+		memcpy(entry->key, key, bytes_per_block);
+		entry->used = 1;
+		entry->valid = 1;
+		memset(entry->known, 0, sizeof(entry->known));
+	}
+	unsigned int image_buffer[32];
+	if (!texture->decoding_function(bitstring, image_buffer, user_data->flags)) {
+		// Validity only depends on the non-index bits.
+		entry->valid = 0;
+		return 0;
+	}
+	double pixel_error[16];
+	calculate_block_pixel_errors(image_buffer, user_data, pixel_error);
+	double error = 0;
+	for (int i = 0; i < 16; i++) {
+		entry->error[i][indices[i]] = pixel_error[i];
+		entry->known[i] |= 1 << indices[i];
+		error += pixel_error[i];
+	}
+	return (double)1 / error;
+}
+
+// Local search.
+//
+// The best block found by the GA is usually close to a local optimum but not at it, since the GA only samples
+// random bit changes. polish_block() finishes the search deterministically with a first-improvement hill climb.
+// For formats for which derive_block_indices() is supported, the moves are single bit flips in the non-index bits
+// (endpoints, base colors, modes and partitions), each followed by choosing the optimal indices for the changed
+// block; the index fields are never searched bit by bit since the optimal ones are known. For other formats, every
+// bit of the block is tried. A move is only kept when the block remains valid and its fitness increases.
+
+// Calculate the fitness of a candidate block of the local search, counting the evaluation in the user data.
+
+static double calculate_candidate_fitness(const unsigned char *bitstring, BlockUserData *user_data) {
+	double fitness = calculate_fitness_without_cache(bitstring, user_data);
+	user_data->nu_evaluations++;
+	if (fitness == 0)
+		user_data->nu_invalid++;
+	return fitness;
+}
+
+// Set the bits of mask that are not part of a pixel index for the block. Returns whether the indices of the block
+// can be derived.
+
+static int get_non_index_bit_mask(BlockUserData *user_data, const unsigned char *bitstring, unsigned char *mask) {
+	Texture *texture = user_data->texture;
+	memset(mask, 0xFF, texture->bits_per_block / 8);
+	if (get_pixel_metric(texture) == METRIC_NONE)
+		return 0;
+	IndexPlane planes[2];
+	int nu_planes = get_index_planes(texture->type, bitstring, planes);
+	if (nu_planes < 0)
+		return 0;
+	for (int i = 0; i < nu_planes; i++)
+		clear_pixel_indices(&planes[i], mask);
+	return 1;
+}
+
+// Improve a compressed block with fitness fitness by local search, for at most max_passes passes over the bits of
+// the block. The block is updated in place and its new fitness is returned.
+
+double polish_block(BlockUserData *user_data, unsigned char *bitstring, double fitness, int max_passes) {
+	Texture *texture = user_data->texture;
+	int bytes_per_block = texture->bits_per_block / 8;
+	unsigned char candidate[16];
+	unsigned char mask[16];
+	// Start with the optimal indices for the endpoints found by the GA.
+	int derive = get_non_index_bit_mask(user_data, bitstring, mask);
+	if (derive) {
+		memcpy(candidate, bitstring, bytes_per_block);
+		if (derive_block_indices(candidate, user_data, NULL) >= 0) {
+			double f = calculate_candidate_fitness(candidate, user_data);
+			if (f > fitness) {
+				memcpy(bitstring, candidate, bytes_per_block);
+				fitness = f;
+			}
+		}
+	}
+	for (int pass = 0; pass < max_passes && !isinf(fitness); pass++) {
+		int improved = 0;
+		for (int bit = 0; bit < texture->bits_per_block; bit++) {
+			if (!(mask[bit >> 3] & (1 << (bit & 7))))
+				continue;
+			memcpy(candidate, bitstring, bytes_per_block);
+			candidate[bit >> 3] ^= 1 << (bit & 7);
+			if (derive) {
+				double error = derive_block_indices(candidate, user_data, NULL);
+				// The derived error uses the same metric as the comparison function, so only blocks that
+				// may be better need to be fully evaluated.
+				if (error < 0 || error >= (double)1 / fitness)
+					continue;
+			}
+			double f = calculate_candidate_fitness(candidate, user_data);
+			if (f > fitness) {
+				memcpy(bitstring, candidate, bytes_per_block);
+				fitness = f;
+				improved = 1;
+				// A different mode may have a different index layout.
+				derive = get_non_index_bit_mask(user_data, bitstring, mask);
+				if (isinf(fitness))
+					break;
+			}
+		}
+		if (!improved)
+			break;
+	}
+	return fitness;
+}
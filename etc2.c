@@ -84,7 +84,7 @@ static int complement3bitshifted_table[8] = {
 	0, 8, 16, 24, -32, -24, -16, -8
 };
 
-static int modifier_table[8][4] = {
+int etc_modifier_table[8][4] = {
 	{ 2, 8, -2, -8 },
 	{ 5, 17, -5, -17 },
 	{ 9, 29, -9, -29 },
@@ -150,7 +150,7 @@ static int complement3bit(int x) {
 	int pixel_index = ((pixel_index_word & (1 << i)) >> i) \
 		| ((pixel_index_word & (0x10000 << i)) >> (16 + i - 1)); \
 	int r, g, b; \
-	int modifier = modifier_table[table_codeword1][pixel_index]; \
+	int modifier = etc_modifier_table[table_codeword1][pixel_index]; \
 	r = clamp(base_color_subblock1_R + modifier); \
 	g = clamp(base_color_subblock1_G + modifier); \
 	b = clamp(base_color_subblock1_B + modifier); \
@@ -163,7 +163,7 @@ static int complement3bit(int x) {
 	int pixel_index = ((pixel_index_word & (1 << i)) >> i) \
 		| ((pixel_index_word & (0x10000 << i)) >> (16 + i - 1)); \
 	int r, g, b; \
-	int modifier = modifier_table[table_codeword2][pixel_index]; \
+	int modifier = etc_modifier_table[table_codeword2][pixel_index]; \
 	r = clamp(base_color_subblock2_R + modifier); \
 	g = clamp(base_color_subblock2_G + modifier); \
 	b = clamp(base_color_subblock2_B + modifier); \
@@ -176,7 +176,7 @@ static int complement3bit(int x) {
 	int pixel_index = ((pixel_index_word & (1 << i)) >> i) \
 		| ((pixel_index_word & (0x10000 << i)) >> (16 + i - 1)); \
 	int r, g, b; \
-	int modifier = modifier_table[table_codeword1][pixel_index]; \
+	int modifier = etc_modifier_table[table_codeword1][pixel_index]; \
 	r = clamp(base_color_subblock1_R + modifier); \
 	g = clamp(base_color_subblock1_G + modifier); \
 	b = clamp(base_color_subblock1_B + modifier); \
@@ -189,7 +189,7 @@ static int complement3bit(int x) {
 	int pixel_index = ((pixel_index_word & (1 << i)) >> i) \
 		| ((pixel_index_word & (0x10000 << i)) >> (16 + i - 1)); \
 	int r, g, b; \
-	int modifier = modifier_table[table_codeword2][pixel_index]; \
+	int modifier = etc_modifier_table[table_codeword2][pixel_index]; \
 	r = clamp(base_color_subblock2_R + modifier); \
 	g = clamp(base_color_subblock2_G + modifier); \
 	b = clamp(base_color_subblock2_B + modifier); \
@@ -305,14 +305,14 @@ int draw_block4x4_etc1(const unsigned char *bitstring, unsigned int *image_buffe
 			// Two 2x4 blocks side-by-side.
 			if (i < 8) {
 				// Subblock 1.
-				int modifier = modifier_table[table_codeword1][pixel_index];
+				int modifier = etc_modifier_table[table_codeword1][pixel_index];
 				r = clamp(base_color_subblock1_R + modifier);
 				g = clamp(base_color_subblock1_G + modifier);
 				b = clamp(base_color_subblock1_B + modifier);
 			}
 			else {
 				// Subblock 2.
-				int modifier = modifier_table[table_codeword2][pixel_index];
+				int modifier = etc_modifier_table[table_codeword2][pixel_index];
 				r = clamp(base_color_subblock2_R + modifier);
 				g = clamp(base_color_subblock2_G + modifier);
 				b = clamp(base_color_subblock2_B + modifier);
@@ -322,14 +322,14 @@ int draw_block4x4_etc1(const unsigned char *bitstring, unsigned int *image_buffe
 			// Two 4x2 blocks on top of each other.
 			if ((i & 2) == 0) {
 				// Subblock 1.
-				int modifier = modifier_table[table_codeword1][pixel_index];
+				int modifier = etc_modifier_table[table_codeword1][pixel_index];
 				r = clamp(base_color_subblock1_R + modifier);
 				g = clamp(base_color_subblock1_G + modifier);
 				b = clamp(base_color_subblock1_B + modifier);
 			}
 			else {
 				// Subblock 2.
-				int modifier = modifier_table[table_codeword2][pixel_index];
+				int modifier = etc_modifier_table[table_codeword2][pixel_index];
 				r = clamp(base_color_subblock2_R + modifier);
 				g = clamp(base_color_subblock2_G + modifier);
 				b = clamp(base_color_subblock2_B + modifier);
@@ -597,7 +597,7 @@ int block4x4_etc2_rgb8_get_mode(const unsigned char *bitstring) {
 }
 
 
-static char eac_modifier_table[16][8] = {
+char eac_modifier_table[16][8] = {
 	{ -3, -6, -9, -15, 2, 5, 8, 14 },
 	{ -3, -7, -10, -13, 2, 6, 9, 12 },
 	{ -2, -5, -8, -13, 1, 4, 7, 12 },
@@ -759,7 +759,7 @@ static unsigned int punchthrough_mask_table[4] = {
 	int pixel_index = ((pixel_index_word & (1 << i)) >> i) \
 		| ((pixel_index_word & (0x10000 << i)) >> (16 + i - 1)); \
 	int r, g, b; \
-	int modifier = modifier_table[table_codeword1][pixel_index]; \
+	int modifier = etc_modifier_table[table_codeword1][pixel_index]; \
 	r = clamp(base_color_subblock1_R + modifier); \
 	g = clamp(base_color_subblock1_G + modifier); \
 	b = clamp(base_color_subblock1_B + modifier); \
@@ -773,7 +773,7 @@ static unsigned int punchthrough_mask_table[4] = {
 	int pixel_index = ((pixel_index_word & (1 << i)) >> i) \
 		| ((pixel_index_word & (0x10000 << i)) >> (16 + i - 1)); \
 	int r, g, b; \
-	int modifier = modifier_table[table_codeword2][pixel_index]; \
+	int modifier = etc_modifier_table[table_codeword2][pixel_index]; \
 	r = clamp(base_color_subblock2_R + modifier); \
 	g = clamp(base_color_subblock2_G + modifier); \
 	b = clamp(base_color_subblock2_B + modifier); \
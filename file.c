@@ -894,6 +894,14 @@ void load_png_file(const char *filename, Image *image) {
 	png_height = png_get_image_height(png_ptr, info_ptr);
 	color_type = png_get_color_type(png_ptr, info_ptr);
 	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	// Expand 8-bit grayscale images to RGB.
+	if (bit_depth == 8 && (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)) {
+		png_set_gray_to_rgb(png_ptr);
+		if (color_type == PNG_COLOR_TYPE_GRAY)
+			color_type = PNG_COLOR_TYPE_RGB;
+		else
+			color_type = PNG_COLOR_TYPE_RGBA;
+	}
 
 	number_of_passes = png_set_interlace_handling(png_ptr);
 	png_read_update_info(png_ptr, info_ptr);
@@ -551,22 +551,23 @@ static void menu_item_compress_activate_cb(GtkMenuItem *menu_item, gpointer data
 			gui_handle_events();
 			current_file_type[1] = FILE_TYPE_UNDEFINED;
 		}
+		CompressContext context;
 		if (current_image[1][i].bits_per_component == 16 && !current_image[1][i].is_half_float) {
 			// The image is in r16 or rg16 format, or the signed version.
-			compress_image(&current_image[0][i], format, compress_rg16_callback,
-				&current_texture[1][i], 0, 0, 0);
+			init_compress_context(&context, compress_rg16_callback);
+			compress_image(&context, &current_image[0][i], format, &current_texture[1][i]);
 		}	
 		else
 		if (current_image[1][i].bits_per_component == 8 && current_image[1][i].nu_components <= 2) {
 			// The image is in r8 or rg8 format, or signed r8 or signed rg8.
-			compress_image(&current_image[0][i], format, compress_rg8_callback,
-				&current_texture[1][i], 0, 0, 0);
+			init_compress_context(&context, compress_rg8_callback);
+			compress_image(&context, &current_image[0][i], format, &current_texture[1][i]);
 		}
 		else
 		if (!current_image[1][i].is_half_float && current_image[0][i].is_half_float) {
 			// The source image is in half-float format, the destination is in regular RGB(A)8 format.
-			compress_image(&current_image[0][i], format, compress_callback,
-				&current_texture[1][i], 0, 0, 0);
+			init_compress_context(&context, compress_callback);
+			compress_image(&context, &current_image[0][i], format, &current_texture[1][i]);
 		}
 		else
 		if (!current_image[1][i].is_half_float) {
@@ -578,13 +579,14 @@ static void menu_item_compress_activate_cb(GtkMenuItem *menu_item, gpointer data
 			memcpy(image.pixels, current_image[0][i].pixels, current_image[0][i].height *
 				current_image[0][i].extended_width * 4);
 			convert_image_to_or_from_cairo_format(&image);
-			compress_image(&image, format, compress_callback, &current_texture[1][i], 0, 0, 0);
+			init_compress_context(&context, compress_callback);
+			compress_image(&context, &image, format, &current_texture[1][i]);
 			free(image.pixels);
 		}
 		else {
 			// The image is in half-float format.
-			compress_image(&current_image[0][i], format, compress_half_float_callback,
-				&current_texture[1][i], 0, 0, 0);
+			init_compress_context(&context, compress_half_float_callback);
+			compress_image(&context, &current_image[0][i], format, &current_texture[1][i]);
 		}
 		// Uncompressed textures didn't generate compress_callback so the image hasn't been filled in.
 		if (current_texture[1][i].type & TEXTURE_TYPE_UNCOMPRESSED_BIT) {
@@ -242,6 +242,7 @@ double compare_images(Image *image1, Image *image2) {
 	int nu_components = image1->nu_components;
 	if (image2->nu_components < image1->nu_components)
 		nu_components = image2->nu_components;
+	init_compare_kernels();
 	TextureComparisonFunction compare_func;
 	if (image1->bits_per_component == 16) {
 		if (image1->is_half_float && image2->is_half_float) {
@@ -308,6 +309,10 @@ double compare_images(Image *image1, Image *image2) {
 	Texture texture;
 	texture.width = image1->width;
 	texture.height = image1->height;
+	// The comparison functions for 8-bit components use the number of components of the texture.
+	TextureInfo info;
+	info.nu_components = nu_components;
+	texture.info = &info;
 	block_user_data.texture = &texture;
 	double error = 0;
 	for (int y = 0; y < image1->height; y += 4)
@@ -0,0 +1,287 @@
+/*
+    manifest.c -- part of texgenpack, a texture compressor using fgen.
+
+    texgenpack -- a genetic algorithm texture compressor.
+    Copyright 2013 Harm Hanemaaijer
+
+    This file is part of texgenpack.
+
+    texgenpack is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    texgenpack is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with texgenpack.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Compression of the jobs of a batch manifest (--batch) in a single process. The jobs share a budget of worker
+// threads, normally one for each processor. A job is given one thread for every BATCH_BLOCKS_PER_THREAD blocks,
+// as far as threads are free, so that small textures are compressed side by side on different processors while a
+// large texture can use all of them. Three kinds of threads cooperate:
+//
+// - A loader thread loads the source images of the upcoming jobs in manifest order (generating mipmaps when
+//   required) while the current jobs are compressed. At most one job per thread of the budget is kept loaded ahead.
+// - Job threads, one for each thread of the budget, take the next loaded job, reserve threads for it and compress
+//   it with its own compression context. The GA populations of the block workers are taken from a population pool
+//   shared by all jobs and returned to it when the job is done, so that they are not created for every job again.
+// - A writer thread compares each compressed texture with its source, writes the texture file, prints a line for
+//   the job and frees its memory, in order of completion, while the job threads continue with the next jobs.
+//
+// The jobs are independent, so in deterministic mode the texture of each job is identical to that of a separate
+// texgenpack invocation with the same options.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "texgenpack.h"
+
+// A job gets one thread for this many blocks (of all mipmap levels).
+
+#define BATCH_BLOCKS_PER_THREAD	1024
+
+#define MAX_MIPMAP_LEVELS	32
+
+// The images and textures of a job while it is processed.
+
+typedef struct {
+	int nu_levels;
+	Image *images;
+	Texture *textures;
+	Image importance_image;
+	int has_importance_image;
+	int nu_blocks;		// Total number of blocks of all levels.
+	int nu_threads;		// Number of threads reserved for the compression.
+	double compression_time;
+} BatchJobData;
+
+typedef struct {
+	BatchJob *jobs;
+	BatchJobData *data;
+	int nu_jobs;
+	int nu_loaded;		// Jobs are loaded in order; the first nu_loaded jobs have been loaded.
+	int nu_started;		// Jobs are started in order.
+	int nu_written;
+	int free_threads;	// Number of threads of the budget that are not reserved by a job.
+	int max_threads;
+	int *completed;		// Queue of compressed jobs that have not yet been written.
+	int completed_head;
+	int completed_tail;
+	int quiet;
+	PopulationPool *population_pool;	// GA populations shared by the jobs.
+	pthread_mutex_t mutex;
+	pthread_cond_t changed;	// Signalled whenever any of the above changes.
+} BatchScheduler;
+
+// Load the source images of a job, generating mipmaps when required, and the importance map.
+
+static void load_job(BatchJob *job, BatchJobData *d) {
+	Image *images = (Image *)malloc(sizeof(Image) * MAX_MIPMAP_LEVELS);
+	int nu_levels;
+	if (job->source_filetype & FILE_TYPE_MIPMAPS_BIT)
+		nu_levels = load_mipmap_images(job->source_filename, job->source_filetype, MAX_MIPMAP_LEVELS, images);
+	else {
+		load_image(job->source_filename, job->source_filetype, &images[0]);
+		nu_levels = 1;
+	}
+	if (job->flip_vertical)
+		for (int i = 0; i < nu_levels; i++)
+			flip_image_vertical(&images[i]);
+	if (job->mipmaps && nu_levels == 1) {
+		nu_levels = count_mipmap_levels(&images[0]);
+		generate_mipmap_images(images, nu_levels, (job->texture_type & TEXTURE_TYPE_SRGB_BIT) != 0);
+	}
+	d->nu_levels = nu_levels;
+	d->images = images;
+	d->textures = (Texture *)malloc(sizeof(Texture) * nu_levels);
+	d->nu_blocks = 0;
+	TextureInfo *info = match_texture_type(job->texture_type);
+	for (int i = 0; i < nu_levels; i++)
+		d->nu_blocks += ((images[i].width + info->block_width - 1) / info->block_width) *
+			((images[i].height + info->block_height - 1) / info->block_height);
+	d->has_importance_image = 0;
+	if (job->importance_filename != NULL) {
+		load_image(job->importance_filename, FILE_TYPE_PNG, &d->importance_image);
+		if (d->importance_image.width != images[0].width || d->importance_image.height != images[0].height) {
+			printf("Error -- importance map %s must have the same size as the source image %s (%d x %d).\n",
+				job->importance_filename, job->source_filename, images[0].width, images[0].height);
+			exit(1);
+		}
+		d->has_importance_image = 1;
+	}
+}
+
+// Free the images and textures of a job.
+
+static void free_job(BatchJobData *d) {
+	for (int i = 0; i < d->nu_levels; i++) {
+		destroy_image(&d->images[i]);
+		destroy_texture(&d->textures[i]);
+	}
+	free(d->images);
+	free(d->textures);
+	if (d->has_importance_image)
+		destroy_image(&d->importance_image);
+}
+
+// Main function of the loader thread.
+
+static void *batch_loader_thread(void *arg) {
+	BatchScheduler *s = (BatchScheduler *)arg;
+	pthread_mutex_lock(&s->mutex);
+	while (s->nu_loaded < s->nu_jobs) {
+		// Limit the number of jobs that have been loaded but not started.
+		if (s->nu_loaded - s->nu_started >= s->max_threads) {
+			pthread_cond_wait(&s->changed, &s->mutex);
+			continue;
+		}
+		int j = s->nu_loaded;
+		pthread_mutex_unlock(&s->mutex);
+		load_job(&s->jobs[j], &s->data[j]);
+		pthread_mutex_lock(&s->mutex);
+		s->nu_loaded++;
+		pthread_cond_broadcast(&s->changed);
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+// Main function of a job thread.
+
+static void *batch_job_thread(void *arg) {
+	BatchScheduler *s = (BatchScheduler *)arg;
+	pthread_mutex_lock(&s->mutex);
+	while (s->nu_started < s->nu_jobs) {
+		if (s->nu_started == s->nu_loaded || s->free_threads == 0) {
+			pthread_cond_wait(&s->changed, &s->mutex);
+			continue;
+		}
+		int j = s->nu_started;
+		s->nu_started++;
+		BatchJob *job = &s->jobs[j];
+		BatchJobData *d = &s->data[j];
+		int nu_threads = (d->nu_blocks + BATCH_BLOCKS_PER_THREAD - 1) / BATCH_BLOCKS_PER_THREAD;
+		if (nu_threads > s->free_threads)
+			nu_threads = s->free_threads;
+		if (nu_threads < 1)
+			nu_threads = 1;
+		s->free_threads -= nu_threads;
+		d->nu_threads = nu_threads;
+		pthread_cond_broadcast(&s->changed);
+		pthread_mutex_unlock(&s->mutex);
+
+		double start_time = get_time();
+		job->context.option_max_threads = nu_threads;
+		job->context.importance_map = d->has_importance_image ? &d->importance_image : NULL;
+		job->context.population_pool = s->population_pool;
+		compress_images(&job->context, d->images, d->nu_levels, job->texture_type, d->textures);
+		d->compression_time = get_time() - start_time;
+
+		pthread_mutex_lock(&s->mutex);
+		s->free_threads += nu_threads;
+		s->completed[s->completed_tail] = j;
+		s->completed_tail++;
+		pthread_cond_broadcast(&s->changed);
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+// Main function of the writer thread.
+
+static void *batch_writer_thread(void *arg) {
+	BatchScheduler *s = (BatchScheduler *)arg;
+	pthread_mutex_lock(&s->mutex);
+	while (s->nu_written < s->nu_jobs) {
+		if (s->completed_head == s->completed_tail) {
+			pthread_cond_wait(&s->changed, &s->mutex);
+			continue;
+		}
+		int j = s->completed[s->completed_head];
+		s->completed_head++;
+		pthread_mutex_unlock(&s->mutex);
+
+		BatchJob *job = &s->jobs[j];
+		BatchJobData *d = &s->data[j];
+		Image compressed_image;
+		convert_texture_to_image(&d->textures[0], &compressed_image);
+		double rmse = compare_images(&d->images[0], &compressed_image);
+		destroy_image(&compressed_image);
+		save_texture(&d->textures[0], d->nu_levels, job->dest_filename, job->dest_filetype);
+		if (job->context.collect_statistics)
+			add_statistics(job->source_filename, job->texture_type, d->textures, d->nu_levels, &job->context,
+				d->compression_time);
+
+		pthread_mutex_lock(&s->mutex);
+		s->nu_written++;
+		if (!s->quiet) {
+			printf("[%d/%d] %s -> %s (%s, %d x %d, %d level%s, %d thread%s): %.2lf s, RMSE %lf\n", s->nu_written,
+				s->nu_jobs, job->source_filename, job->dest_filename, texture_type_text(job->texture_type),
+				d->images[0].width, d->images[0].height, d->nu_levels, d->nu_levels == 1 ? "" : "s",
+				d->nu_threads, d->nu_threads == 1 ? "" : "s", d->compression_time, rmse);
+			fflush(stdout);
+		}
+		free_job(d);
+		pthread_cond_broadcast(&s->changed);
+	}
+	pthread_mutex_unlock(&s->mutex);
+	return NULL;
+}
+
+// Compress the jobs of a batch manifest. The images are loaded and the textures are written by separate threads
+// while the jobs are compressed. The number of threads of the budget is set with --maxthreads (default: number of
+// processors).
+
+void compress_batch_jobs(BatchJob *jobs, int nu_jobs) {
+	BatchScheduler s;
+	s.jobs = jobs;
+	s.data = (BatchJobData *)malloc(sizeof(BatchJobData) * nu_jobs);
+	s.nu_jobs = nu_jobs;
+	s.nu_loaded = 0;
+	s.nu_started = 0;
+	s.nu_written = 0;
+	s.max_threads = option_max_threads != - 1 ? option_max_threads : get_number_of_processors();
+	s.free_threads = s.max_threads;
+	s.completed = (int *)malloc(sizeof(int) * nu_jobs);
+	s.completed_head = 0;
+	s.completed_tail = 0;
+	s.population_pool = create_population_pool();
+	s.quiet = option_quiet;
+	pthread_mutex_init(&s.mutex, NULL);
+	pthread_cond_init(&s.changed, NULL);
+	if (!s.quiet)
+		printf("Compressing %d files with %d thread%s.\n", nu_jobs, s.max_threads, s.max_threads == 1 ? "" : "s");
+	double start_time = get_time();
+
+	pthread_t loader_thread, writer_thread;
+	pthread_t *job_threads = (pthread_t *)malloc(sizeof(pthread_t) * s.max_threads);
+	// Messages printed while loading, comparing and saving would be interleaved between the jobs, so they are
+	// suppressed while the batch threads run; the writer thread prints a line for each job instead.
+	option_quiet = 1;
+	pthread_create(&loader_thread, NULL, batch_loader_thread, &s);
+	for (int i = 0; i < s.max_threads; i++)
+		pthread_create(&job_threads[i], NULL, batch_job_thread, &s);
+	pthread_create(&writer_thread, NULL, batch_writer_thread, &s);
+	pthread_join(loader_thread, NULL);
+	for (int i = 0; i < s.max_threads; i++)
+		pthread_join(job_threads[i], NULL);
+	pthread_join(writer_thread, NULL);
+	option_quiet = s.quiet;
+
+	if (!option_quiet)
+		printf("Compressed %d files in %.2lf seconds.\n", nu_jobs, get_time() - start_time);
+	destroy_population_pool(s.population_pool);
+	pthread_cond_destroy(&s.changed);
+	pthread_mutex_destroy(&s.mutex);
+	free(job_threads);
+	free(s.completed);
+	free(s.data);
+}
@@ -619,6 +619,29 @@ void generate_mipmap_level_from_previous_level(Image *source_image, Image *dest_
 	generate_mipmap_level(source_image, 2, dest_image);
 }
 
+// Generate mipmap levels 1 to nu_levels - 1 from the image in images[0], storing them in images[1] to
+// images[nu_levels - 1]. For sRGB textures, the mipmaps are generated after converting the image to RGB and are then
+// converted back to sRGB.
+
+void generate_mipmap_images(Image *images, int nu_levels, int srgb) {
+	if (srgb && nu_levels > 1) {
+		Image *rgb_images = (Image *)malloc(sizeof(Image) * nu_levels);
+		if (!option_quiet)
+			printf("Converting image from sRGB to RGB for mipmap generation.\n");
+		convert_image_from_srgb_to_rgb(&images[0], &rgb_images[0]);
+		for (int i = 1; i < nu_levels; i++) {
+			generate_mipmap_level_from_previous_level(&rgb_images[i - 1], &rgb_images[i]);
+			convert_image_from_rgb_to_srgb(&rgb_images[i], &images[i]);
+		}
+		for (int i = 0; i < nu_levels; i++)
+			destroy_image(&rgb_images[i]);
+		free(rgb_images);
+	}
+	else
+		for (int i = 1; i < nu_levels; i++)
+			generate_mipmap_level_from_previous_level(&images[i - 1], &images[i]);
+}
+
 int count_mipmap_levels(Image *image) {
 	int i = 1;
 	int divider = 2;
@@ -0,0 +1,340 @@
+/*
+    stats.c -- part of texgenpack, a texture compressor using fgen.
+
+    texgenpack -- a genetic algorithm texture compressor.
+    Copyright 2013 Harm Hanemaaijer
+
+    This file is part of texgenpack.
+
+    texgenpack is free software: you can redistribute it and/or modify it
+    under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    texgenpack is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+    License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with texgenpack.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Export of compression statistics (--stats). The statistics of the blocks of each compressed texture, collected
+// by compress_images in the compression context, are added to a list of textures. When all textures have been
+// compressed, the statistics of every block are written to a .json file, or to a .csv file with one line per
+// block, and a summary for each texture format is printed and (in the .json file) written. Textures are added
+// from the threads that complete them in batch mode, so the list is protected by a mutex.
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "texgenpack.h"
+#ifndef __GNUC__
+#include "strcasecmp.h"
+#endif
+
+// The statistics of a compressed texture with all its mipmap levels.
+
+typedef struct {
+	char *filename;
+	int texture_type;
+	int nu_levels;
+	int *nu_blocks_x;		// Number of blocks per row of each level.
+	int *nu_blocks_y;
+	int block_width;
+	int block_height;
+	int nu_blocks;			// Total number of blocks of all levels.
+	BlockStatistics *blocks;	// NULL when no block statistics are available for the format.
+	double time;			// Wall time of the compression in seconds.
+} TextureStatistics;
+
+// Summary of the textures of a texture format.
+
+typedef struct {
+	int texture_type;
+	int nu_textures;
+	int nu_blocks;
+	int nu_method_blocks[6];	// Number of blocks for each BLOCK_METHOD_* value.
+	double time;			// Total wall time of the compressions.
+	double block_time;		// Total wall time spent on the blocks by all threads.
+	int64_t generations;
+	int64_t nu_evaluations;
+	int64_t nu_invalid;
+	double squared_error;		// Sum of the squared RMSE of the blocks.
+	double max_rmse;
+} FormatSummary;
+
+static const char *method_text[6] = { "ga", "few_colors", "duplicate", "restored", "analytic", "exhaustive" };
+
+static char *statistics_filename = NULL;
+static TextureStatistics *textures = NULL;
+static int nu_textures = 0;
+static int max_textures = 0;
+// Whether all textures were compressed with a quiet context, in which case the summary is not printed.
+static int statistics_quiet = 1;
+static pthread_mutex_t statistics_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Start collecting the statistics of the compressed textures, to be written to the given file by end_statistics.
+
+void begin_statistics(const char *filename) {
+	statistics_filename = strdup(filename);
+	nu_textures = 0;
+	statistics_quiet = 1;
+}
+
+// Add the statistics of a compressed texture from the compression context, which must have had
+// collect_statistics set. The block statistics are taken over from the context. time is the wall time of the
+// compression.
+
+void add_statistics(const char *source_filename, int texture_type, Texture *textures_in, int nu_levels,
+CompressContext *context, double time) {
+	TextureStatistics t;
+	t.filename = strdup(source_filename);
+	t.texture_type = texture_type;
+	t.nu_levels = nu_levels;
+	t.nu_blocks_x = (int *)malloc(sizeof(int) * nu_levels);
+	t.nu_blocks_y = (int *)malloc(sizeof(int) * nu_levels);
+	t.block_width = textures_in[0].block_width;
+	t.block_height = textures_in[0].block_height;
+	t.nu_blocks = 0;
+	for (int i = 0; i < nu_levels; i++) {
+		t.nu_blocks_x[i] = (textures_in[i].width + t.block_width - 1) / t.block_width;
+		t.nu_blocks_y[i] = (textures_in[i].height + t.block_height - 1) / t.block_height;
+		t.nu_blocks += t.nu_blocks_x[i] * t.nu_blocks_y[i];
+	}
+	t.blocks = context->block_statistics;
+	context->block_statistics = NULL;
+	t.time = time;
+	pthread_mutex_lock(&statistics_mutex);
+	if (nu_textures == max_textures) {
+		max_textures = max_textures == 0 ? 16 : max_textures * 2;
+		textures = (TextureStatistics *)realloc(textures, sizeof(TextureStatistics) * max_textures);
+	}
+	textures[nu_textures] = t;
+	nu_textures++;
+	if (!context->option_quiet)
+		statistics_quiet = 0;
+	pthread_mutex_unlock(&statistics_mutex);
+}
+
+// Write a string as a JSON string.
+
+static void write_json_string(FILE *f, const char *s) {
+	fputc('"', f);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else
+		if ((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04X", (unsigned char)*s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+// Write a string as a CSV field.
+
+static void write_csv_string(FILE *f, const char *s) {
+	if (strpbrk(s, ",\"\r\n") == NULL) {
+		fputs(s, f);
+		return;
+	}
+	fputc('"', f);
+	for (; *s != '\0'; s++) {
+		if (*s == '"')
+			fputc('"', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+// Calculate the summaries of the texture formats of the textures. Returns the number of formats.
+
+static int calculate_format_summaries(FormatSummary *summaries) {
+	int nu_formats = 0;
+	for (int i = 0; i < nu_textures; i++) {
+		TextureStatistics *t = &textures[i];
+		FormatSummary *f = NULL;
+		for (int j = 0; j < nu_formats; j++)
+			if (summaries[j].texture_type == t->texture_type)
+				f = &summaries[j];
+		if (f == NULL) {
+			f = &summaries[nu_formats];
+			nu_formats++;
+			memset(f, 0, sizeof(FormatSummary));
+			f->texture_type = t->texture_type;
+		}
+		f->nu_textures++;
+		f->nu_blocks += t->nu_blocks;
+		f->time += t->time;
+		if (t->blocks == NULL)
+			continue;
+		for (int j = 0; j < t->nu_blocks; j++) {
+			BlockStatistics *b = &t->blocks[j];
+			f->nu_method_blocks[b->method]++;
+			f->block_time += b->time;
+			f->generations += b->generations;
+			f->nu_evaluations += b->nu_evaluations;
+			f->nu_invalid += b->nu_invalid;
+			f->squared_error += b->rmse * b->rmse;
+			if (b->rmse > f->max_rmse)
+				f->max_rmse = b->rmse;
+		}
+	}
+	return nu_formats;
+}
+
+static double get_blocks_per_second(FormatSummary *f) {
+	if (f->time <= 0)
+		return 0;
+	return f->nu_blocks / f->time;
+}
+
+static double get_invalid_percentage(FormatSummary *f) {
+	if (f->nu_evaluations == 0)
+		return 0;
+	return f->nu_invalid * 100.0 / f->nu_evaluations;
+}
+
+static double get_format_rmse(FormatSummary *f) {
+	if (f->nu_blocks == 0)
+		return 0;
+	return sqrt(f->squared_error / f->nu_blocks);
+}
+
+// Print the summary of each texture format.
+
+static void print_format_summaries(FormatSummary *summaries, int nu_formats) {
+	for (int i = 0; i < nu_formats; i++) {
+		FormatSummary *f = &summaries[i];
+		printf("Statistics for %s: %d file%s, %d blocks (%d GA, %d analytic, %d exhaustive, %d with few colors, "
+			"%d duplicates, %d restored) in %.2lf s (%.1lf blocks/s).\n", texture_type_text(f->texture_type),
+			f->nu_textures, f->nu_textures == 1 ? "" : "s", f->nu_blocks, f->nu_method_blocks[BLOCK_METHOD_GA],
+			f->nu_method_blocks[BLOCK_METHOD_ANALYTIC], f->nu_method_blocks[BLOCK_METHOD_EXHAUSTIVE],
+			f->nu_method_blocks[BLOCK_METHOD_FEW_COLORS], f->nu_method_blocks[BLOCK_METHOD_DUPLICATE],
+			f->nu_method_blocks[BLOCK_METHOD_RESTORED], f->time, get_blocks_per_second(f));
+		printf("  Block time %.2lf s, %lld generations, %lld fitness evaluations (%.1lf%% invalid), "
+			"RMSE per pixel %lf, worst block %lf.\n", f->block_time, (long long)f->generations,
+			(long long)f->nu_evaluations, get_invalid_percentage(f), get_format_rmse(f), f->max_rmse);
+	}
+}
+
+// Write the statistics as JSON: an object holding an array with the summary of each texture format and an array
+// with the statistics of each texture, including an array with the statistics of each block.
+
+static void write_json_statistics(FILE *f, FormatSummary *summaries, int nu_formats) {
+	fprintf(f, "{\n  \"formats\": [\n");
+	for (int i = 0; i < nu_formats; i++) {
+		FormatSummary *s = &summaries[i];
+		fprintf(f, "    { \"format\": ");
+		write_json_string(f, texture_type_text(s->texture_type));
+		fprintf(f, ", \"files\": %d, \"blocks\": %d, \"ga_blocks\": %d, \"analytic_blocks\": %d, "
+			"\"exhaustive_blocks\": %d, \"few_color_blocks\": %d, \"duplicate_blocks\": %d, "
+			"\"restored_blocks\": %d, \"time\": %.6lf, \"blocks_per_second\": %.3lf, \"block_time\": %.6lf, "
+			"\"generations\": %lld, \"evaluations\": %lld, \"invalid_decodes\": %lld, \"invalid_percentage\": %.3lf, "
+			"\"rmse\": %.6lf, \"max_rmse\": %.6lf }%s\n", s->nu_textures, s->nu_blocks,
+			s->nu_method_blocks[BLOCK_METHOD_GA], s->nu_method_blocks[BLOCK_METHOD_ANALYTIC],
+			s->nu_method_blocks[BLOCK_METHOD_EXHAUSTIVE], s->nu_method_blocks[BLOCK_METHOD_FEW_COLORS],
+			s->nu_method_blocks[BLOCK_METHOD_DUPLICATE], s->nu_method_blocks[BLOCK_METHOD_RESTORED], s->time,
+			get_blocks_per_second(s), s->block_time, (long long)s->generations, (long long)s->nu_evaluations,
+			(long long)s->nu_invalid, get_invalid_percentage(s), get_format_rmse(s), s->max_rmse,
+			i < nu_formats - 1 ? "," : "");
+	}
+	fprintf(f, "  ],\n  \"textures\": [\n");
+	for (int i = 0; i < nu_textures; i++) {
+		TextureStatistics *t = &textures[i];
+		fprintf(f, "    { \"file\": ");
+		write_json_string(f, t->filename);
+		fprintf(f, ", \"format\": ");
+		write_json_string(f, texture_type_text(t->texture_type));
+		fprintf(f, ", \"levels\": %d, \"time\": %.6lf,\n      \"blocks\": [", t->nu_levels, t->time);
+		if (t->blocks != NULL) {
+			BlockStatistics *b = t->blocks;
+			for (int level = 0; level < t->nu_levels; level++)
+				for (int j = 0; j < t->nu_blocks_x[level] * t->nu_blocks_y[level]; j++) {
+					fprintf(f, "%s\n        { \"level\": %d, \"block\": %d, \"x\": %d, \"y\": %d, "
+						"\"method\": \"%s\", \"rmse\": %.6lf, \"generations\": %d, \"evaluations\": %lld, "
+						"\"invalid_decodes\": %lld, \"time\": %.6lf, \"mode\": %d, \"partition\": %d, "
+						"\"island\": %d }", b != t->blocks ? "," : "", level, j,
+						(j % t->nu_blocks_x[level]) * t->block_width,
+						(j / t->nu_blocks_x[level]) * t->block_height, method_text[b->method], b->rmse,
+						b->generations, (long long)b->nu_evaluations, (long long)b->nu_invalid, b->time,
+						b->mode, b->partition, b->island);
+					b++;
+				}
+			fprintf(f, "\n      ");
+		}
+		fprintf(f, "] }%s\n", i < nu_textures - 1 ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+// Write the statistics as CSV with a header line and a line for each block.
+
+static void write_csv_statistics(FILE *f) {
+	fprintf(f, "file,format,level,block,x,y,method,rmse,generations,evaluations,invalid_decodes,time,mode,partition,"
+		"island\n");
+	for (int i = 0; i < nu_textures; i++) {
+		TextureStatistics *t = &textures[i];
+		if (t->blocks == NULL)
+			continue;
+		BlockStatistics *b = t->blocks;
+		for (int level = 0; level < t->nu_levels; level++)
+			for (int j = 0; j < t->nu_blocks_x[level] * t->nu_blocks_y[level]; j++) {
+				write_csv_string(f, t->filename);
+				fprintf(f, ",%s,%d,%d,%d,%d,%s,%.6lf,%d,%lld,%lld,%.6lf,%d,%d,%d\n",
+					texture_type_text(t->texture_type), level, j, (j % t->nu_blocks_x[level]) * t->block_width,
+					(j / t->nu_blocks_x[level]) * t->block_height, method_text[b->method], b->rmse,
+					b->generations, (long long)b->nu_evaluations, (long long)b->nu_invalid, b->time, b->mode,
+					b->partition, b->island);
+				b++;
+			}
+	}
+}
+
+// Write the collected statistics to the file given to begin_statistics, print the summary of each texture format
+// unless the compression contexts of all textures were quiet, and free the statistics. The file is written as CSV
+// when its name ends with .csv, otherwise as JSON.
+
+void end_statistics() {
+	if (statistics_filename == NULL)
+		return;
+	FormatSummary *summaries = (FormatSummary *)malloc(sizeof(FormatSummary) * (nu_textures + 1));
+	int nu_formats = calculate_format_summaries(summaries);
+	int n = strlen(statistics_filename);
+	int csv = n >= 4 && strcasecmp(&statistics_filename[n - 4], ".csv") == 0;
+	FILE *f = fopen(statistics_filename, "wb");
+	if (f == NULL) {
+		printf("Error -- couldn't open statistics file %s for writing.\n", statistics_filename);
+		exit(1);
+	}
+	if (csv)
+		write_csv_statistics(f);
+	else
+		write_json_statistics(f, summaries, nu_formats);
+	fclose(f);
+	if (!statistics_quiet) {
+		print_format_summaries(summaries, nu_formats);
+		printf("Wrote statistics of %d file%s to %s.\n", nu_textures, nu_textures == 1 ? "" : "s",
+			statistics_filename);
+	}
+	free(summaries);
+	for (int i = 0; i < nu_textures; i++) {
+		free(textures[i].filename);
+		free(textures[i].nu_blocks_x);
+		free(textures[i].nu_blocks_y);
+		free(textures[i].blocks);
+	}
+	free(textures);
+	textures = NULL;
+	nu_textures = 0;
+	max_textures = 0;
+	free(statistics_filename);
+	statistics_filename = NULL;
+}
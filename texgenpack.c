@@ -42,6 +42,7 @@ static void compare_files();
 static void decompress();
 static void compress();
 static void calibrate();
+static void compress_batch();
 
 // Variables reflecting command-line options.
 
@@ -50,6 +51,9 @@ int option_verbose = 0;
 int option_max_threads = - 1;
 char *source_filename;
 char *dest_filename;
+char *importance_filename = NULL;
+char *batch_filename = NULL;
+char *stats_filename = NULL;
 int source_filetype;
 int dest_filetype;
 int option_orientation = 0;
@@ -67,23 +71,34 @@ int option_block_width = 4;
 int option_block_height = 4;
 int option_half_float = 0;
 int option_hdr = 0;
-
-// Other option variables that are not actually set by command-line options.
-
 int option_deterministic = 0;
+int option_convergence_window = - 1;
+int option_polish = - 1;
+int option_derive_indices = 0;
+int option_checkpoint_interval = 0;
+int option_resume = 0;
+double option_target_rmse = - 1;
+double option_target_psnr = - 1;
+double option_time_budget = - 1;
+// Bit mask of the speed options given on the command line, used to select the speed settings of --benchmark.
+static int option_speeds = 0;
+static int option_decoders = 0;
+static int option_check = 0;
 
 static char *instructions1 =
 "texgenpack v0.6.1 -- Texture conversion and compression using a genetic algorithm.\n"
 "Usage: texgenpack <command> <options> <source filename> <destination filename>.\n"
+"       texgenpack --benchmark <options> <results filename> [<baseline filename>].\n"
+"       texgenpack --benchmark --check.\n"
 "\n"
 "Commands:\n";
 
-#define NU_COMMANDS 4
+#define NU_COMMANDS 5
 
 static const char *commands[NU_COMMANDS] = {
-	"--compress", "--decompress", "--compare", "--calibrate" };
+	"--compress", "--decompress", "--compare", "--calibrate", "--benchmark" };
 
-#define NU_OPTIONS 19
+#define NU_OPTIONS 35
 
 #define OPTION_VERBOSE		0
 #define OPTION_VERY_VERBOSE	1
@@ -104,15 +119,37 @@ static const char *commands[NU_COMMANDS] = {
 #define OPTION_QUIET		16
 #define OPTION_HALF_FLOAT	17
 #define OPTION_HDR		18
+#define OPTION_DETERMINISTIC	19
+#define OPTION_CONVERGENCE_WINDOW 20
+#define OPTION_POLISH		21
+#define OPTION_CHECKPOINT	22
+#define OPTION_RESUME		23
+#define OPTION_TARGET_RMSE	24
+#define OPTION_TARGET_PSNR	25
+#define OPTION_TIME_BUDGET	26
+#define OPTION_IMPORTANCE	27
+#define OPTION_BATCH		28
+#define OPTION_STATS		29
+#define OPTION_DECODERS		30
+#define OPTION_INSTANT		31
+#define OPTION_EXHAUSTIVE	32
+#define OPTION_DERIVE_INDICES	33
+#define OPTION_CHECK		34
+
+// Checkpoint interval in seconds when --resume is given without --checkpoint.
+#define DEFAULT_CHECKPOINT_INTERVAL 60
 
 static const char *options[NU_OPTIONS] = {
 	"--verbose", "--very-verbose", "--fast", "--medium", "--slow", "--maxthreads", "--orientation", "--format",
 	"--progress", "--modal", "--ultra", "--allowed-modes", "--mipmaps", "--generations", "--islands",
-	"--flip-vertical", "--quiet", "--half-float", "--hdr" };
+	"--flip-vertical", "--quiet", "--half-float", "--hdr", "--deterministic", "--convergence-window",
+	"--polish", "--checkpoint", "--resume", "--target-rmse", "--target-psnr", "--time-budget", "--importance",
+	"--batch", "--stats", "--decoders", "--instant", "--exhaustive", "--derive-indices", "--check" };
 
 static const char *option_argument[NU_OPTIONS] = {
 	"", "", "", "", "", "<number>", "<direction>", "<format>", "", "", "", "<modes>", "", "<number>", "<number>",
-	"", "", "", "" };
+	"", "", "", "", "", "<number>", "<number>", "<seconds>", "", "<value>", "<dB>", "<seconds>", "<filename>",
+	"<filename>", "<filename>", "", "", "", "", "" };
 
 static const char *option_description[NU_OPTIONS] = {
 	"Be verbose (information for each block).",
@@ -120,58 +157,94 @@ static const char *option_description[NU_OPTIONS] = {
 	"Fast compression method (default).",
 	"Medium compression method.",
 	"Slow compression method.",
-	"Specify the maximum number of threads to use (not recommended; uses --islands option to control threading level).",
+	"Specify the number of worker threads used to compress blocks concurrently (default: number of processors).",
 	"Write orientation key when writing .ktx file. Direction must be up or down.",
 	"Texture format. One of the following: ",
-	"Display a percentage progress indicator.",
+	"Display a progress indicator with the number of blocks compressed per second and the estimated remaining "
+	"time.",
 	"Use a different technique for ETC2 compression with islands tied to specific ETC2 modes.",
 	"Ultra fast compression optimizing different blocks concurrently.",
 	"Specify the ETC2 modes to use. Argument is a string containing a subset of the letters IDTHP.",
 	"Generate mipmaps when compressing an image into a texture. When decompressing to an image file, generate a "
 	"sequence of image files named filename-mipmap*.png holding the mipmap levels.",
 	"Set the number of generations for the genetic algorithm per block.",
-	"Set the number of concurrent islands for the genetic algorithm.",
+	"Set the number of islands for the genetic algorithm per block.",
 	"Flip the texture vertically during the conversion process.",
 	"Don't print anything.",
 	"Convert regular images to half-float format before compression.",
-	"The half-float format contains a HDR texture that is not normalized. This affects compression."
+	"The half-float format contains a HDR texture that is not normalized. This affects compression.",
+	"Make compression output reproducible, independent of the number of threads.",
+	"Stop the genetic algorithm for a block when the best solution has not improved significantly for the given "
+	"number of generations (default: half the number of generations, 0 disables).",
+	"Set the maximum number of local search passes used to refine the best solution of the genetic algorithm for "
+	"each block (default depends on the speed setting, 0 disables).",
+	"Write the completed blocks to the checkpoint file <destination filename>.checkpoint at the given interval, so "
+	"that an interrupted compression can be resumed.",
+	"Resume an interrupted compression from the checkpoint file if it matches the source and the settings, and keep "
+	"writing checkpoints (every 60 seconds unless --checkpoint is given).",
+	"Compress each block with just enough effort to reach the given root-mean-square error per pixel, giving "
+	"blocks that miss it more islands and generations, and report the achieved error of each mipmap level.",
+	"Like --target-rmse, with the target specified as a PSNR in dB.",
+	"Compress within the given time: all blocks are compressed quickly first, after which the remaining time is "
+	"spent on running the GA again for the blocks with the highest error.",
+	"Use a grayscale .png image with the size of the source image as importance map. Blocks in bright areas get "
+	"up to twice the normal effort and a lower RMSE threshold, blocks in dark areas down to half the effort.",
+	"Compress the files listed in the given manifest in one process instead of the two filenames. Each line of the "
+	"manifest holds a source filename, a destination filename, optionally a texture format, and options for the job. "
+	"The options on the command line apply to all jobs.",
+	"Write statistics of every compressed block (error, generations, fitness evaluations, invalid blocks, time, "
+	"mode, partition and island) to the given .json or .csv file, and print a summary for each texture format.",
+	"With --benchmark, measure the throughput of the block decoding and comparison functions instead of "
+	"compression.",
+	"Instant compression without the genetic algorithm, for previews: each block gets the best closed-form "
+	"encoding, refined by one local search pass. Formats without closed-form encoders are compressed as with "
+	"--ultra.",
+	"Compress without the genetic algorithm by searching the header space of each block (ETC1, EAC R11/RG11 and "
+	"RGTC), with optimal pixel indices. Other formats are compressed with the default speed setting.",
+	"Let the genetic algorithm search only the modes and endpoints and derive the optimal pixel indices for every "
+	"fitness evaluation for all formats that support it (DXT5, ETC2 with EAC alpha and BPTC except modes 4 and 5 in "
+	"addition to DXT1, DXT1A, DXT3, ETC1, ETC2 RGB and ETC2 punchthrough, for which this is the default). Slower, "
+	"but usually gives a lower error.",
+	"With --benchmark, check that the vector block comparison and batch evaluation kernels give exactly the same "
+	"results as the C versions and that --deterministic compression does not depend on the number of threads, instead of "
+	"measuring speed. No filenames are expected; the exit status signals failed checks."
 };
 
-int main(int argc, char **argv) {
-	if (argc <= 2) {
-		printf("%s", instructions1);
-		for (int i = 0; i < NU_COMMANDS; i++)
-			printf("%s\n", commands[i]);
-		printf("\nOptions:\n");
-		for (int i = 0; i < NU_OPTIONS; i++) {
-			printf("%s %s\n        %s\n", options[i], option_argument[i], option_description[i]);
-			if (i == 7) {
-				int n = get_number_of_texture_formats();
-				for (int j = 0; j < n - 1; j++) {
-					printf("%s, ", get_texture_format_index_text(j, 0));
-					const char *text2 = get_texture_format_index_text(j, 1);
-					if (strlen(text2) > 0)
-						printf("%s, ", text2);
-				}
-				printf("%s\n", get_texture_format_index_text(n - 1, 0));
-			}
-		}
-		exit(0);
-	}
+// Return whether an option can be given for a single job in a batch manifest.
 
-	command = - 1;
-	for (int i = 0; i < NU_COMMANDS; i++)
-		if (strcmp(argv[1], commands[i]) == 0) {
-			command = i;
-			break;
-		}
-	if (command == -1) {
-		printf("Error -- no valid command found as first argument. Valid command are --compress,\n"
-			"--decompress and --compare. Run with no arguments for help.\n");
-		exit(1);
+static int is_job_option(int option) {
+	switch (option) {
+	case OPTION_FAST :
+	case OPTION_MEDIUM :
+	case OPTION_SLOW :
+	case OPTION_ULTRA :
+	case OPTION_INSTANT :
+	case OPTION_EXHAUSTIVE :
+	case OPTION_TEXTURE_FORMAT :
+	case OPTION_MODAL_ETC2 :
+	case OPTION_ALLOWED_MODES :
+	case OPTION_MIPMAPS :
+	case OPTION_GENERATIONS :
+	case OPTION_ISLANDS :
+	case OPTION_FLIP_VERTICAL :
+	case OPTION_DETERMINISTIC :
+	case OPTION_CONVERGENCE_WINDOW :
+	case OPTION_POLISH :
+	case OPTION_DERIVE_INDICES :
+	case OPTION_TARGET_RMSE :
+	case OPTION_TARGET_PSNR :
+	case OPTION_TIME_BUDGET :
+	case OPTION_IMPORTANCE :
+		return 1;
 	}
+	return 0;
+}
 
-	int i = 2;
+// Parse the options in argv starting at index i, setting the option variables. When manifest is set, the options
+// are those of a job in a batch manifest, and only the options that apply to a single job are allowed. Returns the
+// index of the first argument that is not an option.
+
+static int parse_options(int argc, char **argv, int i, int manifest) {
 	for (; i < argc;) {
 		int option = - 1;
 		for (int j = 0; j < NU_OPTIONS; j++)
@@ -181,6 +254,10 @@ int main(int argc, char **argv) {
 			}
 		if (option == - 1)
 			break;
+		if (manifest && !is_job_option(option)) {
+			printf("Error -- option %s cannot be used in a batch manifest.\n", argv[i]);
+			exit(1);
+		}
 		// Single argument options.
 		switch (option) {
 		case OPTION_VERBOSE :
@@ -193,14 +270,17 @@ int main(int argc, char **argv) {
 			continue;
 		case OPTION_FAST :
 			option_speed = SPEED_FAST;
+			option_speeds |= 1 << SPEED_FAST;
 			i++;
 			continue;
 		case OPTION_MEDIUM :
 			option_speed = SPEED_MEDIUM;
+			option_speeds |= 1 << SPEED_MEDIUM;
 			i++;
 			continue;
 		case OPTION_SLOW :
 			option_speed = SPEED_SLOW;
+			option_speeds |= 1 << SPEED_SLOW;
 			i++;
 			continue;
 		case OPTION_PROGRESS :
@@ -213,6 +293,17 @@ int main(int argc, char **argv) {
 			continue;
 		case OPTION_ULTRA :
 			option_speed = SPEED_ULTRA;
+			option_speeds |= 1 << SPEED_ULTRA;
+			i++;
+			continue;
+		case OPTION_INSTANT :
+			option_speed = SPEED_INSTANT;
+			option_speeds |= 1 << SPEED_INSTANT;
+			i++;
+			continue;
+		case OPTION_EXHAUSTIVE :
+			option_speed = SPEED_EXHAUSTIVE;
+			option_speeds |= 1 << SPEED_EXHAUSTIVE;
 			i++;
 			continue;
 		case OPTION_MIPMAPS :
@@ -235,10 +326,33 @@ int main(int argc, char **argv) {
 			option_hdr = 1;
 			i++;
 			continue;
+		case OPTION_DETERMINISTIC :
+			option_deterministic = 1;
+			i++;
+			continue;
+		case OPTION_DERIVE_INDICES :
+			option_derive_indices = 1;
+			i++;
+			continue;
+		case OPTION_RESUME :
+			option_resume = 1;
+			i++;
+			continue;
+		case OPTION_DECODERS :
+			option_decoders = 1;
+			i++;
+			continue;
+		case OPTION_CHECK :
+			option_check = 1;
+			i++;
+			continue;
 		}
 		// Two argument options.
 		if (i + 1 >= argc) {
-			printf("Error -- no filenames specified.\n");
+			if (manifest)
+				printf("Error -- missing argument for option %s.\n", argv[i]);
+			else
+				printf("Error -- no filenames specified.\n");
 			exit(1);
 		}
 		int value;
@@ -320,6 +434,69 @@ int main(int argc, char **argv) {
 			option_islands = value;
 			i += 2;
 			break;
+		case OPTION_CONVERGENCE_WINDOW :
+			value = atoi(argv[i + 1]);
+			if (value < 0 || value > 10000) {
+				printf("Error -- invalid convergence window specified (range 0-10000).\n");
+				exit(1);
+			}
+			option_convergence_window = value;
+			i += 2;
+			break;
+		case OPTION_POLISH :
+			value = atoi(argv[i + 1]);
+			if (value < 0 || value > 100) {
+				printf("Error -- invalid number of local search passes specified (range 0-100).\n");
+				exit(1);
+			}
+			option_polish = value;
+			i += 2;
+			break;
+		case OPTION_CHECKPOINT :
+			value = atoi(argv[i + 1]);
+			if (value < 1 || value > 86400) {
+				printf("Error -- invalid checkpoint interval specified (range 1-86400 seconds).\n");
+				exit(1);
+			}
+			option_checkpoint_interval = value;
+			i += 2;
+			break;
+		case OPTION_TARGET_RMSE :
+			option_target_rmse = atof(argv[i + 1]);
+			if (option_target_rmse <= 0) {
+				printf("Error -- invalid target RMSE specified (must be greater than 0).\n");
+				exit(1);
+			}
+			i += 2;
+			break;
+		case OPTION_TARGET_PSNR :
+			option_target_psnr = atof(argv[i + 1]);
+			if (option_target_psnr <= 0 || option_target_psnr > 200) {
+				printf("Error -- invalid target PSNR specified (range 0-200 dB).\n");
+				exit(1);
+			}
+			i += 2;
+			break;
+		case OPTION_IMPORTANCE :
+			importance_filename = argv[i + 1];
+			i += 2;
+			break;
+		case OPTION_BATCH :
+			batch_filename = argv[i + 1];
+			i += 2;
+			break;
+		case OPTION_STATS :
+			stats_filename = argv[i + 1];
+			i += 2;
+			break;
+		case OPTION_TIME_BUDGET :
+			option_time_budget = atof(argv[i + 1]);
+			if (option_time_budget <= 0) {
+				printf("Error -- invalid time budget specified (must be greater than 0 seconds).\n");
+				exit(1);
+			}
+			i += 2;
+			break;
 #if 0
 		case OPTION_BLOCK_SIZE :
 			{
@@ -343,6 +520,112 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	return i;
+}
+
+// Check for combinations of options that are not allowed.
+
+static void check_options() {
+	if (option_target_rmse > 0 && option_target_psnr > 0) {
+		printf("Error -- only one of --target-rmse and --target-psnr can be specified.\n");
+		exit(1);
+	}
+	if (option_time_budget > 0 && (option_checkpoint_interval > 0 || option_resume)) {
+		printf("Error -- --time-budget cannot be combined with --checkpoint or --resume.\n");
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc <= 2) {
+		printf("%s", instructions1);
+		for (int i = 0; i < NU_COMMANDS; i++)
+			printf("%s\n", commands[i]);
+		printf("\nOptions:\n");
+		for (int i = 0; i < NU_OPTIONS; i++) {
+			printf("%s %s\n        %s\n", options[i], option_argument[i], option_description[i]);
+			if (i == 7) {
+				int n = get_number_of_texture_formats();
+				for (int j = 0; j < n - 1; j++) {
+					printf("%s, ", get_texture_format_index_text(j, 0));
+					const char *text2 = get_texture_format_index_text(j, 1);
+					if (strlen(text2) > 0)
+						printf("%s, ", text2);
+				}
+				printf("%s\n", get_texture_format_index_text(n - 1, 0));
+			}
+		}
+		exit(0);
+	}
+
+	command = - 1;
+	for (int i = 0; i < NU_COMMANDS; i++)
+		if (strcmp(argv[1], commands[i]) == 0) {
+			command = i;
+			break;
+		}
+	if (command == -1) {
+		printf("Error -- no valid command found as first argument. Valid command are --compress,\n"
+			"--decompress and --compare. Run with no arguments for help.\n");
+		exit(1);
+	}
+
+	int i = parse_options(argc, argv, 2, 0);
+	check_options();
+	if (option_decoders && command != COMMAND_BENCHMARK) {
+		printf("Error -- --decoders can only be used with --benchmark.\n");
+		exit(1);
+	}
+	if (option_check && command != COMMAND_BENCHMARK) {
+		printf("Error -- --check can only be used with --benchmark.\n");
+		exit(1);
+	}
+	if (stats_filename != NULL && command != COMMAND_COMPRESS) {
+		printf("Error -- --stats can only be used with --compress.\n");
+		exit(1);
+	}
+	if (batch_filename != NULL) {
+		if (command != COMMAND_COMPRESS) {
+			printf("Error -- --batch can only be used with --compress.\n");
+			exit(1);
+		}
+		if (i < argc) {
+			printf("Error -- no filenames expected on the command line with --batch.\n");
+			exit(1);
+		}
+		if (option_checkpoint_interval > 0 || option_resume) {
+			printf("Error -- --batch cannot be combined with --checkpoint or --resume.\n");
+			exit(1);
+		}
+		if (stats_filename != NULL)
+			begin_statistics(stats_filename);
+		compress_batch();
+		end_statistics();
+		exit(0);
+	}
+	if (command == COMMAND_BENCHMARK && option_check) {
+		if (i != argc) {
+			printf("Error -- no filenames expected on the command line with --check.\n");
+			exit(1);
+		}
+		exit(run_checks() > 0 ? 1 : 0);
+	}
+	if (command == COMMAND_BENCHMARK) {
+		if (i != argc - 1 && i != argc - 2) {
+			printf("Error -- expected a results filename and optionally a baseline filename at the end of the "
+				"command line.\n");
+			exit(1);
+		}
+		// Without speed options, all speed settings are benchmarked. The exit status signals regressions.
+		int nu_regressions;
+		if (option_decoders)
+			nu_regressions = benchmark_decoders(argv[i], i == argc - 2 ? argv[i + 1] : NULL,
+				option_texture_format);
+		else
+			nu_regressions = benchmark(argv[i], i == argc - 2 ? argv[i + 1] : NULL, option_texture_format,
+				option_speeds == 0 ? (1 << NU_SPEEDS) - 1 : option_speeds);
+		exit(nu_regressions > 0 ? 1 : 0);
+	}
 	if (i >= argc - 1) {
 		printf("Error -- expected two filenames at the end of the command line.\n");
 		exit(1);
@@ -405,7 +688,10 @@ int main(int argc, char **argv) {
 			printf("Error -- destination file type cannot hold multiple mipmap levels.\n");
 			exit(1);
 		}
+		if (stats_filename != NULL)
+			begin_statistics(stats_filename);
 		compress();
+		end_statistics();
 	}
 	if (command == COMMAND_CALIBRATE) {
 		calibrate();
@@ -535,6 +821,17 @@ static void compress_callback(BlockUserData *user_data) {
 	// Do nothing.
 }
 
+// Return the texture type to compress to, given the type of the destination file.
+
+static int get_texture_type(int filetype) {
+	if (option_texture_format != - 1)
+		return option_texture_format;
+	// Set default compression format for the given the file type.
+	if (filetype == FILE_TYPE_DDS)
+		return TEXTURE_TYPE_DXT1;
+	return TEXTURE_TYPE_ETC1;
+}
+
 static void compress() {
 	Image image[32];
 	if (!option_quiet)
@@ -549,16 +846,7 @@ static void compress() {
 	if (option_flip_vertical)
 		for (int i = 0; i < nu_mipmaps; i++)
 			flip_image_vertical(&image[i]);
-	int texture_type;
-	if (option_texture_format != - 1)
-		texture_type = option_texture_format;
-	else
-		// Set default compression format for the given the file type.
-		if (dest_filetype == FILE_TYPE_KTX || dest_filetype == FILE_TYPE_PKM)
-			texture_type = TEXTURE_TYPE_ETC1;
-		else
-		if (dest_filetype == FILE_TYPE_DDS)
-			texture_type = TEXTURE_TYPE_DXT1;
+	int texture_type = get_texture_type(dest_filetype);
 	const char *texture_type_str = texture_type_text(texture_type);
 	if (!option_quiet) {
 		if (nu_mipmaps > 1)
@@ -577,26 +865,7 @@ static void compress() {
 	Image *mipmap_image = (Image *)alloca(sizeof(Image) * nu_mipmaps);
 	if (generate_mipmaps) {
 		mipmap_image[0] = image[0];
-		if ((texture_type & TEXTURE_TYPE_SRGB_BIT) && nu_mipmaps > 1) {
-			// For sRGB textures, perform mipmapping after first converting to RGB and then convert the
-			// RGB mipmaps back to sRGB.
-			Image *rgb_mipmap_image = (Image *)alloca(sizeof(Image) * nu_mipmaps);
-			if (!option_quiet)
-				printf("Converting image from sRGB to RGB for mipmap generation.\n");
-			convert_image_from_srgb_to_rgb(&image[0], &rgb_mipmap_image[0]);
-			// Generate the mipmaps in RGB space.
-			for (int i = 1; i < nu_mipmaps; i++) {
-				generate_mipmap_level_from_previous_level(&rgb_mipmap_image[i - 1], &rgb_mipmap_image[i]);
-			}
-			// Convert them to sRGB
-			for (int i = 1; i < nu_mipmaps; i++) {
-				convert_image_from_rgb_to_srgb(&rgb_mipmap_image[i], &mipmap_image[i]);
-			}
-		}
-		else
-			for (int i = 1; i < nu_mipmaps; i++) {
-				generate_mipmap_level_from_previous_level(&mipmap_image[i - 1], &mipmap_image[i]);
-			}
+		generate_mipmap_images(mipmap_image, nu_mipmaps, (texture_type & TEXTURE_TYPE_SRGB_BIT) != 0);
 	}
 	else {
 		// The mipmaps are present in the source file.
@@ -605,11 +874,39 @@ static void compress() {
 			printf("Source mipmap %d: %d x %d\n", i, mipmap_image[i].width, mipmap_image[i].height);
 		}
 	}
+	CompressContext context;
+	init_compress_context(&context, compress_callback);
+	Image importance_image;
+	if (importance_filename != NULL) {
+		if (determine_filename_type(importance_filename) != FILE_TYPE_PNG) {
+			printf("Error -- importance map must be a .png file.\n");
+			exit(1);
+		}
+		load_image(importance_filename, FILE_TYPE_PNG, &importance_image);
+		if (importance_image.width != mipmap_image[0].width ||
+		importance_image.height != mipmap_image[0].height) {
+			printf("Error -- importance map must have the same size as the source image (%d x %d).\n",
+				mipmap_image[0].width, mipmap_image[0].height);
+			exit(1);
+		}
+		context.importance_map = &importance_image;
+	}
+	if (option_checkpoint_interval > 0 || option_resume) {
+		char *checkpoint_filename = (char *)alloca(strlen(dest_filename) + 12);
+		sprintf(checkpoint_filename, "%s.checkpoint", dest_filename);
+		begin_checkpoint(&context, checkpoint_filename, option_checkpoint_interval > 0 ?
+			option_checkpoint_interval : DEFAULT_CHECKPOINT_INTERVAL, option_resume, texture_type, nu_mipmaps,
+			mipmap_image, texture);
+	}
+	// Compress the images of all mipmap levels into textures at once.
+	context.collect_statistics = (stats_filename != NULL);
+	double start_time = get_time();
+	compress_images(&context, mipmap_image, nu_mipmaps, texture_type, texture);
+	if (stats_filename != NULL)
+		add_statistics(source_filename, texture_type, texture, nu_mipmaps, &context, get_time() - start_time);
 	for (int i = 0; i < nu_mipmaps; i++) {
-		// Compress the image into a texture.
 		if (!option_quiet)
 			printf("Mipmap level: %d (%d x %d)\n", i, mipmap_image[i].width, mipmap_image[i].height);
-		compress_image(&mipmap_image[i], texture_type, compress_callback, &texture[i], 0, 0, 0);
 		// Decompress the compressed texture and calculate the difference with the original.
 		Image compressed_image;
 		convert_texture_to_image(&texture[i], &compressed_image);
@@ -618,6 +915,8 @@ static void compress() {
 	}
 	// Save texture.
 	save_texture(&texture[0], nu_mipmaps, dest_filename, dest_filetype);
+	// The checkpoint is no longer needed.
+	end_checkpoint(&context);
 }
 
 static void calibrate() {
@@ -625,16 +924,201 @@ static void calibrate() {
 	if (!option_quiet)
 		printf("Calibrating genetic parameters for compression of source file %s.\n", source_filename);
 	load_image(source_filename, source_filetype, &image);
-	int texture_type;
-	if (option_texture_format != - 1)
-		texture_type = option_texture_format;
-	else
-		// Set default compression format for the given the file type.
-		if (dest_filetype == FILE_TYPE_KTX || dest_filetype == FILE_TYPE_PKM)
-			texture_type = TEXTURE_TYPE_ETC1;
-		else
-		if (dest_filetype == FILE_TYPE_DDS)
-			texture_type = TEXTURE_TYPE_DXT1;
-	calibrate_genetic_parameters(&image, texture_type);	
+	calibrate_genetic_parameters(&image, get_texture_type(dest_filetype));
+}
+
+// Settings of a batch job that are set by the options in the manifest line of the job.
+
+typedef struct {
+	int texture_format;
+	int speed;
+	int modal_etc2;
+	int allowed_modes_etc2;
+	int mipmaps;
+	int generations;
+	int islands;
+	int flip_vertical;
+	int deterministic;
+	int convergence_window;
+	int polish;
+	int derive_indices;
+	double target_rmse;
+	double target_psnr;
+	double time_budget;
+	char *importance_filename;
+} JobOptions;
+
+static void get_job_options(JobOptions *o) {
+	o->texture_format = option_texture_format;
+	o->speed = option_speed;
+	o->modal_etc2 = option_modal_etc2;
+	o->allowed_modes_etc2 = option_allowed_modes_etc2;
+	o->mipmaps = option_mipmaps;
+	o->generations = option_generations;
+	o->islands = option_islands;
+	o->flip_vertical = option_flip_vertical;
+	o->deterministic = option_deterministic;
+	o->convergence_window = option_convergence_window;
+	o->polish = option_polish;
+	o->derive_indices = option_derive_indices;
+	o->target_rmse = option_target_rmse;
+	o->target_psnr = option_target_psnr;
+	o->time_budget = option_time_budget;
+	o->importance_filename = importance_filename;
+}
+
+static void set_job_options(const JobOptions *o) {
+	option_texture_format = o->texture_format;
+	option_speed = o->speed;
+	option_modal_etc2 = o->modal_etc2;
+	option_allowed_modes_etc2 = o->allowed_modes_etc2;
+	option_mipmaps = o->mipmaps;
+	option_generations = o->generations;
+	option_islands = o->islands;
+	option_flip_vertical = o->flip_vertical;
+	option_deterministic = o->deterministic;
+	option_convergence_window = o->convergence_window;
+	option_polish = o->polish;
+	option_derive_indices = o->derive_indices;
+	option_target_rmse = o->target_rmse;
+	option_target_psnr = o->target_psnr;
+	option_time_budget = o->time_budget;
+	importance_filename = o->importance_filename;
+}
+
+// Split a line of a batch manifest into arguments separated by white space. Arguments containing spaces can be
+// enclosed in double quotes. The line is modified. Returns the number of arguments.
+
+static int split_manifest_line(char *line, char **args, int max_args) {
+	int n = 0;
+	char *p = line;
+	for (;;) {
+		while (isspace(*p))
+			p++;
+		if (*p == '\0' || n == max_args)
+			break;
+		if (*p == '"') {
+			p++;
+			args[n++] = p;
+			while (*p != '\0' && *p != '"')
+				p++;
+		}
+		else {
+			args[n++] = p;
+			while (*p != '\0' && !isspace(*p))
+				p++;
+		}
+		if (*p == '\0')
+			break;
+		*p = '\0';
+		p++;
+	}
+	return n;
+}
+
+#define MAX_MANIFEST_LINE_LENGTH	4096
+#define MAX_MANIFEST_ARGUMENTS		64
+
+// Read the batch manifest, and compress the files listed in it. The options of each line are applied on top of
+// the options given on the command line.
+
+static void compress_batch() {
+	FILE *f = fopen(batch_filename, "rb");
+	if (f == NULL) {
+		printf("Error -- batch manifest %s doesn't exist or is unreadable.\n", batch_filename);
+		exit(1);
+	}
+	JobOptions defaults;
+	get_job_options(&defaults);
+	int max_jobs = 64;
+	BatchJob *jobs = (BatchJob *)malloc(sizeof(BatchJob) * max_jobs);
+	int nu_jobs = 0;
+	char line[MAX_MANIFEST_LINE_LENGTH];
+	int line_number = 0;
+	while (fgets(line, MAX_MANIFEST_LINE_LENGTH, f) != NULL) {
+		line_number++;
+		char *args[MAX_MANIFEST_ARGUMENTS];
+		int n = split_manifest_line(line, args, MAX_MANIFEST_ARGUMENTS);
+		if (n == 0 || args[0][0] == '#')
+			continue;
+		if (n < 2) {
+			printf("Error -- expected a source and a destination filename in line %d of the batch manifest.\n",
+				line_number);
+			exit(1);
+		}
+		// The texture format can be given without --format after the filenames.
+		int i = 2;
+		if (i < n && strncmp(args[i], "--", 2) != 0) {
+			TextureInfo *info = match_texture_description(args[i]);
+			if (info == NULL) {
+				printf("Error -- unknown texture format %s in line %d of the batch manifest.\n", args[i],
+					line_number);
+				exit(1);
+			}
+			option_texture_format = info->type;
+			i++;
+		}
+		i = parse_options(n, args, i, 1);
+		if (i < n) {
+			printf("Error -- unexpected argument %s in line %d of the batch manifest.\n", args[i], line_number);
+			exit(1);
+		}
+		check_options();
+		if (nu_jobs == max_jobs) {
+			max_jobs *= 2;
+			jobs = (BatchJob *)realloc(jobs, sizeof(BatchJob) * max_jobs);
+		}
+		BatchJob *job = &jobs[nu_jobs];
+		job->source_filename = strdup(args[0]);
+		job->dest_filename = strdup(args[1]);
+		job->source_filetype = determine_filename_type(job->source_filename);
+		job->dest_filetype = determine_filename_type(job->dest_filename);
+		if (job->source_filetype == FILE_TYPE_UNDEFINED || (job->dest_filetype & FILE_TYPE_TEXTURE_BIT) == 0) {
+			printf("Error -- expected a source file and a texture file in line %d of the batch manifest.\n",
+				line_number);
+			exit(1);
+		}
+		if (!file_exists(job->source_filename)) {
+			printf("Error -- source file %s doesn't exist or is unreadable.\n", job->source_filename);
+			exit(1);
+		}
+		if (strcasecmp(job->source_filename, job->dest_filename) == 0) {
+			printf("Error -- source filename and destination filename are identical in line %d of the batch "
+				"manifest.\n", line_number);
+			exit(1);
+		}
+		if (option_mipmaps && (job->dest_filetype & FILE_TYPE_MIPMAPS_BIT) == 0) {
+			printf("Error -- destination file type cannot hold multiple mipmap levels in line %d of the batch "
+				"manifest.\n", line_number);
+			exit(1);
+		}
+		if (importance_filename != NULL && determine_filename_type(importance_filename) != FILE_TYPE_PNG) {
+			printf("Error -- importance map must be a .png file.\n");
+			exit(1);
+		}
+		job->texture_type = get_texture_type(job->dest_filetype);
+		job->mipmaps = option_mipmaps;
+		job->flip_vertical = option_flip_vertical;
+		job->importance_filename = importance_filename != NULL ? strdup(importance_filename) : NULL;
+		// The jobs are compressed concurrently, so information is only printed for each job as a whole.
+		init_compress_context(&job->context, compress_callback);
+		job->context.option_quiet = 1;
+		job->context.option_progress = 0;
+		job->context.collect_statistics = (stats_filename != NULL);
+		nu_jobs++;
+		set_job_options(&defaults);
+	}
+	fclose(f);
+	if (nu_jobs == 0) {
+		printf("Error -- no jobs found in batch manifest %s.\n", batch_filename);
+		exit(1);
+	}
+	compress_batch_jobs(jobs, nu_jobs);
+	for (int i = 0; i < nu_jobs; i++) {
+		free(jobs[i].source_filename);
+		free(jobs[i].dest_filename);
+		free(jobs[i].importance_filename);
+	}
+	free(jobs);
 }
 
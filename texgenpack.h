@@ -166,16 +166,98 @@ struct BlockUserData_t {
 	Texture *texture;
 	unsigned char *alpha_pixels;
 	int stop_signalled;
+	unsigned char *seed_bitstrings;		// Analytic encodings of the block used to seed the population.
+	int nu_seed_bitstrings;
+	int nu_seeds_used;
+	struct FitnessCache_t *fitness_cache;	// Cached per-pixel errors for incremental fitness evaluation.
+	struct BlockConvergence_t *convergence;	// Convergence state shared by the populations compressing the block.
+	struct CompressContext_t *context;	// Settings and state of the compression the block belongs to.
+	int64_t nu_evaluations;			// Number of fitness evaluations since the block was set up.
+	int64_t nu_invalid;			// Number of these evaluations for which the block was invalid.
 };
 
 typedef void (*CompressCallbackFunction)(BlockUserData *user_data);
 
+// Statistics of a compressed block, collected when collect_statistics is set in the compression context.
+
+#define BLOCK_METHOD_GA		0	// Compressed with the GA.
+#define BLOCK_METHOD_FEW_COLORS	1	// Encoded directly because it has only one or two colors.
+#define BLOCK_METHOD_DUPLICATE	2	// Copied from a block with identical source pixels.
+#define BLOCK_METHOD_RESTORED	3	// Restored from a checkpoint.
+#define BLOCK_METHOD_ANALYTIC	4	// Encoded without the GA (instant speed setting).
+#define BLOCK_METHOD_EXHAUSTIVE	5	// Encoded by searching the header space (exhaustive speed setting).
+
+typedef struct {
+	int method;
+	double rmse;			// RMSE per pixel of the final block.
+	int generations;		// Number of GA generations of all runs on the block.
+	int64_t nu_evaluations;		// Number of fitness evaluations of all runs, including the local search.
+	int64_t nu_invalid;		// Number of these evaluations for which the block was invalid.
+	double time;			// Wall time spent on the block in seconds.
+	int mode;			// Mode of the final block, or - 1 when the format has no modes.
+	int partition;			// Partition (BPTC) or sub-block orientation (ETC1/ETC2), or - 1.
+	int island;			// Island of the GA run that found the final block, or - 1.
+} BlockStatistics;
+
+// The settings and the state of a compression. Several images can be compressed concurrently in one process, as
+// long as each compression uses its own context. init_compress_context() sets the settings from the command line
+// options; they can be changed afterwards.
+
+typedef struct CompressContext_t {
+	// Settings, with the same meaning as the corresponding command line options.
+	int option_speed;
+	int option_max_threads;
+	int option_verbose;
+	int option_quiet;
+	int option_progress;
+	int option_modal_etc2;
+	int option_allowed_modes_etc2;
+	int option_generations;
+	int option_islands;
+	int option_deterministic;
+	int option_convergence_window;
+	int option_polish;
+	int option_derive_indices;
+	int option_hdr;
+	int option_half_float;
+	double option_target_rmse;
+	double option_target_psnr;
+	double option_time_budget;
+	Image *importance_map;		// Importance map with the size of the first image, or NULL.
+	struct Checkpoint_t *checkpoint;	// Checkpoint state set up by begin_checkpoint(), or NULL.
+	struct PopulationPool_t *population_pool;	// GA populations shared with other compressions, or NULL.
+	CompressCallbackFunction compress_callback_func;	// Called for each compressed block.
+	int genetic_parameters;		// When set, the mutation and crossover probabilities below are used.
+	float mutation_probability;
+	float crossover_probability;
+	int collect_statistics;		// When set, the statistics of each block are collected in block_statistics.
+	// State of the compression, set up by compress_images.
+	int population_size;
+	int nu_generations;
+	int nu_islands;
+	int convergence_window;
+	int polish_passes;
+	double rmse_threshold;
+	double target_fitness;		// Fitness required to meet the quality target, or zero when there is no target.
+	double deadline;		// Time at which the time budget runs out, or zero when there is no time budget.
+	int exhaustive;			// Whether blocks are encoded with encode_block_exhaustively() instead of the GA.
+	int analytic;			// Whether blocks are encoded with encode_block_analytically() instead of the GA.
+	int derive_indices;		// Whether the GA uses calculate_fitness_with_derived_indices().
+	int mode_statistics[16];
+	BlockStatistics *block_statistics;	// Statistics of the blocks of all images (in order), allocated by
+					// compress_images when collect_statistics is set, otherwise NULL.
+	double progress_start_time;	// Used for the progress indicator.
+	double progress_time;
+	int progress_start_blocks;
+} CompressContext;
+
 // Command line options defined in texgenpack.c
 
 #define COMMAND_COMPRESS	0
 #define COMMAND_DECOMPRESS	1
 #define COMMAND_COMPARE		2
 #define COMMAND_CALIBRATE	3
+#define COMMAND_BENCHMARK	4
 
 #define ORIENTATION_DOWN	1
 #define ORIENTATION_UP		2
@@ -184,6 +266,9 @@ typedef void (*CompressCallbackFunction)(BlockUserData *user_data);
 #define SPEED_FAST	1
 #define SPEED_MEDIUM	2
 #define SPEED_SLOW	3
+#define SPEED_INSTANT	4
+#define SPEED_EXHAUSTIVE 5
+#define NU_SPEEDS	6
 
 extern int command;
 extern int option_verbose;
@@ -202,6 +287,12 @@ extern int option_block_width;
 extern int option_block_height;
 extern int option_half_float;
 extern int option_deterministic;
+extern int option_convergence_window;
+extern int option_polish;
+extern int option_derive_indices;
+extern double option_target_rmse;
+extern double option_target_psnr;
+extern double option_time_budget;
 extern int option_hdr;
 
 // Defined in image.c
@@ -237,13 +328,64 @@ void convert_image_to_8_bit_format(Image *image, int nu_components, int signed_f
 
 // Defined in compress.c
 
-void compress_image(Image *image, int texture_type, CompressCallbackFunction func, Texture *texture,
-int genetic_parameters, float mutation_prob, float crossover_prob);
+void init_compress_context(CompressContext *context, CompressCallbackFunction callback_func);
+void compress_image(CompressContext *context, Image *image, int texture_type, Texture *texture);
+void compress_images(CompressContext *context, Image *images, int nu_images, int texture_type, Texture *textures);
+uint64_t calculate_image_hash(Image *image);
+uint64_t get_importance_map_hash(CompressContext *context);
+double get_time();
+int get_number_of_processors();
+typedef struct PopulationPool_t PopulationPool;
+PopulationPool *create_population_pool();
+void destroy_population_pool(PopulationPool *pool);
+
+// Defined in encode.c
+
+#define MAX_ANALYTIC_SEEDS	8
+
+int calculate_block_pixel_errors(unsigned int *image_buffer, BlockUserData *user_data, double *pixel_error);
+double derive_block_indices(unsigned char *bitstring, BlockUserData *user_data, double *pixel_error);
+int get_index_derivation_cost(Texture *texture);
+double calculate_fitness_with_derived_indices(unsigned char *bitstring, BlockUserData *user_data);
+int calculate_analytic_seeds(BlockUserData *user_data, unsigned char *bitstrings, int max_seeds);
+int analytic_encoding_supported(int texture_type);
+double encode_block_analytically(BlockUserData *user_data, unsigned char *bitstring, int max_seeds);
+void select_bptc_island_flags(BlockUserData *user_data, int nu_islands, int *island_flags);
+int exhaustive_encoding_supported(int texture_type);
+int exhaustive_encoding_is_optimal(int texture_type);
+double encode_block_exhaustively(BlockUserData *user_data, unsigned char *bitstring);
+void init_single_color_tables();
+double encode_block_with_few_colors(BlockUserData *user_data, unsigned char *bitstring);
+typedef struct FitnessCache_t FitnessCache;
+FitnessCache *create_fitness_cache();
+void destroy_fitness_cache(FitnessCache *cache);
+void reset_fitness_cache(FitnessCache *cache);
+int fitness_cache_supported(Texture *texture);
+double calculate_fitness_with_cache(FitnessCache *cache, const unsigned char *bitstring, BlockUserData *user_data);
+double polish_block(BlockUserData *user_data, unsigned char *bitstring, double fitness, int max_passes);
+
+// Defined in checkpoint.c
+
+typedef struct Checkpoint_t Checkpoint;
+void begin_checkpoint(CompressContext *context, const char *filename, int interval, int resume, int texture_type,
+	int nu_levels, Image *images, Texture *textures);
+int restore_checkpoint_blocks(CompressContext *context, Texture *texture, unsigned char *block_done);
+void update_checkpoint(CompressContext *context, Texture *texture, const unsigned char *block_done, int write);
+int checkpoint_due(CompressContext *context);
+void end_checkpoint(CompressContext *context);
+
+// Defined in batch.c
+
+int select_batch_kernels(int level);
+void init_batch_evaluation();
+void calculate_fitness_batch(BlockUserData *user_data, const unsigned char *bitstrings, int n, double *fitness,
+	double *pixel_error);
 
 // Defined in mipmap.c
 
 void generate_mipmap_level_from_original(Image *source_image, int level, Image *dest_image);
 void generate_mipmap_level_from_previous_level(Image *source_image, Image *dest_image);
+void generate_mipmap_images(Image *images, int nu_levels, int srgb);
 int count_mipmap_levels(Image *image);
 
 // Defined in file.c
@@ -274,6 +416,12 @@ void set_texture_decoding_function(Texture *texture, Image *image);
 
 // Defined in compare.c
 
+// Instruction set levels of the block comparison kernels.
+
+#define COMPARE_KERNELS_C	0
+#define COMPARE_KERNELS_SSE2	1
+#define COMPARE_KERNELS_AVX2	2
+
 extern float *half_float_table;
 extern float *gamma_corrected_half_float_table;
 extern float *normalized_float_table;
@@ -300,6 +448,8 @@ double compare_block_4x4_rg_half_float(unsigned int *image_buffer, BlockUserData
 void calculate_gamma_corrected_half_float_table();
 double compare_block_4x4_rgb_half_float_hdr(unsigned int *image_buffer, BlockUserData *user_data);
 double compare_block_4x4_rgba_half_float_hdr(unsigned int *image_buffer, BlockUserData *user_data);
+int select_compare_kernels(int level);
+void init_compare_kernels();
 
 // Defined in half_float.c
 
@@ -310,3 +460,34 @@ int singles2halfp(void *target, void *source, int numel);
 
 void calibrate_genetic_parameters(Image *image, int texture_type);
 
+// Defined in manifest.c
+
+// A job of a batch manifest, compressing a source file into a texture file.
+
+typedef struct {
+	char *source_filename;
+	char *dest_filename;
+	int source_filetype;
+	int dest_filetype;
+	int texture_type;
+	int mipmaps;			// Generate mipmaps when the source file has a single level.
+	int flip_vertical;
+	char *importance_filename;	// Importance map, or NULL.
+	CompressContext context;	// Settings of the compression.
+} BatchJob;
+
+void compress_batch_jobs(BatchJob *jobs, int nu_jobs);
+
+// Defined in stats.c
+
+void begin_statistics(const char *filename);
+void add_statistics(const char *source_filename, int texture_type, Texture *textures, int nu_levels,
+	CompressContext *context, double time);
+void end_statistics();
+
+// Defined in benchmark.c
+
+int benchmark(const char *results_filename, const char *baseline_filename, int texture_type, int speeds);
+int benchmark_decoders(const char *results_filename, const char *baseline_filename, int texture_type);
+int run_checks();
+
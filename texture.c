@@ -95,8 +95,8 @@ static TextureInfo texture_info[NU_ITEMS] = {
 	{ TEXTURE_TYPE_SIGNED_R11_EAC,			1, 0,	"signed_r11_eac", "",		4, 4, 64, 64, 0, 1,	0x9271, 0,	0,		"", 0,		0xFFFF, 0, 0, 0 },
 	{ TEXTURE_TYPE_SIGNED_RG11_EAC,			1, 0,	"signed_rg11_eac", "",		4, 4, 128, 128, 0, 2,	0x9273, 0,	0,		"", 0,		0xFFFF, 0xFFFF0000, 0, 0 },
 	{ TEXTURE_TYPE_ETC2_SRGB8,			1, 0,	"etc2_srgb8", "",		4, 4, 64, 64, 0, 3,	0x9275, 0,	0,		"", 0,		0xFF, 0xFF00, 0xFF0000, 0},
-	{ TEXTURE_TYPE_ETC2_SRGB_EAC,			1, 0,	"etc2_sgrb_eac", "",		4, 4, 128, 128, 8, 3,	0x9279, 0,	0,		"", 0,		0xFF, 0xFF00, 0xFF0000, 0xFF000000 },
-	{ TEXTURE_TYPE_ETC2_SRGB_PUNCHTHROUGH,		1, 0,	"etc2_sgrb_punchthrough", "",	4, 4, 64, 64, 1, 3,	0x9277, 0,	0,		"", 0,		0xFF, 0xFF00, 0xFF0000, 0xFF000000 },
+	{ TEXTURE_TYPE_ETC2_SRGB_EAC,			1, 0,	"etc2_sgrb_eac", "",		4, 4, 128, 128, 8, 4,	0x9279, 0,	0,		"", 0,		0xFF, 0xFF00, 0xFF0000, 0xFF000000 },
+	{ TEXTURE_TYPE_ETC2_SRGB_PUNCHTHROUGH,		1, 0,	"etc2_sgrb_punchthrough", "",	4, 4, 64, 64, 1, 4,	0x9277, 0,	0,		"", 0,		0xFF, 0xFF00, 0xFF0000, 0xFF000000 },
 	{ TEXTURE_TYPE_DXT1,				1, 1,	"dxt1", "bc1",			4, 4, 64, 64, 0, 3,	0x83F0, 0,	0,		"DXT1",	0,	0xFF, 0xFF00, 0xFF0000, 0},
 	{ TEXTURE_TYPE_DXT1A,				1, 1,	"dxt1a", "bc1a",		4, 4, 64, 64, 1, 4,	0x83F1, 0,	0, 		"", 0,		0xFF, 0xFF00, 0xFF0000, 0xFF000000 },
 	{ TEXTURE_TYPE_DXT3,				1, 1,	"dxt3", "bc2",			4, 4, 128, 128, 8, 4, 	0x83F2, 0,	0,		"DXT3", 0,	0xFF, 0xFF00, 0xFF0000, 0xFF000000 },
@@ -56,6 +56,12 @@ int option_block_width = 4;
 int option_block_height = 4;
 int option_half_float = 0;
 int option_deterministic = 0;
+int option_convergence_window = - 1;
+int option_polish = - 1;
+int option_derive_indices = 0;
+double option_target_rmse = - 1;
+double option_target_psnr = - 1;
+double option_time_budget = - 1;
 int option_half_float_fit_to_range = 0;
 int option_hdr = 0;
 